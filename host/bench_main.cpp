@@ -0,0 +1,20 @@
+// Host runner for the encode and laser benchmarks: loads the default game
+// config like a freshly booted device, then prints the results as JSON.
+
+#include <stdio.h>
+#include "benchmark.h"
+#include "game_state.h"
+
+int main(void)
+{
+    game_state_init(DEVICE_ROLE_WEAPON);
+
+    static BenchmarkResult results[BENCHMARK_MAX_RESULTS];
+    int count = benchmark_run(results, BENCHMARK_MAX_RESULTS);
+
+    static char json[3072];
+    if (benchmark_results_json(results, count, json, sizeof(json)) < 0)
+        return 1;
+    printf("%s\n", json);
+    return count > 0 ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+// Just enough of ESP-IDF, FreeRTOS and the device-only modules for the host
+// benchmark. Single-threaded: locks always succeed, timers never fire, NVS
+// is empty (every read misses, writes are dropped) and the mesh clock is
+// never synced.
+
+#include <stdlib.h>
+#include <time.h>
+#include <esp_cpu.h>
+#include <esp_err.h>
+#include <esp_random.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "match_log.h"
+#include "nvs_store.h"
+#include "radio_policy.h"
+#include "time_sync.h"
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ============================================================================
+// ESP-IDF
+// ============================================================================
+
+extern "C" {
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_ERR";
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return monotonic_ns() / 1000;
+}
+
+// One "cycle" per nanosecond, see esp_rom_get_cpu_ticks_per_us()
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return (uint32_t)monotonic_ns();
+}
+
+struct esp_timer
+{
+    bool active;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out)
+{
+    if (!args || !out)
+        return ESP_ERR_INVALID_ARG;
+    *out = (esp_timer_handle_t)calloc(1, sizeof(struct esp_timer));
+    return *out ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    (void)timeout_us;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    (void)period_us;
+    timer->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t)rand();
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+// ============================================================================
+// FREERTOS
+// ============================================================================
+
+static int s_handle; // Any non-NULL address will do
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &s_handle;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    (void)sem;
+    (void)ticks;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    (void)sem;
+    return pdTRUE;
+}
+
+static EventBits_t s_event_bits = 0;
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return &s_event_bits;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    return *(EventBits_t*)group |= bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t old = *(EventBits_t*)group;
+    *(EventBits_t*)group &= ~bits;
+    return old;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return *(EventBits_t*)group;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &s_handle;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)ticks;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(monotonic_ns() / 1000000);
+}
+
+} // extern "C"
+
+// ============================================================================
+// DEVICE-ONLY MODULES
+// ============================================================================
+
+bool nvs_store_read_str(const char*, const char*, char*, size_t)
+{
+    return false;
+}
+
+bool nvs_store_read_u8(const char*, const char*, uint8_t*)
+{
+    return false;
+}
+
+bool nvs_store_read_u32(const char*, const char*, uint32_t*)
+{
+    return false;
+}
+
+bool nvs_store_read_blob(const char*, const char*, void*, size_t*)
+{
+    return false;
+}
+
+bool nvs_store_write_blob(const char*, const char*, const void*, size_t)
+{
+    return true;
+}
+
+void match_log_init(void) {}
+
+void match_log_record(MatchEventType, uint8_t, uint8_t, uint8_t, uint16_t) {}
+
+void radio_policy_init(void) {}
+
+int64_t time_sync_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+bool time_sync_is_synced(void)
+{
+    return false;
+}
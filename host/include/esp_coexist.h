@@ -0,0 +1,10 @@
+#pragma once
+// Host stub
+
+typedef enum
+{
+    ESP_COEX_PREFER_WIFI = 0,
+    ESP_COEX_PREFER_BT,
+    ESP_COEX_PREFER_BALANCE,
+    ESP_COEX_PREFER_NUM,
+} esp_coex_prefer_t;
@@ -0,0 +1,12 @@
+#pragma once
+// Host stub: the cycle counter ticks in nanoseconds (see esp_rom_sys.h)
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t esp_cpu_get_cycle_count(void);
+#ifdef __cplusplus
+}
+#endif
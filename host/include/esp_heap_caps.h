@@ -0,0 +1,19 @@
+#pragma once
+// Host stub: there is no internal heap to report, both queries return 0
+
+#include <stddef.h>
+
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+static inline size_t heap_caps_get_minimum_free_size(unsigned caps)
+{
+    (void)caps;
+    return 0;
+}
+
+static inline size_t heap_caps_get_largest_free_block(unsigned caps)
+{
+    (void)caps;
+    return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+// Host stub: 1000 "cycles" per microsecond, matching esp_cpu_get_cycle_count()
+
+#include <stdint.h>
+
+static inline uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return 1000;
+}
@@ -0,0 +1,11 @@
+#pragma once
+// Host stub: the Wi-Fi types the shared headers mention; no driver
+
+#include "esp_err.h"
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
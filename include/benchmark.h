@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// On-device benchmarks of the shared hot paths. Every suite drives the real
+// module:
+//
+//   encode        game_state_*_json, http_api_get_status_json, ws_codec_status
+//                 (JSON and MessagePack, so the size/speed gap can be checked)
+//   laser         validateLaserMessage and the configured RayzLaserCode
+//   espnow_rx     frames injected into the ESP-NOW receive path at
+//                 CONFIG_RAYZ_BENCHMARK_ESPNOW_RATE msg/s and drained by the
+//                 calling task; needs espnow_comm_init(), a quiet radio and no
+//                 other task consuming espnow_comm_receive*()
+//   ws_broadcast  ws_server_send_status() to 1..MAX simulated clients, half
+//                 of them MessagePack; needs the WebSocket endpoint registered
+//
+// Latencies are per operation (cycle counter, or esp_timer for espnow_rx), so
+// benchmark_run() must be called from a task pinned to one core. Run it at
+// low priority so the httpd and ESP-NOW tasks can preempt it.
+//
+// With BENCHMARK_HOST=1 (host/CMakeLists.txt) only the encode and laser
+// suites are built, against stub IDF headers, so codec changes can be
+// compared on a workstation. The radio and WebSocket suites need the device.
+
+#ifndef BENCHMARK_HOST
+#define BENCHMARK_HOST 0
+#endif
+
+#ifndef BENCHMARK_SAMPLES
+#define BENCHMARK_SAMPLES 1024 // Timed operations per suite
+#endif
+
+#define BENCHMARK_MAX_RESULTS 24
+
+typedef struct
+{
+    char name[20];
+    uint32_t ops;          // Operations completed
+    uint32_t ops_per_sec;
+    uint32_t p50_ns;
+    uint32_t p99_ns;
+    uint32_t bytes;        // Mean output size, 0 where it does not apply
+    uint32_t dropped;      // Messages or frames lost by the path under test
+    uint32_t heap_min;     // Minimum free internal heap since boot, after the suite
+    uint32_t heap_largest; // Largest free internal block, after the suite
+} BenchmarkResult;
+
+// Run every suite whose prerequisites are met from the calling task and log
+// one line per result. Returns the number of results written to out (which
+// may be NULL to only log).
+int benchmark_run(BenchmarkResult* out, int max_results);
+
+#if !BENCHMARK_HOST
+// Run benchmark_run() once in a low-priority task of its own
+bool benchmark_start(void);
+#endif
+
+// Results as a JSON array. Returns the length or -1 if the buffer was too small.
+int benchmark_results_json(const BenchmarkResult* results, int count, char* buffer, size_t max_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "game_protocol.h"
+#include "protocol_config.h"
+#include "ws_codec.h"
+
+// Single description of every config field: its wire key, where the decoder
+// stores it in WsConfigUpdate, which DeviceConfig/GameConfig member it lands
+// in, and its valid range. The config_update decoder, the status "config"
+// block and game_state_apply_game_config() all walk this table, so the
+// parser, the writer and the clamps cannot drift apart.
+
+enum ConfigTarget : uint8_t
+{
+    CFG_TARGET_NONE,   // Handled by the caller (reset_to_defaults, espnow_peers)
+    CFG_TARGET_DEVICE, // DeviceConfig
+    CFG_TARGET_GAME,   // GameConfig
+};
+
+enum ConfigType : uint8_t
+{
+    CFG_U8,
+    CFG_U16,
+    CFG_U32,
+    CFG_BOOL,
+    CFG_STR,
+};
+
+// ConfigField::flags
+#define CFG_CLAMP (1u << 0)  // Enforce [min, max] on the stored value
+#define CFG_INVERT (1u << 1) // Wire boolean is the negation of the member
+#define CFG_STATUS (1u << 2) // Reported in the status "config" block
+// Status quirks clients already rely on
+#define CFG_STATUS_TRUE (1u << 3) // Boolean always reported as true
+#define CFG_STATUS_NUM (1u << 4)  // Boolean reported as the number 0 or 1
+
+struct ConfigField
+{
+    const char* key;     // Wire key; nullptr for members that are only clamped
+    uint8_t key_len;
+    uint32_t present;    // WS_CFG_* bit, 0 if not carried by config_update
+    ConfigTarget target;
+    ConfigType type;     // Same type on the wire view and in the target struct
+    uint8_t flags;
+    uint16_t msg_offset; // In WsConfigUpdate
+    uint16_t msg_size;
+    uint16_t cfg_offset; // In DeviceConfig or GameConfig
+    uint16_t cfg_size;
+    uint16_t scale;      // Stored value = wire value * scale
+    uint32_t min;        // Range of the stored value (CFG_CLAMP)
+    uint32_t max;
+};
+
+namespace config_fields_detail
+{
+    constexpr uint8_t length(const char* s)
+    {
+        uint8_t n = 0;
+        while (s && s[n])
+            n++;
+        return n;
+    }
+} // namespace config_fields_detail
+
+#define CFG_MEMBER(type, m) (uint16_t)offsetof(type, m), (uint16_t)sizeof(((type*)nullptr)->m)
+#define CFG_NO_MEMBER 0, 0
+
+// Wire field stored into a config member
+#define CFG_FIELD(key, bit, msg_m, tgt, cfg_type, cfg_m, type, flags, scale, lo, hi)                                   \
+    {key,  config_fields_detail::length(key), bit, tgt, type, flags, CFG_MEMBER(WsConfigUpdate, msg_m),                \
+     CFG_MEMBER(cfg_type, cfg_m), scale, lo, hi}
+// Wire field the caller acts on
+#define CFG_COMMAND(key, bit, msg_m, type)                                                                              \
+    {key, config_fields_detail::length(key), bit, CFG_TARGET_NONE, type, 0, CFG_MEMBER(WsConfigUpdate, msg_m),          \
+     CFG_NO_MEMBER, 1, 0, 0}
+// GameConfig member that is not on the wire but still range-checked
+#define CFG_INTERNAL(cfg_m, type, lo, hi)                                                                               \
+    {nullptr, 0, 0, CFG_TARGET_GAME, type, CFG_CLAMP, CFG_NO_MEMBER, CFG_MEMBER(GameConfig, cfg_m), 1, lo, hi}
+
+// Status rows are emitted in table order
+inline constexpr ConfigField kConfigFields[] = {
+    CFG_FIELD("device_id", WS_CFG_DEVICE_ID, device_id, CFG_TARGET_DEVICE, DeviceConfig, device_id, CFG_U8,
+              CFG_STATUS, 1, 0, 0),
+    CFG_FIELD("player_id", WS_CFG_PLAYER_ID, player_id, CFG_TARGET_DEVICE, DeviceConfig, player_id, CFG_U8,
+              CFG_STATUS, 1, 0, 0),
+    CFG_FIELD("team_id", WS_CFG_TEAM_ID, team_id, CFG_TARGET_DEVICE, DeviceConfig, team_id, CFG_U8, CFG_STATUS, 1, 0,
+              0),
+    CFG_FIELD("color_rgb", WS_CFG_COLOR_RGB, color_rgb, CFG_TARGET_DEVICE, DeviceConfig, color_rgb, CFG_U32,
+              CFG_STATUS, 1, 0, 0),
+    CFG_FIELD("enable_hearts", WS_CFG_ENABLE_HEARTS, enable_hearts, CFG_TARGET_GAME, GameConfig, unlimited_respawn,
+              CFG_BOOL, CFG_INVERT | CFG_STATUS | CFG_STATUS_TRUE, 1, 0, 0),
+    CFG_FIELD("max_hearts", WS_CFG_MAX_HEARTS, max_hearts, CFG_TARGET_GAME, GameConfig, max_hearts, CFG_U8,
+              CFG_CLAMP | CFG_STATUS, 1, 1, 99),
+    CFG_FIELD("enable_ammo", WS_CFG_ENABLE_AMMO, enable_ammo, CFG_TARGET_GAME, GameConfig, unlimited_ammo, CFG_BOOL,
+              CFG_INVERT | CFG_STATUS | CFG_STATUS_NUM, 1, 0, 0),
+    CFG_FIELD("max_ammo", WS_CFG_MAX_AMMO, max_ammo, CFG_TARGET_GAME, GameConfig, max_ammo, CFG_U16,
+              CFG_CLAMP | CFG_STATUS, 1, 0, 65535),
+    CFG_FIELD("game_duration_s", WS_CFG_GAME_DURATION_S, game_duration_s, CFG_TARGET_GAME, GameConfig, time_limit_s,
+              CFG_U16, CFG_CLAMP | CFG_STATUS, 1, 0, 7200),
+    CFG_FIELD("friendly_fire", WS_CFG_FRIENDLY_FIRE, friendly_fire, CFG_TARGET_GAME, GameConfig,
+              friendly_fire_enabled, CFG_BOOL, CFG_STATUS, 1, 0, 0),
+    // Floor depends on the laser profile, see game_state_apply_game_config()
+    CFG_FIELD("shot_rate_limit_ms", WS_CFG_SHOT_RATE_LIMIT_MS, shot_rate_limit_ms, CFG_TARGET_GAME, GameConfig,
+              shot_rate_limit_ms, CFG_U16, CFG_CLAMP | CFG_STATUS, 1, 0, 2000),
+    // Out-of-range profiles fall back to Classic rather than clamping
+    CFG_FIELD("laser_profile", WS_CFG_LASER_PROFILE, laser_profile, CFG_TARGET_GAME, GameConfig, laser_profile, CFG_U8,
+              CFG_STATUS, 1, 0, 0),
+
+    CFG_FIELD("device_name", WS_CFG_DEVICE_NAME, device_name, CFG_TARGET_DEVICE, DeviceConfig, device_name, CFG_STR,
+              0, 1, 0, 0),
+    CFG_FIELD("spawn_hearts", WS_CFG_SPAWN_HEARTS, spawn_hearts, CFG_TARGET_GAME, GameConfig, max_hearts, CFG_U8,
+              CFG_CLAMP, 1, 1, 99),
+    CFG_FIELD("respawn_time_s", WS_CFG_RESPAWN_TIME_S, respawn_time_s, CFG_TARGET_GAME, GameConfig,
+              respawn_cooldown_ms, CFG_U32, CFG_CLAMP, 1000, 0, 30000),
+    CFG_FIELD("reload_time_ms", WS_CFG_RELOAD_TIME_MS, reload_time_ms, CFG_TARGET_GAME, GameConfig, reload_time_ms,
+              CFG_U16, CFG_CLAMP, 1, 0, 30000),
+    CFG_COMMAND("reset_to_defaults", WS_CFG_RESET_TO_DEFAULTS, reset_to_defaults, CFG_BOOL),
+    CFG_COMMAND("espnow_peers", WS_CFG_ESPNOW_PEERS, espnow_peers, CFG_STR),
+    CFG_COMMAND("espnow_key", WS_CFG_ESPNOW_KEY, espnow_key, CFG_STR),
+
+    CFG_INTERNAL(score_to_win, CFG_U16, 0, 65535),
+    CFG_INTERNAL(invulnerability_ms, CFG_U16, 0, 30000),
+    CFG_INTERNAL(mag_capacity, CFG_U8, 0, 255),
+};
+
+#undef CFG_FIELD
+#undef CFG_COMMAND
+#undef CFG_INTERNAL
+#undef CFG_MEMBER
+#undef CFG_NO_MEMBER
+
+inline constexpr size_t kConfigFieldCount = sizeof(kConfigFields) / sizeof(kConfigFields[0]);
+
+constexpr uint8_t config_status_field_count()
+{
+    uint8_t n = 0;
+    for (const ConfigField& f : kConfigFields)
+        n += (f.flags & CFG_STATUS) ? 1 : 0;
+    return n;
+}
+static_assert(config_status_field_count() <= 15, "status config block must fit a MessagePack fixmap");
+
+// Scalar accessors for a field's storage; strings are handled by the callers
+inline uint32_t config_field_load(ConfigType type, const void* p)
+{
+    switch (type)
+    {
+        case CFG_U8:
+            return *(const uint8_t*)p;
+        case CFG_U16:
+            return *(const uint16_t*)p;
+        case CFG_U32:
+            return *(const uint32_t*)p;
+        case CFG_BOOL:
+            return *(const bool*)p ? 1 : 0;
+        default:
+            return 0;
+    }
+}
+
+inline void config_field_store(ConfigType type, void* p, uint32_t v)
+{
+    switch (type)
+    {
+        case CFG_U8:
+            *(uint8_t*)p = (uint8_t)v;
+            break;
+        case CFG_U16:
+            *(uint16_t*)p = (uint16_t)v;
+            break;
+        case CFG_U32:
+            *(uint32_t*)p = v;
+            break;
+        case CFG_BOOL:
+            *(bool*)p = v != 0;
+            break;
+        default:
+            break;
+    }
+}
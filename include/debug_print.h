@@ -6,7 +6,10 @@
 #include "wifi_internal.h"
 
 /**
- * @brief Debug function to print all NVS contents to log
+ * @brief Log every NVS entry, one line each, from a single snapshot
+ * Does nothing unless CONFIG_RAYZ_NVS_BOOT_DUMP is enabled, so it can stay in
+ * the boot path of production builds. Fleet tooling should fetch the binary
+ * snapshot from /api/nvs (see nvs_snapshot.h) instead.
  */
 void debug_print_nvs_contents(void);
 
@@ -14,7 +14,8 @@ extern "C"
         DM_EVT_HIT,
         DM_EVT_MSG,
         DM_EVT_ERROR_SET,
-        DM_EVT_ERROR_CLEAR
+        DM_EVT_ERROR_CLEAR,
+        DM_EVT_NEXT_PAGE // Cycle the debug pages (e.g. on a button press)
     } dm_event_type_t;
 
     typedef struct
@@ -59,6 +60,13 @@ extern "C"
         // target-specific
         int (*hit_count)(void);
         uint32_t (*last_hit_ms_ago)(void);
+
+        // optional system page (the system_* sampler accessors); the page is
+        // skipped when free_heap and largest_free_block are both unset
+        uint32_t (*largest_free_block)(void);
+        uint32_t (*min_free_heap)(void);
+        int (*cpu_load_pct)(void);
+        const char* (*tightest_task)(uint32_t* stack_free);
     } dm_sources_t;
 
     bool display_manager_init(lv_disp_t* disp, const dm_sources_t* src);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "espnow_comm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Optional authentication of ESP-NOW frames. With a key installed, every
+// frame sent carries a trailing ESPNOW_AUTH_TAG_LEN-byte tag: SipHash-2-4 of
+// the sender's MAC and the frame, truncated. Receivers drop frames whose tag
+// is missing or wrong before peer tracking, time sync or the receive ring
+// see them. It is a keyed hash over a few dozen bytes rather than ESP-NOW's
+// per-peer encryption, so it covers broadcasts and any number of peers.
+//
+// The key is meant to change per match: the dashboard pushes a fresh one
+// (config_update "espnow_key") to every device before the start. It is kept
+// in NVS so a device rebooting mid-match rejoins. Without a key frames go
+// out untagged and tags on received frames are ignored.
+//
+// Tags stop forged frames, not replays: a frame recorded earlier in the same
+// match still verifies. Reliable messages are caught by the duplicate filter.
+
+#define ESPNOW_AUTH_KEY_LEN 16
+#define ESPNOW_AUTH_TAG_LEN 4
+
+// Where the key is stored; NVS snapshots redact it
+#define ESPNOW_AUTH_NVS_NS "espnow"
+#define ESPNOW_AUTH_NVS_KEY "auth_key"
+
+// Load the stored key; called by espnow_comm_init()
+void espnow_auth_init(void);
+
+// Install (and store) a key. Takes effect for the next frame in both directions.
+void espnow_auth_set_key(const uint8_t key[ESPNOW_AUTH_KEY_LEN]);
+void espnow_auth_clear_key(void);
+// 32 hex digits, or "" to clear. Returns false, keeping the current key, if malformed.
+bool espnow_auth_set_key_hex(const char* hex);
+bool espnow_auth_enabled(void);
+
+// espnow_comm hooks. tag() writes the tag of a frame from this device and
+// returns false, writing nothing, while no key is set. accept() checks a
+// received frame of payload_len bytes, followed by a tag if tagged.
+bool espnow_auth_tag(const uint8_t* frame, size_t len, uint8_t tag[ESPNOW_AUTH_TAG_LEN]);
+bool espnow_auth_accept(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const uint8_t* frame, size_t payload_len,
+                        bool tagged);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,7 @@
 
 #include <esp_now.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
@@ -10,27 +11,88 @@
 extern "C" {
 #endif
 
+// Peers tracked by espnow_comm (link stats, unicast targets). The ESP-NOW
+// driver itself holds at most ESP_NOW_MAX_TOTAL_PEER_NUM; beyond that, peers
+// are registered with it on demand when a unicast is sent to them, evicting
+// the least recently used one. Receiving never needs a registration.
+#ifndef CONFIG_RAYZ_ESPNOW_MAX_PEERS
+#define CONFIG_RAYZ_ESPNOW_MAX_PEERS ESP_NOW_MAX_TOTAL_PEER_NUM
+#endif
+#define ESPNOW_MAX_PEERS CONFIG_RAYZ_ESPNOW_MAX_PEERS
+// A full peer list as CSV: "aa:bb:cc:dd:ee:ff," per peer, the last comma
+// making room for the terminator
+#define ESPNOW_PEER_CSV_LEN (ESPNOW_MAX_PEERS * 18)
+
 // Compact player-to-player message carried over ESP-NOW.
 typedef enum : uint8_t
 {
     ESPNOW_MSG_SHOT = 0,
     ESPNOW_MSG_HIT_EVENT,
     ESPNOW_MSG_HEARTBEAT,
+    ESPNOW_MSG_TIME_SYNC, // EspnowTimeSync, handled inside espnow_comm (see time_sync.h)
 } EspnowMsgType;
 
+// Logical group of a record: the sender's arena (high nibble) and the team it
+// is meant for (low nibble). espnow_comm stamps it on send; receivers drop
+// records for another arena or another team in the receive callback, before
+// peer tracking or the ring. Arena 0 and team 0 match everyone, so devices
+// with no arena set, and firmware that left the byte zero, see all traffic.
+#define ESPNOW_GROUP(arena, team) ((uint8_t)((((arena) & 0x0F) << 4) | ((team) & 0x0F)))
+#define ESPNOW_GROUP_ARENA(group) ((uint8_t)((group) >> 4))
+#define ESPNOW_GROUP_TEAM(group) ((uint8_t)((group) & 0x0F))
+#define ESPNOW_MAX_ARENA 15
+#define ESPNOW_MAX_GROUP_TEAM 15 // Higher team ids can only be reached by unicast
+
 typedef struct __attribute__((packed))
 {
     EspnowMsgType type;
-    uint8_t version;
+    uint8_t group; // ESPNOW_GROUP(); arena set by espnow_comm, callers pick the team
     uint8_t player_id;
     uint8_t device_id;
     uint8_t team_id;
-    uint8_t reserved;
+    uint8_t reserved; // Reliable-delivery sequence number, 0 = fire-and-forget
     uint32_t color_rgb;
-    uint32_t timestamp_ms;
+    uint32_t timestamp_ms; // game_state_synced_time_us() / 1000 at the event
     uint32_t data;
 } PlayerMessage;
 
+// Clock sync exchange, same size and header layout as PlayerMessage so it
+// travels through the same lanes and peer tracking. Never batched, never sent
+// reliably; the timestamps are written by the TX task right before
+// esp_now_send() so queueing delay does not count as path delay.
+#define ESPNOW_TIME_SYNC_REQUEST 1
+#define ESPNOW_TIME_SYNC_RESPONSE 2
+
+typedef struct __attribute__((packed))
+{
+    EspnowMsgType type; // ESPNOW_MSG_TIME_SYNC
+    uint8_t group;      // As in PlayerMessage
+    uint8_t player_id;
+    uint8_t device_id;
+    uint8_t team_id;
+    uint8_t phase;          // ESPNOW_TIME_SYNC_REQUEST or ESPNOW_TIME_SYNC_RESPONSE (the sequence slot)
+    uint32_t t1;            // Requester's esp_timer time at transmission (low 32 bits), echoed back
+    uint32_t t3_lo;         // Response: reference time at transmission, bits 0..31
+    uint16_t t3_hi;         // ...bits 32..47
+    uint16_t turnaround_us; // Response: t3 minus the reference time the request arrived, saturated
+} EspnowTimeSync;
+
+// Aggregated frame: this header followed by `count` PlayerMessage records.
+// The magic byte is never a valid EspnowMsgType, so a receiver tells the two
+// apart by the first byte and the frame length. Only fire-and-forget traffic
+// is batched; a frame holding a single message is sent as a plain record.
+#define ESPNOW_BATCH_MAGIC 0xB7
+#define ESPNOW_BATCH_VERSION 1
+#define ESPNOW_BATCH_MAX_MSGS 12 // 4 + 12 * 20 bytes, plus an auth tag, fits ESP_NOW_MAX_DATA_LEN (250)
+
+typedef struct __attribute__((packed))
+{
+    uint8_t magic;   // ESPNOW_BATCH_MAGIC
+    uint8_t version; // ESPNOW_BATCH_VERSION
+    uint8_t count;   // Records that follow, 1..ESPNOW_BATCH_MAX_MSGS
+    uint8_t group;   // ESPNOW_GROUP(sender's arena, 0): a foreign batch is dropped whole
+} EspnowBatchHeader;
+
 typedef struct
 {
     PlayerMessage msg;
@@ -40,7 +102,7 @@ typedef struct
 typedef struct
 {
     uint8_t channel;   // 0 = keep current Wi-Fi channel, otherwise lock to specific channel
-    bool prefer_wifi;  // Set coexistence preference towards Wi-Fi if true
+    bool prefer_wifi;  // Ignored: radio_policy sets the coexistence preference (Wi-Fi during a match)
     bool set_pmk;      // Configure PMK to a non-zero key (recommended)
 } EspnowCommConfig;
 
@@ -50,20 +112,122 @@ esp_err_t espnow_comm_init(const EspnowCommConfig* config);
 // Force Wi-Fi channel used by ESP-NOW (must match AP channel when STA is up).
 esp_err_t espnow_comm_set_channel(uint8_t channel);
 
-// Peer management helpers.
+// Arena this device plays in, 1..ESPNOW_MAX_ARENA, stamped into every record
+// sent. With 0 the device hears all arenas. Defaults to CONFIG_RAYZ_ESPNOW_ARENA_ID.
+void espnow_comm_set_arena(uint8_t arena_id);
+uint8_t espnow_comm_get_arena(void);
+
+// Peer management helpers. Peers are added and removed incrementally; ESP-NOW
+// stays up throughout, so reconfiguring mid-game does not interrupt the radio.
+// ESP_ERR_ESPNOW_FULL once ESPNOW_MAX_PEERS are tracked.
 esp_err_t espnow_comm_add_peer(const uint8_t mac[ESP_NOW_ETH_ALEN]);
+esp_err_t espnow_comm_remove_peer(const uint8_t mac[ESP_NOW_ETH_ALEN]);
 void espnow_comm_clear_peers(void);
 uint8_t espnow_comm_peer_count(void);
-esp_err_t espnow_comm_load_peers_from_csv(const char* csv_list); // "aa:bb:cc...,11:22:33..."
+// Make the peer set match the list: only missing peers are added and only
+// unlisted ones removed.
+esp_err_t espnow_comm_set_peers(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], int count);
+// Same, from "aa:bb:cc...,11:22:33..."
+esp_err_t espnow_comm_load_peers_from_csv(const char* csv_list);
+
+// Parse a CSV peer list (',' or ';' separated, invalid entries skipped).
+// Returns the number of MACs written to out.
+int espnow_comm_parse_peer_csv(const char* csv_list, uint8_t (*out)[ESP_NOW_ETH_ALEN], int max_count);
+// Format MACs as CSV. Returns the length or -1 if the buffer was too small.
+int espnow_comm_format_peer_csv(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], int count, char* out, size_t max_len);
+
+// Per-peer link statistics, updated by the ESP-NOW callbacks.
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool identified;       // A PlayerMessage was received, ids below are valid
+    bool registered;       // Holds one of the driver's peer slots
+    uint8_t player_id;     // Learned from the last PlayerMessage
+    uint8_t team_id;
+    uint8_t device_id;
+    int8_t rssi;           // dBm of the last received frame
+    uint32_t last_seen_ms; // esp_timer time of the last received frame, 0 = never
+    uint32_t rx_count;
+    uint32_t tx_count;     // Frames reported by the send callback
+    uint32_t tx_failed;    // ...of which were not acknowledged
+} EspnowPeerInfo;
+
+bool espnow_comm_get_peer(const uint8_t mac[ESP_NOW_ETH_ALEN], EspnowPeerInfo* out);
+int espnow_comm_get_peers(EspnowPeerInfo* out, int max_count); // Returns entries written
 
-// Send helpers.
+// Send helpers. Sends are asynchronous: the message is queued for the ESP-NOW
+// TX task and true means it was queued, not delivered. Never blocks, so it is
+// safe from the trigger path (and ISRs). Hit and shot messages use a priority
+// lane that is drained ahead of heartbeats. Other messages to the same
+// destination may be held for CONFIG_RAYZ_ESPNOW_BATCH_WINDOW_MS and sent as a
+// single aggregated frame; anything urgent flushes the window immediately.
 bool espnow_comm_send(const uint8_t mac[ESP_NOW_ETH_ALEN], const PlayerMessage* msg);
 bool espnow_comm_broadcast(const PlayerMessage* msg); // Broadcast to all peers
+// Unicast to every identified peer of a team. Returns the number of messages queued.
+int espnow_comm_send_team(uint8_t team_id, const PlayerMessage* msg, bool reliable);
+// One broadcast frame that only devices of team_id (1..ESPNOW_MAX_GROUP_TEAM)
+// accept; the rest drop it on arrival. Cheaper on air than
+// espnow_comm_send_team() but unacknowledged. Higher team ids fall back to
+// per-peer unicast.
+bool espnow_comm_broadcast_team(uint8_t team_id, const PlayerMessage* msg);
 
-// Receive queue helpers.
-QueueHandle_t espnow_comm_queue(void);
+// Reliable unicast for messages that must not get lost (hit events, kills).
+// The sequence number is stamped into PlayerMessage.reserved; delivery is
+// confirmed by the ESP-NOW MAC-layer ACK reported to the send callback, and
+// failed attempts are retransmitted with exponential backoff. Receivers drop
+// duplicates caused by a lost ACK. Returns false if no in-flight slot is free
+// or the first transmission could not be queued (broadcast falls back to a
+// plain send, since it is never acknowledged).
+bool espnow_comm_send_reliable(const uint8_t mac[ESP_NOW_ETH_ALEN], const PlayerMessage* msg);
+
+// Final outcome of a reliable send. Runs on the Wi-Fi or esp_timer task: keep it short.
+typedef void (*espnow_delivery_cb_t)(const uint8_t mac[ESP_NOW_ETH_ALEN], const PlayerMessage* msg,
+                                     bool delivered);
+void espnow_comm_set_delivery_cb(espnow_delivery_cb_t cb);
+
+typedef struct
+{
+    uint32_t reliable_sent; // Reliable messages accepted
+    uint32_t delivered;     // Confirmed by a MAC-layer ACK
+    uint32_t retries;       // Retransmissions
+    uint32_t failed;        // Given up after the last attempt
+    uint32_t duplicates;    // Received duplicates dropped
+    uint32_t queue_full;    // Sends rejected because the TX lane was full
+    uint32_t batches;       // Aggregated frames sent
+    uint32_t batched_msgs;  // Messages carried by those frames
+} EspnowTxStats;
+
+void espnow_comm_get_tx_stats(EspnowTxStats* out);
+
+// Receive helpers. Messages land in a lock-free single-producer ring filled by
+// the ESP-NOW callback; exactly one task may consume it. They replace the
+// FreeRTOS queue once returned by espnow_comm_queue(), which is gone so that
+// callers still doing xQueueReceive() on it fail to build.
 bool espnow_comm_receive(EspnowMessageEnvelope* out, TickType_t ticks_to_wait);
 
+// Wait up to ticks_to_wait for the first message, then drain up to max_count
+// without blocking. Returns the number of envelopes written to out.
+int espnow_comm_receive_batch(EspnowMessageEnvelope* out, int max_count, TickType_t ticks_to_wait);
+
+typedef struct
+{
+    uint32_t received;       // Messages accepted into the ring
+    uint32_t overflows;      // Messages dropped because the ring was full
+    uint32_t invalid;        // Frames rejected for bad length
+    uint32_t filtered;       // Records for another arena or team, dropped on arrival
+    uint32_t auth_failed;    // Frames dropped for a missing or wrong auth tag (see espnow_auth.h)
+    uint16_t high_watermark; // Deepest fill level seen
+    uint16_t depth;          // Ring capacity
+} EspnowRxStats;
+
+void espnow_comm_get_rx_stats(EspnowRxStats* out);
+
+// Run a frame (one PlayerMessage or a batch) through the receive path as if
+// the radio had delivered it. It takes the place of the ESP-NOW callback as
+// the ring's producer, so only use it while no real frames arrive (load
+// tests). Returns false before espnow_comm_init().
+bool espnow_comm_inject_rx(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const uint8_t* data, int len);
+
 uint8_t espnow_comm_hash_id(const char* id);
 
 #ifdef __cplusplus
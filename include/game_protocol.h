@@ -26,6 +26,7 @@ extern "C"
         OP_HIT_FORWARD = 5,
         OP_KILL_CONFIRMED = 6,
         OP_REMOTE_SOUND = 7,
+        OP_NVS_SNAPSHOT = 8,
 
         // ESP32 -> Client
         OP_STATUS = 10,
@@ -35,6 +36,8 @@ extern "C"
         OP_RESPAWN = 14,
         OP_RELOAD_EVENT = 15,
         OP_GAME_OVER = 16,
+        OP_STATUS_DELTA = 17,
+        OP_SYSTEM_STATS = 18,
         OP_ACK = 20
     } OpCode;
 
@@ -84,6 +87,8 @@ extern "C"
 
         bool random_teams_on_start;
         bool hit_sound_enabled;
+
+        uint8_t laser_profile; // LASER_PROFILE_* (protocol_config.h)
     } GameConfig;
 
     typedef struct
@@ -104,6 +109,11 @@ extern "C"
         uint32_t game_start_time_ms;
         uint32_t last_heartbeat_ms;
         bool server_connected;
+
+        uint16_t current_ammo; // Stays at max_ammo with unlimited_ammo
+        bool reloading;
+        bool invulnerable; // Grace period after a respawn
+        bool game_over;    // Game clock ran out
     } GameStateData;
 
 #ifdef __cplusplus
@@ -3,8 +3,12 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
 #include "game_protocol.h"
 
+// NVS namespace of the persisted config
+#define NVS_GAME_NS "game"
 
 #ifdef __cplusplus
 extern "C"
@@ -19,8 +23,12 @@ extern "C"
 
     const DeviceConfig* game_state_get_config(void);
     DeviceConfig* game_state_get_config_mut(void);
+    // Loads the persisted DeviceConfig and GameConfig (falls back to the
+    // legacy per-key ids). Returns true if stored ids were found.
     bool game_state_load_ids(void);
-    bool game_state_save_ids(void);
+    // Persists DeviceConfig and GameConfig as one versioned, CRC-checked blob
+    bool game_state_save_config(void);
+    bool game_state_save_ids(void); // Same as game_state_save_config()
     void game_state_generate_ids(void);
 
     void game_state_reset_runtime(void);
@@ -33,6 +41,14 @@ extern "C"
     const GameStateData* game_state_get(void);
     GameStateData* game_state_get_mut(void);
 
+    /**
+     * @brief Copy the runtime state without tearing multi-field updates
+     * Lock-free for the writers (record_* never block); readers retry while a
+     * writer on the other core is mid-update. Prefer this over game_state_get()
+     * when reading more than one field.
+     */
+    void game_state_snapshot(GameStateData* out);
+
     void game_state_record_shot(void);
     void game_state_record_hit(void);
     void game_state_record_kill(void);
@@ -41,13 +57,85 @@ extern "C"
     void game_state_reset_stats(void);
     uint8_t game_state_get_player_id(void);
     uint32_t game_state_last_rx_ms_ago(void);
+    // Mesh-wide time (see time_sync.h); stamp every event with this so events
+    // from different devices can be ordered
+    int64_t game_state_synced_time_us(void);
     uint32_t game_state_rx_count(void);
     uint32_t game_state_tx_count(void);
-    int game_state_get_ammo(void);
-    bool game_state_check_respawn(void);
+    int game_state_get_ammo(void); // -1 with unlimited ammo
+    bool game_state_check_respawn(void); // true once per completed respawn
     bool game_state_is_respawning(void);
     void game_state_start_respawn(void);
     bool game_state_friendly_fire_counts(void);
+    bool game_state_is_invulnerable(void); // Deaths are ignored while set
+    bool game_state_is_reloading(void);
+    // Refills to max_ammo after reload_time_ms; false if unlimited or already reloading
+    bool game_state_start_reload(void);
+
+    // Resets the runtime state and starts the game clock (time_limit_s, 0 = none)
+    void game_state_start_game(void);
+    void game_state_stop_game(void);
+    bool game_state_is_game_over(void);
+
+    // ============================================================================
+    // GAME TIMERS
+    // ============================================================================
+
+    // Respawn, invulnerability, reload, the game clock and the heartbeat
+    // timeout run on one timer wheel driven by a single esp_timer. Each
+    // expiry updates the state, sets its bit in the event group and calls the
+    // listeners (on the esp_timer task), so tasks can block on the event
+    // group instead of polling.
+#define GS_EVT_RESPAWN_DONE (1u << 0)
+#define GS_EVT_INVULN_DONE (1u << 1)
+#define GS_EVT_RELOAD_DONE (1u << 2)
+#define GS_EVT_GAME_OVER (1u << 3)
+#define GS_EVT_HEARTBEAT_DUE (1u << 4) // No heartbeat for 60 s
+#define GS_EVT_ALL                                                                                                     \
+    (GS_EVT_RESPAWN_DONE | GS_EVT_INVULN_DONE | GS_EVT_RELOAD_DONE | GS_EVT_GAME_OVER | GS_EVT_HEARTBEAT_DUE)
+
+#define GS_EVENT_LISTENERS_MAX 4
+
+    typedef void (*game_state_event_cb_t)(uint32_t event); // One GS_EVT_* bit per call
+
+    // Bits are set, never cleared; waiters clear the ones they consume
+    EventGroupHandle_t game_state_event_group(void);
+    bool game_state_add_event_listener(game_state_event_cb_t cb);
+
+    // ============================================================================
+    // CHANGE TRACKING
+    // ============================================================================
+
+    // Status fields that changed since the last status broadcast. Set by the
+    // mutators above; code editing through the *_mut() accessors must mark
+    // its own changes.
+#define GS_DIRTY_CONFIG (1u << 0) // Any field of the "config" block
+#define GS_DIRTY_SHOTS (1u << 1)
+#define GS_DIRTY_ENEMY_KILLS (1u << 2)
+#define GS_DIRTY_FRIENDLY_KILLS (1u << 3)
+#define GS_DIRTY_DEATHS (1u << 4)
+#define GS_DIRTY_HEARTS (1u << 5)
+#define GS_DIRTY_AMMO (1u << 6)
+#define GS_DIRTY_RESPAWNING (1u << 7)
+#define GS_DIRTY_RELOADING (1u << 8)
+#define GS_DIRTY_STATS (GS_DIRTY_SHOTS | GS_DIRTY_ENEMY_KILLS | GS_DIRTY_FRIENDLY_KILLS | GS_DIRTY_DEATHS)
+#define GS_DIRTY_STATE (GS_DIRTY_HEARTS | GS_DIRTY_AMMO | GS_DIRTY_RESPAWNING | GS_DIRTY_RELOADING)
+#define GS_DIRTY_ALL (GS_DIRTY_CONFIG | GS_DIRTY_STATS | GS_DIRTY_STATE)
+
+    void game_state_mark_dirty(uint32_t fields);
+
+    /**
+     * @brief Fetch and clear the dirty bitmap
+     * @param seq Receives the status sequence number; it advances by one each
+     *            time a non-empty set of changes is taken (may be NULL)
+     * @return GS_DIRTY_* bits changed since the previous call
+     */
+    uint32_t game_state_take_dirty(uint32_t* seq);
+
+    /**
+     * @brief Current status sequence number (last value handed out by take_dirty)
+     */
+    uint32_t game_state_status_seq(void);
 
     void game_state_set_connected(bool connected);
     void game_state_update_heartbeat(void);
@@ -4,13 +4,13 @@
 #include <stdint.h>
 #include "protocol_config.h"
 
-inline uint8_t calculateHash8bit(uint8_t data)
+constexpr uint8_t calculateHash8bit(uint8_t data)
 {
     uint8_t hash = (((data & 0xFF) ^ HASH_XOR_SEED) + HASH_OFFSET) & 0xFF;
     return hash;
 }
 
-inline uint32_t createLaserMessage(uint8_t player_id, uint8_t device_id)
+constexpr uint32_t createLaserMessage(uint8_t player_id, uint8_t device_id)
 {
     uint8_t p_hash = calculateHash8bit(player_id);
     uint8_t d_hash = calculateHash8bit(device_id);
@@ -35,4 +35,25 @@ inline bool validateLaserMessage(uint32_t message, uint8_t* out_player = nullptr
     return ok;
 }
 
+// Compact 16-bit frame (LASER_PROFILE_COMPACT):
+// player_id[15..10] | device_slot[9..8] | hash of the upper byte[7..0]
+constexpr uint16_t createCompactLaserMessage(uint8_t player_id, uint8_t device_slot)
+{
+    uint8_t id = (uint8_t)(((player_id & 0x3F) << 2) | (device_slot & 0x03));
+    return (uint16_t)(((uint16_t)id << 8) | calculateHash8bit(id));
+}
+
+inline bool validateCompactLaserMessage(uint16_t message, uint8_t* out_player = nullptr,
+                                        uint8_t* out_device_slot = nullptr)
+{
+    uint8_t id = (uint8_t)(message >> 8);
+    if ((uint8_t)(message & 0xFF) != calculateHash8bit(id))
+        return false;
+    if (out_player)
+        *out_player = id >> 2;
+    if (out_device_slot)
+        *out_device_slot = id & 0x03;
+    return true;
+}
+
 #endif // HASH_H
@@ -1,10 +1,16 @@
 #pragma once
 #include <esp_http_server.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "wifi_manager.h"
+
+// Worst case of http_api_get_status_json(), peer list included
+#define HTTP_API_STATUS_JSON_MAX (128 + WIFI_PEER_LIST_LEN)
 
 // Initialize REST endpoints after WiFi connected
 httpd_handle_t http_api_start(httpd_handle_t server);
 
-// Provide status JSON (battery, role, ip etc.)
-// Implementation will build JSON string into a static buffer
-const char* http_api_get_status_json();
+// Status JSON (wifi, ip, channel, peers) written into the caller's buffer,
+// so concurrent callers do not share state. Returns the length or -1 if the
+// buffer was too small.
+int http_api_get_status_json(char* buffer, size_t max_len);
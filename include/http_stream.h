@@ -0,0 +1,56 @@
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Chunked response writer. Output is collected in a small buffer and sent
+// with httpd_resp_send_chunk() whenever it fills, so a response can be any
+// length without a buffer sized for the worst case. The first failed send is
+// latched; later writes are dropped and http_stream_end() reports it.
+
+#ifndef HTTP_STREAM_BUF_LEN
+#define HTTP_STREAM_BUF_LEN 512
+#endif
+
+typedef struct
+{
+    httpd_req_t* req;
+    esp_err_t err;
+    size_t len;
+    char buf[HTTP_STREAM_BUF_LEN];
+} HttpStream;
+
+// content_type may be NULL to keep the httpd default (text/html)
+void http_stream_begin(HttpStream* s, httpd_req_t* req, const char* content_type);
+bool http_stream_write(HttpStream* s, const char* data, size_t len);
+bool http_stream_puts(HttpStream* s, const char* str);
+// One formatted piece must fit HTTP_STREAM_BUF_LEN
+bool http_stream_printf(HttpStream* s, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+// Quoted and escaped JSON string
+bool http_stream_json_str(HttpStream* s, const char* str);
+// Flush and terminate the response. Returns the first send error.
+esp_err_t http_stream_end(HttpStream* s);
+
+// Asset embedded in flash, optionally precompressed. The ETag is a CRC of
+// the data, computed on first use, so matching pages on different devices
+// share a cache entry; a matching If-None-Match is answered with 304.
+typedef struct
+{
+    const uint8_t* data;
+    size_t len;
+    const char* content_type;
+    const char* content_encoding; // "gzip", or NULL for identity
+    char etag[12];                // Filled on first use
+} HttpAsset;
+
+esp_err_t http_send_asset(httpd_req_t* req, HttpAsset* asset);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,334 @@
+#ifndef LASER_CODEC_H
+#define LASER_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash.h"
+#include "protocol_config.h"
+
+// Laser frame codecs. Every codec keeps player_id in bits 31..24 and
+// device_id in bits 23..16 of the 32-bit frame; only the low 16 check bits
+// differ, so frame timing and the photodiode path are unchanged.
+//
+//   LaserHashCode  - the original XOR+offset hashes, detect only
+//   LaserBchCode<> - extended BCH(32,16), minimum distance 8: corrects up to
+//                    two flipped bits and still detects up to five
+//
+// All coding tables are generated at compile time from the generator
+// polynomial and live in flash.
+
+struct LaserDecoded
+{
+    uint8_t player_id;
+    uint8_t device_id;
+    uint8_t corrected_bits; // Bits repaired by the decoder (0 = clean frame)
+};
+
+// ============================================================================
+// LEGACY HASH CODE
+// ============================================================================
+
+struct LaserHashCode
+{
+    static constexpr uint8_t kMaxCorrectable = 0;
+
+    static constexpr uint32_t encode(uint8_t player_id, uint8_t device_id)
+    {
+        return ((uint32_t)player_id << 24) | ((uint32_t)device_id << 16) |
+               ((uint32_t)(uint8_t)((player_id ^ HASH_XOR_SEED) + HASH_OFFSET) << 8) |
+               (uint8_t)((device_id ^ HASH_XOR_SEED) + HASH_OFFSET);
+    }
+
+    static bool decode(uint32_t frame, LaserDecoded* out)
+    {
+        uint8_t player_id, device_id;
+        if (!validateLaserMessage(frame, &player_id, &device_id))
+            return false;
+        if (out)
+            *out = {player_id, device_id, 0};
+        return true;
+    }
+};
+
+// ============================================================================
+// EXTENDED BCH(32,16)
+// ============================================================================
+//
+// Frame layout: data[31..16] | BCH(31,16) parity[15..1] | overall parity[0].
+// The 16-bit syndrome is (remainder mod g(x)) << 1 | overall parity, so it is
+// linear in the received word and computed with four byte-table lookups.
+
+namespace laser_codec_detail
+{
+    // x^n mod g(x) over GF(2), g of degree 15
+    constexpr uint32_t polyModPow(uint32_t generator, unsigned n)
+    {
+        uint32_t r = 1;
+        for (unsigned i = 0; i < n; i++)
+        {
+            r <<= 1;
+            if (r & (1u << 15))
+                r ^= generator;
+        }
+        return r;
+    }
+
+    constexpr uint8_t parity32(uint32_t v)
+    {
+        v ^= v >> 16;
+        v ^= v >> 8;
+        v ^= v >> 4;
+        v ^= v >> 2;
+        v ^= v >> 1;
+        return (uint8_t)(v & 1);
+    }
+
+    // Syndrome contributed by a single set bit of the 32-bit frame
+    constexpr uint16_t bitSyndrome(uint32_t generator, unsigned bit)
+    {
+        return bit == 0 ? (uint16_t)1 : (uint16_t)((polyModPow(generator, bit - 1) << 1) | 1);
+    }
+
+    struct ErrorPattern
+    {
+        uint16_t syndrome;
+        uint8_t bit_a;
+        uint8_t bit_b; // 0xFF for single-bit patterns
+    };
+
+    template <uint32_t Generator, uint8_t MaxCorrectable>
+    struct BchTables
+    {
+        static constexpr size_t kPatterns = MaxCorrectable >= 2 ? 32 + 32 * 31 / 2 : 32;
+
+        uint16_t syndrome[4][256]; // Per frame byte, LSB first
+        uint16_t parity[2][256];   // Check bits for the data high / low byte
+        ErrorPattern patterns[kPatterns]; // Sorted by syndrome
+
+        constexpr BchTables() : syndrome(), parity(), patterns()
+        {
+            uint16_t bit_syn[32] = {};
+            for (unsigned b = 0; b < 32; b++)
+                bit_syn[b] = bitSyndrome(Generator, b);
+
+            for (unsigned byte = 0; byte < 4; byte++)
+            {
+                for (unsigned v = 0; v < 256; v++)
+                {
+                    uint16_t s = 0;
+                    for (unsigned b = 0; b < 8; b++)
+                    {
+                        if (v & (1u << b))
+                            s ^= bit_syn[byte * 8 + b];
+                    }
+                    syndrome[byte][v] = s;
+                }
+            }
+
+            // Check bits solve syndrome(data | check) == 0. The check bits of
+            // the frame (bits 15..0) have syndromes that form an identity-like
+            // basis, so the data syndrome maps onto them directly.
+            for (unsigned half = 0; half < 2; half++)
+            {
+                for (unsigned v = 0; v < 256; v++)
+                {
+                    uint16_t s = 0;
+                    for (unsigned b = 0; b < 8; b++)
+                    {
+                        if (v & (1u << b))
+                            s ^= bit_syn[16 + half * 8 + b];
+                    }
+                    uint32_t rem = s >> 1;
+                    uint32_t check = rem << 1;
+                    uint8_t p = (uint8_t)((s & 1) ^ parity32(check));
+                    parity[half][v] = (uint16_t)(check | p);
+                }
+            }
+
+            size_t n = 0;
+            for (unsigned a = 0; a < 32; a++)
+                patterns[n++] = {bit_syn[a], (uint8_t)a, 0xFF};
+            if (MaxCorrectable >= 2)
+            {
+                for (unsigned a = 0; a < 32; a++)
+                {
+                    for (unsigned b = a + 1; b < 32; b++)
+                        patterns[n++] = {(uint16_t)(bit_syn[a] ^ bit_syn[b]), (uint8_t)a, (uint8_t)b};
+                }
+            }
+
+            // Insertion sort; runs once, in the compiler
+            for (size_t i = 1; i < kPatterns; i++)
+            {
+                ErrorPattern key = patterns[i];
+                size_t j = i;
+                while (j > 0 && patterns[j - 1].syndrome > key.syndrome)
+                {
+                    patterns[j] = patterns[j - 1];
+                    j--;
+                }
+                patterns[j] = key;
+            }
+        }
+    };
+} // namespace laser_codec_detail
+
+template <uint32_t Generator = LASER_BCH_GENERATOR, uint8_t MaxCorrectable = 2>
+struct LaserBchCode
+{
+    static_assert(Generator >> 15 == 1, "generator must have degree 15");
+    static_assert(MaxCorrectable >= 1 && MaxCorrectable <= 2, "table covers one or two bit errors");
+
+    static constexpr uint8_t kMaxCorrectable = MaxCorrectable;
+    static constexpr laser_codec_detail::BchTables<Generator, MaxCorrectable> kTables{};
+
+    static constexpr uint16_t syndrome(uint32_t frame)
+    {
+        return kTables.syndrome[0][frame & 0xFF] ^ kTables.syndrome[1][(frame >> 8) & 0xFF] ^
+               kTables.syndrome[2][(frame >> 16) & 0xFF] ^ kTables.syndrome[3][frame >> 24];
+    }
+
+    static constexpr uint32_t encode(uint8_t player_id, uint8_t device_id)
+    {
+        return ((uint32_t)player_id << 24) | ((uint32_t)device_id << 16) |
+               (uint32_t)(kTables.parity[1][player_id] ^ kTables.parity[0][device_id]);
+    }
+
+    // Corrects up to MaxCorrectable bit errors in place. Returns the number of
+    // bits repaired, or -1 if the frame is not within reach of a codeword.
+    static constexpr int correct(uint32_t* frame)
+    {
+        uint16_t s = syndrome(*frame);
+        if (s == 0)
+            return 0;
+
+        size_t lo = 0, hi = kTables.kPatterns;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (kTables.patterns[mid].syndrome < s)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == kTables.kPatterns || kTables.patterns[lo].syndrome != s)
+            return -1;
+
+        const laser_codec_detail::ErrorPattern& e = kTables.patterns[lo];
+        *frame ^= 1u << e.bit_a;
+        if (e.bit_b == 0xFF)
+            return 1;
+        *frame ^= 1u << e.bit_b;
+        return 2;
+    }
+
+    static bool decode(uint32_t frame, LaserDecoded* out)
+    {
+        int fixed = correct(&frame);
+        if (fixed < 0)
+            return false;
+        if (out)
+            *out = {(uint8_t)(frame >> 24), (uint8_t)(frame >> 16), (uint8_t)fixed};
+        return true;
+    }
+};
+
+// Sanity checks, evaluated by the compiler
+static_assert(LaserBchCode<>::syndrome(LaserBchCode<>::encode(0x00, 0x00)) == 0, "BCH encode");
+static_assert(LaserBchCode<>::syndrome(LaserBchCode<>::encode(0xA5, 0x3C)) == 0, "BCH encode");
+static_assert(LaserBchCode<>::syndrome(LaserBchCode<>::encode(0xFF, 0xFF)) == 0, "BCH encode");
+static_assert(LaserHashCode::encode(7, 42) == createLaserMessage(7, 42), "legacy layout");
+
+// ============================================================================
+// REGISTERED FRAME BOOK
+// ============================================================================
+//
+// Valid frames of every registered (player, device) pair, precomputed when
+// the roster changes. An intact frame is accepted with a single hash probe;
+// only damaged frames go through correction, and a corrected frame must also
+// belong to a registered pair, which keeps false accepts down at range.
+
+template <typename Code, size_t Capacity = 64>
+class LaserFrameBook
+{
+public:
+    static constexpr size_t kBuckets = Capacity * 2; // Load factor <= 0.5
+    static_assert((kBuckets & (kBuckets - 1)) == 0, "Capacity must be a power of two");
+
+    LaserFrameBook() { clear(); }
+
+    void clear()
+    {
+        for (size_t i = 0; i < kBuckets; i++)
+            frames_[i] = kEmpty;
+        count_ = 0;
+    }
+
+    // Returns false if the book is full
+    bool add(uint8_t player_id, uint8_t device_id)
+    {
+        uint32_t frame = Code::encode(player_id, device_id);
+        size_t b = bucket(frame);
+        while (frames_[b] != kEmpty)
+        {
+            if (frames_[b] == frame)
+                return true;
+            b = (b + 1) & (kBuckets - 1);
+        }
+        if (count_ >= Capacity)
+            return false;
+        frames_[b] = frame;
+        count_++;
+        return true;
+    }
+
+    bool contains(uint32_t frame) const
+    {
+        for (size_t b = bucket(frame); frames_[b] != kEmpty; b = (b + 1) & (kBuckets - 1))
+        {
+            if (frames_[b] == frame)
+                return true;
+        }
+        return false;
+    }
+
+    bool decode(uint32_t frame, LaserDecoded* out) const
+    {
+        if (!contains(frame))
+        {
+            LaserDecoded tmp;
+            if (!Code::decode(frame, &tmp))
+                return false;
+            uint32_t fixed = Code::encode(tmp.player_id, tmp.device_id);
+            if (!contains(fixed))
+                return false;
+            if (out)
+                *out = tmp;
+            return true;
+        }
+        if (out)
+            *out = {(uint8_t)(frame >> 24), (uint8_t)(frame >> 16), 0};
+        return true;
+    }
+
+    size_t size() const { return count_; }
+
+private:
+    // Never a valid frame for either code (check bits would have to be zero
+    // while the ids are all ones)
+    static constexpr uint32_t kEmpty = 0xFFFF0000u;
+
+    static size_t bucket(uint32_t frame) { return (size_t)((frame * 0x9E3779B1u) >> 16) & (kBuckets - 1); }
+
+    uint32_t frames_[kBuckets];
+    size_t count_;
+};
+
+// Codec selected for this build; weapons and targets must agree
+#ifdef CONFIG_RAYZ_LASER_CODEC_BCH
+using RayzLaserCode = LaserBchCode<>;
+#else
+using RayzLaserCode = LaserHashCode;
+#endif
+
+#endif // LASER_CODEC_H
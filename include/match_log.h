@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Journal of match events (shots, hits, deaths, respawns, ESP-NOW traffic)
+// kept in a fixed RAM ring so a disputed hit can be looked at afterwards.
+// Recording is lock-free, never allocates and is safe from any task on
+// either core. With CONFIG_RAYZ_MATCH_LOG_FLASH the ring is also spilled to
+// the "spiffs" partition in append-only pages that survive a reboot.
+
+typedef enum : uint8_t
+{
+    MATCH_EVT_SHOT = 1,    // shooter = this player
+    MATCH_EVT_HIT,         // shooter hit victim
+    MATCH_EVT_DEATH,       // victim died, detail = hearts left
+    MATCH_EVT_RESPAWN,     // victim respawned
+    MATCH_EVT_ESPNOW_RX,   // shooter = sender's player id, aux = EspnowMsgType
+} MatchEventType;
+
+#define MATCH_ID_UNKNOWN 0xFF
+
+// 12 bytes, little-endian on the wire (the export streams these as-is)
+typedef struct
+{
+    uint32_t timestamp_ms; // esp_timer time
+    uint16_t seq;          // Low bits of the journal sequence number
+    uint8_t type;          // MatchEventType
+    uint8_t shooter_id;
+    uint8_t victim_id;
+    uint8_t aux;           // Type-specific (device id, message type, ...)
+    uint16_t detail;       // Type-specific (hearts, ammo, ...)
+} MatchEvent;
+
+typedef struct
+{
+    uint32_t recorded; // Events recorded since boot (or since the last restore)
+    uint32_t next_seq; // Sequence number of the next event
+    uint32_t spilled;  // Events written to flash
+    uint32_t flash_errors;
+} MatchLogStats;
+
+// Starts the flash spill task when enabled; recording works without it
+void match_log_init(void);
+
+void match_log_record(MatchEventType type, uint8_t shooter_id, uint8_t victim_id, uint8_t aux, uint16_t detail);
+
+// Copy events with sequence numbers >= *cursor into out, oldest first, and
+// advance *cursor past them. Events that were overwritten before they could
+// be read are skipped over (check the seq of the first one returned).
+// Returns the number of events written, 0 once the reader has caught up.
+int match_log_read(uint32_t* cursor, MatchEvent* out, int max_events);
+
+// Sequence number of the oldest event still held in RAM or flash
+uint32_t match_log_oldest_seq(void);
+
+void match_log_get_stats(MatchLogStats* out);
+
+#ifdef __cplusplus
+}
+#endif
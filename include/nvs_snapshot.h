@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary snapshot of every NVS entry in this component's namespaces (wifi,
+// game, espnow; IDF's own such as nvs.net80211 are left out), built with the
+// NVS iterator in one pass, for config audits over /api/nvs or the WebSocket.
+//
+// Layout, little endian: NvsSnapshotHeader, then `count` records of
+// NvsSnapshotEntry followed by the namespace (ns_len bytes), the key
+// (key_len) and the value (value_len). Integers keep their NVS width,
+// strings carry no terminator. Secrets (Wi-Fi password, ESP-NOW auth key)
+// are replaced by the CRC32 of their value and flagged NVS_SNAP_REDACTED,
+// so a change still shows in a diff; values longer than value_len can hold
+// are likewise, flagged NVS_SNAP_OVERSIZE.
+
+#define NVS_SNAPSHOT_MAGIC 0x5353564Eu // "NVSS"
+#define NVS_SNAPSHOT_VERSION 1
+#define NVS_SNAPSHOT_FLAG_DIFF 0x01 // Records are changes against a baseline
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;   // NVS_SNAPSHOT_FLAG_*
+    uint16_t count;  // Records that follow
+    uint32_t length; // Whole snapshot, header included
+    uint32_t crc32;  // Of everything after the header
+} NvsSnapshotHeader;
+
+#define NVS_SNAP_REDACTED 0x01 // Value is the CRC32 of the stored value
+#define NVS_SNAP_ADDED 0x02    // Diff: not in the baseline
+#define NVS_SNAP_CHANGED 0x04  // Diff: differs from the baseline, current value follows
+#define NVS_SNAP_REMOVED 0x08  // Diff: only in the baseline, its value follows
+#define NVS_SNAP_OVERSIZE 0x10 // Value is the CRC32 of a value over 65535 bytes
+
+typedef struct __attribute__((packed))
+{
+    uint8_t type;  // nvs_type_t
+    uint8_t flags; // NVS_SNAP_*
+    uint8_t ns_len;
+    uint8_t key_len;
+    uint16_t value_len;
+} NvsSnapshotEntry;
+
+// Upper bound of nvs_snapshot_take() for the current contents
+size_t nvs_snapshot_size(void);
+
+// Serialise every entry into buf. Pending nvs_store writes are flushed first
+// so the snapshot matches what a reboot would load. Returns the length or -1
+// if the buffer was too small.
+int nvs_snapshot_take(uint8_t* buf, size_t max_len);
+
+bool nvs_snapshot_valid(const uint8_t* snap, size_t len);
+
+// Changes from base to cur, as a snapshot with NVS_SNAPSHOT_FLAG_DIFF set.
+// base may be NULL for an empty baseline. Returns the length or -1 if the
+// buffer was too small or an input is malformed.
+int nvs_snapshot_diff(const uint8_t* base, size_t base_len, const uint8_t* cur, size_t cur_len, uint8_t* out,
+                      size_t max_len);
+
+// Factory baseline: the snapshot saved at provisioning time (or through
+// POST /api/nvs/baseline), kept in its own namespace, which snapshots skip.
+// Until one is saved the baseline is empty: a factory-reset device has no
+// keys and runs on compiled defaults, so every stored key is a deviation.
+bool nvs_snapshot_save_baseline(void);
+
+// Current contents against the factory baseline, in a malloc()ed buffer the
+// caller frees. Returns NULL on failure.
+uint8_t* nvs_snapshot_diff_baseline(size_t* out_len);
+// Current contents, likewise
+uint8_t* nvs_snapshot_alloc(size_t* out_len);
+
+#ifdef __cplusplus
+}
+#endif
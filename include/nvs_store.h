@@ -8,13 +8,27 @@ extern "C"
 {
 #endif
 
+    // Keys are cached in RAM after the first access. Writes return once the
+    // cache holds the value; a background task stores them shortly after,
+    // coalescing repeated writes and skipping unchanged values.
     bool nvs_store_read_str(const char* ns, const char* key, char* out, size_t max_len);
     bool nvs_store_write_str(const char* ns, const char* key, const char* value);
-    bool nvs_store_erase_namespace(const char* ns);
+    bool nvs_store_erase_namespace(const char* ns); // Synchronous, drops pending writes
     bool nvs_store_read_u8(const char* ns, const char* key, uint8_t* out);
     bool nvs_store_write_u8(const char* ns, const char* key, uint8_t value);
     bool nvs_store_read_u32(const char* ns, const char* key, uint32_t* out);
     bool nvs_store_write_u32(const char* ns, const char* key, uint32_t value);
+    // len: capacity of out on entry, stored length on success
+    bool nvs_store_read_blob(const char* ns, const char* key, void* out, size_t* len);
+    bool nvs_store_write_blob(const char* ns, const char* key, const void* data, size_t len);
+
+    // Group writes: nothing is stored until the outermost commit, so a group
+    // reaches flash together with one nvs_commit per namespace. Nests.
+    void nvs_store_begin(void);
+    void nvs_store_commit(void);
+
+    // Store all pending writes now (e.g. before esp_restart)
+    bool nvs_store_flush(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Edge-capture laser receiver. The RMT peripheral timestamps every edge of
+// the (comparator-conditioned) photodiode line, so no CPU time is spent
+// sampling. A small decoder task turns the captured run lengths into frame
+// bits with integer arithmetic and pushes them, stamped with the capture time
+// of the first edge, into a lock-free ring.
+//
+// Frames are NRZ, MSB first, and must begin with a one-bit start mark
+// (LASER_START_BITS). The start mark also re-measures the bit period, so
+// emitter clock drift is tracked without floating point.
+
+typedef struct
+{
+    uint32_t bits;        // Frame bits, LSB aligned (compact frames use the low 16)
+    uint8_t nbits;        // MESSAGE_TOTAL_BITS or MESSAGE_COMPACT_BITS
+    uint8_t profile;      // LASER_PROFILE_* the frame was decoded with
+    int64_t timestamp_us; // esp_timer time of the leading edge
+} PhotodiodeFrame;
+
+typedef struct
+{
+    uint32_t frames;         // Frames pushed into the ring
+    uint32_t invalid;        // Captures rejected (bad start mark, run or length)
+    uint32_t overflows;      // Frames dropped because the ring was full
+    uint32_t bit_period_us;  // Current bit period estimate
+    uint16_t high_watermark; // Deepest ring fill level seen
+    uint16_t depth;          // Ring capacity
+} PhotodiodeRxStats;
+
+// Start capturing on gpio. active_low inverts the input (light = low level).
+esp_err_t photodiode_rx_init(int gpio, bool active_low, uint8_t profile);
+
+// Switch timing profile (LASER_PROFILE_*); applies from the next capture.
+void photodiode_rx_set_profile(uint8_t profile);
+
+// Single consumer. Waits up to ticks_to_wait for a frame.
+bool photodiode_rx_receive(PhotodiodeFrame* out, TickType_t ticks_to_wait);
+
+void photodiode_rx_get_stats(PhotodiodeRxStats* out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,7 +3,9 @@
 
 #define RAYZ_PROTOCOL_VERSION "1.0.0"
 
-// Timing (ms)
+#include <stdint.h>
+
+// Timing (ms) of LASER_PROFILE_CLASSIC
 #define BIT_DURATION_MS 3
 #define SAMPLE_INTERVAL_MS 1
 #define SAMPLES_PER_BIT 3
@@ -21,10 +23,96 @@
 
 #define MESSAGE_DURATION_MS (BIT_DURATION_MS * MESSAGE_TOTAL_BITS)
 
+// Laser timing profiles, selected by GameConfig.laser_profile (default
+// CONFIG_RAYZ_LASER_TIMING_PROFILE). Every weapon and target in a game must
+// use the same profile, so it is part of the config push.
+#define LASER_PROFILE_CLASSIC 0 // 3 ms bits, 32-bit frame: 96 ms
+#define LASER_PROFILE_FAST 1    // 1 ms bits, 32-bit frame: 32 ms
+#define LASER_PROFILE_COMPACT 2 // 1 ms bits, 16-bit ID frame: 16 ms, player_id < 64
+#define LASER_PROFILE_COUNT 3
+
+#define LASER_START_BITS 1 // Start mark ahead of every frame (edge-capture receiver)
+#define LASER_COMPACT_MAX_PLAYERS 64
+#define MESSAGE_COMPACT_BITS 16
+
+#ifndef CONFIG_RAYZ_LASER_TIMING_PROFILE
+#define CONFIG_RAYZ_LASER_TIMING_PROFILE LASER_PROFILE_CLASSIC
+#endif
+
+typedef struct
+{
+    uint16_t bit_us;         // Duration of one bit
+    uint16_t sample_us;      // Photodiode sampling period
+    uint8_t samples_per_bit; // bit_us / sample_us
+    uint8_t frame_bits;      // MESSAGE_TOTAL_BITS or MESSAGE_COMPACT_BITS
+    uint16_t pause_ms;       // Minimum gap between two frames
+} LaserTimingProfile;
+
+inline constexpr LaserTimingProfile LASER_TIMING_PROFILES[LASER_PROFILE_COUNT] = {
+    {BIT_DURATION_MS * 1000, SAMPLE_INTERVAL_MS * 1000, SAMPLES_PER_BIT, MESSAGE_TOTAL_BITS, TRANSMISSION_PAUSE_MS},
+    {1000, 250, 4, MESSAGE_TOTAL_BITS, 35},
+    {1000, 250, 4, MESSAGE_COMPACT_BITS, 20},
+};
+
+// Time the receiver needs after the decoder's idle timeout to arm the next
+// capture (task wakeup and rmt_receive)
+#define LASER_REARM_MARGIN_US 2000
+
+constexpr const LaserTimingProfile* laser_timing_profile(uint8_t profile)
+{
+    return &LASER_TIMING_PROFILES[profile < LASER_PROFILE_COUNT ? profile : LASER_PROFILE_CLASSIC];
+}
+
+// Airtime of one frame, rounded up to whole milliseconds
+constexpr uint16_t laser_frame_duration_ms(uint8_t profile)
+{
+    const LaserTimingProfile* p = laser_timing_profile(profile);
+    return (uint16_t)(((uint32_t)p->bit_us * p->frame_bits + 999) / 1000);
+}
+
+// Low time after which the receiver ends a capture. The longest low run
+// inside a frame is frame_bits zeros after the start mark.
+constexpr uint32_t laser_idle_gap_us(uint8_t profile)
+{
+    const LaserTimingProfile* p = laser_timing_profile(profile);
+    return (uint32_t)p->bit_us * p->frame_bits + p->bit_us / 2;
+}
+
+// Shortest shot interval that keeps frames apart: start mark, frame and
+// pause. Anything faster leaves less than the idle gap between two frames
+// and the receiver merges them into one capture.
+constexpr uint16_t laser_min_shot_interval_ms(uint8_t profile)
+{
+    const LaserTimingProfile* p = laser_timing_profile(profile);
+    return (uint16_t)(((uint32_t)p->bit_us * (LASER_START_BITS + p->frame_bits) + 999) / 1000 + p->pause_ms);
+}
+
+constexpr bool laser_profiles_consistent()
+{
+    for (uint8_t i = 0; i < LASER_PROFILE_COUNT; i++)
+    {
+        const LaserTimingProfile* p = &LASER_TIMING_PROFILES[i];
+        if (p->bit_us != (uint32_t)p->sample_us * p->samples_per_bit)
+            return false;
+        // Frames sent pause_ms apart must end the capture and leave time to re-arm
+        if ((uint32_t)p->pause_ms * 1000 < laser_idle_gap_us(i) + LASER_REARM_MARGIN_US)
+            return false;
+        if (laser_min_shot_interval_ms(i) * 1000u < (uint32_t)p->bit_us * (LASER_START_BITS + p->frame_bits) +
+                                                        laser_idle_gap_us(i) + LASER_REARM_MARGIN_US)
+            return false;
+    }
+    return true;
+}
+static_assert(laser_profiles_consistent(), "Laser profile pause is shorter than the receiver idle gap");
+
 // Hash
 #define HASH_XOR_SEED 0b10101010
 #define HASH_OFFSET 1
 
+// Error correction (laser_codec.h): generator of the BCH(31,16) code,
+// x^15+x^11+x^10+x^9+x^8+x^7+x^5+x^3+x^2+x+1
+#define LASER_BCH_GENERATOR 0x8FAF
+
 // Threshold weights
 #define THRESHOLD_MIN_WEIGHT 0.98f
 #define THRESHOLD_NEW_WEIGHT 0.02f
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <esp_coexist.h>
+#include <esp_wifi.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "game_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Radio power/latency policy, driven by game commands. Between matches
+// heartbeats slow down and, with CONFIG_RAYZ_RADIO_IDLE_MODEM_SLEEP, the
+// station uses modem sleep; without it the radio stays awake. While a match
+// runs, power saving is off and the coexistence arbiter favours Wi-Fi (which
+// ESP-NOW rides on) so shots and hits see the lowest latency.
+//
+// Power saving only applies in station mode. The setup AP and devices
+// without an association keep the radio awake.
+
+typedef enum
+{
+    RADIO_MODE_IDLE = 0, // Lobby, stopped or paused
+    RADIO_MODE_MATCH,
+    RADIO_MODE_COUNT
+} RadioMode;
+
+typedef struct
+{
+    RadioMode mode;
+    uint32_t time_in_mode_ms[RADIO_MODE_COUNT]; // Including the current stretch
+    uint32_t transitions;
+} RadioPolicyStats;
+
+// Registers for game-over events; called by game_state_init()
+void radio_policy_init(void);
+
+// CMD_START and CMD_UNPAUSE enter RADIO_MODE_MATCH, everything else leaves it
+void radio_policy_on_command(GameCommandType cmd);
+void radio_policy_set_mode(RadioMode mode);
+RadioMode radio_policy_mode(void);
+
+// Settings for the current mode. The Wi-Fi driver picks these up before it
+// starts; mode changes apply them to the running driver.
+wifi_ps_type_t radio_policy_wifi_ps(void);
+esp_coex_prefer_t radio_policy_coex(void);
+// Interval applications should send ESP-NOW heartbeats at
+uint32_t radio_policy_heartbeat_interval_ms(void);
+
+void radio_policy_get_stats(RadioPolicyStats* out);
+
+// Stats as a JSON object. Returns the length or -1 if the buffer was too small.
+int radio_policy_stats_json(char* buffer, size_t max_len);
+
+#ifdef __cplusplus
+}
+#endif
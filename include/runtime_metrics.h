@@ -1,6 +1,23 @@
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef CONFIG_RAYZ_METRICS
+#define RAYZ_METRICS 1
+#else
+#define RAYZ_METRICS 0
+#endif
+
+#if RAYZ_METRICS
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#endif
+
+#ifndef CONFIG_RAYZ_SYSTEM_STATS_PERIOD_MS
+#define CONFIG_RAYZ_SYSTEM_STATS_PERIOD_MS 5000
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -19,6 +36,182 @@ extern "C"
     int metric_hit_count(void);
     uint32_t metric_last_hit_ms_ago(void);
 
+    // ========================================================================
+    // System sampler
+    // ========================================================================
+    //
+    // Every CONFIG_RAYZ_SYSTEM_STATS_PERIOD_MS the sampler records heap
+    // headroom (internal RAM and PSRAM separately), per-core CPU load and the
+    // stack headroom of the tightest tasks, and broadcasts it to WebSocket
+    // clients as OP_SYSTEM_STATS. With configUSE_TRACE_FACILITY every task is
+    // scanned (CPU figures also need configGENERATE_RUN_TIME_STATS);
+    // otherwise only the tasks named in system_stats_watch_task() and this
+    // component's own tasks are.
+
+#define SYSTEM_STATS_MAX_TASKS 10
+#define SYSTEM_STATS_CPU_UNKNOWN 0xFF
+
+    typedef struct
+    {
+        char name[16];
+        uint32_t stack_free; // Bytes, lowest since the task started
+        uint8_t cpu_pct;     // Of one core since the previous sample, or SYSTEM_STATS_CPU_UNKNOWN
+    } SystemTaskStats;
+
+    typedef struct
+    {
+        uint32_t free_bytes;
+        uint32_t largest_block; // Largest single allocation that would succeed
+        uint32_t min_free;      // Lowest free_bytes since boot
+    } SystemHeapStats;
+
+    typedef struct
+    {
+        uint32_t sampled_ms; // 0 = no sample yet
+        SystemHeapStats internal;
+        SystemHeapStats psram;   // All zero without PSRAM
+        uint8_t cpu_load_pct[2]; // Per core, SYSTEM_STATS_CPU_UNKNOWN without run-time stats
+        uint8_t task_count;
+        SystemTaskStats tasks[SYSTEM_STATS_MAX_TASKS]; // Least stack headroom first
+    } SystemStats;
+
+    // Start the periodic sampler (idempotent, no-op if the period is 0)
+    bool system_stats_start(void);
+
+    // Track a task that is not otherwise found (no trace facility). The name
+    // is copied (as SystemTaskStats::name, 15 characters at most).
+    bool system_stats_watch_task(const char* name);
+
+    void system_stats_sample(void);
+
+    // Latest sample; false before the first one
+    bool system_stats_get(SystemStats* out);
+
+    // Pull accessors for display_manager. The heap figures are read live,
+    // the CPU load and tightest task come from the latest sample.
+    uint32_t system_largest_free_block(void);
+    uint32_t system_min_free_heap(void);
+    int system_cpu_load_pct(void); // Busiest core, -1 if unknown
+    const char* system_tightest_task(uint32_t* stack_free);
+
+    // ========================================================================
+    // Boot timeline
+    // ========================================================================
+    //
+    // esp_timer time at which each boot phase was first reached, reported
+    // in /api/metrics under "boot".
+
+    typedef enum
+    {
+        BOOT_PHASE_WIFI_INIT,    // wifi_manager_init() entered
+        BOOT_PHASE_RADIO_READY,  // Wi-Fi driver started on its channel (cached or scanned)
+        BOOT_PHASE_ESPNOW_READY, // espnow_comm_init() done: hits and shots can flow
+        BOOT_PHASE_ASSOCIATED,   // Associated with the AP
+        BOOT_PHASE_GOT_IP,       // IP address (DHCP or reused lease)
+        BOOT_PHASE_SERVICES,     // HTTP API and WebSocket endpoint up
+        BOOT_PHASE_COUNT,
+    } BootPhase;
+
+    // Record the first time a phase is reached (later calls are ignored)
+    void boot_phase_mark(BootPhase phase);
+
+    // ms since boot at which the phase was reached, 0 if not yet
+    uint32_t boot_phase_ms(BootPhase phase);
+
+    // ========================================================================
+    // Hot-path registry
+    // ========================================================================
+    //
+    // Fixed-bucket histograms and counters fed by the ESP-NOW, WebSocket,
+    // photodiode and display paths. Recording is a few relaxed atomics; with
+    // CONFIG_RAYZ_METRICS off every METRICS_* macro expands to nothing.
+    //
+    // Cycle timings use the per-core cycle counter, so they are only taken
+    // around code that does not block (and so cannot move to the other core).
+
+    typedef enum
+    {
+        METRICS_HIST_ESPNOW_RX_LATENCY, // us, receive callback to dequeue
+        METRICS_HIST_ESPNOW_SEND,       // cycles in esp_now_send()
+        METRICS_HIST_WS_QUEUE_DEPTH,    // frames queued to a client after each enqueue
+        METRICS_HIST_WS_ENCODE_JSON,    // cycles per JSON encode
+        METRICS_HIST_WS_ENCODE_MSGPACK, // cycles per MessagePack encode
+        METRICS_HIST_PHOTODIODE_DECODE, // cycles per capture decode
+        METRICS_HIST_DISPLAY_FLUSH,     // us per panel bitmap write
+        METRICS_HIST_COUNT,
+    } MetricsHist;
+
+    typedef enum
+    {
+        METRICS_CTR_ESPNOW_SEND_ERRORS, // esp_now_send() returned an error
+        METRICS_CTR_WS_ENCODE_ERRORS,   // Encoder ran out of frame space
+        METRICS_CTR_COUNT,
+    } MetricsCounter;
+
+    // Bucket 0 holds zeros, bucket i (i >= 1) values in [2^(i-1), 2^i); the
+    // last bucket also takes everything above
+#define METRICS_HIST_BUCKETS 24
+
+    typedef struct
+    {
+        uint32_t count;
+        uint32_t sum; // Wraps; divide by count for the mean over short windows
+        uint32_t max;
+        uint32_t buckets[METRICS_HIST_BUCKETS];
+    } MetricsHistogram;
+
+    typedef struct
+    {
+        uint32_t uptime_ms;
+        uint32_t cpu_mhz; // Cycles per us for the cycle histograms
+        MetricsHistogram hists[METRICS_HIST_COUNT];
+        uint32_t counters[METRICS_CTR_COUNT];
+    } MetricsSnapshot;
+
+    // Copy the registry (zeroed when CONFIG_RAYZ_METRICS is off)
+    void metrics_snapshot(MetricsSnapshot* out);
+
+    // Registry plus the drop counters of the radio, laser and WebSocket
+    // paths as JSON. Returns the length or -1 if the buffer was too small.
+    int metrics_snapshot_json(char* buffer, size_t max_len);
+
+    void metrics_reset(void);
+
+#if RAYZ_METRICS
+    extern MetricsHistogram g_metrics_hists[METRICS_HIST_COUNT];
+    extern uint32_t g_metrics_counters[METRICS_CTR_COUNT];
+
+    static inline void metrics_hist_record(MetricsHist id, uint32_t value)
+    {
+        MetricsHistogram* h = &g_metrics_hists[id];
+        uint32_t bucket = value ? 32 - __builtin_clz(value) : 0;
+        if (bucket >= METRICS_HIST_BUCKETS)
+            bucket = METRICS_HIST_BUCKETS - 1;
+        __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+        uint32_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        while (value > max &&
+               !__atomic_compare_exchange_n(&h->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+        }
+    }
+
+#define METRICS_RECORD(id, value) metrics_hist_record((id), (uint32_t)(value))
+#define METRICS_COUNT(id) __atomic_fetch_add(&g_metrics_counters[(id)], 1, __ATOMIC_RELAXED)
+#define METRICS_CYCLES_BEGIN(var) const uint32_t var = esp_cpu_get_cycle_count()
+#define METRICS_CYCLES_END(id, var) metrics_hist_record((id), esp_cpu_get_cycle_count() - (var))
+#define METRICS_US_BEGIN(var) const int64_t var = esp_timer_get_time()
+#define METRICS_US_END(id, var) metrics_hist_record((id), (uint32_t)(esp_timer_get_time() - (var)))
+#else
+#define METRICS_RECORD(id, value) ((void)0)
+#define METRICS_COUNT(id) ((void)0)
+#define METRICS_CYCLES_BEGIN(var)
+#define METRICS_CYCLES_END(id, var) ((void)0)
+#define METRICS_US_BEGIN(var)
+#define METRICS_US_END(id, var) ((void)0)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
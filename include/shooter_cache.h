@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "espnow_comm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Recently announced shooters, keyed by the laser frame they are about to
+// emit. Every ESPNOW_MSG_SHOT announcement is inserted with an expiry, so a
+// decoded frame is matched against all shooters currently in flight with one
+// hashed probe window instead of the single expectedMessage slot.
+
+#ifndef SHOOTER_CACHE_SLOTS
+#define SHOOTER_CACHE_SLOTS 32 // Power of two
+#endif
+
+#ifndef SHOOTER_CACHE_TTL_MS
+#define SHOOTER_CACHE_TTL_MS 250 // Announcement to frame arrival, Classic frame plus ESP-NOW latency
+#endif
+
+typedef struct
+{
+    uint8_t player_id;
+    uint8_t device_id;
+    uint8_t team_id;
+    uint32_t announced_ms; // esp_timer time the announcement was received
+} ShooterInfo;
+
+typedef struct
+{
+    uint32_t announced; // Announcements inserted
+    uint32_t matched;   // Frames attributed to an announced shooter
+    uint32_t missed;    // Frames with no live announcement
+    uint32_t evicted;   // Live entries overwritten because the probe window was full
+} ShooterCacheStats;
+
+// Record a shot announcement; profile is the LASER_PROFILE_* the shooter uses
+void shooter_cache_announce(const PlayerMessage* msg, uint8_t profile);
+
+// Look up a decoded laser frame (LSB aligned, as delivered by the decoder).
+// Returns true and fills out (may be NULL) if a live announcement matches.
+bool shooter_cache_match(uint32_t frame, ShooterInfo* out);
+
+void shooter_cache_clear(void);
+void shooter_cache_get_stats(ShooterCacheStats* out);
+
+#ifdef __cplusplus
+}
+#endif
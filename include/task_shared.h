@@ -5,20 +5,28 @@
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <stdint.h>
+#include <atomic>
 #include "photodiode.hpp"
 
 extern Photodiode photodiode;
 
+// Single most recent announcement. shooter_cache.h tracks every shooter in
+// flight and should be preferred for hit attribution.
 extern uint32_t expectedMessage;
 extern bool hasExpectedMessage;
 extern TickType_t last_expected_update;
 extern uint8_t last_shooter_hash;
 
-extern uint16_t all_expected_messages;
-extern uint16_t correct_messages;
-extern uint16_t not_expected_messages;
+// Hit statistics; lock-free, safe to bump from any task
+extern std::atomic<uint16_t> all_expected_messages;
+extern std::atomic<uint16_t> correct_messages;
+extern std::atomic<uint16_t> not_expected_messages;
 
+// Software-sampled path. The edge-capture decoder (photodiode_rx.h) delivers
+// timestamped frames through its own ring instead.
 extern QueueHandle_t photodiodeMessageQueue;
+// Deprecated: the counters above no longer need it. Still created so
+// existing callers keep working.
 extern SemaphoreHandle_t statsMutex;
 
 bool init_task_shared();
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "espnow_comm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared clock across the ESP-NOW mesh. One device is the reference; every
+// other device periodically broadcasts an ESPNOW_MSG_TIME_SYNC request and
+// estimates its offset (and drift) to the reference from the four timestamps
+// of the exchange, NTP style. Only the exchange with the lowest round trip out
+// of the last few is trusted, so a retransmission or a busy Wi-Fi task does
+// not pull the clock.
+//
+// Shared time is in microseconds. On the reference, and on any device that
+// has not synced yet, it is the reference's own esp_timer time. Small
+// corrections are slewed, but a device switching references may jump.
+//
+// Several references are allowed (two dashboards); clients follow the one
+// with the lowest MAC, and an AUTO reference that hears a lower one follows
+// it as well, so the mesh converges on one timeline.
+
+typedef enum
+{
+    TIME_SYNC_AUTO = 0,  // Reference while a WebSocket dashboard is connected
+    TIME_SYNC_REFERENCE, // Always reference
+    TIME_SYNC_CLIENT,    // Never reference
+} TimeSyncRole;
+
+typedef struct
+{
+    TimeSyncRole role;
+    bool reference;             // Answering requests right now
+    bool synced;                // Following a reference
+    uint8_t ref_mac[ESP_NOW_ETH_ALEN];
+    int64_t offset_us;          // Shared minus local time, now
+    int32_t drift_ppb;          // Estimated rate difference to the reference
+    uint32_t rtt_us;            // Round trip of the last exchange applied
+    uint32_t last_sync_ms;      // esp_timer time of that exchange, 0 = never
+    uint32_t exchanges;         // Responses applied
+    uint32_t rejected;          // Responses dropped: to another device, too slow or from a higher MAC
+    uint32_t answered;          // Requests answered as reference
+} TimeSyncStatus;
+
+// Create the request timer; called by espnow_comm_init()
+void time_sync_init(void);
+
+void time_sync_set_role(TimeSyncRole role);
+TimeSyncRole time_sync_get_role(void);
+
+// Shared time now, or for a local esp_timer timestamp captured earlier (an
+// edge-capture time, say). Safe from any task.
+int64_t time_sync_now_us(void);
+int64_t time_sync_to_shared_us(int64_t local_us);
+bool time_sync_is_synced(void);
+void time_sync_get_status(TimeSyncStatus* out);
+
+// Status as a JSON object. Returns the length or -1 if the buffer was too small.
+int time_sync_status_json(char* buffer, size_t max_len);
+
+// espnow_comm hooks: a received exchange (Wi-Fi task, rx_us is the local
+// esp_timer time of reception) and the last-moment stamping of an outgoing
+// one (ESP-NOW TX task).
+void time_sync_on_rx(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const EspnowTimeSync* msg, int64_t rx_us,
+                     bool known_peer);
+void time_sync_stamp_tx(EspnowTimeSync* msg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,7 +15,9 @@
 #define NVS_KEY_PASS "pass"
 #define NVS_KEY_NAME "name"
 #define NVS_KEY_ROLE "role"
-#define NVS_KEY_PEERS "peers"
+#define NVS_KEY_PEERS "peers" // Legacy CSV string, migrated to NVS_KEY_PEER_MACS
+#define NVS_KEY_PEER_MACS "peer_macs"
+#define NVS_KEY_AP_CACHE "ap_cache"
 
 // Shared state
 extern EventGroupHandle_t g_wifi_events;
@@ -25,7 +27,8 @@ extern httpd_handle_t g_httpd;
 extern char g_device_name[32];
 extern char g_role[12];
 extern uint8_t g_wifi_channel;
-extern char g_peer_list[256];
+extern uint8_t g_peers[ESPNOW_MAX_PEERS][ESP_NOW_ETH_ALEN];
+extern uint8_t g_peer_count;
 
 #ifndef WIFI_COUNTRY_CODE
 #define WIFI_COUNTRY_CODE "SK"
@@ -22,14 +22,22 @@ extern "C"
 #include <freertos/event_groups.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include "espnow_comm.h"
 
 // Event group bits
 #define WIFI_EVENT_PROVISIONED_BIT (1 << 0)
 #define WIFI_EVENT_STA_CONNECTED_BIT (1 << 1)
+// The radio sits on its operating channel: the cached AP channel right after
+// a fast boot, otherwise once associated. ESP-NOW can be started
+// (espnow_comm_init() with wifi_manager_get_channel()) without waiting for
+// an IP address.
+#define WIFI_EVENT_RADIO_READY_BIT (1 << 2)
 
 // Maximum sizes for stored credentials
 #define WIFI_MAX_SSID_LEN 32
 #define WIFI_MAX_PASS_LEN 64
+// Stored ESP-NOW peer list rendered as CSV: a full peer table
+#define WIFI_PEER_LIST_LEN ESPNOW_PEER_CSV_LEN
 
     typedef enum
     {
@@ -54,7 +62,13 @@ extern "C"
     const char* wifi_manager_get_status_string();
     wifi_boot_mode_t wifi_manager_get_boot_mode();
     const char* wifi_manager_get_device_name(); // Added
+    // Stored ESP-NOW peers, kept in NVS as packed MACs (at most ESPNOW_MAX_PEERS)
+    int wifi_manager_get_peers(uint8_t (*out)[ESP_NOW_ETH_ALEN], int max_count);
+    bool wifi_manager_set_peers(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], int count);
+    // The same list as CSV; read-only, valid until the list changes. Tasks
+    // that may race a change should copy it with wifi_manager_load_peer_list().
     const char* wifi_manager_get_peer_list();
+    // False, keeping the stored peers, if the list is not empty but no MAC parses
     bool wifi_manager_set_peer_list(const char* csv_peers);
     bool wifi_manager_load_peer_list(char* out, size_t max_len);
 
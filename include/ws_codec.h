@@ -0,0 +1,211 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "espnow_comm.h"
+#include "game_protocol.h"
+#include "runtime_metrics.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // ============================================================================
+    // WIRE FORMATS
+    // ============================================================================
+
+    typedef enum
+    {
+        WS_FORMAT_JSON = 0, // Text frames, protocol v2.2 (legacy dashboards)
+        WS_FORMAT_MSGPACK,  // Binary frames, same keys as JSON minus "type"
+    } WsFormat;
+
+    // ============================================================================
+    // PROTOCOL MESSAGE ENCODERS (ESP32 -> Client)
+    // ============================================================================
+    //
+    // Every encoder writes the message straight into the caller's buffer and
+    // never touches the heap. Return value is the number of bytes written or -1
+    // if the buffer was too small. JSON output is additionally NUL-terminated
+    // (the terminator is not counted).
+
+    // Worst-case sizes, useful for stack buffers on the send path
+#define WS_CODEC_STATUS_MAX_LEN 512
+#define WS_CODEC_EVENT_MAX_LEN 128
+
+    /**
+     * @brief Encode full device status (OP_STATUS): config, stats and state blocks
+     */
+    int ws_codec_status(WsFormat fmt, uint8_t* buffer, size_t max_len);
+
+    /**
+     * @brief Encode incremental status (OP_STATUS_DELTA) with only the changed fields
+     * @param fields GS_DIRTY_* bits from game_state_take_dirty()
+     * @param seq Sequence number returned alongside them; a client that sees
+     *            a gap re-requests a full snapshot with OP_GET_STATUS
+     */
+    int ws_codec_status_delta(WsFormat fmt, uint8_t* buffer, size_t max_len, uint32_t fields, uint32_t seq);
+
+    /**
+     * @brief Encode heartbeat acknowledgment (OP_HEARTBEAT_ACK)
+     */
+    int ws_codec_heartbeat_ack(WsFormat fmt, uint8_t* buffer, size_t max_len);
+
+    /**
+     * @brief Encode shot fired event (OP_SHOT_FIRED)
+     */
+    int ws_codec_shot_fired(WsFormat fmt, uint8_t* buffer, size_t max_len);
+
+    /**
+     * @brief Encode hit report (OP_HIT_REPORT)
+     * @param shooter_id ID of the device that hit us
+     */
+    int ws_codec_hit_report(WsFormat fmt, uint8_t* buffer, size_t max_len, uint8_t shooter_id);
+
+    /**
+     * @brief Encode respawn event (OP_RESPAWN)
+     */
+    int ws_codec_respawn(WsFormat fmt, uint8_t* buffer, size_t max_len);
+
+    /**
+     * @brief Encode reload event (OP_RELOAD_EVENT)
+     * @param current_ammo Ammo after the reload completed
+     */
+    int ws_codec_reload_event(WsFormat fmt, uint8_t* buffer, size_t max_len, uint16_t current_ammo);
+
+    /**
+     * @brief Encode game over notification (OP_GAME_OVER)
+     */
+    int ws_codec_game_over(WsFormat fmt, uint8_t* buffer, size_t max_len);
+
+    /**
+     * @brief Encode generic acknowledgment (OP_ACK)
+     * @param reply_to req_id of the acknowledged message (may be NULL)
+     * @param success Result of the command
+     */
+    int ws_codec_ack(WsFormat fmt, uint8_t* buffer, size_t max_len, const char* reply_to, bool success);
+
+    /**
+     * @brief Encode a system telemetry sample (OP_SYSTEM_STATS)
+     * @param stats Sample from system_stats_get()
+     */
+    int ws_codec_system_stats(WsFormat fmt, uint8_t* buffer, size_t max_len, const SystemStats* stats);
+
+    // ============================================================================
+    // PROTOCOL MESSAGE DECODER (Client -> ESP32)
+    // ============================================================================
+
+    // Presence bits for WsConfigUpdate::present
+#define WS_CFG_RESET_TO_DEFAULTS (1u << 0)
+#define WS_CFG_DEVICE_NAME (1u << 1)
+#define WS_CFG_DEVICE_ID (1u << 2)
+#define WS_CFG_PLAYER_ID (1u << 3)
+#define WS_CFG_TEAM_ID (1u << 4)
+#define WS_CFG_COLOR_RGB (1u << 5)
+#define WS_CFG_MAX_HEARTS (1u << 6)
+#define WS_CFG_SPAWN_HEARTS (1u << 7)
+#define WS_CFG_RESPAWN_TIME_S (1u << 8)
+#define WS_CFG_ENABLE_HEARTS (1u << 9)
+#define WS_CFG_FRIENDLY_FIRE (1u << 10)
+#define WS_CFG_MAX_AMMO (1u << 11)
+#define WS_CFG_RELOAD_TIME_MS (1u << 12)
+#define WS_CFG_ENABLE_AMMO (1u << 13)
+#define WS_CFG_GAME_DURATION_S (1u << 14)
+#define WS_CFG_ESPNOW_PEERS (1u << 15)
+#define WS_CFG_SHOT_RATE_LIMIT_MS (1u << 16)
+#define WS_CFG_LASER_PROFILE (1u << 17)
+#define WS_CFG_ESPNOW_KEY (1u << 18)
+
+    typedef struct
+    {
+        uint32_t present; // WS_CFG_* bits of the fields carried by the message
+        bool reset_to_defaults;
+        char device_name[32];
+        uint8_t device_id;
+        uint8_t player_id;
+        uint8_t team_id;
+        uint32_t color_rgb;
+        uint8_t max_hearts;
+        uint8_t spawn_hearts;
+        uint32_t respawn_time_s;
+        bool enable_hearts;
+        bool friendly_fire;
+        uint16_t max_ammo;
+        uint16_t reload_time_ms;
+        bool enable_ammo;
+        uint16_t game_duration_s;
+        uint16_t shot_rate_limit_ms;
+        uint8_t laser_profile; // LASER_PROFILE_*
+        char espnow_peers[ESPNOW_PEER_CSV_LEN]; // CSV list, same format as the JSON field
+        char espnow_key[33];                   // 32 hex digits of the frame auth key, "" = off
+    } WsConfigUpdate;
+
+    typedef struct
+    {
+        OpCode op;       // 0 if the message carried neither op nor a known type
+        char req_id[24]; // Empty if absent
+        union
+        {
+            WsConfigUpdate config;
+            struct
+            {
+                uint8_t command; // GameCommandType
+            } game_command;
+            struct
+            {
+                uint8_t shooter_id;
+            } hit_forward;
+            struct
+            {
+                uint8_t sound_id;
+            } remote_sound;
+            struct
+            {
+                bool diff; // Only the changes against the factory baseline
+            } nvs_snapshot;
+        };
+    } WsClientMessage;
+
+    /**
+     * @brief Decode a client message in either wire format
+     * @param fmt Format of the frame (text frames are JSON, binary frames MessagePack)
+     * @param data Frame payload (JSON need not be NUL-terminated)
+     * @param len Payload length
+     * @param out Decoded message
+     * @return true if the frame was well-formed
+     */
+    bool ws_codec_decode(WsFormat fmt, const uint8_t* data, size_t len, WsClientMessage* out);
+
+    // Opcodes are small integers; routing tables are indexed by them directly
+#define WS_OP_TABLE_SIZE 32
+
+    /**
+     * @brief Read only the opcode of a client message, without decoding its fields
+     * Walks the top-level keys, skipping values, and stops at "op" (clients
+     * send it first); falls back to the "type" string. The frame is not
+     * validated past the opcode, the handler's own decode does that.
+     * @return The opcode, or 0 if the frame carries none or is malformed
+     */
+    OpCode ws_codec_peek_op(WsFormat fmt, const uint8_t* data, size_t len);
+
+    /**
+     * @brief Store the fields carried by a config update into the target structs
+     * Driven by the shared field table (config_fields.h): applies scaling,
+     * inverted booleans and the per-field clamps. Cross-field rules are left
+     * to game_state_apply_game_config().
+     * @param dev DeviceConfig to update (NULL skips device fields)
+     * @param game GameConfig to update (NULL skips game fields)
+     */
+    void ws_codec_apply_config(const WsConfigUpdate* upd, DeviceConfig* dev, GameConfig* game);
+
+    /**
+     * @brief Protocol type string for an opcode ("status", "heartbeat", ...)
+     * @return "unknown" for unregistered opcodes
+     */
+    const char* ws_codec_op_name(int op);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <esp_http_server.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // ============================================================================
+    // CONFIGURATION
+    // ============================================================================
+
+    /**
+     * @brief Number of shared frame buffers (each WS_FRAME_MAX_LEN bytes)
+     */
+#ifndef WS_FRAME_POOL_SIZE
+#define WS_FRAME_POOL_SIZE 8
+#endif
+
+    /**
+     * @brief Largest payload a pooled frame can carry
+     */
+#ifndef WS_FRAME_MAX_LEN
+#define WS_FRAME_MAX_LEN 1024
+#endif
+
+    /**
+     * @brief Most sockets a single fan-out job writes to
+     */
+#ifndef WS_FRAME_MAX_TARGETS
+#if defined(CONFIG_RAYZ_WS_MAX_CLIENTS) && CONFIG_RAYZ_WS_MAX_CLIENTS > 8
+#define WS_FRAME_MAX_TARGETS CONFIG_RAYZ_WS_MAX_CLIENTS
+#else
+#define WS_FRAME_MAX_TARGETS 8
+#endif
+#endif
+
+    // ============================================================================
+    // SHARED FRAMES
+    // ============================================================================
+    //
+    // A frame is encoded (or copied) once and then referenced by every consumer
+    // that needs it; the buffer returns to the pool when the last reference is
+    // dropped. Nothing here touches the heap.
+
+    typedef struct
+    {
+        uint8_t refs; // Managed by ws_frame_ref/unref, do not touch
+        bool binary;  // Binary (MessagePack) or text (JSON) frame
+        uint8_t op;   // OpCode carried by the frame (0 = unknown), used by send queues
+        size_t len;   // Payload length
+        uint8_t data[WS_FRAME_MAX_LEN];
+    } ws_frame_t;
+
+    /**
+     * @brief Take a free frame from the pool
+     * @return Frame holding one reference, or NULL if the pool is exhausted
+     */
+    ws_frame_t* ws_frame_alloc(void);
+
+    /**
+     * @brief Allocate a frame and copy a payload into it
+     * @return Frame holding one reference, or NULL if exhausted / too large
+     */
+    ws_frame_t* ws_frame_from(const void* data, size_t len, bool binary);
+
+    /**
+     * @brief Add a reference to a frame
+     */
+    void ws_frame_ref(ws_frame_t* frame);
+
+    /**
+     * @brief Drop a reference; the frame returns to the pool at zero
+     */
+    void ws_frame_unref(ws_frame_t* frame);
+
+    /**
+     * @brief Number of frames currently free in the pool
+     */
+    int ws_frame_pool_available(void);
+
+    // ============================================================================
+    // FAN-OUT
+    // ============================================================================
+
+    /**
+     * @brief Called on the httpd task once a fan-out job has been written
+     * @param fds Target sockets, in the order they were passed
+     * @param ok Per-socket send result
+     * @param count Number of targets
+     */
+    typedef void (*ws_frame_done_cb_t)(const int* fds, const bool* ok, int count);
+
+    /**
+     * @brief Write one frame to several sockets with a single httpd_queue_work
+     *
+     * The job takes its own reference, so the caller keeps (and must still
+     * drop) the reference it holds.
+     *
+     * @param server httpd handle
+     * @param frame Frame to send
+     * @param fds Target sockets (at most WS_FRAME_MAX_TARGETS are used)
+     * @param count Number of targets
+     * @param on_done Optional completion callback
+     * @return true if the job was queued
+     */
+    bool ws_frame_fanout(httpd_handle_t server, ws_frame_t* frame, const int* fds, int count,
+                         ws_frame_done_cb_t on_done);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,14 +2,93 @@
 
 #include <esp_http_server.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "game_protocol.h"
+#include "ws_codec.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    // ============================================================================
+    // CONFIGURATION FLAGS
+    // ============================================================================
+
+    /**
+     * @brief Enable MessagePack binary protocol alongside JSON
+     * Clients that request the "msgpack" subprotocol get binary frames encoded
+     * by ws_codec; everyone else keeps receiving JSON text frames.
+     */
+#ifndef WS_ENABLE_MSGPACK
+#define WS_ENABLE_MSGPACK 1
+#endif
+
+    /**
+     * @brief Most WebSocket clients connected at once
+     */
+#ifndef CONFIG_RAYZ_WS_MAX_CLIENTS
+#define CONFIG_RAYZ_WS_MAX_CLIENTS 4
+#endif
+#define WS_MAX_CLIENTS CONFIG_RAYZ_WS_MAX_CLIENTS
+
+    /**
+     * @brief Queue outgoing frames per client and write them from the httpd task
+     * Callers never block on a slow socket. With 0 every send is written
+     * synchronously and waits for the socket: through httpd_ws_send_data from
+     * other tasks, straight to the socket from handlers on the httpd task.
+     */
+#ifndef WS_ENABLE_ASYNC_SEND
+#define WS_ENABLE_ASYNC_SEND 1
+#endif
+
+    /**
+     * @brief Keep clients alive with WebSocket PING/PONG
+     * The server pings every WS_PING_INTERVAL_MS and drops clients that
+     * answered nothing for WS_CLIENT_TIMEOUT_MS. With 0, liveness relies on
+     * the application-level heartbeat (OP_HEARTBEAT).
+     */
+#ifndef WS_USE_NATIVE_PING
+#define WS_USE_NATIVE_PING 1
+#endif
+
+#ifndef WS_PING_INTERVAL_MS
+#define WS_PING_INTERVAL_MS 10000
+#endif
+
+    /**
+     * @brief Disable HTTP API endpoints (WebSocket only mode)
+     * Saves ~8KB RAM per device
+     */
+#ifndef WS_DISABLE_HTTP_API
+#define WS_DISABLE_HTTP_API 0
+#endif
+
+    /**
+     * @brief Depth of the per-client send queue (frames waiting for the socket)
+     */
+#ifndef WS_CLIENT_QUEUE_DEPTH
+#define WS_CLIENT_QUEUE_DEPTH 6
+#endif
+
+    /**
+     * @brief Receive buffers per client slot
+     * The handler reads frames into a static pool of this many 1 KB buffers
+     * per client instead of allocating; raise it if on_message borrows
+     * buffers (see ws_server_rx_borrow()).
+     */
+#ifndef WS_RX_BUFFERS_PER_CLIENT
+#define WS_RX_BUFFERS_PER_CLIENT 1
+#endif
+
+    /**
+     * @brief First byte of binary frames that carry raw data instead of a message
+     * 0xC1 is never used by MessagePack, so clients can tell the two apart.
+     * Followed by the chunk index and the chunk count (nvs_snapshot replies).
+     */
+#define WS_RAW_FRAME_MARKER 0xC1
+
     // ============================================================================
     // CALLBACK TYPES
     // ============================================================================
@@ -24,10 +103,23 @@ extern "C"
     /**
      * @brief Callback for incoming messages from browser
      * @param client_fd Client file descriptor
-     * @param type Message type parsed from JSON
-     * @param json Full JSON message
+     * @param type Protocol type of the opcode ("unknown" if none)
+     * @param data Full message (JSON text or MessagePack), valid until the
+     *             callback returns unless borrowed. A NUL follows the payload,
+     *             but MessagePack frames may contain 0x00: use len, not strlen.
+     * @param len Payload length
      */
-    typedef void (*ws_server_message_cb_t)(int client_fd, const char* type, const char* json);
+    typedef void (*ws_server_message_cb_t)(int client_fd, const char* type, const char* data, size_t len);
+
+    /**
+     * @brief Handler for one client opcode
+     * Gets the raw frame and decodes only what it needs (ws_codec_decode())
+     * @param client_fd Client file descriptor
+     * @param fmt Wire format of the frame (text = JSON, binary = MessagePack)
+     * @param data Frame payload, NUL-terminated
+     * @param len Payload length
+     */
+    typedef void (*ws_server_op_handler_t)(int client_fd, WsFormat fmt, const uint8_t* data, size_t len);
 
     // ============================================================================
     // SERVER CONFIGURATION
@@ -55,6 +147,17 @@ extern "C"
      */
     void ws_server_register(httpd_handle_t server);
 
+    /**
+     * @brief Route an opcode to a handler, replacing the built-in one
+     * ws_server_init() installs handlers for the v2.2 client opcodes; call
+     * this afterwards, during setup (dispatch does not lock the table).
+     * on_message still sees every frame after its handler ran.
+     * @param op Client opcode
+     * @param handler Handler, or NULL to ignore the opcode
+     * @return false if op is out of range
+     */
+    bool ws_server_register_op(OpCode op, ws_server_op_handler_t handler);
+
     // ============================================================================
     // CONNECTION MANAGEMENT
     // ============================================================================
@@ -72,10 +175,16 @@ extern "C"
     int ws_server_client_count(void);
 
     /**
-     * @brief Cleanup stale clients that haven't sent activity recently
+     * @brief Drop clients whose socket failed or that were idle too long
      */
     void ws_server_cleanup_stale(void);
 
+    /**
+     * @brief Send WebSocket PING to all clients
+     * Runs periodically when WS_USE_NATIVE_PING is set.
+     */
+    void ws_server_ping_clients(void);
+
     // ============================================================================
     // MESSAGE SENDING
     // ============================================================================
@@ -84,7 +193,7 @@ extern "C"
      * @brief Send message to a specific client
      * @param client_fd Client file descriptor
      * @param message JSON message string
-     * @return true if sent successfully
+     * @return true if sent (or queued) successfully
      */
     bool ws_server_send(int client_fd, const char* message);
 
@@ -94,15 +203,195 @@ extern "C"
      */
     void ws_server_broadcast(const char* message);
 
+    /**
+     * @brief Send a raw frame to a specific client
+     * @param client_fd Client file descriptor
+     * @param data Message data (JSON or MessagePack)
+     * @param len Length of data
+     * @param binary true for binary (MessagePack), false for text (JSON)
+     * @return true if sent (or queued) successfully
+     */
+    bool ws_server_send_raw(int client_fd, const uint8_t* data, size_t len, bool binary);
+
+    /**
+     * @brief Broadcast a raw frame to all connected clients
+     * @param data Message data (JSON or MessagePack)
+     * @param len Length of data
+     * @param binary true for binary (MessagePack), false for text (JSON)
+     */
+    void ws_server_broadcast_raw(const uint8_t* data, size_t len, bool binary);
+
+    /**
+     * @brief Send JSON or MessagePack message to client (auto-detects format)
+     * @param client_fd Client file descriptor
+     * @param json_or_msgpack Message data
+     * @param len Length of data (0 = auto-calculate for JSON)
+     * @return true if sent successfully
+     */
+    bool ws_server_send_auto(int client_fd, const void* json_or_msgpack, size_t len);
+
+    /**
+     * @brief Broadcast JSON or MessagePack message to all clients
+     * @param json_or_msgpack Message data
+     * @param len Length of data (0 = auto-calculate for JSON)
+     */
+    void ws_server_broadcast_auto(const void* json_or_msgpack, size_t len);
+
+    // ============================================================================
+    // SEND QUEUES & BACKPRESSURE
+    // ============================================================================
+    //
+    // With WS_ENABLE_ASYNC_SEND every client owns a bounded queue of pooled
+    // frames drained round-robin by the httpd task, so a client on a weak link
+    // only ever delays its own frames. OP_HIT_REPORT / OP_SHOT_FIRED /
+    // OP_GAME_OVER are never dropped in favour of less important traffic.
+
+    typedef struct
+    {
+        uint8_t high_watermark;        // Queue depth at which a client counts as congested
+        uint32_t congested_timeout_ms; // Disconnect after this long over the watermark (0 = never)
+        bool coalesce_status;          // A new OP_STATUS replaces one still queued
+    } WsSendQueuePolicy;
+
+    typedef struct
+    {
+        int fd;
+        uint8_t depth;       // Frames currently queued
+        uint8_t max_depth;   // High-water mark since connect
+        uint32_t sent;       // Frames written to the socket
+        uint32_t dropped;    // Frames discarded because the queue was full
+        uint32_t coalesced;  // OP_STATUS frames superseded while queued
+        uint32_t send_errors;
+    } WsClientQueueStats;
+
+    /**
+     * @brief Replace the send queue policy (defaults: watermark 4, 5 s, coalesce on)
+     */
+    void ws_server_set_queue_policy(const WsSendQueuePolicy* policy);
+
+    /**
+     * @brief Snapshot per-client queue counters
+     * @param out Destination array
+     * @param max_entries Capacity of out
+     * @return Number of entries written
+     */
+    int ws_server_get_queue_stats(WsClientQueueStats* out, int max_entries);
+
+    /**
+     * @brief Number of clients disconnected for staying over the watermark
+     */
+    uint32_t ws_server_congestion_disconnects(void);
+
+    // ============================================================================
+    // SIMULATED CLIENTS
+    // ============================================================================
+
+    /**
+     * @brief fd of the first simulated client; the others count down from it
+     */
+#define WS_SIMULATED_FD_BASE (-100)
+
+    /**
+     * @brief Add clients without a socket, for load tests
+     * They take part in broadcasts, queueing and the send pump like real
+     * clients, but their frames are discarded instead of written and they
+     * are never pinged, timed out or reported through on_connect.
+     * @param count Clients to add
+     * @param binary Negotiate MessagePack instead of JSON
+     * @return Number added (limited by the free client slots, 0 before
+     *         ws_server_register())
+     */
+    int ws_server_add_simulated_clients(int count, bool binary);
+
+    /**
+     * @brief Remove every simulated client and drop its queued frames
+     */
+    void ws_server_remove_simulated_clients(void);
+
+    // ============================================================================
+    // RECEIVE BUFFER HAND-OFF
+    // ============================================================================
+
+    /**
+     * @brief Keep the buffer passed to on_message after the callback returns
+     * Lets the callback hand the frame to an application task without a copy.
+     * The borrower must call ws_server_rx_release() with the same pointer.
+     * @param data The data pointer on_message received
+     * @param len Receives the payload length, so it can travel with the
+     *            pointer to another task (may be NULL)
+     * @return false if data is not a receive buffer or is already borrowed
+     */
+    bool ws_server_rx_borrow(const uint8_t* data, size_t* len);
+
+    /**
+     * @brief Return a borrowed receive buffer to the pool (any task)
+     */
+    void ws_server_rx_release(const uint8_t* data);
+
+    /**
+     * @brief Number of receive buffers currently free
+     */
+    int ws_server_rx_available(void);
+
+    /**
+     * @brief Frames rejected because every receive buffer was borrowed
+     */
+    uint32_t ws_server_rx_exhausted(void);
+
+    // ============================================================================
+    // FORMAT-AWARE MESSAGING
+    // ============================================================================
+
+    /**
+     * @brief Encoder used by the format-aware helpers (see ws_codec.h)
+     * @param fmt Wire format of the receiving client
+     * @param ctx Caller context passed through unchanged
+     * @return Encoded length or -1 if the buffer was too small
+     */
+    typedef int (*ws_server_encode_fn_t)(WsFormat fmt, uint8_t* buffer, size_t max_len, const void* ctx);
+
+    /**
+     * @brief Check whether a client negotiated the binary (MessagePack) format
+     * @param client_fd Client file descriptor
+     */
+    bool ws_server_client_is_binary(int client_fd);
+
+    /**
+     * @brief Encode a message in the client's format and send it
+     * @return true if sent successfully
+     */
+    bool ws_server_send_encoded(int client_fd, ws_server_encode_fn_t encode, const void* ctx);
+
+    /**
+     * @brief Encode a message at most once per format and broadcast it
+     */
+    void ws_server_broadcast_encoded(ws_server_encode_fn_t encode, const void* ctx);
+
     // ============================================================================
     // GAME-SPECIFIC MESSAGES
     // ============================================================================
+    //
+    // All of these are encoded in each client's negotiated format.
 
     /**
-     * @brief Send registration/status response to browser
+     * @brief Broadcast a full status snapshot (OP_STATUS)
      */
     void ws_server_send_status(void);
 
+    /**
+     * @brief Send a full status snapshot to one client
+     * @param client_fd Client to respond to
+     */
+    void ws_server_send_status_to(int client_fd);
+
+    /**
+     * @brief Broadcast only the status fields changed since the last status
+     *        or delta (OP_STATUS_DELTA); does nothing if nothing changed
+     * Deltas are never coalesced; a client that misses one sees a seq gap and
+     * asks for a full snapshot with OP_GET_STATUS.
+     */
+    void ws_server_broadcast_status_delta(void);
+
     /**
      * @brief Send heartbeat acknowledgment
      * @param client_fd Client to respond to
@@ -130,6 +419,30 @@ extern "C"
      */
     void ws_server_broadcast_respawn(void);
 
+    /**
+     * @brief Broadcast reload event
+     * @param current_ammo Ammo after the reload completed
+     */
+    void ws_server_broadcast_reload(uint16_t current_ammo);
+
+    /**
+     * @brief Broadcast game over notification
+     */
+    void ws_server_broadcast_game_over(void);
+
+    /**
+     * @brief Broadcast the latest system telemetry sample (OP_SYSTEM_STATS)
+     * Sent by the runtime_metrics sampler; nothing is sent before its first sample.
+     */
+    void ws_server_broadcast_system_stats(void);
+
+    /**
+     * @brief Acknowledge a control message (OP_ACK)
+     * @param reply_to req_id of the acknowledged message (may be NULL)
+     * @param success Result of the command
+     */
+    void ws_server_send_ack(int client_fd, const char* reply_to, bool success);
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
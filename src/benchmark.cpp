@@ -0,0 +1,460 @@
+#include "benchmark.h"
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <esp_timer.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "espnow_comm.h"
+#include "game_state.h"
+#include "hash.h"
+#include "laser_codec.h"
+#include "ws_codec.h"
+#if !BENCHMARK_HOST
+#include "http_api.h"
+#include "ws_server.h"
+#endif
+
+#ifndef CONFIG_RAYZ_BENCHMARK_ESPNOW_RATE
+#define CONFIG_RAYZ_BENCHMARK_ESPNOW_RATE 2000
+#endif
+
+#define ESPNOW_RX_DURATION_US 2000000
+#define LASER_BATCH 16 // Decodes per timed sample, a single one is close to the timer overhead
+#define LASER_FRAMES 64
+#define BENCH_TASK_STACK 4096
+#define BENCH_TASK_PRIORITY 1
+#define PRODUCER_TASK_STACK 3072
+
+static const char* TAG = "Bench";
+
+// Locally administered, never a real peer
+static const uint8_t BENCH_MAC[ESP_NOW_ETH_ALEN] = {0x02, 'r', 'a', 'y', 'z', 'b'};
+
+static uint32_t s_samples[BENCHMARK_SAMPLES]; // ns per operation
+static uint8_t s_buf[1024];
+static BenchmarkResult s_results[BENCHMARK_MAX_RESULTS];
+
+static inline uint32_t cycles_to_ns(uint32_t cycles)
+{
+    return (uint32_t)((uint64_t)cycles * 1000 / esp_rom_get_cpu_ticks_per_us());
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// s_samples holds the latency of the last min(ops, BENCHMARK_SAMPLES) operations
+static void finish(BenchmarkResult* r, const char* name, uint32_t ops, int64_t elapsed_us, uint64_t bytes,
+                   uint32_t dropped)
+{
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->ops = ops;
+    r->ops_per_sec = elapsed_us > 0 ? (uint32_t)((uint64_t)ops * 1000000 / elapsed_us) : 0;
+    r->bytes = ops ? (uint32_t)(bytes / ops) : 0;
+    r->dropped = dropped;
+
+    uint32_t n = ops < BENCHMARK_SAMPLES ? ops : BENCHMARK_SAMPLES;
+    if (n > 0)
+    {
+        qsort(s_samples, n, sizeof(s_samples[0]), cmp_u32);
+        r->p50_ns = s_samples[(n - 1) * 50 / 100];
+        r->p99_ns = s_samples[(n - 1) * 99 / 100];
+    }
+
+    r->heap_min = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    r->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+}
+
+// ============================================================================
+// ENCODERS
+// ============================================================================
+
+typedef int (*bench_encode_fn_t)(uint8_t* buf, size_t max_len);
+
+static int enc_state_json(uint8_t* buf, size_t max_len)
+{
+    return game_state_to_json((char*)buf, max_len);
+}
+
+static int enc_config_json(uint8_t* buf, size_t max_len)
+{
+    return game_state_config_to_json((char*)buf, max_len, false);
+}
+
+static int enc_heartbeat_json(uint8_t* buf, size_t max_len)
+{
+    return game_state_create_heartbeat_json((char*)buf, max_len);
+}
+
+static int enc_hit_report_json(uint8_t* buf, size_t max_len)
+{
+    return game_state_create_hit_report_json((char*)buf, max_len, 7);
+}
+
+static int enc_shot_fired_json(uint8_t* buf, size_t max_len)
+{
+    return game_state_create_shot_fired_json((char*)buf, max_len);
+}
+
+#if !BENCHMARK_HOST
+static int enc_http_status(uint8_t* buf, size_t max_len)
+{
+    return http_api_get_status_json((char*)buf, max_len);
+}
+#endif
+
+static int enc_ws_status_json(uint8_t* buf, size_t max_len)
+{
+    return ws_codec_status(WS_FORMAT_JSON, buf, max_len);
+}
+
+static int enc_ws_status_msgpack(uint8_t* buf, size_t max_len)
+{
+    return ws_codec_status(WS_FORMAT_MSGPACK, buf, max_len);
+}
+
+static void run_encode(BenchmarkResult* r, const char* name, bench_encode_fn_t encode)
+{
+    uint64_t bytes = 0;
+    uint32_t ops = 0;
+    uint32_t failed = 0;
+
+    const int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++)
+    {
+        const uint32_t c0 = esp_cpu_get_cycle_count();
+        int len = encode(s_buf, sizeof(s_buf));
+        const uint32_t c1 = esp_cpu_get_cycle_count();
+        if (len <= 0)
+        {
+            failed++;
+            continue;
+        }
+        s_samples[ops++] = cycles_to_ns(c1 - c0);
+        bytes += (uint64_t)len;
+    }
+    finish(r, name, ops, esp_timer_get_time() - start, bytes, failed);
+}
+
+// ============================================================================
+// LASER DECODE
+// ============================================================================
+
+typedef bool (*bench_decode_fn_t)(uint32_t frame);
+
+static bool dec_validate(uint32_t frame)
+{
+    return validateLaserMessage(frame);
+}
+
+static bool dec_codec(uint32_t frame)
+{
+    LaserDecoded out;
+    return RayzLaserCode::decode(frame, &out);
+}
+
+static void run_decode(BenchmarkResult* r, const char* name, bench_decode_fn_t decode)
+{
+    // Three in four frames intact, the rest with one flipped bit
+    uint32_t frames[LASER_FRAMES];
+    for (int i = 0; i < LASER_FRAMES; i++)
+    {
+        frames[i] = RayzLaserCode::encode((uint8_t)(i * 7 + 1), (uint8_t)(i & 3));
+        if ((i & 3) == 3)
+            frames[i] ^= 1u << (i % 32);
+    }
+
+    volatile uint32_t accepted = 0;
+    const int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++)
+    {
+        const uint32_t* batch = &frames[(i * LASER_BATCH) % LASER_FRAMES];
+        uint32_t ok = 0;
+        const uint32_t c0 = esp_cpu_get_cycle_count();
+        for (int j = 0; j < LASER_BATCH; j++)
+            ok += decode(batch[j]);
+        const uint32_t c1 = esp_cpu_get_cycle_count();
+        accepted = accepted + ok;
+        s_samples[i] = cycles_to_ns(c1 - c0) / LASER_BATCH;
+    }
+    const int64_t elapsed = esp_timer_get_time() - start;
+
+    // Sorts the samples, so ops is fixed up afterwards
+    finish(r, name, BENCHMARK_SAMPLES, elapsed, 0, 0);
+    r->ops = BENCHMARK_SAMPLES * LASER_BATCH;
+    r->ops_per_sec = elapsed > 0 ? (uint32_t)((uint64_t)r->ops * 1000000 / elapsed) : 0;
+}
+
+#if !BENCHMARK_HOST
+// ============================================================================
+// ESP-NOW RECEIVE PATH
+// ============================================================================
+
+static bool s_producing = false;
+static uint32_t s_injected = 0;
+
+// Injects heartbeats (they stay out of the match journal) at the configured
+// rate, each carrying its injection time in data
+static void producer_task(void* arg)
+{
+    PlayerMessage msg = {};
+    msg.type = ESPNOW_MSG_HEARTBEAT;
+
+    uint32_t sent = 0;
+    const int64_t start = esp_timer_get_time();
+    for (;;)
+    {
+        const int64_t elapsed = esp_timer_get_time() - start;
+        if (elapsed >= ESPNOW_RX_DURATION_US)
+            break;
+        const uint32_t due = (uint32_t)(elapsed * CONFIG_RAYZ_BENCHMARK_ESPNOW_RATE / 1000000);
+        while (sent < due)
+        {
+            const int64_t now = esp_timer_get_time();
+            msg.timestamp_ms = (uint32_t)(now / 1000);
+            msg.data = (uint32_t)now;
+            espnow_comm_inject_rx(BENCH_MAC, (const uint8_t*)&msg, sizeof(msg));
+            sent++;
+        }
+        vTaskDelay(1);
+    }
+
+    s_injected = sent;
+    __atomic_store_n(&s_producing, false, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+static bool run_espnow_rx(BenchmarkResult* r)
+{
+    EspnowMessageEnvelope env[16];
+
+    // One warm-up message tells whether the receive path is up; then start
+    // from an empty ring
+    PlayerMessage probe = {};
+    probe.type = ESPNOW_MSG_HEARTBEAT;
+    if (!espnow_comm_inject_rx(BENCH_MAC, (const uint8_t*)&probe, sizeof(probe)))
+        return false;
+    while (espnow_comm_receive_batch(env, 16, 0) > 0)
+    {
+    }
+
+    __atomic_store_n(&s_producing, true, __ATOMIC_RELAXED);
+    const int64_t start = esp_timer_get_time();
+    if (xTaskCreatePinnedToCore(producer_task, "bench_rx", PRODUCER_TASK_STACK, NULL,
+                                uxTaskPriorityGet(NULL) + 1, NULL, tskNO_AFFINITY) != pdPASS)
+    {
+        s_producing = false;
+        ESP_LOGE(TAG, "Failed to start the ESP-NOW producer");
+        return false;
+    }
+
+    uint32_t received = 0;
+    for (;;)
+    {
+        const bool producing = __atomic_load_n(&s_producing, __ATOMIC_ACQUIRE);
+        int n = espnow_comm_receive_batch(env, 16, pdMS_TO_TICKS(20));
+        const uint32_t now = (uint32_t)esp_timer_get_time();
+        for (int i = 0; i < n; i++)
+        {
+            if (memcmp(env[i].src_mac, BENCH_MAC, ESP_NOW_ETH_ALEN) != 0)
+                continue;
+            s_samples[received % BENCHMARK_SAMPLES] = (now - env[i].msg.data) * 1000;
+            received++;
+        }
+        if (!producing && n == 0)
+            break;
+    }
+
+    const uint32_t injected = s_injected;
+    finish(r, "espnow_rx", received, esp_timer_get_time() - start, 0, injected - received);
+    r->bytes = sizeof(PlayerMessage);
+    return true;
+}
+
+// ============================================================================
+// WEBSOCKET BROADCAST
+// ============================================================================
+
+// Frames the simulated clients never got: dropped from a full queue or
+// superseded by a newer status while queued
+static uint32_t simulated_lost(void)
+{
+    WsClientQueueStats stats[WS_MAX_CLIENTS];
+    int n = ws_server_get_queue_stats(stats, WS_MAX_CLIENTS);
+    uint32_t lost = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (stats[i].fd <= WS_SIMULATED_FD_BASE)
+            lost += stats[i].dropped + stats[i].coalesced;
+    }
+    return lost;
+}
+
+static int run_ws_broadcast(BenchmarkResult* out, int max_results)
+{
+    int count = 0;
+    for (int clients = 1; count < max_results; clients++)
+    {
+        ws_server_remove_simulated_clients();
+        int added = ws_server_add_simulated_clients((clients + 1) / 2, false);
+        added += ws_server_add_simulated_clients(clients / 2, true);
+        if (added < clients)
+            break;
+
+        const int64_t start = esp_timer_get_time();
+        for (int i = 0; i < BENCHMARK_SAMPLES; i++)
+        {
+            const uint32_t c0 = esp_cpu_get_cycle_count();
+            ws_server_send_status();
+            s_samples[i] = cycles_to_ns(esp_cpu_get_cycle_count() - c0);
+        }
+        const int64_t elapsed = esp_timer_get_time() - start;
+
+        vTaskDelay(pdMS_TO_TICKS(50)); // Let the pump drain before counting
+        char name[sizeof(out->name)];
+        snprintf(name, sizeof(name), "ws_bcast_%dc", clients);
+        finish(&out[count++], name, BENCHMARK_SAMPLES, elapsed, 0, simulated_lost());
+    }
+    ws_server_remove_simulated_clients();
+    return count;
+}
+#endif // !BENCHMARK_HOST
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+static void log_result(const BenchmarkResult* r)
+{
+    ESP_LOGI(TAG, "%-18s %8lu ops/s  p50 %7lu ns  p99 %7lu ns  %4lu B  drop %lu  heap min %lu blk %lu", r->name,
+             (unsigned long)r->ops_per_sec, (unsigned long)r->p50_ns, (unsigned long)r->p99_ns,
+             (unsigned long)r->bytes, (unsigned long)r->dropped, (unsigned long)r->heap_min,
+             (unsigned long)r->heap_largest);
+}
+
+int benchmark_run(BenchmarkResult* out, int max_results)
+{
+    static const struct
+    {
+        const char* name;
+        bench_encode_fn_t fn;
+    } encoders[] = {
+        {"state_json", enc_state_json},
+        {"config_json", enc_config_json},
+        {"heartbeat_json", enc_heartbeat_json},
+        {"hit_report_json", enc_hit_report_json},
+        {"shot_fired_json", enc_shot_fired_json},
+#if !BENCHMARK_HOST
+        {"http_status_json", enc_http_status},
+#endif
+        {"ws_status_json", enc_ws_status_json},
+        {"ws_status_msgpack", enc_ws_status_msgpack},
+    };
+
+    if (!out)
+    {
+        out = s_results;
+        max_results = BENCHMARK_MAX_RESULTS;
+    }
+
+    ESP_LOGI(TAG, "Running benchmarks (%d samples per suite)", BENCHMARK_SAMPLES);
+    int count = 0;
+    for (size_t i = 0; i < sizeof(encoders) / sizeof(encoders[0]) && count < max_results; i++)
+        run_encode(&out[count++], encoders[i].name, encoders[i].fn);
+
+    if (count < max_results)
+        run_decode(&out[count++], "laser_validate", dec_validate);
+    if (count < max_results)
+        run_decode(&out[count++], "laser_decode", dec_codec);
+
+#if !BENCHMARK_HOST
+    if (count < max_results && !run_espnow_rx(&out[count]))
+        ESP_LOGW(TAG, "espnow_rx skipped: ESP-NOW not initialised");
+    else if (count < max_results)
+        count++;
+
+    int ws = run_ws_broadcast(&out[count], max_results - count);
+    if (ws == 0)
+        ESP_LOGW(TAG, "ws_broadcast skipped: WebSocket endpoint not registered or no free client slot");
+    count += ws;
+#endif
+
+    for (int i = 0; i < count; i++)
+        log_result(&out[i]);
+    return count;
+}
+
+#if !BENCHMARK_HOST
+static char s_json[3072];
+
+static void bench_task(void* arg)
+{
+    int count = benchmark_run(s_results, BENCHMARK_MAX_RESULTS);
+    if (benchmark_results_json(s_results, count, s_json, sizeof(s_json)) > 0)
+        ESP_LOGI(TAG, "%s", s_json);
+    vTaskDelete(NULL);
+}
+
+bool benchmark_start(void)
+{
+    // Pinned: the latencies come from the per-core cycle counter
+    if (xTaskCreatePinnedToCore(bench_task, "bench", BENCH_TASK_STACK, NULL, BENCH_TASK_PRIORITY, NULL,
+                                portNUM_PROCESSORS - 1) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create benchmark task");
+        return false;
+    }
+    return true;
+}
+#endif
+
+static bool append(char* buffer, size_t max_len, size_t* pos, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static bool append(char* buffer, size_t max_len, size_t* pos, const char* fmt, ...)
+{
+    if (*pos >= max_len)
+        return false;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer + *pos, max_len - *pos, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= max_len - *pos)
+    {
+        *pos = max_len;
+        return false;
+    }
+    *pos += (size_t)n;
+    return true;
+}
+
+int benchmark_results_json(const BenchmarkResult* results, int count, char* buffer, size_t max_len)
+{
+    if (!buffer || max_len == 0 || (count > 0 && !results))
+        return -1;
+
+    size_t pos = 0;
+    bool ok = append(buffer, max_len, &pos, "[");
+    for (int i = 0; i < count && ok; i++)
+    {
+        const BenchmarkResult* r = &results[i];
+        ok = append(buffer, max_len, &pos,
+                    "%s{\"name\":\"%s\",\"ops\":%lu,\"ops_per_sec\":%lu,\"p50_ns\":%lu,\"p99_ns\":%lu,"
+                    "\"bytes\":%lu,\"dropped\":%lu,\"heap_min\":%lu,\"heap_largest\":%lu}",
+                    i ? "," : "", r->name, (unsigned long)r->ops, (unsigned long)r->ops_per_sec,
+                    (unsigned long)r->p50_ns, (unsigned long)r->p99_ns, (unsigned long)r->bytes,
+                    (unsigned long)r->dropped, (unsigned long)r->heap_min, (unsigned long)r->heap_largest);
+    }
+    ok = ok && append(buffer, max_len, &pos, "]");
+    return ok ? (int)pos : -1;
+}
@@ -1,10 +1,22 @@
 #include "debug_print.h"
+#include <stdlib.h>
+#include <string.h>
 #include "esp_log.h"
+#include "nvs_snapshot.h"
+
+#ifdef CONFIG_RAYZ_NVS_BOOT_DUMP
+#define NVS_BOOT_DUMP 1
+#else
+#define NVS_BOOT_DUMP 0
+#endif
 
 static const char* TAG = "DebugPrint";
 
 void debug_print_nvs_contents(void)
 {
+    if (!NVS_BOOT_DUMP)
+        return;
+
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
@@ -12,13 +24,26 @@ void debug_print_nvs_contents(void)
         nvs_flash_init();
     }
 
-    nvs_handle_t handle;
-    err = nvs_open(NVS_NS_WIFI, NVS_READONLY, &handle);
-    if (err != ESP_OK)
+    size_t len = 0;
+    uint8_t* snap = nvs_snapshot_alloc(&len);
+    if (!snap)
     {
-        ESP_LOGI(TAG, "Error opening NVS namespace '%s': %s\n", NVS_NS_WIFI, esp_err_to_name(err));
+        ESP_LOGW(TAG, "NVS snapshot failed");
         return;
     }
 
-    nvs_close(handle);
+    const NvsSnapshotHeader* hdr = (const NvsSnapshotHeader*)snap;
+    ESP_LOGI(TAG, "NVS: %u entries, %u bytes", hdr->count, (unsigned)len);
+    size_t pos = sizeof(*hdr);
+    for (uint16_t i = 0; i < hdr->count; i++)
+    {
+        NvsSnapshotEntry e;
+        memcpy(&e, snap + pos, sizeof(e));
+        const char* ns = (const char*)(snap + pos + sizeof(e));
+        const char* key = ns + e.ns_len;
+        ESP_LOGI(TAG, "  %.*s/%.*s type=0x%02x len=%u%s", e.ns_len, ns, e.key_len, key, e.type, e.value_len,
+                 (e.flags & NVS_SNAP_REDACTED) ? " (redacted)" : "");
+        pos += sizeof(e) + e.ns_len + e.key_len + e.value_len;
+    }
+    free(snap);
 }
@@ -6,14 +6,98 @@
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <driver/i2c.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 #include <lvgl.h>
+#include <string.h>
 
 #include "config.h"
+#include "runtime_metrics.h"
 
 static const char* TAG = "DisplayInit";
 
+#ifdef CONFIG_RAYZ_DISPLAY_DOUBLE_BUFFER
+#define DOUBLE_BUFFER 1
+#else
+#define DOUBLE_BUFFER 0
+#endif
+
+#define FLUSH_TASK_STACK 2560
+#define FLUSH_TASK_PRIORITY 2
+
+// One 8-pixel page worth of lines per draw buffer
+#define DRAW_BUF_PIXELS (OLED_WIDTH * 8)
+#define DRAW_BUF_COUNT (DOUBLE_BUFFER ? 2 : 1)
+
 // Owned ONLY here
 static esp_lcd_panel_handle_t s_panel = NULL;
+static lv_disp_drv_t s_disp_drv;
+static uint8_t s_draw_buf[DRAW_BUF_COUNT][DRAW_BUF_PIXELS];
+
+#if LV_COLOR_DEPTH == 1
+// Native 1-bpp: LVGL renders one lv_color_t byte per pixel with its normal
+// fill and blend paths, and flush_cb packs the area into SSD1306 pages (one
+// byte = 8 vertical pixels). One packed buffer per draw buffer, since the
+// flush task may still be sending the previous area.
+static uint8_t s_packed[DRAW_BUF_COUNT][DRAW_BUF_PIXELS / 8];
+
+static const uint8_t* pack_pages(const lv_color_t* color_map, int w, int h)
+{
+    uint8_t* out = s_packed[DOUBLE_BUFFER && (const uint8_t*)color_map != s_draw_buf[0]];
+    memset(out, 0, (size_t)(w * h / 8));
+    for (int y = 0; y < h; y++)
+    {
+        const lv_color_t* row = color_map + y * w;
+        uint8_t* page = out + (y / 8) * w;
+        const uint8_t bit = (uint8_t)(1 << (y & 0x7));
+        for (int x = 0; x < w; x++)
+        {
+            if (row[x].full)
+                page[x] |= bit;
+        }
+    }
+    return out;
+}
+#endif
+
+#if DOUBLE_BUFFER
+// Double-buffered mode: flush_cb hands the finished buffer to the flush task
+// and returns, so LVGL renders the next area into the other buffer while
+// this one goes out over I2C. Flush-ready is signalled by the panel IO's
+// transfer-done callback.
+typedef struct
+{
+    int x1, y1, x2, y2;
+    const void* data;
+} flush_job_t;
+
+static QueueHandle_t s_flush_q = NULL;
+
+static bool on_color_trans_done(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t* edata, void* user_ctx)
+{
+    (void)io;
+    (void)edata;
+    lv_disp_flush_ready((lv_disp_drv_t*)user_ctx);
+    return false;
+}
+
+static void flush_task(void* arg)
+{
+    (void)arg;
+    flush_job_t job;
+    for (;;)
+    {
+        if (xQueueReceive(s_flush_q, &job, portMAX_DELAY) != pdTRUE)
+            continue;
+        METRICS_US_BEGIN(flush_start);
+        esp_err_t err = esp_lcd_panel_draw_bitmap(s_panel, job.x1, job.y1, job.x2, job.y2, job.data);
+        METRICS_US_END(METRICS_HIST_DISPLAY_FLUSH, flush_start);
+        if (err != ESP_OK)
+            lv_disp_flush_ready(&s_disp_drv); // No transfer, no callback
+    }
+}
+#endif
 
 // LVGL tick
 static void lvgl_tick_timer_cb(void* arg)
@@ -36,12 +120,36 @@ static void ssd1306_flush_cb(lv_disp_drv_t* drv, const lv_area_t* area, lv_color
     int x2 = area->x2 + 1;
     int y2 = area->y2 + 1;
 
-    if (x1 >= 0 && y1 >= 0 && x2 > x1 && y2 > y1 && x2 <= OLED_WIDTH && y2 <= OLED_HEIGHT)
+    if (x1 < 0 || y1 < 0 || x2 <= x1 || y2 <= y1 || x2 > OLED_WIDTH || y2 > OLED_HEIGHT)
     {
-        esp_lcd_panel_draw_bitmap(s_panel, x1, y1, x2, y2, color_map);
+        lv_disp_flush_ready(drv);
+        return;
     }
 
-    lv_disp_flush_ready(drv);
+#if LV_COLOR_DEPTH == 1
+    const void* data = pack_pages(color_map, x2 - x1, y2 - y1);
+#else
+    const void* data = color_map; // Already packed by set_px_cb
+#endif
+
+#if DOUBLE_BUFFER
+    if (s_flush_q)
+    {
+        // LVGL waits for flush-ready before reusing this buffer, so the
+        // queue never holds more than one job
+        flush_job_t job = {x1, y1, x2, y2, data};
+        xQueueSend(s_flush_q, &job, portMAX_DELAY);
+        return;
+    }
+#endif
+
+    // Synchronous: with on_color_trans_done registered the IO callback has
+    // already signalled flush-ready when draw_bitmap returns
+    METRICS_US_BEGIN(flush_start);
+    esp_err_t err = esp_lcd_panel_draw_bitmap(s_panel, x1, y1, x2, y2, data);
+    METRICS_US_END(METRICS_HIST_DISPLAY_FLUSH, flush_start);
+    if (err != ESP_OK || !DOUBLE_BUFFER)
+        lv_disp_flush_ready(drv);
 }
 
 static void ssd1306_rounder_cb(lv_disp_drv_t* drv, lv_area_t* area)
@@ -59,6 +167,7 @@ static void ssd1306_rounder_cb(lv_disp_drv_t* drv, lv_area_t* area)
         area->y2 = OLED_HEIGHT - 1;
 }
 
+#if LV_COLOR_DEPTH != 1
 static void ssd1306_set_px_cb(lv_disp_drv_t* drv, uint8_t* buf, lv_coord_t buf_w, lv_coord_t x, lv_coord_t y,
                               lv_color_t color, lv_opa_t opa)
 {
@@ -73,6 +182,7 @@ static void ssd1306_set_px_cb(lv_disp_drv_t* drv, uint8_t* buf, lv_coord_t buf_w
     else
         buf[byte_index] &= ~(1 << bit_index);
 }
+#endif
 
 lv_disp_t* init_display(void)
 {
@@ -100,6 +210,10 @@ lv_disp_t* init_display(void)
     io_config.dc_bit_offset = 6;
     io_config.lcd_cmd_bits = 8;
     io_config.lcd_param_bits = 8;
+#if DOUBLE_BUFFER
+    io_config.on_color_trans_done = on_color_trans_done;
+    io_config.user_ctx = &s_disp_drv;
+#endif
 
     ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c((esp_lcd_i2c_bus_handle_t)I2C_NUM_0, &io_config, &io_handle));
 
@@ -136,21 +250,33 @@ lv_disp_t* init_display(void)
     // LVGL display driver (MONO buffer!)
     // ---------------------------------------------------------------------
     static lv_disp_draw_buf_t draw_buf;
-    // One 8-pixel page worth of lines; set_px_cb packs bits into bytes.
-    static uint8_t mono_buf[OLED_WIDTH * 8];
-
-    lv_disp_draw_buf_init(&draw_buf, (lv_color_t*)mono_buf, NULL, OLED_WIDTH * 8);
+#if DOUBLE_BUFFER
+    s_flush_q = xQueueCreate(1, sizeof(flush_job_t));
+    if (s_flush_q &&
+        xTaskCreate(flush_task, "oled_flush", FLUSH_TASK_STACK, NULL, FLUSH_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        vQueueDelete(s_flush_q);
+        s_flush_q = NULL;
+    }
+    if (!s_flush_q)
+        ESP_LOGW(TAG, "Flush task unavailable, flushing synchronously");
+    lv_disp_draw_buf_init(&draw_buf, (lv_color_t*)s_draw_buf[0], s_flush_q ? (lv_color_t*)s_draw_buf[1] : NULL,
+                          DRAW_BUF_PIXELS);
+#else
+    lv_disp_draw_buf_init(&draw_buf, (lv_color_t*)s_draw_buf[0], NULL, DRAW_BUF_PIXELS);
+#endif
 
-    static lv_disp_drv_t disp_drv;
-    lv_disp_drv_init(&disp_drv);
-    disp_drv.hor_res = OLED_WIDTH;
-    disp_drv.ver_res = OLED_HEIGHT;
-    disp_drv.draw_buf = &draw_buf;
-    disp_drv.flush_cb = ssd1306_flush_cb;
-    disp_drv.rounder_cb = ssd1306_rounder_cb;
-    disp_drv.set_px_cb = ssd1306_set_px_cb;
+    lv_disp_drv_init(&s_disp_drv);
+    s_disp_drv.hor_res = OLED_WIDTH;
+    s_disp_drv.ver_res = OLED_HEIGHT;
+    s_disp_drv.draw_buf = &draw_buf;
+    s_disp_drv.flush_cb = ssd1306_flush_cb;
+    s_disp_drv.rounder_cb = ssd1306_rounder_cb;
+#if LV_COLOR_DEPTH != 1
+    s_disp_drv.set_px_cb = ssd1306_set_px_cb;
+#endif
 
-    lv_disp_t* disp = lv_disp_drv_register(&disp_drv);
+    lv_disp_t* disp = lv_disp_drv_register(&s_disp_drv);
 
     ESP_LOGI(TAG, "SSD1306 display initialized");
     return disp;
@@ -6,6 +6,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#define DM_ROW_LEN 32
+#define DM_FAST_MS 100          // Debug page refresh / overlay blink
+#define DM_SLOW_MS 1000         // Error page refresh
+#define DM_IDLE_MS 1000         // Longest sleep, also LVGL housekeeping period
+#define DM_LV_SETTLE_MS 100     // Keep servicing LVGL this long after a change so it flushes
+
 typedef enum
 {
     DM_ST_BOOT = 0,
@@ -23,32 +29,67 @@ static uint32_t s_state_until_ms = 0;
 static uint32_t s_last_slow_ms = 0;
 static uint32_t s_last_fast_ms = 0;
 static uint32_t s_error_code = 0;
+static uint8_t s_page = 0;
 static lv_obj_t* s_row1;
 static lv_obj_t* s_row2;
 static lv_obj_t* s_row3;
 static lv_obj_t* s_overlay;
 
+// Last text pushed to each label; unchanged rows are never re-set, so LVGL
+// invalidates nothing and no I2C flush happens
+static char s_row_text[3][DM_ROW_LEN];
+static char s_overlay_text[DM_ROW_LEN];
+static bool s_overlay_visible = false;
+static bool s_ui_dirty = false;
+static uint32_t s_lv_active_until_ms = 0;
+static uint32_t s_last_lv_ms = 0;
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
 static uint32_t now_ms(void)
 {
     return s_src.uptime_ms ? s_src.uptime_ms() : (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
 }
 
+static bool update_text(lv_obj_t* label, char* cache, const char* text)
+{
+    if (strncmp(cache, text, DM_ROW_LEN) == 0)
+        return false;
+    strncpy(cache, text, DM_ROW_LEN - 1);
+    cache[DM_ROW_LEN - 1] = '\0';
+    lv_label_set_text(label, cache);
+    s_ui_dirty = true;
+    return true;
+}
+
 static void set_rows(const char* r1, const char* r2, const char* r3)
 {
-    lv_label_set_text(s_row1, r1);
-    lv_label_set_text(s_row2, r2);
-    lv_label_set_text(s_row3, r3);
+    update_text(s_row1, s_row_text[0], r1);
+    update_text(s_row2, s_row_text[1], r2);
+    update_text(s_row3, s_row_text[2], r3);
 }
 
 static void overlay_show(const char* txt)
 {
-    lv_label_set_text(s_overlay, txt);
-    lv_obj_clear_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
+    update_text(s_overlay, s_overlay_text, txt);
+    if (!s_overlay_visible)
+    {
+        lv_obj_clear_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
+        s_overlay_visible = true;
+        s_ui_dirty = true;
+    }
 }
 
 static void overlay_hide(void)
 {
+    if (!s_overlay_visible)
+        return;
     lv_obj_add_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
+    s_overlay_visible = false;
+    s_ui_dirty = true;
 }
 
 static void ui_init(lv_disp_t* disp)
@@ -74,11 +115,60 @@ static void ui_init(lv_disp_t* disp)
     lv_obj_add_flag(s_overlay, LV_OBJ_FLAG_HIDDEN);
 }
 
+typedef enum
+{
+    DM_PAGE_MAIN = 0,
+    DM_PAGE_SYSTEM,
+    DM_PAGE_COUNT
+} dm_page_t;
+
+static bool page_available(uint8_t page)
+{
+    if (page == DM_PAGE_SYSTEM)
+        return s_src.free_heap || s_src.largest_free_block;
+    return page < DM_PAGE_COUNT;
+}
+
+// Heap headroom, fragmentation and the tightest task stack; changes slowly,
+// so it is only refreshed on the slow tick
+static void render_system(bool slow)
+{
+    if (!slow)
+        return;
+    char r1[DM_ROW_LEN], r2[DM_ROW_LEN], r3[DM_ROW_LEN];
+
+    const uint32_t free_b = s_src.free_heap ? s_src.free_heap() : 0;
+    const uint32_t min_b = s_src.min_free_heap ? s_src.min_free_heap() : 0;
+    const uint32_t block = s_src.largest_free_block ? s_src.largest_free_block() : 0;
+    const int cpu = s_src.cpu_load_pct ? s_src.cpu_load_pct() : -1;
+    uint32_t stack = 0;
+    const char* task = s_src.tightest_task ? s_src.tightest_task(&stack) : NULL;
+
+    snprintf(r1, sizeof(r1), "Heap:%luk Min:%luk", (unsigned long)(free_b / 1024), (unsigned long)(min_b / 1024));
+    if (free_b > 0)
+        snprintf(r2, sizeof(r2), "Blk:%luk Frag:%lu%%", (unsigned long)(block / 1024),
+                 (unsigned long)(100 - (uint64_t)block * 100 / free_b));
+    else
+        snprintf(r2, sizeof(r2), "Blk:%luk", (unsigned long)(block / 1024));
+    if (task && cpu >= 0)
+        snprintf(r3, sizeof(r3), "CPU:%d%% %.8s:%lu", cpu, task, (unsigned long)stack);
+    else if (task)
+        snprintf(r3, sizeof(r3), "Stk %.10s:%lu", task, (unsigned long)stack);
+    else if (cpu >= 0)
+        snprintf(r3, sizeof(r3), "CPU:%d%%", cpu);
+    else
+        snprintf(r3, sizeof(r3), "CPU:--");
+    set_rows(r1, r2, r3);
+}
+
 static void render_debug(uint8_t page, bool slow)
 {
-    (void)page;
-    (void)slow;
-    char r1[32], r2[32], r3[32];
+    if (page == DM_PAGE_SYSTEM)
+    {
+        render_system(slow);
+        return;
+    }
+    char r1[DM_ROW_LEN], r2[DM_ROW_LEN], r3[DM_ROW_LEN];
 
     const bool wifi = s_src.wifi_connected ? s_src.wifi_connected() : false;
     const bool ws = s_src.ws_connected ? s_src.ws_connected() : false;
@@ -145,7 +235,7 @@ static void render_debug(uint8_t page, bool slow)
 
 static void render_error(void)
 {
-    char r1[32], r2[32], r3[32];
+    char r1[DM_ROW_LEN], r2[DM_ROW_LEN], r3[DM_ROW_LEN];
     snprintf(r1, sizeof(r1), "ERROR");
     snprintf(r2, sizeof(r2), "C:%lu", (unsigned long)s_error_code);
     snprintf(r3, sizeof(r3), "Fix & reboot");
@@ -205,22 +295,42 @@ static void handle_event(const dm_event_t* e)
             enter_state(DM_ST_OVERLAY_MSG, 800);
             overlay_show(e->msg.text);
             break;
+        case DM_EVT_NEXT_PAGE:
+            do
+            {
+                s_page = (uint8_t)((s_page + 1) % DM_PAGE_COUNT);
+            } while (!page_available(s_page));
+            s_last_fast_ms = now_ms() - DM_FAST_MS; // Render the new page right away
+            s_last_slow_ms = now_ms() - DM_SLOW_MS;
+            break;
         default:
             break;
     }
 }
 
+static uint32_t ms_until(uint32_t deadline, uint32_t t)
+{
+    return (int32_t)(deadline - t) > 0 ? deadline - t : 0;
+}
+
+// Time until the state machine next has work, so the task can sleep on s_q
+static uint32_t next_wakeup_ms(uint32_t t)
+{
+    uint32_t wait = DM_IDLE_MS;
+    if (s_state_until_ms)
+        wait = min_u32(wait, ms_until(s_state_until_ms, t));
+    if (s_state == DM_ST_DEBUG || s_state == DM_ST_OVERLAY_HIT)
+        wait = min_u32(wait, ms_until(s_last_fast_ms + DM_FAST_MS, t));
+    else if (s_state == DM_ST_ERROR)
+        wait = min_u32(wait, ms_until(s_last_slow_ms + DM_SLOW_MS, t));
+    return wait;
+}
+
 void display_manager_task(void* pv)
 {
     (void)pv;
     for (;;)
     {
-        dm_event_t e;
-        while (xQueueReceive(s_q, &e, 0) == pdTRUE)
-        {
-            handle_event(&e);
-        }
-
         const uint32_t t = now_ms();
 
         if (s_state_until_ms && t >= s_state_until_ms)
@@ -237,8 +347,8 @@ void display_manager_task(void* pv)
             s_state_until_ms = 0;
         }
 
-        const bool slow = (t - s_last_slow_ms) >= 1000;
-        const bool fast = (t - s_last_fast_ms) >= 100;
+        const bool slow = (t - s_last_slow_ms) >= DM_SLOW_MS;
+        const bool fast = (t - s_last_fast_ms) >= DM_FAST_MS;
 
         if (s_state == DM_ST_ERROR)
         {
@@ -250,9 +360,9 @@ void display_manager_task(void* pv)
         }
         else if (s_state == DM_ST_DEBUG)
         {
-            if (fast)
+            if (fast || slow)
             {
-                render_debug(0, slow);
+                render_debug(s_page, slow);
                 s_last_fast_ms = t;
             }
             if (slow)
@@ -269,7 +379,33 @@ void display_manager_task(void* pv)
             }
         }
 
-        lv_timer_handler();
-        vTaskDelay(pdMS_TO_TICKS(20));
+        // LVGL only needs servicing while a change is being flushed, plus an
+        // occasional housekeeping pass
+        uint32_t wait = next_wakeup_ms(t);
+        if (s_ui_dirty)
+        {
+            s_ui_dirty = false;
+            s_lv_active_until_ms = t + DM_LV_SETTLE_MS;
+        }
+        const bool lv_active = (int32_t)(s_lv_active_until_ms - t) > 0;
+        if (lv_active || (t - s_last_lv_ms) >= DM_IDLE_MS)
+        {
+            uint32_t lv_wait = lv_timer_handler();
+            s_last_lv_ms = t;
+            if (lv_active)
+                wait = min_u32(wait, lv_wait);
+        }
+
+        TickType_t ticks = pdMS_TO_TICKS(wait);
+        if (ticks == 0 && wait > 0)
+            ticks = 1;
+        dm_event_t e;
+        if (xQueueReceive(s_q, &e, ticks) == pdTRUE)
+        {
+            do
+            {
+                handle_event(&e);
+            } while (xQueueReceive(s_q, &e, 0) == pdTRUE);
+        }
     }
 }
@@ -0,0 +1,211 @@
+#include "espnow_auth.h"
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include "nvs_store.h"
+
+static const char* TAG = "EspNowAuth";
+
+// SipHash state right after the key is mixed in; every tag starts from a copy
+typedef struct
+{
+    uint64_t v0, v1, v2, v3;
+} sip_state_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static sip_state_t s_key_state;
+static bool s_enabled = false;
+static uint8_t s_own_mac[ESP_NOW_ETH_ALEN];
+
+static inline uint64_t rotl(uint64_t x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void sip_round(sip_state_t* s)
+{
+    s->v0 += s->v1;
+    s->v1 = rotl(s->v1, 13) ^ s->v0;
+    s->v0 = rotl(s->v0, 32);
+    s->v2 += s->v3;
+    s->v3 = rotl(s->v3, 16) ^ s->v2;
+    s->v0 += s->v3;
+    s->v3 = rotl(s->v3, 21) ^ s->v0;
+    s->v2 += s->v1;
+    s->v1 = rotl(s->v1, 17) ^ s->v2;
+    s->v2 = rotl(s->v2, 32);
+}
+
+static inline void sip_compress(sip_state_t* s, uint64_t m)
+{
+    s->v3 ^= m;
+    sip_round(s);
+    sip_round(s);
+    s->v0 ^= m;
+}
+
+static uint64_t load_le64(const uint8_t* p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// SipHash-2-4 of mac || frame, without joining the two into one buffer
+static uint64_t sip_hash(const sip_state_t* key, const uint8_t mac[ESP_NOW_ETH_ALEN], const uint8_t* frame,
+                         size_t len)
+{
+    sip_state_t s = *key;
+    const size_t total = ESP_NOW_ETH_ALEN + len;
+    uint64_t m = 0;
+    unsigned fill = 0;
+    for (size_t i = 0; i < total; i++)
+    {
+        const uint8_t byte = i < ESP_NOW_ETH_ALEN ? mac[i] : frame[i - ESP_NOW_ETH_ALEN];
+        m |= (uint64_t)byte << (8 * fill);
+        if (++fill == 8)
+        {
+            sip_compress(&s, m);
+            m = 0;
+            fill = 0;
+        }
+    }
+    sip_compress(&s, m | ((uint64_t)(total & 0xFF) << 56));
+
+    s.v2 ^= 0xFF;
+    for (int i = 0; i < 4; i++)
+        sip_round(&s);
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+static void install_key(const uint8_t key[ESPNOW_AUTH_KEY_LEN])
+{
+    const uint64_t k0 = load_le64(key);
+    const uint64_t k1 = load_le64(key + 8);
+    sip_state_t state = {k0 ^ 0x736f6d6570736575ULL, k1 ^ 0x646f72616e646f6dULL, k0 ^ 0x6c7967656e657261ULL,
+                         k1 ^ 0x7465646279746573ULL};
+    portENTER_CRITICAL(&s_lock);
+    s_key_state = state;
+    s_enabled = true;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// Copy of the key state, false while no key is set
+static bool key_snapshot(sip_state_t* out)
+{
+    portENTER_CRITICAL_SAFE(&s_lock);
+    const bool enabled = s_enabled;
+    if (enabled)
+        *out = s_key_state;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+    return enabled;
+}
+
+void espnow_auth_init(void)
+{
+    esp_read_mac(s_own_mac, ESP_MAC_WIFI_STA);
+
+    uint8_t key[ESPNOW_AUTH_KEY_LEN];
+    size_t len = sizeof(key);
+    if (nvs_store_read_blob(ESPNOW_AUTH_NVS_NS, ESPNOW_AUTH_NVS_KEY, key, &len) && len == sizeof(key))
+    {
+        install_key(key);
+        ESP_LOGI(TAG, "Frame authentication on (stored key)");
+    }
+}
+
+void espnow_auth_set_key(const uint8_t key[ESPNOW_AUTH_KEY_LEN])
+{
+    if (!key)
+        return;
+    install_key(key);
+    nvs_store_write_blob(ESPNOW_AUTH_NVS_NS, ESPNOW_AUTH_NVS_KEY, key, ESPNOW_AUTH_KEY_LEN);
+    ESP_LOGI(TAG, "Frame authentication on");
+}
+
+void espnow_auth_clear_key(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_enabled = false;
+    memset(&s_key_state, 0, sizeof(s_key_state));
+    portEXIT_CRITICAL(&s_lock);
+    nvs_store_write_blob(ESPNOW_AUTH_NVS_NS, ESPNOW_AUTH_NVS_KEY, NULL, 0);
+    ESP_LOGI(TAG, "Frame authentication off");
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool espnow_auth_set_key_hex(const char* hex)
+{
+    if (!hex)
+        return false;
+    if (hex[0] == '\0')
+    {
+        espnow_auth_clear_key();
+        return true;
+    }
+
+    uint8_t key[ESPNOW_AUTH_KEY_LEN];
+    for (int i = 0; i < ESPNOW_AUTH_KEY_LEN; i++)
+    {
+        const int hi = hex_nibble(hex[2 * i]);
+        const int lo = hi < 0 ? -1 : hex_nibble(hex[2 * i + 1]);
+        if (lo < 0)
+        {
+            ESP_LOGW(TAG, "Key must be %d hex digits", 2 * ESPNOW_AUTH_KEY_LEN);
+            return false;
+        }
+        key[i] = (uint8_t)((hi << 4) | lo);
+    }
+    if (hex[2 * ESPNOW_AUTH_KEY_LEN] != '\0')
+    {
+        ESP_LOGW(TAG, "Key must be %d hex digits", 2 * ESPNOW_AUTH_KEY_LEN);
+        return false;
+    }
+    espnow_auth_set_key(key);
+    return true;
+}
+
+bool espnow_auth_enabled(void)
+{
+    return s_enabled;
+}
+
+bool espnow_auth_tag(const uint8_t* frame, size_t len, uint8_t tag[ESPNOW_AUTH_TAG_LEN])
+{
+    sip_state_t key;
+    if (!key_snapshot(&key))
+        return false;
+    const uint64_t h = sip_hash(&key, s_own_mac, frame, len);
+    for (int i = 0; i < ESPNOW_AUTH_TAG_LEN; i++)
+        tag[i] = (uint8_t)(h >> (8 * i));
+    return true;
+}
+
+bool espnow_auth_accept(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const uint8_t* frame, size_t payload_len,
+                        bool tagged)
+{
+    sip_state_t key;
+    if (!key_snapshot(&key))
+        return true;
+    if (!tagged)
+        return false;
+
+    const uint64_t h = sip_hash(&key, src_mac, frame, payload_len);
+    const uint8_t* tag = frame + payload_len;
+    uint8_t diff = 0; // No early exit, so timing says nothing about the tag
+    for (int i = 0; i < ESPNOW_AUTH_TAG_LEN; i++)
+        diff |= tag[i] ^ (uint8_t)(h >> (8 * i));
+    return diff == 0;
+}
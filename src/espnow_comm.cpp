@@ -4,7 +4,48 @@
 #include <esp_wifi.h>
 #include <ctype.h>
 #include <string.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
+#include "espnow_auth.h"
+#include "game_state.h"
 #include "hash.h"
+#include "match_log.h"
+#include "radio_policy.h"
+#include "runtime_metrics.h"
+#include "time_sync.h"
+
+#ifndef CONFIG_RAYZ_ESPNOW_RX_RING_DEPTH
+#define CONFIG_RAYZ_ESPNOW_RX_RING_DEPTH 64
+#endif
+#define RX_RING_DEPTH CONFIG_RAYZ_ESPNOW_RX_RING_DEPTH
+#define RX_RING_MASK (RX_RING_DEPTH - 1)
+static_assert((RX_RING_DEPTH & RX_RING_MASK) == 0, "CONFIG_RAYZ_ESPNOW_RX_RING_DEPTH must be a power of two");
+
+#ifndef CONFIG_RAYZ_ESPNOW_ARENA_ID
+#define CONFIG_RAYZ_ESPNOW_ARENA_ID 0
+#endif
+static_assert(CONFIG_RAYZ_ESPNOW_ARENA_ID <= ESPNOW_MAX_ARENA, "CONFIG_RAYZ_ESPNOW_ARENA_ID out of range");
+
+#ifndef CONFIG_RAYZ_ESPNOW_TX_QUEUE_DEPTH
+#define CONFIG_RAYZ_ESPNOW_TX_QUEUE_DEPTH 16
+#endif
+#ifndef CONFIG_RAYZ_ESPNOW_TX_TASK_CORE
+#define CONFIG_RAYZ_ESPNOW_TX_TASK_CORE 0
+#endif
+#define TX_LANE_DEPTH CONFIG_RAYZ_ESPNOW_TX_QUEUE_DEPTH
+#define TX_LANE_MASK (TX_LANE_DEPTH - 1)
+static_assert((TX_LANE_DEPTH & TX_LANE_MASK) == 0, "CONFIG_RAYZ_ESPNOW_TX_QUEUE_DEPTH must be a power of two");
+#define TX_TASK_STACK 3072
+#define TX_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define TX_MAX_IN_FLIGHT 2         // Frames handed to the driver but not yet reported by send_cb
+#define TX_CREDIT_TIMEOUT_MS 20    // Resume anyway if a send_cb went missing
+
+#ifndef CONFIG_RAYZ_ESPNOW_BATCH_WINDOW_MS
+#define CONFIG_RAYZ_ESPNOW_BATCH_WINDOW_MS 2
+#endif
+#define BATCH_WINDOW_US ((int64_t)CONFIG_RAYZ_ESPNOW_BATCH_WINDOW_MS * 1000)
+static_assert(sizeof(EspnowBatchHeader) + ESPNOW_BATCH_MAX_MSGS * sizeof(PlayerMessage) <= ESP_NOW_MAX_DATA_LEN,
+              "batch container must fit one ESP-NOW frame");
 
 static const uint8_t ESPNOW_PMK[ESP_NOW_KEY_LEN] = {'r', 'a', 'y', 'z', '-', 'e', 's', 'p',
                                                     'n', 'o', 'w', '-', 'p', 'm', 'k', '!'};
@@ -13,9 +54,317 @@ static const char* TAG = "EspNowComm";
 static_assert(sizeof(EspnowMsgType) == 1, "EspnowMsgType must stay 1 byte");
 static bool s_initialised = false;
 static uint8_t s_channel = 0;
-static QueueHandle_t s_rx_queue = NULL;
-static SemaphoreHandle_t s_send_mutex = NULL;
+static uint8_t s_arena = CONFIG_RAYZ_ESPNOW_ARENA_ID; // Read by recv_cb for the group filter
+
+// SPSC receive ring: recv_cb (Wi-Fi task) is the only producer and advances
+// s_rx_head; the consumer task is the only one advancing s_rx_tail. Indices
+// run freely and are masked on access.
+static EspnowMessageEnvelope s_rx_ring[RX_RING_DEPTH];
+static uint32_t s_rx_head = 0;
+static uint32_t s_rx_tail = 0;
+#if RAYZ_METRICS
+static uint32_t s_rx_time_us[RX_RING_DEPTH]; // esp_timer time each slot was filled
+#endif
+static SemaphoreHandle_t s_rx_ready = NULL; // Given by the producer after every push
+static EspnowRxStats s_rx_stats = {0, 0, 0, 0, RX_RING_DEPTH};
+
+// Reliable delivery. Every esp_now_send() gets an entry in s_tx_pending (the
+// reliable slot index, or -1 for fire-and-forget); send_cb reports results in
+// the same order, so it pops the oldest entry to find which message it is for.
+#define RELIABLE_SLOTS 8
+#define RELIABLE_MAX_ATTEMPTS 5
+#define RELIABLE_BACKOFF_BASE_MS 8
+#define TX_PENDING_DEPTH 16
+#define DEDUP_PEERS 8
+#define DEDUP_WINDOW 16
+#define DEDUP_TTL_MS 2000 // Forget sequence numbers after this (sender reboot)
+
+typedef struct
+{
+    bool in_use;
+    bool awaiting_cb;
+    uint8_t attempts;
+    int64_t retry_at_us;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    PlayerMessage msg;
+} reliable_slot_t;
+
+typedef struct
+{
+    bool in_use;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t next;
+    uint8_t seq[DEDUP_WINDOW];
+    uint32_t seen_ms[DEDUP_WINDOW];
+    uint32_t last_ms;
+} dedup_peer_t;
+
+static reliable_slot_t s_reliable[RELIABLE_SLOTS];
+static int8_t s_tx_pending[TX_PENDING_DEPTH];
+static uint8_t s_tx_pending_head = 0;
+static uint8_t s_tx_pending_len = 0;
+static portMUX_TYPE s_tx_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t s_next_seq = 0;
+static esp_timer_handle_t s_retry_timer = NULL;
+static espnow_delivery_cb_t s_delivery_cb = NULL;
+static EspnowTxStats s_tx_stats = {};
+static dedup_peer_t s_dedup[DEDUP_PEERS]; // Only touched by recv_cb
+
+// Asynchronous TX path. Callers push into one of two bounded lock-free MPSC
+// queues (Vyukov's sequence-per-cell design) and notify the TX task, which is
+// the only context calling esp_now_send(). The high lane (hits, shots,
+// reliable traffic) is always drained before the normal lane.
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int8_t reliable_slot; // -1 for fire-and-forget
+    PlayerMessage msg;
+} tx_item_t;
+
+typedef struct
+{
+    uint32_t seq;
+    tx_item_t item;
+} tx_cell_t;
+
+typedef struct
+{
+    tx_cell_t cells[TX_LANE_DEPTH];
+    uint32_t enqueue_pos;
+    uint32_t dequeue_pos;
+} tx_lane_t;
+
+static tx_lane_t s_tx_high;
+static tx_lane_t s_tx_normal;
+static TaskHandle_t s_tx_task = NULL;
+static SemaphoreHandle_t s_tx_credits = NULL; // Counting, TX_MAX_IN_FLIGHT
+
+// Open aggregation frame, TX task only. Normal-lane fire-and-forget messages
+// to the same destination are packed until the window closes, the frame is
+// full, or something urgent needs the air.
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int64_t deadline_us;
+    EspnowBatchHeader header;
+    PlayerMessage msgs[ESPNOW_BATCH_MAX_MSGS];
+} __attribute__((packed)) tx_batch_t;
+
+static tx_batch_t s_batch;
+// A frame plus its auth tag; TX task only
+static uint8_t s_tx_frame[sizeof(EspnowBatchHeader) + ESPNOW_BATCH_MAX_MSGS * sizeof(PlayerMessage) +
+                          ESPNOW_AUTH_TAG_LEN];
+static_assert(sizeof(s_tx_frame) <= ESP_NOW_MAX_DATA_LEN, "a tagged full batch must fit one ESP-NOW frame");
+static esp_timer_handle_t s_batch_timer = NULL;
+
+// Peer table. Slots hold the per-peer link statistics; s_peer_index is an
+// open-addressed MAC -> slot hash (linear probing, backward-shift deletion)
+// so recv_cb/send_cb find their peer without scanning. Guarded by s_peer_lock.
+#define PEER_SLOTS ESPNOW_MAX_PEERS
+static_assert(PEER_SLOTS > 0 && PEER_SLOTS <= 127, "CONFIG_RAYZ_ESPNOW_MAX_PEERS out of range");
+
+// At least twice PEER_SLOTS buckets keeps the probe runs short
+static constexpr int peer_hash_bits(int slots)
+{
+    int bits = 4;
+    while ((1 << bits) < 2 * slots)
+        bits++;
+    return bits;
+}
+#define PEER_HASH_BITS peer_hash_bits(PEER_SLOTS)
+#define PEER_HASH_BUCKETS (1 << PEER_HASH_BITS)
+#define PEER_HASH_MASK (PEER_HASH_BUCKETS - 1)
+static_assert(PEER_HASH_BUCKETS > PEER_SLOTS, "peer hash must have spare buckets");
+
+typedef struct
+{
+    bool in_use;
+    uint32_t last_tx_ms; // Last unicast handed to the driver; picks whom to evict
+    EspnowPeerInfo info;
+} peer_slot_t;
+
+static peer_slot_t s_peers[PEER_SLOTS];
+static int8_t s_peer_index[PEER_HASH_BUCKETS];
 static uint8_t s_peer_count = 0;
+static portMUX_TYPE s_peer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void tx_lane_init(tx_lane_t* lane)
+{
+    for (uint32_t i = 0; i < TX_LANE_DEPTH; i++)
+        lane->cells[i].seq = i;
+    lane->enqueue_pos = 0;
+    lane->dequeue_pos = 0;
+}
+
+// Multi-producer push; safe from tasks and ISRs, never blocks
+static bool tx_lane_push(tx_lane_t* lane, const tx_item_t* item)
+{
+    uint32_t pos = __atomic_load_n(&lane->enqueue_pos, __ATOMIC_RELAXED);
+    tx_cell_t* cell;
+    for (;;)
+    {
+        cell = &lane->cells[pos & TX_LANE_MASK];
+        uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&lane->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false; // Full
+        }
+        else
+        {
+            pos = __atomic_load_n(&lane->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->item = *item;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Single-consumer pop, TX task only
+static bool tx_lane_pop(tx_lane_t* lane, tx_item_t* out)
+{
+    uint32_t pos = lane->dequeue_pos;
+    tx_cell_t* cell = &lane->cells[pos & TX_LANE_MASK];
+    uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    if ((int32_t)(seq - (pos + 1)) < 0)
+        return false; // Empty, or the producer has not published yet
+    *out = cell->item;
+    __atomic_store_n(&cell->seq, pos + TX_LANE_DEPTH, __ATOMIC_RELEASE);
+    lane->dequeue_pos = pos + 1;
+    return true;
+}
+
+static void tx_task_wake(void)
+{
+    if (!s_tx_task)
+        return;
+    if (xPortInIsrContext())
+    {
+        BaseType_t hp_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_tx_task, &hp_task_woken);
+        if (hp_task_woken == pdTRUE)
+            portYIELD_FROM_ISR();
+    }
+    else
+    {
+        xTaskNotifyGive(s_tx_task);
+    }
+}
+
+static bool tx_enqueue(const uint8_t* mac, const PlayerMessage* msg, int8_t reliable_slot)
+{
+    tx_item_t item;
+    memcpy(item.mac, mac, ESP_NOW_ETH_ALEN);
+    item.reliable_slot = reliable_slot;
+    item.msg = *msg;
+    item.msg.group = ESPNOW_GROUP(s_arena, ESPNOW_GROUP_TEAM(msg->group)); // Senders only pick the team
+
+    // Clock sync is timed per frame, so it must not sit in the batch window
+    const bool urgent = reliable_slot >= 0 || msg->type == ESPNOW_MSG_HIT_EVENT || msg->type == ESPNOW_MSG_SHOT ||
+                        msg->type == ESPNOW_MSG_TIME_SYNC;
+    if (!tx_lane_push(urgent ? &s_tx_high : &s_tx_normal, &item))
+    {
+        __atomic_fetch_add(&s_tx_stats.queue_full, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    tx_task_wake();
+    return true;
+}
+
+static uint32_t peer_hash(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    // The low three bytes are the NIC-specific part; the OUI is mostly shared
+    uint32_t h = ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+    h ^= (uint32_t)mac[2] << 5;
+    h *= 0x9E3779B1u;
+    return h >> (32 - PEER_HASH_BITS); // Top bits mix best
+}
+
+static void peer_table_reset(void)
+{
+    memset(s_peers, 0, sizeof(s_peers));
+    memset(s_peer_index, -1, sizeof(s_peer_index));
+    s_peer_count = 0;
+}
+
+// Returns the bucket holding mac, or -1; s_peer_lock must be held
+static int peer_bucket_unsafe(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    uint32_t b = peer_hash(mac) & PEER_HASH_MASK;
+    for (int probes = 0; probes < PEER_HASH_BUCKETS; probes++, b = (b + 1) & PEER_HASH_MASK)
+    {
+        int8_t slot = s_peer_index[b];
+        if (slot < 0)
+            return -1;
+        if (memcmp(s_peers[slot].info.mac, mac, ESP_NOW_ETH_ALEN) == 0)
+            return (int)b;
+    }
+    return -1;
+}
+
+static peer_slot_t* peer_find_unsafe(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    int b = peer_bucket_unsafe(mac);
+    return b < 0 ? NULL : &s_peers[s_peer_index[b]];
+}
+
+static peer_slot_t* peer_insert_unsafe(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    int slot = -1;
+    for (int i = 0; i < PEER_SLOTS; i++)
+    {
+        if (!s_peers[i].in_use)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+        return NULL;
+
+    uint32_t b = peer_hash(mac) & PEER_HASH_MASK;
+    while (s_peer_index[b] >= 0)
+        b = (b + 1) & PEER_HASH_MASK;
+    s_peer_index[b] = (int8_t)slot;
+
+    peer_slot_t* peer = &s_peers[slot];
+    memset(peer, 0, sizeof(*peer));
+    peer->in_use = true;
+    memcpy(peer->info.mac, mac, ESP_NOW_ETH_ALEN);
+    s_peer_count++;
+    return peer;
+}
+
+static void peer_erase_unsafe(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    int hole = peer_bucket_unsafe(mac);
+    if (hole < 0)
+        return;
+    s_peers[s_peer_index[hole]].in_use = false;
+    s_peer_index[hole] = -1;
+    s_peer_count--;
+
+    // Backward-shift the rest of the probe run so lookups never stop early
+    uint32_t b = ((uint32_t)hole + 1) & PEER_HASH_MASK;
+    while (s_peer_index[b] >= 0)
+    {
+        uint32_t home = peer_hash(s_peers[s_peer_index[b]].info.mac) & PEER_HASH_MASK;
+        // Move the entry if its home bucket is not within (hole, b]
+        if (((b - home) & PEER_HASH_MASK) >= ((b - (uint32_t)hole) & PEER_HASH_MASK))
+        {
+            s_peer_index[hole] = s_peer_index[b];
+            s_peer_index[b] = -1;
+            hole = (int)b;
+        }
+        b = (b + 1) & PEER_HASH_MASK;
+    }
+}
 
 static void log_mac(const uint8_t mac[ESP_NOW_ETH_ALEN], const char* prefix)
 {
@@ -38,51 +387,546 @@ uint8_t espnow_comm_hash_id(const char* id)
     return hash;
 }
 
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// "aa:bb:cc:dd:ee:ff" or "aa-bb-cc-dd-ee-ff"; single-digit octets are accepted
 static bool parse_mac_str(const char* str, uint8_t mac[ESP_NOW_ETH_ALEN])
 {
-    int values[ESP_NOW_ETH_ALEN] = {0};
-    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &values[0], &values[1], &values[2], &values[3], &values[4], &values[5]) == 6 ||
-        sscanf(str, "%x-%x-%x-%x-%x-%x", &values[0], &values[1], &values[2], &values[3], &values[4], &values[5]) == 6)
+    char sep = 0;
+    for (int i = 0; i < ESP_NOW_ETH_ALEN; i++)
     {
-        for (int i = 0; i < ESP_NOW_ETH_ALEN; i++)
+        int hi = hex_nibble(*str);
+        if (hi < 0)
+            return false;
+        str++;
+        int lo = hex_nibble(*str);
+        if (lo >= 0)
         {
-            mac[i] = (uint8_t)values[i];
+            hi = (hi << 4) | lo;
+            str++;
         }
-        return true;
+        mac[i] = (uint8_t)hi;
+
+        if (i == ESP_NOW_ETH_ALEN - 1)
+            break;
+        if (*str != ':' && *str != '-')
+            return false;
+        if (sep && *str != sep)
+            return false;
+        sep = *str++;
+    }
+    return *str == '\0' || isspace((int)*str);
+}
+
+// Returns true if (mac, seq) was already seen recently
+static bool dedup_seen(const uint8_t mac[ESP_NOW_ETH_ALEN], uint8_t seq)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    dedup_peer_t* peer = NULL;
+    dedup_peer_t* oldest = &s_dedup[0];
+    for (int i = 0; i < DEDUP_PEERS; i++)
+    {
+        if (s_dedup[i].in_use && memcmp(s_dedup[i].mac, mac, ESP_NOW_ETH_ALEN) == 0)
+        {
+            peer = &s_dedup[i];
+            break;
+        }
+        if (!s_dedup[i].in_use || (oldest->in_use && s_dedup[i].last_ms < oldest->last_ms))
+            oldest = &s_dedup[i];
     }
+
+    if (!peer)
+    {
+        peer = oldest;
+        memset(peer, 0, sizeof(*peer));
+        peer->in_use = true;
+        memcpy(peer->mac, mac, ESP_NOW_ETH_ALEN);
+    }
+    peer->last_ms = now;
+
+    for (int i = 0; i < DEDUP_WINDOW; i++)
+    {
+        if (peer->seq[i] == seq && now - peer->seen_ms[i] < DEDUP_TTL_MS)
+            return true;
+    }
+    peer->seq[peer->next] = seq;
+    peer->seen_ms[peer->next] = now;
+    peer->next = (peer->next + 1) % DEDUP_WINDOW;
     return false;
 }
 
+// Run one received record through peer tracking and dedup, then push it into
+// the ring. Returns true if the consumer needs waking.
+static bool rx_accept(const esp_now_recv_info_t* info, const PlayerMessage* rx, int64_t rx_us)
+{
+    portENTER_CRITICAL(&s_peer_lock);
+    peer_slot_t* peer = peer_find_unsafe(info->src_addr);
+    if (peer)
+    {
+        peer->info.last_seen_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        if (info->rx_ctrl)
+            peer->info.rssi = (int8_t)info->rx_ctrl->rssi;
+        peer->info.player_id = rx->player_id;
+        peer->info.team_id = rx->team_id;
+        peer->info.device_id = rx->device_id;
+        peer->info.identified = true;
+        peer->info.rx_count++;
+    }
+    const bool known_peer = peer != NULL;
+    portEXIT_CRITICAL(&s_peer_lock);
+
+    // Consumed here: the exchange is only useful while its timestamps are fresh
+    if (rx->type == ESPNOW_MSG_TIME_SYNC)
+    {
+        time_sync_on_rx(info->src_addr, (const EspnowTimeSync*)rx, rx_us, known_peer);
+        return false;
+    }
+
+    const uint8_t seq = rx->reserved;
+    if (seq != 0 && dedup_seen(info->src_addr, seq))
+    {
+        portENTER_CRITICAL(&s_tx_lock);
+        s_tx_stats.duplicates++;
+        portEXIT_CRITICAL(&s_tx_lock);
+        return false;
+    }
+
+    uint32_t head = s_rx_head;
+    uint32_t used = head - __atomic_load_n(&s_rx_tail, __ATOMIC_ACQUIRE);
+    if (used >= RX_RING_DEPTH)
+    {
+        s_rx_stats.overflows++;
+        return false;
+    }
+
+    // Written straight into the slot, no intermediate copy
+    EspnowMessageEnvelope* env = &s_rx_ring[head & RX_RING_MASK];
+    memcpy(&env->msg, rx, sizeof(PlayerMessage));
+    memcpy(env->src_mac, info->src_addr, ESP_NOW_ETH_ALEN);
+#if RAYZ_METRICS
+    s_rx_time_us[head & RX_RING_MASK] = (uint32_t)esp_timer_get_time();
+#endif
+    __atomic_store_n(&s_rx_head, head + 1, __ATOMIC_RELEASE);
+
+    s_rx_stats.received++;
+    if (used + 1 > s_rx_stats.high_watermark)
+        s_rx_stats.high_watermark = (uint16_t)(used + 1);
+    // Heartbeats would crowd the game traffic out of the journal
+    if (rx->type != ESPNOW_MSG_HEARTBEAT)
+        match_log_record(MATCH_EVT_ESPNOW_RX, rx->player_id, MATCH_ID_UNKNOWN, rx->type, (uint16_t)rx->data);
+    return true;
+}
+
+// Group filter, run before anything else touches a record; Wi-Fi task
+static bool group_accepts(uint8_t group)
+{
+    const uint8_t arena = ESPNOW_GROUP_ARENA(group);
+    if (arena != 0 && s_arena != 0 && arena != s_arena)
+        return false;
+    const uint8_t team = ESPNOW_GROUP_TEAM(group);
+    if (team == 0)
+        return true;
+    const DeviceConfig* cfg = game_state_get_config();
+    return cfg && cfg->team_id == team;
+}
+
 static void recv_cb(const esp_now_recv_info_t* info, const uint8_t* data, int len)
 {
-    if (!info || !data || len != sizeof(PlayerMessage))
+    const int64_t rx_us = esp_timer_get_time(); // Before the tag check, for time sync
+    if (!info || !data || len <= 0)
     {
+        s_rx_stats.invalid++;
+        return;
+    }
+
+    // Shape from the first byte: one record or a batch, either one optionally
+    // followed by an auth tag
+    const EspnowBatchHeader* hdr = (const EspnowBatchHeader*)data;
+    const bool batch = data[0] == ESPNOW_BATCH_MAGIC;
+    size_t payload = sizeof(PlayerMessage);
+    if (batch)
+    {
+        if ((size_t)len < sizeof(EspnowBatchHeader) || hdr->version != ESPNOW_BATCH_VERSION || hdr->count == 0 ||
+            hdr->count > ESPNOW_BATCH_MAX_MSGS)
+            payload = 0;
+        else
+            payload = sizeof(EspnowBatchHeader) + hdr->count * sizeof(PlayerMessage);
+    }
+    const bool tagged = payload > 0 && (size_t)len == payload + ESPNOW_AUTH_TAG_LEN;
+    if (payload == 0 || (!tagged && (size_t)len != payload))
+    {
+        s_rx_stats.invalid++;
         ESP_LOGW(TAG, "RX invalid len=%d", len);
         return;
     }
 
-    if (!s_rx_queue)
+    // Cheap group filter first; the sender's arena is the same in every record
+    const PlayerMessage* records = batch ? (const PlayerMessage*)(data + sizeof(EspnowBatchHeader))
+                                         : (const PlayerMessage*)data;
+    const uint8_t count = batch ? hdr->count : 1;
+    const uint8_t group = batch ? ESPNOW_GROUP(ESPNOW_GROUP_ARENA(hdr->group), 0) : records[0].group;
+    if (!group_accepts(group))
+    {
+        s_rx_stats.filtered += count;
+        return;
+    }
+    if (!espnow_auth_accept(info->src_addr, data, payload, tagged))
+    {
+        s_rx_stats.auth_failed++;
+        return;
+    }
+
+    bool wake = false;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (group_accepts(records[i].group))
+            wake |= rx_accept(info, &records[i], rx_us);
+        else
+            s_rx_stats.filtered++;
+    }
+
+    if (wake && s_rx_ready)
+        xSemaphoreGive(s_rx_ready);
+}
+
+static int64_t backoff_us(uint8_t attempts)
+{
+    return (int64_t)(RELIABLE_BACKOFF_BASE_MS << (attempts - 1)) * 1000;
+}
+
+// Arm the retry timer for the earliest pending retransmission
+static void arm_retry_timer(void)
+{
+    if (!s_retry_timer)
         return;
 
-    EspnowMessageEnvelope env = {};
-    memcpy(env.src_mac, info->src_addr, ESP_NOW_ETH_ALEN);
-    memcpy(&env.msg, data, sizeof(PlayerMessage));
+    int64_t earliest = 0;
+    portENTER_CRITICAL(&s_tx_lock);
+    for (int i = 0; i < RELIABLE_SLOTS; i++)
+    {
+        const reliable_slot_t* slot = &s_reliable[i];
+        if (slot->in_use && !slot->awaiting_cb && (earliest == 0 || slot->retry_at_us < earliest))
+            earliest = slot->retry_at_us;
+    }
+    portEXIT_CRITICAL(&s_tx_lock);
+
+    if (earliest == 0)
+        return;
+    int64_t delay = earliest - esp_timer_get_time();
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, delay > 0 ? (uint64_t)delay : 1);
+}
 
-    BaseType_t hp_task_woken = pdFALSE;
-    xQueueSendFromISR(s_rx_queue, &env, &hp_task_woken);
-    if (hp_task_woken == pdTRUE)
+// Push before esp_now_send so send_cb can never run ahead of the record
+static bool tx_pending_push(int8_t slot)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&s_tx_lock);
+    if (s_tx_pending_len < TX_PENDING_DEPTH)
     {
-        portYIELD_FROM_ISR();
+        s_tx_pending[(s_tx_pending_head + s_tx_pending_len) % TX_PENDING_DEPTH] = slot;
+        s_tx_pending_len++;
+        ok = true;
     }
+    portEXIT_CRITICAL(&s_tx_lock);
+    return ok;
+}
+
+// Undo the push for a send that esp_now_send() rejected
+static void tx_pending_drop_last(void)
+{
+    portENTER_CRITICAL(&s_tx_lock);
+    if (s_tx_pending_len > 0)
+        s_tx_pending_len--;
+    portEXIT_CRITICAL(&s_tx_lock);
+}
+
+// esp_now_send() plus bookkeeping; TX task only. Waits for a free in-flight
+// credit first so the driver queue is paced by send_cb completions.
+static esp_err_t driver_register(const uint8_t mac[ESP_NOW_ETH_ALEN], bool evict);
+
+static esp_err_t raw_send_frame(const uint8_t* mac, const void* data, size_t len, int8_t slot)
+{
+    // Unicast to a tracked peer without a driver slot: register it first
+    if ((mac[0] & 0x01) == 0)
+    {
+        bool need_slot = false;
+        portENTER_CRITICAL(&s_peer_lock);
+        peer_slot_t* peer = peer_find_unsafe(mac);
+        if (peer)
+        {
+            peer->last_tx_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            need_slot = !peer->info.registered;
+        }
+        portEXIT_CRITICAL(&s_peer_lock);
+        if (need_slot)
+        {
+            esp_err_t err = driver_register(mac, true);
+            if (err != ESP_OK)
+                return err;
+        }
+    }
+
+    if (xSemaphoreTake(s_tx_credits, pdMS_TO_TICKS(TX_CREDIT_TIMEOUT_MS)) != pdTRUE)
+        ESP_LOGW(TAG, "send_cb overdue, continuing");
+    if (!tx_pending_push(slot))
+    {
+        xSemaphoreGive(s_tx_credits);
+        return ESP_ERR_NO_MEM;
+    }
+    // Stamped as late as possible; the frame is the TX task's own copy
+    if (len == sizeof(PlayerMessage) && ((const PlayerMessage*)data)->type == ESPNOW_MSG_TIME_SYNC)
+        time_sync_stamp_tx((EspnowTimeSync*)data);
+    // Tagged last, once every byte of the frame is final
+    if (espnow_auth_tag((const uint8_t*)data, len, s_tx_frame + len))
+    {
+        memcpy(s_tx_frame, data, len);
+        data = s_tx_frame;
+        len += ESPNOW_AUTH_TAG_LEN;
+    }
+    METRICS_CYCLES_BEGIN(send_start);
+    esp_err_t err = esp_now_send(mac, (const uint8_t*)data, len);
+    METRICS_CYCLES_END(METRICS_HIST_ESPNOW_SEND, send_start);
+    if (err != ESP_OK)
+    {
+        METRICS_COUNT(METRICS_CTR_ESPNOW_SEND_ERRORS);
+        tx_pending_drop_last();
+        xSemaphoreGive(s_tx_credits);
+    }
+    return err;
+}
+
+static esp_err_t raw_send(const uint8_t* mac, const PlayerMessage* msg, int8_t slot)
+{
+    return raw_send_frame(mac, msg, sizeof(PlayerMessage), slot);
 }
 
 static void send_cb(const esp_now_send_info_t* info, esp_now_send_status_t status)
 {
-    (void)info;
     if (status != ESP_NOW_SEND_SUCCESS)
     {
         ESP_LOGW(TAG, "Send status: %d", status);
     }
+
+    if (info && info->des_addr)
+    {
+        portENTER_CRITICAL(&s_peer_lock);
+        peer_slot_t* peer = peer_find_unsafe(info->des_addr);
+        if (peer)
+        {
+            peer->info.tx_count++;
+            if (status != ESP_NOW_SEND_SUCCESS)
+                peer->info.tx_failed++;
+        }
+        portEXIT_CRITICAL(&s_peer_lock);
+    }
+
+    if (s_tx_credits)
+        xSemaphoreGive(s_tx_credits);
+
+    bool finished = false;
+    bool delivered = false;
+    bool need_retry = false;
+    reliable_slot_t done = {};
+
+    portENTER_CRITICAL(&s_tx_lock);
+    int8_t idx = -1;
+    if (s_tx_pending_len > 0)
+    {
+        idx = s_tx_pending[s_tx_pending_head];
+        s_tx_pending_head = (s_tx_pending_head + 1) % TX_PENDING_DEPTH;
+        s_tx_pending_len--;
+    }
+    if (idx >= 0 && s_reliable[idx].in_use)
+    {
+        reliable_slot_t* slot = &s_reliable[idx];
+        slot->awaiting_cb = false;
+        if (status == ESP_NOW_SEND_SUCCESS || slot->attempts >= RELIABLE_MAX_ATTEMPTS)
+        {
+            finished = true;
+            delivered = (status == ESP_NOW_SEND_SUCCESS);
+            if (delivered)
+                s_tx_stats.delivered++;
+            else
+                s_tx_stats.failed++;
+            done = *slot;
+            slot->in_use = false;
+        }
+        else
+        {
+            slot->retry_at_us = esp_timer_get_time() + backoff_us(slot->attempts);
+            need_retry = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_tx_lock);
+
+    if (finished)
+    {
+        if (!delivered)
+            ESP_LOGW(TAG, "Reliable seq=%u type=%u lost after %u attempts", done.msg.reserved, done.msg.type,
+                     done.attempts);
+        if (s_delivery_cb)
+            s_delivery_cb(done.mac, &done.msg, delivered);
+    }
+    if (need_retry)
+        arm_retry_timer();
+}
+
+// Reliable send failed to reach the driver: back off, or give up
+static void reliable_send_failed(int idx, int64_t now)
+{
+    reliable_slot_t* slot = &s_reliable[idx];
+    portENTER_CRITICAL(&s_tx_lock);
+    slot->awaiting_cb = false;
+    slot->retry_at_us = now + backoff_us(slot->attempts);
+    bool give_up = slot->attempts >= RELIABLE_MAX_ATTEMPTS;
+    reliable_slot_t done = *slot;
+    if (give_up)
+    {
+        slot->in_use = false;
+        s_tx_stats.failed++;
+    }
+    portEXIT_CRITICAL(&s_tx_lock);
+    if (give_up && s_delivery_cb)
+        s_delivery_cb(done.mac, &done.msg, false);
+}
+
+// Retransmit every reliable message whose backoff expired; TX task only
+static void process_retries(void)
+{
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < RELIABLE_SLOTS; i++)
+    {
+        reliable_slot_t* slot = &s_reliable[i];
+        bool due = false;
+        portENTER_CRITICAL(&s_tx_lock);
+        if (slot->in_use && !slot->awaiting_cb && slot->retry_at_us <= now)
+        {
+            slot->awaiting_cb = true;
+            slot->attempts++;
+            s_tx_stats.retries++;
+            due = true;
+        }
+        portEXIT_CRITICAL(&s_tx_lock);
+
+        if (due && raw_send(slot->mac, &slot->msg, (int8_t)i) != ESP_OK)
+            reliable_send_failed(i, now);
+    }
+}
+
+static void retry_timer_cb(void* arg)
+{
+    (void)arg;
+    tx_task_wake();
+}
+
+// Send the open aggregation frame; TX task only. A lone message goes out as
+// a plain PlayerMessage so it stays readable by older firmware.
+static void batch_flush(void)
+{
+    const uint8_t count = s_batch.header.count;
+    if (count == 0)
+        return;
+
+    esp_err_t err;
+    if (count == 1)
+    {
+        err = raw_send(s_batch.mac, &s_batch.msgs[0], -1);
+    }
+    else
+    {
+        err = raw_send_frame(s_batch.mac, &s_batch.header,
+                             sizeof(EspnowBatchHeader) + count * sizeof(PlayerMessage), -1);
+        if (err == ESP_OK)
+        {
+            s_tx_stats.batches++;
+            s_tx_stats.batched_msgs += count;
+        }
+    }
+    s_batch.header.count = 0;
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "esp_now_send failed: %s", esp_err_to_name(err));
+}
+
+static void batch_add(const tx_item_t* item)
+{
+    if (s_batch.header.count > 0 && memcmp(s_batch.mac, item->mac, ESP_NOW_ETH_ALEN) != 0)
+        batch_flush();
+    if (s_batch.header.count == 0)
+    {
+        memcpy(s_batch.mac, item->mac, ESP_NOW_ETH_ALEN);
+        s_batch.header.group = ESPNOW_GROUP(ESPNOW_GROUP_ARENA(item->msg.group), 0);
+        s_batch.deadline_us = esp_timer_get_time() + BATCH_WINDOW_US;
+    }
+    s_batch.msgs[s_batch.header.count++] = item->msg;
+    if (s_batch.header.count == ESPNOW_BATCH_MAX_MSGS)
+        batch_flush();
+}
+
+static void batch_timer_cb(void* arg)
+{
+    (void)arg;
+    tx_task_wake();
+}
+
+static void tx_task(void* arg)
+{
+    (void)arg;
+    s_batch.header.magic = ESPNOW_BATCH_MAGIC;
+    s_batch.header.version = ESPNOW_BATCH_VERSION;
+    s_batch.header.count = 0;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        process_retries();
+
+        tx_item_t item;
+        bool urgent;
+        while ((urgent = tx_lane_pop(&s_tx_high, &item)) || tx_lane_pop(&s_tx_normal, &item))
+        {
+            if (!urgent && item.reliable_slot < 0 && BATCH_WINDOW_US > 0)
+            {
+                batch_add(&item);
+                continue;
+            }
+
+            // Urgent traffic never waits behind the window: flush, then send alone
+            batch_flush();
+            esp_err_t err = raw_send(item.mac, &item.msg, item.reliable_slot);
+            if (err != ESP_OK)
+            {
+                ESP_LOGW(TAG, "esp_now_send failed: %s", esp_err_to_name(err));
+                if (item.reliable_slot >= 0)
+                    reliable_send_failed(item.reliable_slot, esp_timer_get_time());
+            }
+        }
+
+        if (s_batch.header.count > 0)
+        {
+            int64_t wait = s_batch.deadline_us - esp_timer_get_time();
+            if (wait <= 0 || !s_batch_timer)
+            {
+                batch_flush();
+            }
+            else if (!esp_timer_is_active(s_batch_timer))
+            {
+                esp_timer_start_once(s_batch_timer, (uint64_t)wait);
+            }
+        }
+
+        arm_retry_timer();
+    }
 }
 
 esp_err_t espnow_comm_init(const EspnowCommConfig* config)
@@ -110,18 +954,54 @@ esp_err_t espnow_comm_init(const EspnowCommConfig* config)
         return err;
     }
 
-    if (!s_rx_queue)
+    if (!s_rx_ready)
+    {
+        s_rx_ready = xSemaphoreCreateBinary();
+    }
+    if (!s_tx_credits)
+    {
+        s_tx_credits = xSemaphoreCreateCounting(TX_MAX_IN_FLIGHT, TX_MAX_IN_FLIGHT);
+    }
+    if (!s_tx_task)
     {
-        s_rx_queue = xQueueCreate(16, sizeof(EspnowMessageEnvelope));
+        tx_lane_init(&s_tx_high);
+        tx_lane_init(&s_tx_normal);
+        if (xTaskCreatePinnedToCore(tx_task, "espnow_tx", TX_TASK_STACK, NULL, TX_TASK_PRIORITY, &s_tx_task,
+                                    CONFIG_RAYZ_ESPNOW_TX_TASK_CORE) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create TX task");
+            s_tx_task = NULL;
+            return ESP_ERR_NO_MEM;
+        }
     }
-    if (!s_send_mutex)
+    if (!s_retry_timer)
     {
-        s_send_mutex = xSemaphoreCreateMutex();
+        const esp_timer_create_args_t args = {
+            .callback = retry_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "espnow_retry",
+            .skip_unhandled_events = true,
+        };
+        esp_timer_create(&args, &s_retry_timer);
+    }
+    if (!s_batch_timer && BATCH_WINDOW_US > 0)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = batch_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "espnow_batch",
+            .skip_unhandled_events = true,
+        };
+        esp_timer_create(&args, &s_batch_timer);
     }
 
+    portENTER_CRITICAL(&s_peer_lock);
+    peer_table_reset();
+    portEXIT_CRITICAL(&s_peer_lock);
     esp_now_register_recv_cb(recv_cb);
     esp_now_register_send_cb(send_cb);
-    s_peer_count = 0;
 
     if (config)
     {
@@ -133,13 +1013,15 @@ esp_err_t espnow_comm_init(const EspnowCommConfig* config)
         {
             espnow_comm_set_channel(config->channel);
         }
-        if (config->prefer_wifi)
-        {
-            esp_coex_preference_set(ESP_COEX_PREFER_WIFI);
-        }
     }
 
+    // The coexistence preference is radio_policy's, whatever prefer_wifi says
+    esp_coex_preference_set(radio_policy_coex());
+
+    espnow_auth_init();
+    time_sync_init();
     s_initialised = true;
+    boot_phase_mark(BOOT_PHASE_ESPNOW_READY);
     ESP_LOGI(TAG, "ESP-NOW ready%s", s_channel ? " with fixed channel" : "");
     return ESP_OK;
 }
@@ -164,40 +1046,176 @@ esp_err_t espnow_comm_set_channel(uint8_t channel)
     return err;
 }
 
-esp_err_t espnow_comm_add_peer(const uint8_t mac[ESP_NOW_ETH_ALEN])
+void espnow_comm_set_arena(uint8_t arena_id)
 {
-    if (!mac)
-        return ESP_ERR_INVALID_ARG;
-
-    if (esp_now_is_peer_exist(mac))
+    if (arena_id > ESPNOW_MAX_ARENA)
     {
-        return ESP_OK;
+        ESP_LOGW(TAG, "Arena %u out of range, keeping %u", arena_id, s_arena);
+        return;
     }
+    s_arena = arena_id;
+    ESP_LOGI(TAG, "Arena set to %u", arena_id);
+}
 
+uint8_t espnow_comm_get_arena(void)
+{
+    return s_arena;
+}
+
+static esp_err_t driver_add(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    if (esp_now_is_peer_exist(mac))
+        return ESP_OK;
     esp_now_peer_info_t peer = {};
     memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
     peer.channel = s_channel; // 0 = current channel
     peer.ifidx = WIFI_IF_STA;
     peer.encrypt = false;
+    return esp_now_add_peer(&peer);
+}
 
-    esp_err_t err = esp_now_add_peer(&peer);
-    if (err == ESP_OK)
+// Give up the driver slot of the least recently used registered peer other
+// than keep. A frame of its still inside the driver fails out through send_cb.
+static bool driver_evict_lru(const uint8_t keep[ESP_NOW_ETH_ALEN])
+{
+    uint8_t victim[ESP_NOW_ETH_ALEN];
+    peer_slot_t* lru = NULL;
+    portENTER_CRITICAL(&s_peer_lock);
+    for (int i = 0; i < PEER_SLOTS; i++)
     {
-        s_peer_count++;
-        log_mac(mac, "Peer added");
+        peer_slot_t* p = &s_peers[i];
+        if (!p->in_use || !p->info.registered || memcmp(p->info.mac, keep, ESP_NOW_ETH_ALEN) == 0)
+            continue;
+        if (!lru || (int32_t)(p->last_tx_ms - lru->last_tx_ms) < 0)
+            lru = p;
     }
-    else
+    if (lru)
+    {
+        lru->info.registered = false;
+        memcpy(victim, lru->info.mac, ESP_NOW_ETH_ALEN);
+    }
+    portEXIT_CRITICAL(&s_peer_lock);
+    if (!lru)
+        return false;
+    esp_now_del_peer(victim);
+    return true;
+}
+
+// Make sure a tracked peer holds a driver slot, evicting another if allowed
+static esp_err_t driver_register(const uint8_t mac[ESP_NOW_ETH_ALEN], bool evict)
+{
+    esp_err_t err = driver_add(mac);
+    if (err == ESP_ERR_ESPNOW_FULL && evict && driver_evict_lru(mac))
+        err = driver_add(mac);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No driver slot for peer: %s", esp_err_to_name(err));
+        return err;
+    }
+    portENTER_CRITICAL(&s_peer_lock);
+    peer_slot_t* peer = peer_find_unsafe(mac);
+    if (peer)
+        peer->info.registered = true;
+    portEXIT_CRITICAL(&s_peer_lock);
+    return ESP_OK;
+}
+
+esp_err_t espnow_comm_add_peer(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    if (!mac)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_peer_lock);
+    bool known = peer_find_unsafe(mac) != NULL;
+    bool full = s_peer_count >= PEER_SLOTS;
+    portEXIT_CRITICAL(&s_peer_lock);
+    if (known)
+        return ESP_OK;
+    if (full)
+        return ESP_ERR_ESPNOW_FULL;
+
+    // A full driver table is fine: the peer gets a slot on its first unicast
+    esp_err_t err = driver_add(mac);
+    const bool registered = err == ESP_OK;
+    if (err == ESP_ERR_ESPNOW_FULL)
+        err = ESP_OK;
+    if (err != ESP_OK)
     {
         ESP_LOGW(TAG, "Failed to add peer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    portENTER_CRITICAL(&s_peer_lock);
+    peer_slot_t* slot = peer_find_unsafe(mac);
+    if (!slot)
+        slot = peer_insert_unsafe(mac);
+    if (slot)
+        slot->info.registered |= registered;
+    else
+        err = ESP_ERR_ESPNOW_FULL;
+    portEXIT_CRITICAL(&s_peer_lock);
+
+    if (err == ESP_OK)
+        log_mac(mac, registered ? "Peer added" : "Peer added (driver slot on demand)");
+    else if (registered)
+        esp_now_del_peer(mac);
+    return err;
+}
+
+// Abandon queued retransmissions to a peer; frames already handed to the
+// driver still get their send_cb and fail out through the normal path.
+static void cancel_reliable_to(const uint8_t* mac)
+{
+    portENTER_CRITICAL(&s_tx_lock);
+    for (int i = 0; i < RELIABLE_SLOTS; i++)
+    {
+        reliable_slot_t* slot = &s_reliable[i];
+        if (slot->in_use && !slot->awaiting_cb && (!mac || memcmp(slot->mac, mac, ESP_NOW_ETH_ALEN) == 0))
+        {
+            slot->in_use = false;
+            s_tx_stats.failed++;
+        }
     }
+    portEXIT_CRITICAL(&s_tx_lock);
+}
+
+esp_err_t espnow_comm_remove_peer(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    if (!mac)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_peer_lock);
+    bool known = peer_find_unsafe(mac) != NULL;
+    peer_erase_unsafe(mac);
+    portEXIT_CRITICAL(&s_peer_lock);
+    if (!known)
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+
+    cancel_reliable_to(mac);
+    esp_err_t err = esp_now_del_peer(mac);
+    if (err == ESP_ERR_ESPNOW_NOT_FOUND)
+        err = ESP_OK;
+    log_mac(mac, "Peer removed");
     return err;
 }
 
 void espnow_comm_clear_peers(void)
 {
-    esp_now_deinit();
-    s_initialised = false;
-    s_peer_count = 0;
+    uint8_t macs[PEER_SLOTS][ESP_NOW_ETH_ALEN];
+    int count = 0;
+    portENTER_CRITICAL(&s_peer_lock);
+    for (int i = 0; i < PEER_SLOTS; i++)
+    {
+        if (s_peers[i].in_use)
+            memcpy(macs[count++], s_peers[i].info.mac, ESP_NOW_ETH_ALEN);
+    }
+    peer_table_reset();
+    portEXIT_CRITICAL(&s_peer_lock);
+
+    // ESP-NOW itself stays up: no radio outage, no re-registration of callbacks
+    cancel_reliable_to(NULL);
+    for (int i = 0; i < count; i++)
+        esp_now_del_peer(macs[i]);
 }
 
 uint8_t espnow_comm_peer_count(void)
@@ -205,70 +1223,325 @@ uint8_t espnow_comm_peer_count(void)
     return s_peer_count;
 }
 
-esp_err_t espnow_comm_load_peers_from_csv(const char* csv_list)
+bool espnow_comm_get_peer(const uint8_t mac[ESP_NOW_ETH_ALEN], EspnowPeerInfo* out)
 {
-    if (!csv_list || !*csv_list)
-        return ESP_OK;
+    if (!mac || !out)
+        return false;
+    portENTER_CRITICAL(&s_peer_lock);
+    peer_slot_t* peer = peer_find_unsafe(mac);
+    if (peer)
+        *out = peer->info;
+    portEXIT_CRITICAL(&s_peer_lock);
+    return peer != NULL;
+}
 
-    char buffer[256] = {0};
-    strncpy(buffer, csv_list, sizeof(buffer) - 1);
+int espnow_comm_get_peers(EspnowPeerInfo* out, int max_count)
+{
+    if (!out || max_count <= 0)
+        return 0;
+    int n = 0;
+    portENTER_CRITICAL(&s_peer_lock);
+    for (int i = 0; i < PEER_SLOTS && n < max_count; i++)
+    {
+        if (s_peers[i].in_use)
+            out[n++] = s_peers[i].info;
+    }
+    portEXIT_CRITICAL(&s_peer_lock);
+    return n;
+}
 
-    char* token = strtok(buffer, ",;");
-    uint8_t mac[ESP_NOW_ETH_ALEN];
-    uint8_t loaded = 0;
-    while (token)
+int espnow_comm_parse_peer_csv(const char* csv_list, uint8_t (*out)[ESP_NOW_ETH_ALEN], int max_count)
+{
+    if (!csv_list || !out)
+        return 0;
+    int count = 0;
+    const char* p = csv_list;
+    while (*p && count < max_count)
     {
-        while (isspace((int)*token))
-            token++;
-        if (parse_mac_str(token, mac))
+        while (*p == ',' || *p == ';' || isspace((int)*p))
+            p++;
+        const char* end = p;
+        while (*end && *end != ',' && *end != ';')
+            end++;
+        // Tokens are parsed one at a time, so the list length is unbounded
+        char token[24];
+        size_t n = (size_t)(end - p);
+        if (n > 0 && n < sizeof(token))
         {
-            if (espnow_comm_add_peer(mac) == ESP_OK)
-            {
-                loaded++;
-            }
+            memcpy(token, p, n);
+            token[n] = '\0';
+            if (parse_mac_str(token, out[count]))
+                count++;
         }
-        token = strtok(NULL, ",;");
+        p = end;
     }
+    return count;
+}
 
-    ESP_LOGI(TAG, "Loaded %u peers from list", loaded);
-    return loaded > 0 ? ESP_OK : ESP_FAIL;
+int espnow_comm_format_peer_csv(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], int count, char* out, size_t max_len)
+{
+    if (!out || max_len == 0)
+        return -1;
+    size_t pos = 0;
+    out[0] = '\0';
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t* m = macs[i];
+        int n = snprintf(out + pos, max_len - pos, "%s%02X:%02X:%02X:%02X:%02X:%02X", i ? "," : "", m[0], m[1], m[2],
+                         m[3], m[4], m[5]);
+        if (n < 0 || (size_t)n >= max_len - pos)
+            return -1;
+        pos += (size_t)n;
+    }
+    return (int)pos;
+}
+
+esp_err_t espnow_comm_set_peers(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], int count)
+{
+    if (!macs && count > 0)
+        return ESP_ERR_INVALID_ARG;
+    if (count > PEER_SLOTS)
+        count = PEER_SLOTS;
+
+    // Drop peers that left the list, then add the new ones; unchanged peers
+    // keep their registration and link statistics.
+    uint8_t stale[PEER_SLOTS][ESP_NOW_ETH_ALEN];
+    int stale_count = 0;
+    portENTER_CRITICAL(&s_peer_lock);
+    for (int i = 0; i < PEER_SLOTS; i++)
+    {
+        if (!s_peers[i].in_use)
+            continue;
+        bool keep = false;
+        for (int j = 0; j < count && !keep; j++)
+            keep = memcmp(s_peers[i].info.mac, macs[j], ESP_NOW_ETH_ALEN) == 0;
+        if (!keep)
+            memcpy(stale[stale_count++], s_peers[i].info.mac, ESP_NOW_ETH_ALEN);
+    }
+    portEXIT_CRITICAL(&s_peer_lock);
+    for (int i = 0; i < stale_count; i++)
+        espnow_comm_remove_peer(stale[i]);
+
+    uint8_t loaded = 0;
+    for (int j = 0; j < count; j++)
+    {
+        if (espnow_comm_add_peer(macs[j]) == ESP_OK)
+            loaded++;
+    }
+
+    ESP_LOGI(TAG, "Peer list applied: %u peers", loaded);
+    return loaded > 0 || count == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t espnow_comm_load_peers_from_csv(const char* csv_list)
+{
+    if (!csv_list || !*csv_list)
+        return ESP_OK;
+
+    uint8_t wanted[PEER_SLOTS][ESP_NOW_ETH_ALEN];
+    int wanted_count = espnow_comm_parse_peer_csv(csv_list, wanted, PEER_SLOTS);
+    if (wanted_count == 0)
+    {
+        ESP_LOGW(TAG, "No valid MAC in peer list, keeping current peers");
+        return ESP_FAIL;
+    }
+    return espnow_comm_set_peers(wanted, wanted_count);
 }
 
 bool espnow_comm_send(const uint8_t mac[ESP_NOW_ETH_ALEN], const PlayerMessage* msg)
+{
+    if (!mac || !msg || !s_tx_task)
+        return false;
+
+    PlayerMessage plain = *msg;
+    plain.group = 0;
+    if (plain.type != ESPNOW_MSG_TIME_SYNC) // Its phase sits in the sequence slot
+        plain.reserved = 0;                 // Never subject to receiver dedup
+    return tx_enqueue(mac, &plain, -1);
+}
+
+bool espnow_comm_broadcast(const PlayerMessage* msg)
+{
+    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    return espnow_comm_send(broadcast_mac, msg);
+}
+
+int espnow_comm_send_team(uint8_t team_id, const PlayerMessage* msg, bool reliable)
 {
     if (!msg)
+        return 0;
+
+    uint8_t targets[PEER_SLOTS][ESP_NOW_ETH_ALEN];
+    int count = 0;
+    portENTER_CRITICAL(&s_peer_lock);
+    for (int i = 0; i < PEER_SLOTS; i++)
+    {
+        const EspnowPeerInfo* info = &s_peers[i].info;
+        if (s_peers[i].in_use && info->identified && info->team_id == team_id)
+            memcpy(targets[count++], info->mac, ESP_NOW_ETH_ALEN);
+    }
+    portEXIT_CRITICAL(&s_peer_lock);
+
+    int queued = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (reliable ? espnow_comm_send_reliable(targets[i], msg) : espnow_comm_send(targets[i], msg))
+            queued++;
+    }
+    return queued;
+}
+
+bool espnow_comm_broadcast_team(uint8_t team_id, const PlayerMessage* msg)
+{
+    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (!msg || !s_tx_task || team_id == 0)
         return false;
-    if (!s_send_mutex)
+    if (team_id > ESPNOW_MAX_GROUP_TEAM)
+        return espnow_comm_send_team(team_id, msg, false) > 0;
+
+    PlayerMessage plain = *msg;
+    plain.group = ESPNOW_GROUP(0, team_id);
+    plain.reserved = 0;
+    return tx_enqueue(broadcast_mac, &plain, -1);
+}
+
+bool espnow_comm_send_reliable(const uint8_t mac[ESP_NOW_ETH_ALEN], const PlayerMessage* msg)
+{
+    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (!mac || !msg || !s_tx_task)
         return false;
+    if (memcmp(mac, broadcast_mac, ESP_NOW_ETH_ALEN) == 0)
+        return espnow_comm_send(mac, msg);
 
-    bool ok = false;
-    if (xSemaphoreTake(s_send_mutex, pdMS_TO_TICKS(50)) == pdTRUE)
+    int idx = -1;
+    portENTER_CRITICAL_SAFE(&s_tx_lock);
+    for (int i = 0; i < RELIABLE_SLOTS; i++)
     {
-        esp_err_t err = esp_now_send(mac, (const uint8_t*)msg, sizeof(PlayerMessage));
-        ok = (err == ESP_OK);
-        if (!ok)
+        if (!s_reliable[i].in_use)
         {
-            ESP_LOGW(TAG, "esp_now_send failed: %s", esp_err_to_name(err));
+            idx = i;
+            break;
         }
-        xSemaphoreGive(s_send_mutex);
     }
-    return ok;
+    if (idx >= 0)
+    {
+        reliable_slot_t* slot = &s_reliable[idx];
+        if (++s_next_seq == 0)
+            s_next_seq = 1;
+        slot->in_use = true;
+        slot->awaiting_cb = true;
+        slot->attempts = 1;
+        memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+        slot->msg = *msg;
+        // Stamped here, not only in tx_enqueue: retries re-send slot->msg as is
+        slot->msg.group = ESPNOW_GROUP(s_arena, ESPNOW_GROUP_TEAM(msg->group));
+        slot->msg.reserved = s_next_seq;
+        s_tx_stats.reliable_sent++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_tx_lock);
+
+    if (idx < 0)
+    {
+        ESP_LOGW(TAG, "No free reliable slot, message dropped");
+        return false;
+    }
+    if (!tx_enqueue(mac, &s_reliable[idx].msg, (int8_t)idx))
+    {
+        portENTER_CRITICAL_SAFE(&s_tx_lock);
+        s_reliable[idx].in_use = false;
+        s_tx_stats.reliable_sent--;
+        portEXIT_CRITICAL_SAFE(&s_tx_lock);
+        return false;
+    }
+    return true;
 }
 
-bool espnow_comm_broadcast(const PlayerMessage* msg)
+void espnow_comm_set_delivery_cb(espnow_delivery_cb_t cb)
 {
-    static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    return espnow_comm_send(broadcast_mac, msg);
+    s_delivery_cb = cb;
+}
+
+void espnow_comm_get_tx_stats(EspnowTxStats* out)
+{
+    if (!out)
+        return;
+    portENTER_CRITICAL(&s_tx_lock);
+    *out = s_tx_stats;
+    portEXIT_CRITICAL(&s_tx_lock);
+}
+
+static int rx_ring_drain(EspnowMessageEnvelope* out, int max_count)
+{
+    uint32_t tail = s_rx_tail;
+    uint32_t avail = __atomic_load_n(&s_rx_head, __ATOMIC_ACQUIRE) - tail;
+    int n = avail < (uint32_t)max_count ? (int)avail : max_count;
+#if RAYZ_METRICS
+    const uint32_t now_us = (uint32_t)esp_timer_get_time();
+#endif
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = s_rx_ring[(tail + i) & RX_RING_MASK];
+        METRICS_RECORD(METRICS_HIST_ESPNOW_RX_LATENCY, now_us - s_rx_time_us[(tail + i) & RX_RING_MASK]);
+    }
+    __atomic_store_n(&s_rx_tail, tail + n, __ATOMIC_RELEASE);
+    return n;
 }
 
-QueueHandle_t espnow_comm_queue(void)
+int espnow_comm_receive_batch(EspnowMessageEnvelope* out, int max_count, TickType_t ticks_to_wait)
 {
-    return s_rx_queue;
+    if (!s_rx_ready || !out || max_count <= 0)
+        return 0;
+
+    int n = rx_ring_drain(out, max_count);
+    if (n > 0 || ticks_to_wait == 0)
+        return n;
+
+    // Ring empty: sleep until the producer signals. The semaphore may be
+    // stale from a push we already drained, so loop on spurious wakeups
+    // until the deadline.
+    TickType_t start = xTaskGetTickCount();
+    TickType_t remaining = ticks_to_wait;
+    while (xSemaphoreTake(s_rx_ready, remaining) == pdTRUE)
+    {
+        n = rx_ring_drain(out, max_count);
+        if (n > 0)
+            return n;
+        if (ticks_to_wait != portMAX_DELAY)
+        {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= ticks_to_wait)
+                break;
+            remaining = ticks_to_wait - elapsed;
+        }
+    }
+    return rx_ring_drain(out, max_count);
 }
 
 bool espnow_comm_receive(EspnowMessageEnvelope* out, TickType_t ticks_to_wait)
 {
-    if (!s_rx_queue || !out)
+    return espnow_comm_receive_batch(out, 1, ticks_to_wait) == 1;
+}
+
+void espnow_comm_get_rx_stats(EspnowRxStats* out)
+{
+    if (!out)
+        return;
+    *out = s_rx_stats;
+}
+
+bool espnow_comm_inject_rx(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const uint8_t* data, int len)
+{
+    if (!s_rx_ready || !src_mac)
         return false;
-    return xQueueReceive(s_rx_queue, out, ticks_to_wait) == pdTRUE;
+
+    uint8_t src[ESP_NOW_ETH_ALEN];
+    uint8_t dst[ESP_NOW_ETH_ALEN];
+    memcpy(src, src_mac, ESP_NOW_ETH_ALEN);
+    memset(dst, 0xFF, ESP_NOW_ETH_ALEN);
+    esp_now_recv_info_t info = {};
+    info.src_addr = src;
+    info.des_addr = dst;
+    info.rx_ctrl = NULL;
+    recv_cb(&info, data, len);
+    return true;
 }
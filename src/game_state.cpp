@@ -3,10 +3,17 @@
 #include <string.h>
 #include "esp_log.h"
 #include "esp_random.h"
+#include "esp_rom_crc.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/semphr.h"
+#include "config_fields.h"
+#include "match_log.h"
 #include "nvs_store.h"
+#include "protocol_config.h"
+#include "radio_policy.h"
+#include "time_sync.h"
 
 static const char* TAG = "game_state";
 
@@ -15,12 +22,25 @@ static GameConfig s_game_cfg;
 static GameStateData s_state;
 static SemaphoreHandle_t s_mutex = NULL;
 static bool s_initialized = false;
+static uint32_t s_dirty = 0;
+static uint32_t s_status_seq = 0;
 
-#define NVS_GAME_NS "game"
 #define NVS_KEY_DEVICE_ID "device_id_u8"
 #define NVS_KEY_PLAYER_ID "player_id_u8"
 #define NVS_KEY_TEAM_ID "team_id_u8"
 #define NVS_KEY_COLOR "color_u32"
+#define NVS_KEY_CONFIG_BLOB "config_v1"
+
+// Runtime state (s_state) does not use the mutex. Single counters are bumped
+// with relaxed atomics so the trigger/ISR path never blocks; updates touching
+// several fields run inside a short writer section that also bumps a seqlock,
+// which game_state_snapshot() uses to hand out torn-free copies.
+static portMUX_TYPE s_state_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_state_seq = 0; // Odd while a writer is active
+
+#define ATOMIC_INC(field) __atomic_fetch_add(&(field), 1, __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define ATOMIC_STORE(field, v) __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
 
 #define LOCK()                                                                                                         \
     if (s_mutex)                                                                                                       \
@@ -29,11 +49,332 @@ static bool s_initialized = false;
     if (s_mutex)                                                                                                       \
     xSemaphoreGive(s_mutex)
 
+static inline void state_write_begin(void)
+{
+    portENTER_CRITICAL_SAFE(&s_state_lock);
+    __atomic_store_n(&s_state_seq, s_state_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void state_write_end(void)
+{
+    __atomic_store_n(&s_state_seq, s_state_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL_SAFE(&s_state_lock);
+}
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
 static uint8_t rand_u8()
 {
     return (uint8_t)(esp_random() & 0xFF);
 }
 
+// ============================================================================
+// GAME TIMERS
+// ============================================================================
+//
+// Hierarchical timing wheel: 4 levels of 64 slots over 10 ms ticks (~46 h of
+// range). Arming and cancelling are O(1) list operations under a spinlock;
+// a timer sitting on an upper level cascades down when its slot comes up.
+// The single esp_timer is one-shot and only programmed for the next tick
+// that has work (an expiry or a cascade), so an idle wheel costs no wakeups.
+
+#define WHEEL_TICK_MS 10
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1u << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+#define WHEEL_RANGE (1u << (WHEEL_BITS * WHEEL_LEVELS)) // Ticks
+#define WHEEL_NONE 0xFF
+#define HEARTBEAT_TIMEOUT_MS 60000
+
+typedef enum
+{
+    TMR_RESPAWN,
+    TMR_INVULN,
+    TMR_RELOAD,
+    TMR_GAME_CLOCK,
+    TMR_HEARTBEAT,
+    TMR_COUNT
+} game_timer_t;
+
+typedef struct
+{
+    uint32_t expires; // Tick
+    uint8_t level;    // WHEEL_NONE while idle
+    uint8_t slot;
+    uint8_t next; // Slot list links (timer ids)
+    uint8_t prev;
+} wheel_timer_t;
+
+static wheel_timer_t s_timers[TMR_COUNT];
+static uint8_t s_wheel_heads[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t s_wheel_tick = 0; // Next tick to process
+static uint8_t s_wheel_armed = 0; // Timers currently linked
+static bool s_wheel_ready = false; // Lists initialized; arming before init is a no-op
+static portMUX_TYPE s_wheel_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_wheel_timer = NULL;
+static SemaphoreHandle_t s_wheel_prog = NULL; // Serializes esp_timer reprogramming
+
+static EventGroupHandle_t s_events = NULL;
+static game_state_event_cb_t s_listeners[GS_EVENT_LISTENERS_MAX];
+static bool s_respawn_completed = false; // Reported once by game_state_check_respawn()
+
+static inline uint32_t now_tick(void)
+{
+    return (uint32_t)(esp_timer_get_time() / (WHEEL_TICK_MS * 1000));
+}
+
+static inline uint32_t level_mask(uint8_t level)
+{
+    return (1u << (WHEEL_BITS * level)) - 1;
+}
+
+static void wheel_unlink(uint8_t id)
+{
+    wheel_timer_t* t = &s_timers[id];
+    if (t->level == WHEEL_NONE)
+        return;
+    if (t->prev != WHEEL_NONE)
+        s_timers[t->prev].next = t->next;
+    else
+        s_wheel_heads[t->level][t->slot] = t->next;
+    if (t->next != WHEEL_NONE)
+        s_timers[t->next].prev = t->prev;
+    t->level = WHEEL_NONE;
+    s_wheel_armed--;
+}
+
+// Files a timer by its distance from the current tick
+static void wheel_link(uint8_t id)
+{
+    wheel_timer_t* t = &s_timers[id];
+    if ((int32_t)(t->expires - s_wheel_tick) < 0)
+        t->expires = s_wheel_tick;
+    uint32_t delta = t->expires - s_wheel_tick;
+    if (delta >= WHEEL_RANGE)
+    {
+        t->expires = s_wheel_tick + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+    uint8_t level = 0;
+    while (delta > level_mask(level + 1))
+        level++;
+
+    t->level = level;
+    t->slot = (uint8_t)((t->expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+    t->prev = WHEEL_NONE;
+    t->next = s_wheel_heads[level][t->slot];
+    if (t->next != WHEEL_NONE)
+        s_timers[t->next].prev = id;
+    s_wheel_heads[level][t->slot] = id;
+    s_wheel_armed++;
+}
+
+// Earliest tick with work: an expiry on level 0, the start of the slot for
+// timers on upper levels
+static bool wheel_next_locked(uint32_t* out)
+{
+    bool any = false;
+    uint32_t best = 0;
+    for (uint8_t id = 0; id < TMR_COUNT; id++)
+    {
+        const wheel_timer_t* t = &s_timers[id];
+        if (t->level == WHEEL_NONE)
+            continue;
+        uint32_t due = t->expires & ~level_mask(t->level);
+        if (!any || (int32_t)(due - best) < 0)
+            best = due;
+        any = true;
+    }
+    *out = best;
+    return any;
+}
+
+// Processes every tick with work up to `now`; returns the expired timers
+static uint32_t wheel_advance_locked(uint32_t now)
+{
+    uint32_t fired = 0;
+    while ((int32_t)(now - s_wheel_tick) >= 0)
+    {
+        const uint32_t tick = s_wheel_tick;
+        for (uint8_t level = WHEEL_LEVELS - 1; level > 0; level--)
+        {
+            if (tick & level_mask(level))
+                continue;
+            uint8_t id = s_wheel_heads[level][(tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+            while (id != WHEEL_NONE)
+            {
+                uint8_t next = s_timers[id].next;
+                wheel_unlink(id);
+                wheel_link(id);
+                id = next;
+            }
+        }
+        uint8_t id = s_wheel_heads[0][tick & (WHEEL_SLOTS - 1)];
+        while (id != WHEEL_NONE)
+        {
+            uint8_t next = s_timers[id].next;
+            wheel_unlink(id);
+            fired |= 1u << id;
+            id = next;
+        }
+
+        // Skip the ticks without work
+        uint32_t due;
+        if (wheel_next_locked(&due) && (int32_t)(now - due) >= 0)
+            s_wheel_tick = due;
+        else
+            s_wheel_tick = now + 1;
+    }
+    return fired;
+}
+
+static void wheel_reprogram(void)
+{
+    if (!s_wheel_timer)
+        return;
+    xSemaphoreTake(s_wheel_prog, portMAX_DELAY);
+    uint32_t due;
+    portENTER_CRITICAL(&s_wheel_lock);
+    bool any = wheel_next_locked(&due);
+    portEXIT_CRITICAL(&s_wheel_lock);
+
+    esp_timer_stop(s_wheel_timer);
+    if (any)
+    {
+        int64_t delay_us = (int64_t)due * WHEEL_TICK_MS * 1000 - esp_timer_get_time();
+        esp_timer_start_once(s_wheel_timer, delay_us > 0 ? (uint64_t)delay_us : 1);
+    }
+    xSemaphoreGive(s_wheel_prog);
+}
+
+static void timer_arm(game_timer_t id, uint32_t delay_ms)
+{
+    if (!s_wheel_ready)
+        return;
+    const int64_t now_us = esp_timer_get_time();
+    const uint32_t now = (uint32_t)(now_us / (WHEEL_TICK_MS * 1000));
+    uint32_t prev_due = 0;
+    uint32_t due = 0;
+
+    portENTER_CRITICAL(&s_wheel_lock);
+    bool had_due = wheel_next_locked(&prev_due);
+    wheel_unlink(id);
+    if (s_wheel_armed == 0)
+        s_wheel_tick = now; // Nothing pending: the wheel may have idled for a long time
+    // Round up to the next tick boundary so a timer never fires early
+    const int64_t tick_us = WHEEL_TICK_MS * 1000;
+    s_timers[id].expires = (uint32_t)((now_us + (int64_t)delay_ms * 1000 + tick_us - 1) / tick_us);
+    wheel_link(id);
+    wheel_next_locked(&due);
+    portEXIT_CRITICAL(&s_wheel_lock);
+
+    // Only an earlier deadline needs the esp_timer moved
+    if (!had_due || (int32_t)(due - prev_due) < 0)
+        wheel_reprogram();
+}
+
+// A cancelled timer may leave one spurious wakeup behind, which is harmless
+static void timer_cancel(game_timer_t id)
+{
+    if (!s_wheel_ready)
+        return;
+    portENTER_CRITICAL(&s_wheel_lock);
+    wheel_unlink(id);
+    portEXIT_CRITICAL(&s_wheel_lock);
+}
+
+static void emit_event(uint32_t event)
+{
+    if (s_events)
+        xEventGroupSetBits(s_events, event);
+    for (int i = 0; i < GS_EVENT_LISTENERS_MAX; i++)
+    {
+        game_state_event_cb_t cb = __atomic_load_n(&s_listeners[i], __ATOMIC_ACQUIRE);
+        if (cb)
+            cb(event);
+    }
+}
+
+static bool finish_respawn(bool force);
+static void finish_reload(void);
+
+static void timer_expired(game_timer_t id)
+{
+    switch (id)
+    {
+        case TMR_RESPAWN:
+            if (finish_respawn(true))
+            {
+                __atomic_store_n(&s_respawn_completed, true, __ATOMIC_RELEASE);
+                emit_event(GS_EVT_RESPAWN_DONE);
+            }
+            break;
+        case TMR_INVULN:
+            ATOMIC_STORE(s_state.invulnerable, false);
+            emit_event(GS_EVT_INVULN_DONE);
+            break;
+        case TMR_RELOAD:
+            finish_reload();
+            emit_event(GS_EVT_RELOAD_DONE);
+            break;
+        case TMR_GAME_CLOCK:
+            ATOMIC_STORE(s_state.game_over, true);
+            ESP_LOGI(TAG, "Game clock expired");
+            emit_event(GS_EVT_GAME_OVER);
+            break;
+        case TMR_HEARTBEAT:
+            emit_event(GS_EVT_HEARTBEAT_DUE);
+            break;
+        default:
+            break;
+    }
+}
+
+static void wheel_cb(void* arg)
+{
+    (void)arg;
+    portENTER_CRITICAL(&s_wheel_lock);
+    uint32_t fired = wheel_advance_locked(now_tick());
+    portEXIT_CRITICAL(&s_wheel_lock);
+
+    // Actions run outside the lock; they may arm timers again
+    for (uint8_t id = 0; id < TMR_COUNT; id++)
+    {
+        if (fired & (1u << id))
+            timer_expired((game_timer_t)id);
+    }
+    wheel_reprogram();
+}
+
+static bool wheel_init(void)
+{
+    memset(s_timers, 0, sizeof(s_timers));
+    for (uint8_t id = 0; id < TMR_COUNT; id++)
+        s_timers[id].level = WHEEL_NONE;
+    memset(s_wheel_heads, WHEEL_NONE, sizeof(s_wheel_heads));
+    s_wheel_armed = 0;
+    s_wheel_tick = now_tick();
+    s_wheel_ready = true;
+
+    s_events = xEventGroupCreate();
+    s_wheel_prog = xSemaphoreCreateMutex();
+    if (!s_events || !s_wheel_prog)
+        return false;
+
+    const esp_timer_create_args_t args = {
+        .callback = wheel_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "game_timers",
+        .skip_unhandled_events = true,
+    };
+    return esp_timer_create(&args, &s_wheel_timer) == ESP_OK;
+}
+
 bool game_state_init(DeviceRole role)
 {
     if (s_initialized)
@@ -50,11 +391,18 @@ bool game_state_init(DeviceRole role)
     memset(&s_game_cfg, 0, sizeof(s_game_cfg));
     memset(&s_state, 0, sizeof(s_state));
 
+    match_log_init();
+    // Without the esp_timer the polled accessors still work
+    if (!wheel_init())
+        ESP_LOGE(TAG, "Failed to create game timers");
+    radio_policy_init();
+
     s_config.role = role;
     game_state_load_default_game_config();
     game_state_generate_ids();
     game_state_load_ids();
     game_state_reset_runtime();
+    game_state_update_heartbeat();
 
     s_initialized = true;
     ESP_LOGI(TAG, "Game state initialized role=%d device=%u player=%u", role, s_config.device_id, s_config.player_id);
@@ -73,59 +421,137 @@ DeviceConfig* game_state_get_config_mut(void)
     return &s_config;
 }
 
-bool game_state_load_ids(void)
+// Persisted settings: one blob holding DeviceConfig and GameConfig, read in a
+// single NVS access at boot. Fields may only be appended to either struct;
+// the stored lengths let newer firmware read older blobs (missing tail fields
+// keep their defaults) and older firmware ignore the extra tail. Bump
+// PERSIST_VERSION only for incompatible layout changes.
+#define PERSIST_MAGIC 0x5A52 // "RZ"
+#define PERSIST_VERSION 1
+
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t device_len; // sizeof(DeviceConfig) of the writer
+    uint16_t game_len;   // sizeof(GameConfig) of the writer
+    uint32_t crc;        // CRC-32 of the payload that follows
+} persist_header_t;
+
+#define PERSIST_MAX_PAYLOAD 256
+
+static bool load_persisted(DeviceConfig* dev, GameConfig* game)
+{
+    uint8_t buf[sizeof(persist_header_t) + PERSIST_MAX_PAYLOAD];
+    size_t len = sizeof(buf);
+    if (!nvs_store_read_blob(NVS_GAME_NS, NVS_KEY_CONFIG_BLOB, buf, &len) || len < sizeof(persist_header_t))
+        return false;
+
+    persist_header_t hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    const uint8_t* payload = buf + sizeof(hdr);
+    const size_t payload_len = len - sizeof(hdr);
+    if (hdr.magic != PERSIST_MAGIC || hdr.version != PERSIST_VERSION ||
+        (size_t)hdr.device_len + hdr.game_len != payload_len)
+    {
+        ESP_LOGW(TAG, "Ignoring persisted config (version %u, %u bytes)", hdr.version, (unsigned)len);
+        return false;
+    }
+    if (esp_rom_crc32_le(0, payload, payload_len) != hdr.crc)
+    {
+        ESP_LOGW(TAG, "Persisted config CRC mismatch");
+        return false;
+    }
+
+    memcpy(dev, payload, hdr.device_len < sizeof(*dev) ? hdr.device_len : sizeof(*dev));
+    memcpy(game, payload + hdr.device_len, hdr.game_len < sizeof(*game) ? hdr.game_len : sizeof(*game));
+    return true;
+}
+
+// Pre-blob firmware stored the ids as separate keys
+static bool load_legacy_ids(DeviceConfig* dev)
 {
-    LOCK();
     bool loaded = false;
     uint8_t id = 0;
     if (nvs_store_read_u8(NVS_GAME_NS, NVS_KEY_DEVICE_ID, &id))
     {
-        s_config.device_id = id;
+        dev->device_id = id;
         loaded = true;
     }
     if (nvs_store_read_u8(NVS_GAME_NS, NVS_KEY_PLAYER_ID, &id))
     {
-        s_config.player_id = id;
+        dev->player_id = id;
     }
     if (nvs_store_read_u8(NVS_GAME_NS, NVS_KEY_TEAM_ID, &id))
     {
-        s_config.team_id = id;
+        dev->team_id = id;
     }
     uint32_t color = 0;
     if (nvs_store_read_u32(NVS_GAME_NS, NVS_KEY_COLOR, &color))
     {
-        s_config.color_rgb = color;
+        dev->color_rgb = color;
     }
     
     // Load device name
     char name_buf[32] = {0};
     if (nvs_store_read_str(NVS_GAME_NS, "device_name", name_buf, sizeof(name_buf)))
     {
-        strncpy(s_config.device_name, name_buf, sizeof(s_config.device_name) - 1);
-        s_config.device_name[sizeof(s_config.device_name) - 1] = '\0';
+        strncpy(dev->device_name, name_buf, sizeof(dev->device_name) - 1);
+        dev->device_name[sizeof(dev->device_name) - 1] = '\0';
     }
-    
+    return loaded;
+}
+
+bool game_state_load_ids(void)
+{
+    LOCK();
+    DeviceConfig dev = s_config;
+    GameConfig game = s_game_cfg;
+    UNLOCK();
+
+    const DeviceRole role = dev.role;
+    const bool persisted = load_persisted(&dev, &game);
+    const bool loaded = persisted || load_legacy_ids(&dev);
+    dev.role = role; // Fixed by the firmware, not by what was stored
+    dev.device_name[sizeof(dev.device_name) - 1] = '\0';
+
+    LOCK();
+    s_config = dev;
     UNLOCK();
+    if (persisted)
+        game_state_apply_game_config(&game, NULL); // Re-validated like a live push
+    game_state_mark_dirty(GS_DIRTY_CONFIG);
     return loaded;
 }
 
-bool game_state_save_ids(void)
+bool game_state_save_config(void)
 {
+    uint8_t buf[sizeof(persist_header_t) + sizeof(DeviceConfig) + sizeof(GameConfig)];
+    static_assert(sizeof(DeviceConfig) + sizeof(GameConfig) <= PERSIST_MAX_PAYLOAD, "grow PERSIST_MAX_PAYLOAD");
+    uint8_t* payload = buf + sizeof(persist_header_t);
+
+    memset(buf, 0, sizeof(buf)); // Padding bytes are part of the CRC
     LOCK();
-    bool ok = true;
-    ok &= nvs_store_write_u8(NVS_GAME_NS, NVS_KEY_DEVICE_ID, s_config.device_id);
-    ok &= nvs_store_write_u8(NVS_GAME_NS, NVS_KEY_PLAYER_ID, s_config.player_id);
-    ok &= nvs_store_write_u8(NVS_GAME_NS, NVS_KEY_TEAM_ID, s_config.team_id);
-    ok &= nvs_store_write_u32(NVS_GAME_NS, NVS_KEY_COLOR, s_config.color_rgb);
-    
-    // Save device name
-    if (strlen(s_config.device_name) > 0)
-    {
-        ok &= nvs_store_write_str(NVS_GAME_NS, "device_name", s_config.device_name);
-    }
-    
+    memcpy(payload, &s_config, sizeof(DeviceConfig));
+    memcpy(payload + sizeof(DeviceConfig), &s_game_cfg, sizeof(GameConfig));
     UNLOCK();
-    return ok;
+
+    persist_header_t hdr = {};
+    hdr.magic = PERSIST_MAGIC;
+    hdr.version = PERSIST_VERSION;
+    hdr.device_len = sizeof(DeviceConfig);
+    hdr.game_len = sizeof(GameConfig);
+    hdr.crc = esp_rom_crc32_le(0, payload, sizeof(DeviceConfig) + sizeof(GameConfig));
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    // Unchanged settings cost nothing; changes go out with the next write-back
+    return nvs_store_write_blob(NVS_GAME_NS, NVS_KEY_CONFIG_BLOB, buf, sizeof(buf));
+}
+
+bool game_state_save_ids(void)
+{
+    return game_state_save_config();
 }
 
 void game_state_generate_ids(void)
@@ -140,10 +566,23 @@ void game_state_generate_ids(void)
 
 void game_state_reset_runtime(void)
 {
-    LOCK();
+    uint8_t hearts = s_game_cfg.max_hearts;
+    uint16_t ammo = s_game_cfg.max_ammo;
+    timer_cancel(TMR_RESPAWN);
+    timer_cancel(TMR_INVULN);
+    timer_cancel(TMR_RELOAD);
+    timer_cancel(TMR_GAME_CLOCK);
+    state_write_begin();
+    uint32_t last_heartbeat = s_state.last_heartbeat_ms;
+    bool connected = s_state.server_connected;
     memset(&s_state, 0, sizeof(s_state));
-    s_state.hearts_remaining = s_game_cfg.max_hearts;
-    UNLOCK();
+    s_state.hearts_remaining = hearts;
+    s_state.current_ammo = ammo;
+    s_state.last_heartbeat_ms = last_heartbeat;
+    s_state.server_connected = connected;
+    state_write_end();
+    __atomic_store_n(&s_respawn_completed, false, __ATOMIC_RELAXED);
+    game_state_mark_dirty(GS_DIRTY_STATS | GS_DIRTY_STATE);
 }
 
 // Game config
@@ -158,62 +597,59 @@ GameConfig* game_state_get_game_config_mut(void)
     return &s_game_cfg;
 }
 
-static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi)
+// Range and cross-field checks shared by live pushes and stored configs.
+// Returns true if anything had to be adjusted.
+static bool validate_game_config(GameConfig* nc, uint8_t player_id)
 {
-    if (v < lo)
-        return lo;
-    if (v > hi)
-        return hi;
-    return v;
+    bool clamped = false;
+
+    // Per-field ranges come from the same table the decoder uses
+    for (const ConfigField& f : kConfigFields)
+    {
+        if (f.target != CFG_TARGET_GAME || !(f.flags & CFG_CLAMP))
+            continue;
+        uint8_t* p = (uint8_t*)nc + f.cfg_offset;
+        const uint32_t v = config_field_load(f.type, p);
+        const uint32_t c = v < f.min ? f.min : v > f.max ? f.max : v;
+        if (c != v)
+        {
+            config_field_store(f.type, p, c);
+            clamped = true;
+        }
+    }
+
+    if (nc->laser_profile >= LASER_PROFILE_COUNT)
+    {
+        nc->laser_profile = LASER_PROFILE_CLASSIC;
+        clamped = true;
+    }
+    if (nc->laser_profile == LASER_PROFILE_COMPACT && player_id >= LASER_COMPACT_MAX_PLAYERS)
+    {
+        // Our id does not fit the compact frame; FAST keeps the bit rate
+        nc->laser_profile = LASER_PROFILE_FAST;
+        clamped = true;
+    }
+    // One frame plus the pause, so the receiver sees the idle gap between shots
+    const uint16_t floor_ms = laser_min_shot_interval_ms(nc->laser_profile);
+    if (nc->shot_rate_limit_ms < floor_ms)
+    {
+        nc->shot_rate_limit_ms = floor_ms;
+        clamped = true;
+    }
+    return clamped;
 }
 
 void game_state_apply_game_config(const GameConfig* cfg, bool* clamped)
 {
     if (!cfg)
         return;
-    bool local_clamped = false;
     GameConfig nc = *cfg;
-
-    auto clamp8 = [&](uint8_t v, uint8_t lo, uint8_t hi) {
-        if (v < lo)
-        {
-            local_clamped = true;
-            return lo;
-        }
-        if (v > hi)
-        {
-            local_clamped = true;
-            return hi;
-        }
-        return v;
-    };
-    auto clamp16 = [&](uint16_t v, uint16_t lo, uint16_t hi) {
-        if (v < lo)
-        {
-            local_clamped = true;
-            return lo;
-        }
-        if (v > hi)
-        {
-            local_clamped = true;
-            return hi;
-        }
-        return v;
-    };
-
-    nc.max_hearts = clamp8(nc.max_hearts, 1, 99);
-    nc.time_limit_s = clamp16(nc.time_limit_s, 0, 7200);
-    nc.score_to_win = clamp16(nc.score_to_win, 0, 65535);
-    nc.respawn_cooldown_ms = clamp_u32(nc.respawn_cooldown_ms, 0, 30000);
-    nc.invulnerability_ms = clamp16(nc.invulnerability_ms, 0, 30000);
-    nc.mag_capacity = clamp8(nc.mag_capacity, 0, 255);
-    nc.max_ammo = clamp16(nc.max_ammo, 0, 65535);
-    nc.reload_time_ms = clamp16(nc.reload_time_ms, 0, 30000);
-    nc.shot_rate_limit_ms = clamp16(nc.shot_rate_limit_ms, 50, 2000);
+    bool local_clamped = validate_game_config(&nc, s_config.player_id);
 
     LOCK();
     s_game_cfg = nc;
     UNLOCK();
+    game_state_mark_dirty(GS_DIRTY_CONFIG);
     if (clamped)
         *clamped = local_clamped;
 }
@@ -234,7 +670,8 @@ void game_state_load_default_game_config(void)
     cfg.max_ammo = 0;
     cfg.mag_capacity = 0;
     cfg.reload_time_ms = 0;
-    cfg.shot_rate_limit_ms = 100;
+    cfg.laser_profile = CONFIG_RAYZ_LASER_TIMING_PROFILE;
+    cfg.shot_rate_limit_ms = laser_min_shot_interval_ms(cfg.laser_profile);
     cfg.team_play = false;
     cfg.friendly_fire_enabled = false;
     cfg.unlimited_ammo = true;
@@ -258,58 +695,95 @@ GameStateData* game_state_get_mut(void)
     return &s_state;
 }
 
+void game_state_snapshot(GameStateData* out)
+{
+    if (!out)
+        return;
+    for (;;)
+    {
+        uint32_t begin = __atomic_load_n(&s_state_seq, __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue; // Writer active on the other core
+        memcpy(out, &s_state, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s_state_seq, __ATOMIC_RELAXED) == begin)
+            return;
+    }
+}
+
 void game_state_record_shot(void)
 {
-    LOCK();
-    s_state.shots_fired++;
-    UNLOCK();
+    ATOMIC_INC(s_state.shots_fired);
+    uint32_t dirty = GS_DIRTY_SHOTS;
+    if (!s_game_cfg.unlimited_ammo)
+    {
+        // Never blocks: an empty magazine waits for game_state_start_reload()
+        state_write_begin();
+        if (s_state.current_ammo > 0)
+        {
+            s_state.current_ammo--;
+            dirty |= GS_DIRTY_AMMO;
+        }
+        state_write_end();
+    }
+    game_state_mark_dirty(dirty);
+    match_log_record(MATCH_EVT_SHOT, s_config.player_id, MATCH_ID_UNKNOWN, s_config.device_id,
+                     ATOMIC_LOAD(s_state.current_ammo));
 }
 
 void game_state_record_hit(void)
 {
-    LOCK();
-    s_state.hits_landed++;
-    UNLOCK();
+    ATOMIC_INC(s_state.hits_landed);
+    match_log_record(MATCH_EVT_HIT, s_config.player_id, MATCH_ID_UNKNOWN, s_config.device_id,
+                     (uint16_t)ATOMIC_LOAD(s_state.hits_landed));
 }
 
 void game_state_record_kill(void)
 {
-    LOCK();
-    s_state.kills++;
-    UNLOCK();
+    ATOMIC_INC(s_state.kills);
+    game_state_mark_dirty(GS_DIRTY_ENEMY_KILLS);
 }
 
 void game_state_record_death(void)
 {
-    LOCK();
-    s_state.deaths++;
+    if (ATOMIC_LOAD(s_state.invulnerable))
+        return;
+    const uint32_t cooldown = s_game_cfg.respawn_cooldown_ms;
+    uint32_t respawn_end = now_ms() + cooldown;
+    state_write_begin();
+    ATOMIC_INC(s_state.deaths);
     if (s_state.hearts_remaining > 0)
         s_state.hearts_remaining--;
     s_state.respawning = true;
-    s_state.respawn_end_time_ms = (uint32_t)(esp_timer_get_time() / 1000) + s_game_cfg.respawn_cooldown_ms;
-    UNLOCK();
+    s_state.respawn_end_time_ms = respawn_end;
+    uint8_t hearts = s_state.hearts_remaining;
+    state_write_end();
+    game_state_mark_dirty(GS_DIRTY_DEATHS | GS_DIRTY_HEARTS | GS_DIRTY_RESPAWNING);
+    match_log_record(MATCH_EVT_DEATH, MATCH_ID_UNKNOWN, s_config.player_id, s_config.device_id, hearts);
+    timer_arm(TMR_RESPAWN, cooldown);
 }
 
 void game_state_record_friendly_fire(void)
 {
-    LOCK();
-    s_state.friendly_fire_count++;
-    UNLOCK();
+    ATOMIC_INC(s_state.friendly_fire_count);
+    game_state_mark_dirty(GS_DIRTY_FRIENDLY_KILLS);
 }
 
 void game_state_reset_stats(void)
 {
-    LOCK();
-    s_state.kills = 0;
-    s_state.deaths = 0;
-    s_state.shots_fired = 0;
-    s_state.hits_landed = 0;
-    s_state.friendly_fire_count = 0;
-    s_state.hearts_remaining = s_game_cfg.max_hearts;
-    s_state.rx_count = 0;
-    s_state.tx_count = 0;
-    s_state.last_rx_ms = 0;
-    UNLOCK();
+    uint8_t hearts = s_game_cfg.max_hearts;
+    state_write_begin();
+    ATOMIC_STORE(s_state.kills, 0);
+    ATOMIC_STORE(s_state.deaths, 0);
+    ATOMIC_STORE(s_state.shots_fired, 0);
+    ATOMIC_STORE(s_state.hits_landed, 0);
+    ATOMIC_STORE(s_state.friendly_fire_count, 0);
+    s_state.hearts_remaining = hearts;
+    ATOMIC_STORE(s_state.rx_count, 0);
+    ATOMIC_STORE(s_state.tx_count, 0);
+    ATOMIC_STORE(s_state.last_rx_ms, 0);
+    state_write_end();
+    game_state_mark_dirty(GS_DIRTY_STATS | GS_DIRTY_HEARTS);
 }
 
 uint8_t game_state_get_player_id(void)
@@ -317,56 +791,163 @@ uint8_t game_state_get_player_id(void)
     return s_config.player_id;
 }
 
+int64_t game_state_synced_time_us(void)
+{
+    return time_sync_now_us();
+}
+
 uint32_t game_state_last_rx_ms_ago(void)
 {
-    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
-    if (s_state.last_rx_ms == 0)
+    uint32_t now = now_ms();
+    uint32_t last = ATOMIC_LOAD(s_state.last_rx_ms);
+    if (last == 0)
         return 0;
-    return now > s_state.last_rx_ms ? now - s_state.last_rx_ms : 0;
+    return now > last ? now - last : 0;
 }
 
 uint32_t game_state_rx_count(void)
 {
-    return s_state.rx_count;
+    return ATOMIC_LOAD(s_state.rx_count);
 }
 
 uint32_t game_state_tx_count(void)
 {
-    return s_state.tx_count;
+    return ATOMIC_LOAD(s_state.tx_count);
 }
 
 int game_state_get_ammo(void)
 {
-    return 0;
+    if (s_game_cfg.unlimited_ammo)
+        return -1;
+    return ATOMIC_LOAD(s_state.current_ammo);
 }
 
-bool game_state_check_respawn(void)
+// Ends the respawn and opens the invulnerability window. The timer forces
+// it; the polled path only completes once the end time has passed.
+static bool finish_respawn(bool force)
 {
-    if (!s_state.respawning)
+    if (!ATOMIC_LOAD(s_state.respawning))
         return false;
-    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
-    if (now >= s_state.respawn_end_time_ms)
+    uint32_t now = now_ms();
+    uint8_t hearts = s_game_cfg.max_hearts;
+    uint16_t grace = s_game_cfg.invulnerability_ms;
+    bool done = false;
+
+    state_write_begin();
+    if (s_state.respawning && (force || (int32_t)(now - s_state.respawn_end_time_ms) >= 0))
     {
-        LOCK();
         s_state.respawning = false;
-        s_state.hearts_remaining = s_game_cfg.max_hearts;
-        UNLOCK();
-        return true;
+        s_state.hearts_remaining = hearts;
+        s_state.invulnerable = grace > 0;
+        done = true;
     }
-    return false;
+    state_write_end();
+
+    if (!done)
+        return false;
+    match_log_record(MATCH_EVT_RESPAWN, MATCH_ID_UNKNOWN, s_config.player_id, s_config.device_id, hearts);
+    timer_cancel(TMR_RESPAWN);
+    if (grace > 0)
+        timer_arm(TMR_INVULN, grace);
+    game_state_mark_dirty(GS_DIRTY_RESPAWNING | GS_DIRTY_HEARTS);
+    return true;
+}
+
+bool game_state_check_respawn(void)
+{
+    if (__atomic_exchange_n(&s_respawn_completed, false, __ATOMIC_ACQ_REL))
+        return true;
+    return finish_respawn(false);
 }
 
 bool game_state_is_respawning(void)
 {
-    return s_state.respawning;
+    return ATOMIC_LOAD(s_state.respawning);
 }
 
 void game_state_start_respawn(void)
 {
-    LOCK();
+    const uint32_t cooldown = s_game_cfg.respawn_cooldown_ms;
+    uint32_t respawn_end = now_ms() + cooldown;
+    state_write_begin();
     s_state.respawning = true;
-    s_state.respawn_end_time_ms = (uint32_t)(esp_timer_get_time() / 1000) + s_game_cfg.respawn_cooldown_ms;
-    UNLOCK();
+    s_state.respawn_end_time_ms = respawn_end;
+    state_write_end();
+    game_state_mark_dirty(GS_DIRTY_RESPAWNING);
+    timer_arm(TMR_RESPAWN, cooldown);
+}
+
+bool game_state_is_invulnerable(void)
+{
+    return ATOMIC_LOAD(s_state.invulnerable);
+}
+
+static void finish_reload(void)
+{
+    uint16_t ammo = s_game_cfg.max_ammo;
+    state_write_begin();
+    s_state.current_ammo = ammo;
+    s_state.reloading = false;
+    state_write_end();
+    game_state_mark_dirty(GS_DIRTY_AMMO | GS_DIRTY_RELOADING);
+}
+
+bool game_state_is_reloading(void)
+{
+    return ATOMIC_LOAD(s_state.reloading);
+}
+
+bool game_state_start_reload(void)
+{
+    if (s_game_cfg.unlimited_ammo || ATOMIC_LOAD(s_state.reloading))
+        return false;
+    const uint16_t duration = s_game_cfg.reload_time_ms;
+    if (duration == 0)
+    {
+        finish_reload();
+        emit_event(GS_EVT_RELOAD_DONE);
+        return true;
+    }
+    ATOMIC_STORE(s_state.reloading, true);
+    game_state_mark_dirty(GS_DIRTY_RELOADING);
+    timer_arm(TMR_RELOAD, duration);
+    return true;
+}
+
+void game_state_start_game(void)
+{
+    game_state_reset_runtime();
+    ATOMIC_STORE(s_state.game_start_time_ms, now_ms());
+    if (s_game_cfg.time_limit_s > 0)
+        timer_arm(TMR_GAME_CLOCK, (uint32_t)s_game_cfg.time_limit_s * 1000);
+}
+
+void game_state_stop_game(void)
+{
+    timer_cancel(TMR_GAME_CLOCK);
+}
+
+bool game_state_is_game_over(void)
+{
+    return ATOMIC_LOAD(s_state.game_over);
+}
+
+EventGroupHandle_t game_state_event_group(void)
+{
+    return s_events;
+}
+
+bool game_state_add_event_listener(game_state_event_cb_t cb)
+{
+    if (!cb)
+        return false;
+    for (int i = 0; i < GS_EVENT_LISTENERS_MAX; i++)
+    {
+        game_state_event_cb_t empty = NULL;
+        if (__atomic_compare_exchange_n(&s_listeners[i], &empty, cb, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
 }
 
 bool game_state_friendly_fire_counts(void)
@@ -374,29 +955,46 @@ bool game_state_friendly_fire_counts(void)
     return s_game_cfg.friendly_fire_enabled;
 }
 
+// Change tracking
+
+void game_state_mark_dirty(uint32_t fields)
+{
+    __atomic_fetch_or(&s_dirty, fields, __ATOMIC_RELAXED);
+}
+
+uint32_t game_state_take_dirty(uint32_t* seq)
+{
+    uint32_t fields = __atomic_exchange_n(&s_dirty, 0, __ATOMIC_ACQ_REL);
+    uint32_t cur = fields ? __atomic_add_fetch(&s_status_seq, 1, __ATOMIC_RELAXED) : ATOMIC_LOAD(s_status_seq);
+    if (seq)
+        *seq = cur;
+    return fields;
+}
+
+uint32_t game_state_status_seq(void)
+{
+    return ATOMIC_LOAD(s_status_seq);
+}
+
 // Connection
 
 void game_state_set_connected(bool connected)
 {
-    LOCK();
-    s_state.server_connected = connected;
-    UNLOCK();
+    ATOMIC_STORE(s_state.server_connected, connected);
 }
 
 void game_state_update_heartbeat(void)
 {
-    LOCK();
-    s_state.last_heartbeat_ms = (uint32_t)(esp_timer_get_time() / 1000);
-    UNLOCK();
+    ATOMIC_STORE(s_state.last_heartbeat_ms, now_ms());
+    timer_arm(TMR_HEARTBEAT, HEARTBEAT_TIMEOUT_MS);
 }
 
 bool game_state_heartbeat_due(void)
 {
-    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
-    return (now - s_state.last_heartbeat_ms) >= 60000;
+    return (now_ms() - ATOMIC_LOAD(s_state.last_heartbeat_ms)) >= HEARTBEAT_TIMEOUT_MS;
 }
 
-// JSON stubs (to be implemented with actual JSON lib)
+// Config as JSON; parsing goes through ws_codec_decode()
 
 int game_state_config_to_json(char* buffer, size_t max_len, bool clamp_noted)
 {
@@ -416,16 +1014,18 @@ int game_state_to_json(char* buffer, size_t max_len)
 {
     if (!buffer || max_len == 0)
         return -1;
-    uint32_t uptime = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t uptime = now_ms();
+    GameStateData st;
+    game_state_snapshot(&st);
     int len = snprintf(buffer, max_len,
                        "{"
                        "\"shots\":%lu,\"hits\":%lu,\"kills\":%lu,\"deaths\":%lu,\"hearts\":%u,"
                        "\"respawning\":%s,"
                        "\"server_connected\":%s,\"uptime\":%lu"
                        "}",
-                       (unsigned long)s_state.shots_fired, (unsigned long)s_state.hits_landed,
-                       (unsigned long)s_state.kills, (unsigned long)s_state.deaths, (unsigned)s_state.hearts_remaining,
-                       s_state.respawning ? "true" : "false", s_state.server_connected ? "true" : "false",
+                       (unsigned long)st.shots_fired, (unsigned long)st.hits_landed, (unsigned long)st.kills,
+                       (unsigned long)st.deaths, (unsigned)st.hearts_remaining, st.respawning ? "true" : "false",
+                       st.server_connected ? "true" : "false",
                        (unsigned long)uptime);
     return len < (int)max_len ? len : -1;
 }
@@ -434,9 +1034,20 @@ bool game_state_config_from_json(const char* json, GameConfig* out_config, bool*
 {
     if (!json || !out_config)
         return false;
-    *out_config = s_game_cfg;
+    WsClientMessage msg;
+    if (!ws_codec_decode(WS_FORMAT_JSON, (const uint8_t*)json, strlen(json), &msg))
+        return false;
+
+    // Fields absent from the JSON keep their current values
+    LOCK();
+    GameConfig cfg = s_game_cfg;
+    const uint8_t player_id = s_config.player_id;
+    UNLOCK();
+    ws_codec_apply_config(&msg.config, NULL, &cfg);
+    bool cl = validate_game_config(&cfg, player_id);
+    *out_config = cfg;
     if (clamped)
-        *clamped = false;
+        *clamped = cl;
     return true;
 }
 
@@ -458,8 +1069,8 @@ int game_state_create_hit_report_json(char* buffer, size_t max_len, uint8_t shoo
 {
     if (!buffer || max_len == 0)
         return -1;
-    int len = snprintf(buffer, max_len, "{\"shooter_id\":%u,\"ts\":%lu}", shooter_id,
-                       (unsigned long)(esp_timer_get_time() / 1000));
+    int len = snprintf(buffer, max_len, "{\"shooter_id\":%u,\"ts\":%llu}", shooter_id,
+                       (unsigned long long)(game_state_synced_time_us() / 1000));
     return len < (int)max_len ? len : -1;
 }
 
@@ -467,7 +1078,7 @@ int game_state_create_shot_fired_json(char* buffer, size_t max_len)
 {
     if (!buffer || max_len == 0)
         return -1;
-    int len = snprintf(buffer, max_len, "{\"shots\":%lu,\"ts\":%lu}", (unsigned long)s_state.shots_fired,
-                       (unsigned long)(esp_timer_get_time() / 1000));
+    int len = snprintf(buffer, max_len, "{\"shots\":%lu,\"ts\":%llu}", (unsigned long)ATOMIC_LOAD(s_state.shots_fired),
+                       (unsigned long long)(game_state_synced_time_us() / 1000));
     return len < (int)max_len ? len : -1;
 }
@@ -1,41 +1,89 @@
 #include "http_api.h"
 #include <esp_log.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "espnow_comm.h"
+#include "http_stream.h"
+#include "match_log.h"
+#include "nvs_snapshot.h"
+#include "runtime_metrics.h"
 #include "wifi_manager.h"
 
 static const char* TAG = "HttpApi";
 
-static char s_status[256];
+static char s_metrics[3520]; // Worst case of metrics_snapshot_json(); httpd task only
 
 static esp_err_t status_get_handler(httpd_req_t* req)
 {
-    const char* json = http_api_get_status_json();
+    char json[HTTP_API_STATUS_JSON_MAX];
+    int len = http_api_get_status_json(json, sizeof(json));
+    if (len < 0)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Status too large");
+        return ESP_OK;
+    }
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    return httpd_resp_send(req, json, len);
 }
 
+// Stored peer list plus the live link stats of every ESP-NOW peer. Streamed,
+// so the size grows with the peer table instead of a fixed buffer.
 static esp_err_t peers_get_handler(httpd_req_t* req)
 {
-    char peers[256] = {0};
-    wifi_manager_load_peer_list(peers, sizeof(peers));
-    char response[320];
-    snprintf(response, sizeof(response), "{\"peers\":\"%s\"}", peers);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+    char stored[WIFI_PEER_LIST_LEN] = {0};
+    wifi_manager_load_peer_list(stored, sizeof(stored));
+
+    static EspnowPeerInfo peers[ESPNOW_MAX_PEERS]; // httpd task only
+    int count = espnow_comm_get_peers(peers, ESPNOW_MAX_PEERS);
+
+    HttpStream s;
+    http_stream_begin(&s, req, "application/json");
+    http_stream_puts(&s, "{\"peers\":");
+    http_stream_json_str(&s, stored);
+    http_stream_puts(&s, ",\"espnow\":[");
+    for (int i = 0; i < count; i++)
+    {
+        const EspnowPeerInfo* p = &peers[i];
+        http_stream_printf(&s,
+                           "%s{\"mac\":\"%02X:%02X:%02X:%02X:%02X:%02X\",\"identified\":%s,\"registered\":%s,\"player_id\":%u,"
+                           "\"team_id\":%u,\"device_id\":%u,\"rssi\":%d,\"last_seen_ms\":%lu,\"rx\":%lu,"
+                           "\"tx\":%lu,\"tx_failed\":%lu}",
+                           i ? "," : "", p->mac[0], p->mac[1], p->mac[2], p->mac[3], p->mac[4], p->mac[5],
+                           p->identified ? "true" : "false", p->registered ? "true" : "false", p->player_id, p->team_id, p->device_id, p->rssi,
+                           (unsigned long)p->last_seen_ms, (unsigned long)p->rx_count, (unsigned long)p->tx_count,
+                           (unsigned long)p->tx_failed);
+    }
+    http_stream_puts(&s, "]}");
+    return http_stream_end(&s);
 }
 
 static esp_err_t peers_post_handler(httpd_req_t* req)
 {
-    char buf[256] = {0};
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0)
+    if (req->content_len == 0)
     {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No peer list");
         return ESP_OK;
     }
+    if (req->content_len >= WIFI_PEER_LIST_LEN)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Peer list too long");
+        return ESP_OK;
+    }
+
+    // The body can arrive in several segments
+    char buf[WIFI_PEER_LIST_LEN];
+    size_t len = 0;
+    while (len < req->content_len)
+    {
+        int n = httpd_req_recv(req, buf + len, req->content_len - len);
+        if (n <= 0)
+        {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Incomplete peer list");
+            return ESP_OK;
+        }
+        len += (size_t)n;
+    }
     buf[len] = '\0';
     while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r'))
     {
@@ -43,9 +91,122 @@ static esp_err_t peers_post_handler(httpd_req_t* req)
         len--;
     }
 
-    wifi_manager_set_peer_list(buf);
-    espnow_comm_load_peers_from_csv(buf);
+    uint8_t macs[ESPNOW_MAX_PEERS][ESP_NOW_ETH_ALEN];
+    int count = espnow_comm_parse_peer_csv(buf, macs, ESPNOW_MAX_PEERS);
+    if (count == 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No valid MAC in peer list");
+        return ESP_OK;
+    }
+    wifi_manager_set_peers(macs, count);
+    espnow_comm_set_peers(macs, count);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, "{\"stored\":true}", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+// JSON by default; ?format=bin returns the raw MetricsSnapshot struct
+static esp_err_t metrics_get_handler(httpd_req_t* req)
+{
+    char query[32];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK && strcmp(value, "bin") == 0)
+    {
+        static MetricsSnapshot snap;
+        metrics_snapshot(&snap);
+        httpd_resp_set_type(req, "application/octet-stream");
+        return httpd_resp_send(req, (const char*)&snap, sizeof(snap));
+    }
+
+    int len = metrics_snapshot_json(s_metrics, sizeof(s_metrics));
+    if (len < 0)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Metrics too large");
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, s_metrics, len);
+}
+
+#define MATCH_LOG_CHUNK_EVENTS 32
+
+// Streams the journal as raw 12-byte MatchEvent records, oldest first.
+// X-Match-Log-Start is the sequence number of the first record and
+// X-Match-Log-Next the one to pass as ?since= to fetch only newer events.
+static esp_err_t match_log_get_handler(httpd_req_t* req)
+{
+    uint32_t cursor = match_log_oldest_seq();
+    char query[32];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK)
+    {
+        uint32_t since = (uint32_t)strtoul(value, NULL, 10);
+        if ((int32_t)(since - cursor) > 0)
+            cursor = since;
+    }
+
+    // Upper bound at request time; events recorded during the export follow
+    MatchLogStats stats;
+    match_log_get_stats(&stats);
+    char first[12];
+    char next[12];
+    snprintf(first, sizeof(first), "%lu", (unsigned long)cursor);
+    snprintf(next, sizeof(next), "%lu", (unsigned long)stats.next_seq);
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "X-Match-Log-Start", first);
+    httpd_resp_set_hdr(req, "X-Match-Log-Next", next);
+
+    MatchEvent events[MATCH_LOG_CHUNK_EVENTS];
+    while ((int32_t)(cursor - stats.next_seq) < 0)
+    {
+        int max = MATCH_LOG_CHUNK_EVENTS;
+        if ((uint32_t)max > stats.next_seq - cursor)
+            max = (int)(stats.next_seq - cursor);
+        int n = match_log_read(&cursor, events, max);
+        if (n <= 0)
+            break;
+        if (httpd_resp_send_chunk(req, (const char*)events, (ssize_t)(n * sizeof(MatchEvent))) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Match log export aborted");
+            return ESP_FAIL;
+        }
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Binary NVS snapshot (layout in nvs_snapshot.h); ?diff=1 returns only the
+// entries that differ from the factory baseline
+static esp_err_t nvs_get_handler(httpd_req_t* req)
+{
+    char query[32];
+    char value[4];
+    bool diff = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                httpd_query_key_value(query, "diff", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
 
+    size_t len = 0;
+    uint8_t* snap = diff ? nvs_snapshot_diff_baseline(&len) : nvs_snapshot_alloc(&len);
+    if (!snap)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "NVS snapshot failed");
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/octet-stream");
+    esp_err_t err = httpd_resp_send(req, (const char*)snap, (ssize_t)len);
+    free(snap);
+    return err;
+}
+
+// Stores the current contents as the factory baseline for ?diff=1
+static esp_err_t nvs_baseline_post_handler(httpd_req_t* req)
+{
+    if (!nvs_snapshot_save_baseline())
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Baseline not stored");
+        return ESP_OK;
+    }
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, "{\"stored\":true}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
@@ -76,21 +237,63 @@ httpd_handle_t http_api_start(httpd_handle_t server)
                                   .is_websocket = false,
                                   .handle_ws_control_frames = false,
                                   .supported_subprotocol = NULL};
+    httpd_uri_t match_log_uri = {.uri = "/api/match_log",
+                                 .method = HTTP_GET,
+                                 .handler = match_log_get_handler,
+                                 .user_ctx = NULL,
+                                 .is_websocket = false,
+                                 .handle_ws_control_frames = false,
+                                 .supported_subprotocol = NULL};
+    httpd_uri_t metrics_uri = {.uri = "/api/metrics",
+                               .method = HTTP_GET,
+                               .handler = metrics_get_handler,
+                               .user_ctx = NULL,
+                               .is_websocket = false,
+                               .handle_ws_control_frames = false,
+                               .supported_subprotocol = NULL};
+    httpd_uri_t nvs_uri = {.uri = "/api/nvs",
+                           .method = HTTP_GET,
+                           .handler = nvs_get_handler,
+                           .user_ctx = NULL,
+                           .is_websocket = false,
+                           .handle_ws_control_frames = false,
+                           .supported_subprotocol = NULL};
+    httpd_uri_t nvs_baseline_uri = {.uri = "/api/nvs/baseline",
+                                    .method = HTTP_POST,
+                                    .handler = nvs_baseline_post_handler,
+                                    .user_ctx = NULL,
+                                    .is_websocket = false,
+                                    .handle_ws_control_frames = false,
+                                    .supported_subprotocol = NULL};
     httpd_register_uri_handler(server, &status_uri);
     httpd_register_uri_handler(server, &peers_uri_get);
     httpd_register_uri_handler(server, &peers_uri_post);
+    httpd_register_uri_handler(server, &match_log_uri);
+    httpd_register_uri_handler(server, &metrics_uri);
+    httpd_register_uri_handler(server, &nvs_uri);
+    httpd_register_uri_handler(server, &nvs_baseline_uri);
     ESP_LOGI(TAG, "HTTP API registered");
     return server;
 }
 
-const char* http_api_get_status_json()
+int http_api_get_status_json(char* buffer, size_t max_len)
 {
+    if (!buffer || max_len == 0)
+        return -1;
     bool connected = wifi_manager_is_connected();
     const char* ip = wifi_manager_get_ip();
-    const char* peers = wifi_manager_get_peer_list();
-    snprintf(s_status, sizeof(s_status),
-             "{\"wifi\":%s,\"ip\":\"%s\",\"channel\":%u,\"peers\":\"%s\",\"espnow_peers\":%u}",
-             connected ? "true" : "false", ip, wifi_manager_get_channel(), peers ? peers : "",
-             espnow_comm_peer_count());
-    return s_status;
+    int len = snprintf(buffer, max_len, "{\"wifi\":%s,\"ip\":\"%s\",\"channel\":%u,\"peers\":\"",
+                       connected ? "true" : "false", ip, wifi_manager_get_channel());
+    if (len < 0 || len >= (int)max_len)
+        return -1;
+
+    uint8_t macs[ESPNOW_MAX_PEERS][ESP_NOW_ETH_ALEN];
+    int count = wifi_manager_get_peers(macs, ESPNOW_MAX_PEERS);
+    int n = espnow_comm_format_peer_csv(macs, count, buffer + len, max_len - (size_t)len);
+    if (n < 0)
+        return -1;
+    len += n;
+
+    n = snprintf(buffer + len, max_len - (size_t)len, "\",\"espnow_peers\":%u}", espnow_comm_peer_count());
+    return n >= 0 && n < (int)(max_len - (size_t)len) ? len + n : -1;
 }
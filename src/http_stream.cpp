@@ -0,0 +1,144 @@
+#include "http_stream.h"
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* TAG = "HttpStream";
+
+static bool flush(HttpStream* s)
+{
+    if (s->err != ESP_OK)
+        return false;
+    if (s->len == 0)
+        return true;
+    s->err = httpd_resp_send_chunk(s->req, s->buf, (ssize_t)s->len);
+    s->len = 0;
+    return s->err == ESP_OK;
+}
+
+void http_stream_begin(HttpStream* s, httpd_req_t* req, const char* content_type)
+{
+    s->req = req;
+    s->err = req ? ESP_OK : ESP_ERR_INVALID_ARG;
+    s->len = 0;
+    if (req && content_type)
+        httpd_resp_set_type(req, content_type);
+}
+
+bool http_stream_write(HttpStream* s, const char* data, size_t len)
+{
+    if (s->err != ESP_OK)
+        return false;
+    while (len > 0)
+    {
+        size_t room = sizeof(s->buf) - s->len;
+        if (room == 0)
+        {
+            if (!flush(s))
+                return false;
+            room = sizeof(s->buf);
+        }
+        size_t n = len < room ? len : room;
+        memcpy(s->buf + s->len, data, n);
+        s->len += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool http_stream_puts(HttpStream* s, const char* str)
+{
+    return str ? http_stream_write(s, str, strlen(str)) : true;
+}
+
+bool http_stream_printf(HttpStream* s, const char* fmt, ...)
+{
+    if (s->err != ESP_OK)
+        return false;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        size_t room = sizeof(s->buf) - s->len;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(s->buf + s->len, room, fmt, args);
+        va_end(args);
+        if (n < 0)
+            break;
+        if ((size_t)n < room)
+        {
+            s->len += (size_t)n;
+            return true;
+        }
+        // Did not fit: send what is buffered and format again into the empty buffer
+        if (s->len == 0 || !flush(s))
+            break;
+    }
+    if (s->err == ESP_OK)
+    {
+        ESP_LOGW(TAG, "Formatted piece exceeds %d bytes", HTTP_STREAM_BUF_LEN);
+        s->err = ESP_ERR_INVALID_SIZE;
+    }
+    return false;
+}
+
+bool http_stream_json_str(HttpStream* s, const char* str)
+{
+    if (!http_stream_write(s, "\"", 1))
+        return false;
+    if (str)
+    {
+        const char* run = str;
+        for (const char* p = str; *p; p++)
+        {
+            const unsigned char c = (unsigned char)*p;
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+            http_stream_write(s, run, (size_t)(p - run));
+            char esc[8];
+            int n = (c == '"' || c == '\\') ? snprintf(esc, sizeof(esc), "\\%c", c)
+                                            : snprintf(esc, sizeof(esc), "\\u%04x", c);
+            http_stream_write(s, esc, (size_t)n);
+            run = p + 1;
+        }
+        http_stream_puts(s, run);
+    }
+    return http_stream_write(s, "\"", 1);
+}
+
+esp_err_t http_stream_end(HttpStream* s)
+{
+    if (!flush(s))
+        return s->err;
+    s->err = httpd_resp_send_chunk(s->req, NULL, 0);
+    return s->err;
+}
+
+esp_err_t http_send_asset(httpd_req_t* req, HttpAsset* asset)
+{
+    if (!req || !asset || !asset->data)
+        return ESP_ERR_INVALID_ARG;
+    if (asset->etag[0] == '\0')
+        snprintf(asset->etag, sizeof(asset->etag), "\"%08lx\"",
+                 (unsigned long)esp_rom_crc32_le(0, asset->data, (uint32_t)asset->len));
+
+    // Revalidate every time; a reprovisioned device may run newer firmware
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char match[48];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK &&
+        strstr(match, asset->etag) != NULL)
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    if (asset->content_type)
+        httpd_resp_set_type(req, asset->content_type);
+    if (asset->content_encoding)
+        httpd_resp_set_hdr(req, "Content-Encoding", asset->content_encoding);
+    return httpd_resp_send(req, (const char*)asset->data, (ssize_t)asset->len);
+}
@@ -0,0 +1,447 @@
+#include "match_log.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#ifndef CONFIG_RAYZ_MATCH_LOG_DEPTH
+#define CONFIG_RAYZ_MATCH_LOG_DEPTH 512
+#endif
+#define RING_DEPTH CONFIG_RAYZ_MATCH_LOG_DEPTH
+#define RING_MASK (RING_DEPTH - 1)
+static_assert((RING_DEPTH & RING_MASK) == 0, "CONFIG_RAYZ_MATCH_LOG_DEPTH must be a power of two");
+static_assert(RING_DEPTH <= 32768, "the slot seq must tell successive laps apart");
+static_assert(sizeof(MatchEvent) == 12, "MatchEvent is part of the export format");
+
+#ifdef CONFIG_RAYZ_MATCH_LOG_FLASH
+#define FLASH_SPILL 1
+#else
+#define FLASH_SPILL 0
+#endif
+
+static const char* TAG = "MatchLog";
+
+// Writers reserve a slot with one fetch-add on s_head, fill it and publish it
+// by storing the slot's seq last. A reader accepts a slot only if its seq
+// matches (the writer finished) and s_head has not lapped it by the time the
+// copy is done (no newer writer reused it). Slots start with ~index as seq:
+// only sequence numbers with the index in their low bits map to a slot, so
+// a reserved but unpublished slot is never taken for one before its first
+// write (a zero seq would pass as event 0).
+struct EventRing
+{
+    MatchEvent slot[RING_DEPTH];
+    constexpr EventRing() : slot{}
+    {
+        for (uint32_t i = 0; i < RING_DEPTH; i++)
+            slot[i].seq = (uint16_t)~i;
+    }
+};
+static EventRing s_ring_store;
+static MatchEvent (&s_ring)[RING_DEPTH] = s_ring_store.slot;
+static uint32_t s_head = 0;  // Next sequence number to reserve
+static uint32_t s_first = 0; // First sequence number recorded since boot
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Events returned by one call have consecutive sequence numbers ending just
+// before the updated *cursor
+static int ring_read(uint32_t* cursor, MatchEvent* out, int max_events)
+{
+    const uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    uint32_t c = *cursor;
+    if ((int32_t)(head - c) > RING_DEPTH)
+        c = head - RING_DEPTH; // Overwritten, resume at the oldest slot
+    else if ((int32_t)(c - s_first) < 0)
+        c = s_first;
+
+    int n = 0;
+    while (n < max_events && c != head)
+    {
+        const MatchEvent* slot = &s_ring[c & RING_MASK];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (uint16_t)c)
+            break; // Reserved but not yet published
+        memcpy(&out[n], slot, sizeof(MatchEvent));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        const uint32_t now_head = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        if ((int32_t)(now_head - c) > RING_DEPTH)
+        {
+            // Lapped during the copy; what was returned so far stays contiguous
+            if (n > 0)
+                break;
+            c = now_head - RING_DEPTH;
+            continue;
+        }
+        n++;
+        c++;
+    }
+    *cursor = c;
+    return n;
+}
+
+// ============================================================================
+// FLASH SPILL
+// ============================================================================
+//
+// Every sector of the partition is one append-only page: a header slot, then
+// events with consecutive sequence numbers. Events are appended as they are
+// spilled, so a page is never rewritten, only erased when the writer wraps
+// around to it again. A page ends at the first erased slot or the first
+// event whose seq does not follow on.
+
+#if FLASH_SPILL
+#include <esp_partition.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_MAGIC 0x4C5A5952u // "RYZL"
+#define PAGE_VERSION 1
+#define PAGE_EVENTS ((PAGE_SIZE - sizeof(page_header_t)) / sizeof(MatchEvent))
+#define SPILL_BATCH 32
+#define SPILL_INTERVAL_MS 1000
+#define SPILL_TASK_STACK 3072
+#define SPILL_TASK_PRIORITY 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t first_seq;
+    uint16_t version;
+    uint16_t reserved;
+} page_header_t;
+static_assert(sizeof(page_header_t) == sizeof(MatchEvent), "header occupies one event slot");
+
+static const esp_partition_t* s_part = NULL;
+static uint32_t s_pages = 0;
+static SemaphoreHandle_t s_flash_lock = NULL;
+static TaskHandle_t s_spill_task = NULL;
+
+// Spill task state, guarded by s_flash_lock
+static int32_t s_page = -1;      // Page being appended to, -1 = none yet
+static uint32_t s_page_first = 0;
+static uint32_t s_page_fill = 0; // Events in s_page
+static uint32_t s_spilled = 0;   // Next sequence number to spill
+static uint32_t s_read_hint = 0; // Page the last flash read ended in
+static MatchEvent s_spill_buf[SPILL_BATCH];
+
+static uint32_t s_spilled_count = 0;
+static uint32_t s_flash_errors = 0;
+
+static inline size_t page_offset(uint32_t page, uint32_t slot)
+{
+    return (size_t)page * PAGE_SIZE + sizeof(page_header_t) + (size_t)slot * sizeof(MatchEvent);
+}
+
+static bool read_header(uint32_t page, page_header_t* out)
+{
+    if (esp_partition_read(s_part, (size_t)page * PAGE_SIZE, out, sizeof(*out)) != ESP_OK)
+        return false;
+    return out->magic == PAGE_MAGIC && out->version == PAGE_VERSION;
+}
+
+// Number of events in a page, by walking its slots in batches
+static uint32_t page_count(uint32_t page, uint32_t first_seq)
+{
+    uint32_t n = 0;
+    while (n < PAGE_EVENTS)
+    {
+        uint32_t batch = PAGE_EVENTS - n < SPILL_BATCH ? PAGE_EVENTS - n : SPILL_BATCH;
+        if (esp_partition_read(s_part, page_offset(page, n), s_spill_buf, batch * sizeof(MatchEvent)) != ESP_OK)
+            return n;
+        for (uint32_t i = 0; i < batch; i++, n++)
+        {
+            if (s_spill_buf[i].type == 0xFF || s_spill_buf[i].seq != (uint16_t)(first_seq + n))
+                return n;
+        }
+    }
+    return n;
+}
+
+// Page with the largest first_seq <= seq, -1 if none. Pages are written in
+// order, so a sequential reader is normally still in the hinted page.
+static int32_t find_page(uint32_t seq, page_header_t* hdr)
+{
+    page_header_t next;
+    if (read_header(s_read_hint, hdr) && (int32_t)(seq - hdr->first_seq) >= 0)
+    {
+        const uint32_t np = (s_read_hint + 1) % s_pages;
+        if (!read_header(np, &next) || (int32_t)(next.first_seq - hdr->first_seq) < 0 ||
+            (int32_t)(seq - next.first_seq) < 0)
+            return (int32_t)s_read_hint;
+    }
+
+    int32_t found = -1;
+    page_header_t h;
+    for (uint32_t p = 0; p < s_pages; p++)
+    {
+        if (read_header(p, &h) && (int32_t)(seq - h.first_seq) >= 0 &&
+            (found < 0 || (int32_t)(h.first_seq - hdr->first_seq) > 0))
+        {
+            found = (int32_t)p;
+            *hdr = h;
+        }
+    }
+    return found;
+}
+
+// Smallest first_seq after seq (or the oldest page if seq is older than all)
+static bool next_page_first(uint32_t seq, uint32_t* out)
+{
+    bool found = false;
+    page_header_t h;
+    for (uint32_t p = 0; p < s_pages; p++)
+    {
+        if (read_header(p, &h) && (int32_t)(h.first_seq - seq) > 0 &&
+            (!found || (int32_t)(h.first_seq - *out) < 0))
+        {
+            *out = h.first_seq;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Caller holds s_flash_lock
+static bool open_page(uint32_t first_seq)
+{
+    const uint32_t page = s_page < 0 ? 0 : ((uint32_t)s_page + 1) % s_pages;
+    const page_header_t hdr = {PAGE_MAGIC, first_seq, PAGE_VERSION, 0};
+    if (esp_partition_erase_range(s_part, (size_t)page * PAGE_SIZE, PAGE_SIZE) != ESP_OK ||
+        esp_partition_write(s_part, (size_t)page * PAGE_SIZE, &hdr, sizeof(hdr)) != ESP_OK)
+    {
+        s_flash_errors++;
+        return false;
+    }
+    s_page = (int32_t)page;
+    s_page_first = first_seq;
+    s_page_fill = 0;
+    return true;
+}
+
+static void spill_pending(void)
+{
+    xSemaphoreTake(s_flash_lock, portMAX_DELAY);
+    for (;;)
+    {
+        uint32_t cursor = s_spilled;
+        int n = ring_read(&cursor, s_spill_buf, SPILL_BATCH);
+        if (n == 0)
+            break;
+        // ring_read may have skipped events lost to an overrun
+        const uint32_t first = cursor - (uint32_t)n;
+        int done = 0;
+        while (done < n)
+        {
+            const uint32_t seq = first + (uint32_t)done;
+            if (s_page < 0 || s_page_fill == PAGE_EVENTS || s_page_first + s_page_fill != seq)
+            {
+                if (!open_page(seq))
+                    goto out;
+            }
+            int chunk = n - done;
+            if ((uint32_t)chunk > PAGE_EVENTS - s_page_fill)
+                chunk = (int)(PAGE_EVENTS - s_page_fill);
+            if (esp_partition_write(s_part, page_offset((uint32_t)s_page, s_page_fill), &s_spill_buf[done],
+                                    (size_t)chunk * sizeof(MatchEvent)) != ESP_OK)
+            {
+                s_flash_errors++;
+                s_page_fill = PAGE_EVENTS; // Retry on a fresh page
+                goto out;
+            }
+            s_page_fill += (uint32_t)chunk;
+            s_spilled_count += (uint32_t)chunk;
+            done += chunk;
+        }
+        s_spilled = cursor;
+    }
+out:
+    xSemaphoreGive(s_flash_lock);
+}
+
+static void spill_task(void* arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SPILL_INTERVAL_MS));
+        spill_pending();
+    }
+}
+
+// Find where the previous boot stopped; returns the next sequence number
+static uint32_t flash_restore(void)
+{
+    uint32_t newest_first = 0;
+    page_header_t hdr;
+    for (uint32_t p = 0; p < s_pages; p++)
+    {
+        if (read_header(p, &hdr) && (s_page < 0 || (int32_t)(hdr.first_seq - newest_first) > 0))
+        {
+            s_page = (int32_t)p;
+            newest_first = hdr.first_seq;
+        }
+    }
+    if (s_page < 0)
+        return 0;
+    s_page_first = newest_first;
+    s_page_fill = page_count((uint32_t)s_page, newest_first);
+    s_read_hint = (uint32_t)s_page;
+    return newest_first + s_page_fill;
+}
+
+static int flash_read(uint32_t* cursor, MatchEvent* out, int max_events)
+{
+    xSemaphoreTake(s_flash_lock, portMAX_DELAY);
+    int n = 0;
+    for (int pass = 0; pass < 3 && n == 0 && (int32_t)(*cursor - s_spilled) < 0; pass++)
+    {
+        page_header_t hdr;
+        int32_t page = find_page(*cursor, &hdr);
+        const uint32_t slot = page < 0 ? PAGE_EVENTS : *cursor - hdr.first_seq;
+        if (slot >= PAGE_EVENTS)
+        {
+            // Older than every page, or in a gap after a page that ended early
+            if (!next_page_first(*cursor, cursor))
+                break;
+            continue;
+        }
+        s_read_hint = (uint32_t)page;
+
+        uint32_t want = (uint32_t)max_events;
+        if (want > PAGE_EVENTS - slot)
+            want = PAGE_EVENTS - slot;
+        if (want > s_spilled - *cursor)
+            want = s_spilled - *cursor;
+        if (esp_partition_read(s_part, page_offset((uint32_t)page, slot), out, want * sizeof(MatchEvent)) != ESP_OK)
+            break;
+        while ((uint32_t)n < want && out[n].type != 0xFF && out[n].seq == (uint16_t)(*cursor + (uint32_t)n))
+            n++;
+        if (n == 0 && !next_page_first(*cursor, cursor))
+            break;
+    }
+    *cursor += (uint32_t)n;
+    xSemaphoreGive(s_flash_lock);
+    return n;
+}
+
+static void flash_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+    if (!s_part || s_part->size < 2 * PAGE_SIZE)
+    {
+        ESP_LOGW(TAG, "No spiffs partition, journal stays in RAM");
+        s_part = NULL;
+        return;
+    }
+    s_pages = s_part->size / PAGE_SIZE;
+    static StaticSemaphore_t s_flash_lock_buf;
+    s_flash_lock = xSemaphoreCreateMutexStatic(&s_flash_lock_buf);
+
+    const uint32_t next = flash_restore();
+    // Continue the previous boot's numbering so flash pages stay ordered
+    uint32_t expected = 0;
+    if (next != 0 && !__atomic_compare_exchange_n(&s_head, &expected, next, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+        ESP_LOGW(TAG, "Events recorded before init, flash spill disabled");
+        s_part = NULL;
+        return;
+    }
+    s_first = next;
+    s_spilled = next;
+
+    if (xTaskCreate(spill_task, "match_log", SPILL_TASK_STACK, NULL, SPILL_TASK_PRIORITY, &s_spill_task) != pdPASS)
+    {
+        ESP_LOGW(TAG, "Spill task unavailable, journal stays in RAM");
+        s_spill_task = NULL;
+        s_part = NULL;
+        return;
+    }
+    ESP_LOGI(TAG, "Flash journal: %lu pages, next seq %lu", (unsigned long)s_pages, (unsigned long)next);
+}
+#endif
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void match_log_init(void)
+{
+#if FLASH_SPILL
+    if (!s_part)
+        flash_init();
+#endif
+}
+
+void match_log_record(MatchEventType type, uint8_t shooter_id, uint8_t victim_id, uint8_t aux, uint16_t detail)
+{
+    const uint32_t seq = __atomic_fetch_add(&s_head, 1, __ATOMIC_RELAXED);
+    MatchEvent* slot = &s_ring[seq & RING_MASK];
+    slot->timestamp_ms = now_ms();
+    slot->type = type;
+    slot->shooter_id = shooter_id;
+    slot->victim_id = victim_id;
+    slot->aux = aux;
+    slot->detail = detail;
+    __atomic_store_n(&slot->seq, (uint16_t)seq, __ATOMIC_RELEASE);
+#if FLASH_SPILL
+    // Wake the spill task twice per lap; the timeout picks up the rest
+    if ((seq & (RING_DEPTH / 2 - 1)) == 0 && s_spill_task)
+        xTaskNotifyGive(s_spill_task);
+#endif
+}
+
+int match_log_read(uint32_t* cursor, MatchEvent* out, int max_events)
+{
+    if (!cursor || !out || max_events <= 0)
+        return 0;
+#if FLASH_SPILL
+    // Older than the RAM ring: serve it from flash
+    const uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    const uint32_t oldest_ram = (int32_t)(head - s_first) > RING_DEPTH ? head - RING_DEPTH : s_first;
+    if (s_part && (int32_t)(*cursor - oldest_ram) < 0)
+    {
+        int n = flash_read(cursor, out, max_events);
+        if (n > 0)
+            return n;
+    }
+#endif
+    return ring_read(cursor, out, max_events);
+}
+
+uint32_t match_log_oldest_seq(void)
+{
+    const uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    uint32_t oldest = (int32_t)(head - s_first) > RING_DEPTH ? head - RING_DEPTH : s_first;
+#if FLASH_SPILL
+    if (s_part)
+    {
+        uint32_t first = 0;
+        xSemaphoreTake(s_flash_lock, portMAX_DELAY);
+        // Any page first_seq is at most one lap of the numbering behind head
+        if (next_page_first(head - 0x80000000u, &first) && (int32_t)(first - oldest) < 0)
+            oldest = first;
+        xSemaphoreGive(s_flash_lock);
+    }
+#endif
+    return oldest;
+}
+
+void match_log_get_stats(MatchLogStats* out)
+{
+    if (!out)
+        return;
+    const uint32_t head = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    out->recorded = head - s_first;
+    out->next_seq = head;
+#if FLASH_SPILL
+    out->spilled = s_spilled_count;
+    out->flash_errors = s_flash_errors;
+#else
+    out->spilled = 0;
+    out->flash_errors = 0;
+#endif
+}
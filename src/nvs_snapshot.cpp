@@ -0,0 +1,522 @@
+#include "nvs_snapshot.h"
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <nvs.h>
+#include <stdlib.h>
+#include <string.h>
+#include "espnow_auth.h"
+#include "game_state.h"
+#include "nvs_store.h"
+#include "wifi_internal.h"
+
+// The baseline lives in NVS too, in a namespace snapshots leave out. It is
+// read and written with the plain NVS API: a few KB is too big for the
+// nvs_store cache and is only touched on request.
+#define BASELINE_NS "nvs_snap"
+#define BASELINE_KEY "factory"
+#define TAKE_SLACK 256 // Room for entries written between sizing and taking
+
+static const char* TAG = "NvsSnapshot";
+
+typedef struct
+{
+    const char* ns;
+    const char* key;
+} secret_t;
+
+// Only the namespaces this component writes are dumped: IDF keeps its own
+// in the same partition (nvs.net80211 holds the station password and PMK,
+// phy the RF calibration) and those must not leave the device.
+static const char* const kNamespaces[] = {
+    NVS_NS_WIFI,
+    NVS_GAME_NS,
+    ESPNOW_AUTH_NVS_NS,
+};
+
+static const secret_t kSecrets[] = {
+    {NVS_NS_WIFI, NVS_KEY_PASS},
+    {ESPNOW_AUTH_NVS_NS, ESPNOW_AUTH_NVS_KEY},
+};
+
+typedef struct
+{
+    const NvsSnapshotEntry* entry;
+    const char* ns;
+    const char* key;
+    const uint8_t* value;
+} entry_view_t;
+
+static bool is_secret(const char* ns, const char* key)
+{
+    for (const secret_t& s : kSecrets)
+    {
+        if (strcmp(s.ns, ns) == 0 && strcmp(s.key, key) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool is_dumped(const char* ns)
+{
+    for (const char* n : kNamespaces)
+    {
+        if (strcmp(n, ns) == 0)
+            return true;
+    }
+    return false;
+}
+
+static size_t int_width(nvs_type_t type)
+{
+    switch (type)
+    {
+        case NVS_TYPE_U8:
+        case NVS_TYPE_I8:
+            return 1;
+        case NVS_TYPE_U16:
+        case NVS_TYPE_I16:
+            return 2;
+        case NVS_TYPE_U32:
+        case NVS_TYPE_I32:
+            return 4;
+        case NVS_TYPE_U64:
+        case NVS_TYPE_I64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+#define READ_NO_ROOM -1
+#define READ_FAILED -2
+
+// Value of one entry into out, or only its size with out == NULL (strings
+// then count their terminator, so sizing is an upper bound). Returns the
+// length, READ_NO_ROOM or READ_FAILED.
+static int read_value(nvs_handle_t h, const nvs_entry_info_t* info, uint8_t* out, size_t room)
+{
+    const size_t width = int_width(info->type);
+    if (width > 0)
+    {
+        if (!out)
+            return (int)width;
+        if (room < width)
+            return READ_NO_ROOM;
+        union
+        {
+            uint8_t u8;
+            int8_t i8;
+            uint16_t u16;
+            int16_t i16;
+            uint32_t u32;
+            int32_t i32;
+            uint64_t u64;
+            int64_t i64;
+        } v = {};
+        esp_err_t err = ESP_FAIL;
+        switch (info->type)
+        {
+            case NVS_TYPE_U8:
+                err = nvs_get_u8(h, info->key, &v.u8);
+                break;
+            case NVS_TYPE_I8:
+                err = nvs_get_i8(h, info->key, &v.i8);
+                break;
+            case NVS_TYPE_U16:
+                err = nvs_get_u16(h, info->key, &v.u16);
+                break;
+            case NVS_TYPE_I16:
+                err = nvs_get_i16(h, info->key, &v.i16);
+                break;
+            case NVS_TYPE_U32:
+                err = nvs_get_u32(h, info->key, &v.u32);
+                break;
+            case NVS_TYPE_I32:
+                err = nvs_get_i32(h, info->key, &v.i32);
+                break;
+            case NVS_TYPE_U64:
+                err = nvs_get_u64(h, info->key, &v.u64);
+                break;
+            default:
+                err = nvs_get_i64(h, info->key, &v.i64);
+                break;
+        }
+        if (err != ESP_OK)
+            return READ_FAILED;
+        memcpy(out, &v, width); // Little endian: the low bytes come first
+        return (int)width;
+    }
+
+    size_t len = 0;
+    if (info->type == NVS_TYPE_STR)
+    {
+        if (nvs_get_str(h, info->key, NULL, &len) != ESP_OK || len == 0)
+            return READ_FAILED;
+        if (!out)
+            return (int)len;
+        if (room < len)
+            return READ_NO_ROOM;
+        if (nvs_get_str(h, info->key, (char*)out, &len) != ESP_OK)
+            return READ_FAILED;
+        return (int)len - 1;
+    }
+    if (info->type == NVS_TYPE_BLOB)
+    {
+        if (nvs_get_blob(h, info->key, NULL, &len) != ESP_OK)
+            return READ_FAILED;
+        if (!out)
+            return (int)len;
+        if (room < len)
+            return READ_NO_ROOM;
+        if (nvs_get_blob(h, info->key, out, &len) != ESP_OK)
+            return READ_FAILED;
+        return (int)len;
+    }
+    return READ_FAILED;
+}
+
+// Append one live entry at *pos (buf == NULL: only advance *pos). An entry
+// that cannot be read is skipped; false means the buffer is full.
+static bool append_live(nvs_handle_t h, const nvs_entry_info_t* info, uint8_t* buf, size_t max_len, size_t* pos,
+                        uint16_t* count)
+{
+    const size_t ns_len = strlen(info->namespace_name);
+    const size_t key_len = strlen(info->key);
+    const size_t head = sizeof(NvsSnapshotEntry) + ns_len + key_len;
+    uint8_t* value = NULL;
+    size_t room = 0;
+    if (buf)
+    {
+        if (*pos + head > max_len)
+            return false;
+        value = buf + *pos + head;
+        room = max_len - *pos - head;
+    }
+
+    int len = read_value(h, info, value, room);
+    if (len == READ_NO_ROOM)
+        return false;
+    if (len < 0)
+    {
+        ESP_LOGW(TAG, "Skipping unreadable %s/%s", info->namespace_name, info->key);
+        return true;
+    }
+
+    // Secrets and values too long for value_len are both replaced by their
+    // CRC32, so a change still shows in a diff
+    uint8_t flags = 0;
+    if (is_secret(info->namespace_name, info->key))
+        flags |= NVS_SNAP_REDACTED;
+    else if (len > UINT16_MAX)
+        flags |= NVS_SNAP_OVERSIZE;
+    if (flags)
+    {
+        if (value)
+        {
+            if (room < sizeof(uint32_t))
+                return false;
+            const uint32_t crc = esp_rom_crc32_le(0, value, (uint32_t)len);
+            memcpy(value, &crc, sizeof(crc));
+            len = sizeof(crc);
+        }
+        else if (len < (int)sizeof(uint32_t))
+        {
+            len = sizeof(uint32_t); // Sizing: the CRC can be longer than the value
+        }
+    }
+
+    if (buf)
+    {
+        NvsSnapshotEntry e = {(uint8_t)info->type, flags, (uint8_t)ns_len, (uint8_t)key_len, (uint16_t)len};
+        memcpy(buf + *pos, &e, sizeof(e));
+        memcpy(buf + *pos + sizeof(e), info->namespace_name, ns_len);
+        memcpy(buf + *pos + sizeof(e) + ns_len, info->key, key_len);
+    }
+    *pos += head + (size_t)len;
+    (*count)++;
+    return true;
+}
+
+static void finish_header(uint8_t* buf, size_t len, uint16_t count, uint8_t flags)
+{
+    NvsSnapshotHeader hdr;
+    hdr.magic = NVS_SNAPSHOT_MAGIC;
+    hdr.version = NVS_SNAPSHOT_VERSION;
+    hdr.flags = flags;
+    hdr.count = count;
+    hdr.length = (uint32_t)len;
+    hdr.crc32 = esp_rom_crc32_le(0, buf + sizeof(hdr), (uint32_t)(len - sizeof(hdr)));
+    memcpy(buf, &hdr, sizeof(hdr));
+}
+
+// One pass over the NVS iterator; buf == NULL only sizes
+static int walk(uint8_t* buf, size_t max_len)
+{
+    size_t pos = sizeof(NvsSnapshotHeader);
+    if (buf && max_len < pos)
+        return -1;
+
+    uint16_t count = 0;
+    bool fits = true;
+    nvs_handle_t handle = 0;
+    bool have_handle = false;
+    char handle_ns[sizeof(((nvs_entry_info_t*)nullptr)->namespace_name)] = "";
+
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY, &it);
+    while (err == ESP_OK && fits)
+    {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        if (is_dumped(info.namespace_name))
+        {
+            // Entries come roughly grouped by namespace; reopen only on a change
+            if (!have_handle || strcmp(handle_ns, info.namespace_name) != 0)
+            {
+                if (have_handle)
+                    nvs_close(handle);
+                have_handle = nvs_open(info.namespace_name, NVS_READONLY, &handle) == ESP_OK;
+                strncpy(handle_ns, info.namespace_name, sizeof(handle_ns) - 1);
+            }
+            if (have_handle)
+                fits = append_live(handle, &info, buf, max_len, &pos, &count);
+        }
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    if (have_handle)
+        nvs_close(handle);
+
+    if (!fits)
+        return -1;
+    if (buf)
+        finish_header(buf, pos, count, 0);
+    return (int)pos;
+}
+
+size_t nvs_snapshot_size(void)
+{
+    int len = walk(NULL, 0);
+    return len > 0 ? (size_t)len : sizeof(NvsSnapshotHeader);
+}
+
+int nvs_snapshot_take(uint8_t* buf, size_t max_len)
+{
+    if (!buf)
+        return -1;
+    nvs_store_flush();
+    return walk(buf, max_len);
+}
+
+// Record at *pos of a snapshot already checked by nvs_snapshot_valid()
+static bool entry_at(const uint8_t* snap, size_t len, size_t* pos, entry_view_t* out)
+{
+    if (*pos + sizeof(NvsSnapshotEntry) > len)
+        return false;
+    const NvsSnapshotEntry* e = (const NvsSnapshotEntry*)(snap + *pos);
+    const size_t total = sizeof(*e) + e->ns_len + e->key_len + e->value_len;
+    if (*pos + total > len)
+        return false;
+    out->entry = e;
+    out->ns = (const char*)(snap + *pos + sizeof(*e));
+    out->key = out->ns + e->ns_len;
+    out->value = (const uint8_t*)out->key + e->key_len;
+    *pos += total;
+    return true;
+}
+
+bool nvs_snapshot_valid(const uint8_t* snap, size_t len)
+{
+    if (!snap || len < sizeof(NvsSnapshotHeader))
+        return false;
+    NvsSnapshotHeader hdr;
+    memcpy(&hdr, snap, sizeof(hdr));
+    if (hdr.magic != NVS_SNAPSHOT_MAGIC || hdr.version != NVS_SNAPSHOT_VERSION || hdr.length != len ||
+        hdr.crc32 != esp_rom_crc32_le(0, snap + sizeof(hdr), (uint32_t)(len - sizeof(hdr))))
+        return false;
+
+    size_t pos = sizeof(hdr);
+    entry_view_t v;
+    for (uint16_t i = 0; i < hdr.count; i++)
+    {
+        if (!entry_at(snap, len, &pos, &v))
+            return false;
+    }
+    return pos == len;
+}
+
+static bool same_key(const entry_view_t* a, const entry_view_t* b)
+{
+    return a->entry->ns_len == b->entry->ns_len && a->entry->key_len == b->entry->key_len &&
+           memcmp(a->ns, b->ns, a->entry->ns_len) == 0 && memcmp(a->key, b->key, a->entry->key_len) == 0;
+}
+
+static bool same_value(const entry_view_t* a, const entry_view_t* b)
+{
+    return a->entry->type == b->entry->type && a->entry->flags == b->entry->flags &&
+           a->entry->value_len == b->entry->value_len && memcmp(a->value, b->value, a->entry->value_len) == 0;
+}
+
+static bool find_entry(const uint8_t* snap, size_t len, const entry_view_t* like, entry_view_t* out)
+{
+    if (!snap)
+        return false;
+    const NvsSnapshotHeader* hdr = (const NvsSnapshotHeader*)snap;
+    size_t pos = sizeof(*hdr);
+    for (uint16_t i = 0; i < hdr->count && entry_at(snap, len, &pos, out); i++)
+    {
+        if (same_key(out, like))
+            return true;
+    }
+    return false;
+}
+
+static bool append_view(uint8_t* out, size_t max_len, size_t* pos, const entry_view_t* v, uint8_t flags)
+{
+    const NvsSnapshotEntry* e = v->entry;
+    const size_t total = sizeof(*e) + e->ns_len + e->key_len + e->value_len;
+    if (*pos + total > max_len)
+        return false;
+    NvsSnapshotEntry copy = *e;
+    copy.flags = (uint8_t)((e->flags & (NVS_SNAP_REDACTED | NVS_SNAP_OVERSIZE)) | flags);
+    memcpy(out + *pos, &copy, sizeof(copy));
+    memcpy(out + *pos + sizeof(copy), v->ns, total - sizeof(copy)); // ns, key and value are contiguous
+    *pos += total;
+    return true;
+}
+
+int nvs_snapshot_diff(const uint8_t* base, size_t base_len, const uint8_t* cur, size_t cur_len, uint8_t* out,
+                      size_t max_len)
+{
+    if ((base && !nvs_snapshot_valid(base, base_len)) || !nvs_snapshot_valid(cur, cur_len) || !out ||
+        max_len < sizeof(NvsSnapshotHeader))
+        return -1;
+
+    size_t pos = sizeof(NvsSnapshotHeader);
+    uint16_t count = 0;
+    entry_view_t v, match;
+
+    // Added and changed, with the current value
+    size_t at = sizeof(NvsSnapshotHeader);
+    for (uint16_t i = 0; i < ((const NvsSnapshotHeader*)cur)->count && entry_at(cur, cur_len, &at, &v); i++)
+    {
+        uint8_t flags;
+        if (!find_entry(base, base_len, &v, &match))
+            flags = NVS_SNAP_ADDED;
+        else if (!same_value(&v, &match))
+            flags = NVS_SNAP_CHANGED;
+        else
+            continue;
+        if (!append_view(out, max_len, &pos, &v, flags))
+            return -1;
+        count++;
+    }
+
+    // Removed, with the baseline value
+    at = sizeof(NvsSnapshotHeader);
+    for (uint16_t i = 0; base && i < ((const NvsSnapshotHeader*)base)->count && entry_at(base, base_len, &at, &v);
+         i++)
+    {
+        if (find_entry(cur, cur_len, &v, &match))
+            continue;
+        if (!append_view(out, max_len, &pos, &v, NVS_SNAP_REMOVED))
+            return -1;
+        count++;
+    }
+
+    finish_header(out, pos, count, NVS_SNAPSHOT_FLAG_DIFF);
+    return (int)pos;
+}
+
+uint8_t* nvs_snapshot_alloc(size_t* out_len)
+{
+    if (!out_len)
+        return NULL;
+    const size_t cap = nvs_snapshot_size() + TAKE_SLACK;
+    uint8_t* buf = (uint8_t*)malloc(cap);
+    if (!buf)
+        return NULL;
+    int len = nvs_snapshot_take(buf, cap);
+    if (len < 0)
+    {
+        free(buf);
+        return NULL;
+    }
+    *out_len = (size_t)len;
+    return buf;
+}
+
+bool nvs_snapshot_save_baseline(void)
+{
+    size_t len = 0;
+    uint8_t* snap = nvs_snapshot_alloc(&len);
+    if (!snap)
+        return false;
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(BASELINE_NS, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, BASELINE_KEY, snap, len);
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    free(snap);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Baseline not saved: %s", esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "Baseline saved (%u bytes)", (unsigned)len);
+    return true;
+}
+
+// Stored baseline in a malloc()ed buffer, or NULL if there is none
+static uint8_t* load_baseline(size_t* out_len)
+{
+    nvs_handle_t handle;
+    if (nvs_open(BASELINE_NS, NVS_READONLY, &handle) != ESP_OK)
+        return NULL;
+    size_t len = 0;
+    uint8_t* buf = NULL;
+    if (nvs_get_blob(handle, BASELINE_KEY, NULL, &len) == ESP_OK && len > 0)
+    {
+        buf = (uint8_t*)malloc(len);
+        if (buf && (nvs_get_blob(handle, BASELINE_KEY, buf, &len) != ESP_OK || !nvs_snapshot_valid(buf, len)))
+        {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    nvs_close(handle);
+    *out_len = len;
+    return buf;
+}
+
+uint8_t* nvs_snapshot_diff_baseline(size_t* out_len)
+{
+    if (!out_len)
+        return NULL;
+    size_t cur_len = 0;
+    uint8_t* cur = nvs_snapshot_alloc(&cur_len);
+    if (!cur)
+        return NULL;
+    size_t base_len = 0;
+    uint8_t* base = load_baseline(&base_len);
+
+    // Every record of either side at most once
+    const size_t cap = cur_len + (base ? base_len : 0);
+    uint8_t* out = (uint8_t*)malloc(cap);
+    int len = out ? nvs_snapshot_diff(base, base_len, cur, cur_len, out, cap) : -1;
+    free(base);
+    free(cur);
+    if (len < 0)
+    {
+        free(out);
+        return NULL;
+    }
+    *out_len = (size_t)len;
+    return out;
+}
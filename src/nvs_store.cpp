@@ -2,54 +2,433 @@
 #include <esp_log.h>
 #include <nvs.h>
 #include <nvs_flash.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
 static const char* TAG = "NVSStore";
 
-bool nvs_store_read_str(const char* ns, const char* key, char* out, size_t max_len)
+#ifndef CONFIG_RAYZ_NVS_WRITEBACK_MS
+#define CONFIG_RAYZ_NVS_WRITEBACK_MS 500
+#endif
+
+#define CACHE_ENTRIES 16
+#define MAX_NAMESPACES 4
+#define CACHE_STR_MAX 65 // Fits SSID and password; longer strings bypass the cache
+#define CACHE_BLOB_MAX 512
+#define WRITEBACK_TASK_STACK 3072
+#define WRITEBACK_TASK_PRIORITY 1
+
+// Write-back cache of individual keys. Reads are served from RAM after the
+// first access, writes only mark the entry dirty; the write-back task stores
+// dirty entries once writes have been quiet for CONFIG_RAYZ_NVS_WRITEBACK_MS,
+// with one nvs_commit per namespace. Writing an unchanged value is free.
+
+typedef enum
 {
-    if (!ns || !key || !out)
-        return false;
+    ENTRY_EMPTY = 0,
+    ENTRY_U8,
+    ENTRY_U32,
+    ENTRY_STR,
+    ENTRY_BLOB,
+} entry_type_t;
+
+typedef struct
+{
+    char ns[NVS_NS_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;   // entry_type_t
+    bool present;   // false = known to be absent from flash
+    bool dirty;     // RAM value not yet stored
+    uint16_t seq;   // Bumped on every change; guards against racing write-back
+    uint32_t num;   // Value, or blob length
+    char str[CACHE_STR_MAX];
+    uint8_t* blob;  // Heap copy, ENTRY_BLOB only
+} cache_entry_t;
+
+typedef struct
+{
+    char name[NVS_NS_NAME_MAX_SIZE];
     nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK)
-        return false;
-    size_t required = max_len;
-    esp_err_t err = nvs_get_str(handle, key, out, &required);
-    nvs_close(handle);
-    if (err == ESP_OK)
-        return true;
+} ns_handle_t;
+
+static cache_entry_t s_cache[CACHE_ENTRIES];
+static ns_handle_t s_handles[MAX_NAMESPACES];
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_wb_task = NULL;
+static uint32_t s_txn_depth = 0;
+static portMUX_TYPE s_init_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void entry_reset(cache_entry_t* e)
+{
+    free(e->blob);
+    memset(e, 0, sizeof(*e));
+}
+
+static bool lock(void)
+{
+    if (!s_lock)
+    {
+        static StaticSemaphore_t s_lock_buf;
+        portENTER_CRITICAL(&s_init_mux);
+        if (!s_lock)
+            s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+        portEXIT_CRITICAL(&s_init_mux);
+    }
+    return xSemaphoreTake(s_lock, portMAX_DELAY) == pdTRUE;
+}
+
+static void unlock(void)
+{
+    xSemaphoreGive(s_lock);
+}
+
+// Handles stay open for the lifetime of the app; caller holds the lock
+static bool get_handle(const char* ns, nvs_handle_t* out)
+{
+    for (int i = 0; i < MAX_NAMESPACES; i++)
+    {
+        if (s_handles[i].name[0] && strncmp(s_handles[i].name, ns, sizeof(s_handles[i].name)) == 0)
+        {
+            *out = s_handles[i].handle;
+            return true;
+        }
+    }
+    for (int i = 0; i < MAX_NAMESPACES; i++)
+    {
+        if (s_handles[i].name[0] == '\0')
+        {
+            if (nvs_open(ns, NVS_READWRITE, &s_handles[i].handle) != ESP_OK)
+                return false;
+            strncpy(s_handles[i].name, ns, sizeof(s_handles[i].name) - 1);
+            *out = s_handles[i].handle;
+            return true;
+        }
+    }
+    ESP_LOGW(TAG, "No namespace slot for %s", ns);
     return false;
 }
 
-bool nvs_store_write_str(const char* ns, const char* key, const char* value)
+static bool name_fits(const char* ns, const char* key)
+{
+    return strlen(ns) < NVS_NS_NAME_MAX_SIZE && strlen(key) < NVS_KEY_NAME_MAX_SIZE;
+}
+
+static cache_entry_t* find_entry(const char* ns, const char* key)
+{
+    for (int i = 0; i < CACHE_ENTRIES; i++)
+    {
+        cache_entry_t* e = &s_cache[i];
+        if (e->type != ENTRY_EMPTY && strcmp(e->key, key) == 0 && strcmp(e->ns, ns) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+// Finds or claims an entry; only clean entries are ever evicted
+static cache_entry_t* claim_entry(const char* ns, const char* key)
+{
+    cache_entry_t* e = find_entry(ns, key);
+    if (e)
+        return e;
+    if (!name_fits(ns, key))
+        return NULL;
+    cache_entry_t* victim = NULL;
+    for (int i = 0; i < CACHE_ENTRIES; i++)
+    {
+        if (s_cache[i].type == ENTRY_EMPTY)
+        {
+            victim = &s_cache[i];
+            break;
+        }
+        if (!victim && !s_cache[i].dirty)
+            victim = &s_cache[i];
+    }
+    if (!victim)
+        return NULL;
+    entry_reset(victim);
+    strcpy(victim->ns, ns);
+    strcpy(victim->key, key);
+    return victim;
+}
+
+static void writeback_task(void* arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Coalesce: restart the window while writes keep arriving
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_RAYZ_NVS_WRITEBACK_MS)) != 0)
+        {
+        }
+        nvs_store_flush();
+    }
+}
+
+// Caller holds the lock
+static void schedule_writeback(void)
+{
+    if (s_txn_depth > 0)
+        return; // nvs_store_commit() schedules it
+    if (!s_wb_task &&
+        xTaskCreate(writeback_task, "nvs_wb", WRITEBACK_TASK_STACK, NULL, WRITEBACK_TASK_PRIORITY, &s_wb_task) != pdPASS)
+    {
+        s_wb_task = NULL;
+        ESP_LOGW(TAG, "Write-back task unavailable, storing immediately");
+        unlock();
+        nvs_store_flush();
+        lock();
+        return;
+    }
+    xTaskNotifyGive(s_wb_task);
+}
+
+// Value of one key as passed in by a writer: num for integers, data/len for
+// strings (len includes the terminator) and blobs
+typedef struct
+{
+    uint32_t num;
+    const void* data;
+    size_t len;
+} value_t;
+
+static esp_err_t set_value(nvs_handle_t handle, const char* key, entry_type_t type, const value_t* v)
+{
+    switch (type)
+    {
+    case ENTRY_U8:
+        return nvs_set_u8(handle, key, (uint8_t)v->num);
+    case ENTRY_U32:
+        return nvs_set_u32(handle, key, v->num);
+    case ENTRY_STR:
+        return nvs_set_str(handle, key, (const char*)v->data);
+    default:
+        return nvs_set_blob(handle, key, v->data, v->len);
+    }
+}
+
+// Loads a key into the cache on first access. Caller holds the lock.
+static cache_entry_t* load_entry(const char* ns, const char* key, entry_type_t type)
+{
+    cache_entry_t* e = find_entry(ns, key);
+    if (e && e->type == type)
+        return e;
+    if (e && e->dirty)
+        return NULL; // Pending write of another type; read straight from flash
+
+    nvs_handle_t handle;
+    if (!get_handle(ns, &handle))
+        return NULL;
+    e = claim_entry(ns, key);
+    if (!e)
+        return NULL;
+
+    esp_err_t err;
+    if (type == ENTRY_U8)
+    {
+        uint8_t v = 0;
+        err = nvs_get_u8(handle, key, &v);
+        e->num = v;
+    }
+    else if (type == ENTRY_U32)
+    {
+        err = nvs_get_u32(handle, key, &e->num);
+    }
+    else if (type == ENTRY_STR)
+    {
+        size_t len = sizeof(e->str);
+        err = nvs_get_str(handle, key, e->str, &len);
+    }
+    else
+    {
+        size_t len = 0;
+        err = nvs_get_blob(handle, key, NULL, &len);
+        if (err == ESP_OK && len > CACHE_BLOB_MAX)
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        if (err == ESP_OK && len > 0)
+        {
+            e->blob = (uint8_t*)malloc(len);
+            err = e->blob ? nvs_get_blob(handle, key, e->blob, &len) : ESP_ERR_NO_MEM;
+        }
+        e->num = (uint32_t)len;
+    }
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+    {
+        entry_reset(e); // Unreadable or too long to cache
+        return NULL;
+    }
+    e->type = type;
+    e->present = err == ESP_OK;
+    return e;
+}
+
+// Uncached paths, used when the cache cannot hold the key
+static bool direct_read(const char* ns, const char* key, entry_type_t type, void* out, size_t* len)
 {
-    if (!ns || !key || !value)
-        return false;
     nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READWRITE, &handle) != ESP_OK)
+    if (!get_handle(ns, &handle))
         return false;
-    esp_err_t err = nvs_set_str(handle, key, value);
-    if (err == ESP_OK)
-        err = nvs_commit(handle);
-    nvs_close(handle);
-    if (err != ESP_OK)
+    if (type == ENTRY_U8)
+        return nvs_get_u8(handle, key, (uint8_t*)out) == ESP_OK;
+    if (type == ENTRY_U32)
+        return nvs_get_u32(handle, key, (uint32_t*)out) == ESP_OK;
+    if (type == ENTRY_STR)
+        return nvs_get_str(handle, key, (char*)out, len) == ESP_OK;
+    return nvs_get_blob(handle, key, out, len) == ESP_OK;
+}
+
+static bool cacheable(entry_type_t type, const value_t* v)
+{
+    if (type == ENTRY_STR)
+        return v->len <= CACHE_STR_MAX;
+    if (type == ENTRY_BLOB)
+        return v->len <= CACHE_BLOB_MAX;
+    return true;
+}
+
+static bool same_value(const cache_entry_t* e, entry_type_t type, const value_t* v)
+{
+    if (e->type != type || !e->present)
+        return false;
+    if (type == ENTRY_STR)
+        return strcmp(e->str, (const char*)v->data) == 0;
+    if (type == ENTRY_BLOB)
+        return e->num == v->len && (v->len == 0 || memcmp(e->blob, v->data, v->len) == 0);
+    return e->num == v->num;
+}
+
+// Copies v into e; false if a blob copy cannot be allocated
+static bool store_value(cache_entry_t* e, entry_type_t type, const value_t* v)
+{
+    if (type == ENTRY_BLOB)
     {
-        ESP_LOGE(TAG, "Failed write %s:%s err=%d", ns, key, err);
+        uint8_t* copy = NULL;
+        if (v->len > 0)
+        {
+            copy = (uint8_t*)malloc(v->len);
+            if (!copy)
+                return false;
+            memcpy(copy, v->data, v->len);
+        }
+        free(e->blob);
+        e->blob = copy;
+        e->num = (uint32_t)v->len;
+    }
+    else if (type == ENTRY_STR)
+    {
+        memcpy(e->str, v->data, v->len);
+    }
+    else
+    {
+        e->num = v->num;
+    }
+    e->type = type;
+    e->present = true;
+    return true;
+}
+
+static bool cached_write(const char* ns, const char* key, entry_type_t type, const value_t* v)
+{
+    if (!lock())
         return false;
+    cache_entry_t* e = NULL;
+    if (cacheable(type, v))
+    {
+        e = load_entry(ns, key, type);
+        if (!e)
+        {
+            // Not in flash with this type (or unreadable): take a fresh entry
+            e = claim_entry(ns, key);
+            if (e && e->dirty && e->type != type)
+                e = NULL;
+        }
+    }
+
+    if (e && !same_value(e, type, v))
+    {
+        if (store_value(e, type, v))
+        {
+            e->dirty = true;
+            e->seq++;
+            schedule_writeback();
+        }
+        else
+        {
+            e = NULL;
+        }
+    }
+
+    if (!e)
+    {
+        // Store synchronously; this write supersedes any cached copy
+        cache_entry_t* stale = find_entry(ns, key);
+        if (stale)
+            entry_reset(stale);
+        nvs_handle_t handle;
+        esp_err_t err = get_handle(ns, &handle) ? set_value(handle, key, type, v) : ESP_FAIL;
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        unlock();
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed write %s:%s err=%d", ns, key, err);
+            return false;
+        }
+        return true;
     }
+    unlock();
     return true;
 }
 
+bool nvs_store_read_str(const char* ns, const char* key, char* out, size_t max_len)
+{
+    if (!ns || !key || !out || max_len == 0)
+        return false;
+    if (!lock())
+        return false;
+    bool ok;
+    cache_entry_t* e = load_entry(ns, key, ENTRY_STR);
+    if (e)
+    {
+        ok = e->present && strlen(e->str) < max_len;
+        if (ok)
+            strcpy(out, e->str);
+    }
+    else
+    {
+        ok = direct_read(ns, key, ENTRY_STR, out, &max_len);
+    }
+    unlock();
+    return ok;
+}
+
+bool nvs_store_write_str(const char* ns, const char* key, const char* value)
+{
+    if (!ns || !key || !value)
+        return false;
+    value_t v = {0, value, strlen(value) + 1};
+    return cached_write(ns, key, ENTRY_STR, &v);
+}
+
 bool nvs_store_erase_namespace(const char* ns)
 {
     if (!ns)
         return false;
-    nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READWRITE, &handle) != ESP_OK)
+    if (!lock())
         return false;
-    esp_err_t err = nvs_erase_all(handle);
+    for (int i = 0; i < CACHE_ENTRIES; i++)
+    {
+        if (s_cache[i].type != ENTRY_EMPTY && strcmp(s_cache[i].ns, ns) == 0)
+            entry_reset(&s_cache[i]); // Pending writes are discarded too
+    }
+    nvs_handle_t handle;
+    esp_err_t err = get_handle(ns, &handle) ? nvs_erase_all(handle) : ESP_FAIL;
     if (err == ESP_OK)
         err = nvs_commit(handle);
-    nvs_close(handle);
+    unlock();
     return err == ESP_OK;
 }
 
@@ -57,50 +436,190 @@ bool nvs_store_read_u8(const char* ns, const char* key, uint8_t* out)
 {
     if (!ns || !key || !out)
         return false;
-    nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK)
+    if (!lock())
         return false;
-    esp_err_t err = nvs_get_u8(handle, key, out);
-    nvs_close(handle);
-    return err == ESP_OK;
+    bool ok;
+    cache_entry_t* e = load_entry(ns, key, ENTRY_U8);
+    if (e)
+    {
+        ok = e->present;
+        if (ok)
+            *out = (uint8_t)e->num;
+    }
+    else
+    {
+        ok = direct_read(ns, key, ENTRY_U8, out, NULL);
+    }
+    unlock();
+    return ok;
 }
 
 bool nvs_store_write_u8(const char* ns, const char* key, uint8_t value)
 {
     if (!ns || !key)
         return false;
-    nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READWRITE, &handle) != ESP_OK)
-        return false;
-    esp_err_t err = nvs_set_u8(handle, key, value);
-    if (err == ESP_OK)
-        err = nvs_commit(handle);
-    nvs_close(handle);
-    return err == ESP_OK;
+    value_t v = {value, NULL, 0};
+    return cached_write(ns, key, ENTRY_U8, &v);
 }
 
 bool nvs_store_read_u32(const char* ns, const char* key, uint32_t* out)
 {
     if (!ns || !key || !out)
         return false;
-    nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK)
+    if (!lock())
         return false;
-    esp_err_t err = nvs_get_u32(handle, key, out);
-    nvs_close(handle);
-    return err == ESP_OK;
+    bool ok;
+    cache_entry_t* e = load_entry(ns, key, ENTRY_U32);
+    if (e)
+    {
+        ok = e->present;
+        if (ok)
+            *out = e->num;
+    }
+    else
+    {
+        ok = direct_read(ns, key, ENTRY_U32, out, NULL);
+    }
+    unlock();
+    return ok;
 }
 
 bool nvs_store_write_u32(const char* ns, const char* key, uint32_t value)
 {
     if (!ns || !key)
         return false;
-    nvs_handle_t handle;
-    if (nvs_open(ns, NVS_READWRITE, &handle) != ESP_OK)
+    value_t v = {value, NULL, 0};
+    return cached_write(ns, key, ENTRY_U32, &v);
+}
+
+bool nvs_store_read_blob(const char* ns, const char* key, void* out, size_t* len)
+{
+    if (!ns || !key || !out || !len)
         return false;
-    esp_err_t err = nvs_set_u32(handle, key, value);
-    if (err == ESP_OK)
-        err = nvs_commit(handle);
-    nvs_close(handle);
-    return err == ESP_OK;
+    if (!lock())
+        return false;
+    bool ok;
+    cache_entry_t* e = load_entry(ns, key, ENTRY_BLOB);
+    if (e)
+    {
+        ok = e->present && e->num <= *len;
+        if (ok)
+        {
+            if (e->num > 0)
+                memcpy(out, e->blob, e->num);
+            *len = e->num;
+        }
+    }
+    else
+    {
+        ok = direct_read(ns, key, ENTRY_BLOB, out, len);
+    }
+    unlock();
+    return ok;
+}
+
+bool nvs_store_write_blob(const char* ns, const char* key, const void* data, size_t len)
+{
+    if (!ns || !key || (!data && len > 0))
+        return false;
+    value_t v = {0, data, len};
+    return cached_write(ns, key, ENTRY_BLOB, &v);
+}
+
+void nvs_store_begin(void)
+{
+    if (!lock())
+        return;
+    s_txn_depth++;
+    unlock();
+}
+
+void nvs_store_commit(void)
+{
+    if (!lock())
+        return;
+    if (s_txn_depth > 0)
+        s_txn_depth--;
+    bool pending = false;
+    for (int i = 0; i < CACHE_ENTRIES && !pending; i++)
+        pending = s_cache[i].type != ENTRY_EMPTY && s_cache[i].dirty;
+    if (pending)
+        schedule_writeback();
+    unlock();
+}
+
+bool nvs_store_flush(void)
+{
+    if (!lock())
+        return false;
+    if (s_txn_depth > 0)
+    {
+        unlock();
+        return true; // The group is still being written; commit reschedules
+    }
+
+    bool ok = true;
+    nvs_handle_t touched[MAX_NAMESPACES];
+    int touched_count = 0;
+
+    for (int i = 0; i < CACHE_ENTRIES; i++)
+    {
+        cache_entry_t* e = &s_cache[i];
+        if (e->type == ENTRY_EMPTY || !e->dirty)
+            continue;
+
+        // Store a snapshot without holding the lock across the flash write,
+        // readers keep hitting the cache meanwhile
+        nvs_handle_t handle;
+        if (!get_handle(e->ns, &handle))
+        {
+            ok = false;
+            continue;
+        }
+        cache_entry_t snap = *e;
+        snap.blob = NULL;
+        value_t v = {snap.num, snap.str, 0};
+        if (snap.type == ENTRY_BLOB)
+        {
+            snap.blob = (uint8_t*)malloc(snap.num ? snap.num : 1);
+            if (!snap.blob)
+            {
+                ok = false;
+                continue;
+            }
+            memcpy(snap.blob, e->blob, snap.num);
+            v.data = snap.blob;
+            v.len = snap.num;
+        }
+        unlock();
+
+        esp_err_t err = set_value(handle, snap.key, (entry_type_t)snap.type, &v);
+        free(snap.blob);
+
+        lock();
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed write %s:%s err=%d", snap.ns, snap.key, err);
+            ok = false;
+            continue; // Stays dirty, retried on the next flush
+        }
+        // A newer value written meanwhile stays dirty
+        if (e->type == snap.type && e->seq == snap.seq && strcmp(e->key, snap.key) == 0 &&
+            strcmp(e->ns, snap.ns) == 0)
+            e->dirty = false;
+
+        int t = 0;
+        while (t < touched_count && touched[t] != handle)
+            t++;
+        if (t == touched_count && touched_count < MAX_NAMESPACES)
+            touched[touched_count++] = handle;
+    }
+    unlock();
+
+    for (int t = 0; t < touched_count; t++)
+    {
+        if (nvs_commit(touched[t]) != ESP_OK)
+            ok = false;
+    }
+    return ok;
 }
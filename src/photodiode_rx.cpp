@@ -0,0 +1,286 @@
+#include "photodiode_rx.h"
+#include <driver/rmt_rx.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "protocol_config.h"
+#include "runtime_metrics.h"
+
+#ifndef CONFIG_RAYZ_PHOTODIODE_RING_DEPTH
+#define CONFIG_RAYZ_PHOTODIODE_RING_DEPTH 16
+#endif
+#define RING_DEPTH CONFIG_RAYZ_PHOTODIODE_RING_DEPTH
+#define RING_MASK (RING_DEPTH - 1)
+static_assert((RING_DEPTH & RING_MASK) == 0, "CONFIG_RAYZ_PHOTODIODE_RING_DEPTH must be a power of two");
+
+// 80 MHz / 256: the slowest tick the RMT divider allows. It keeps the idle
+// threshold of a Classic frame (32.5 bits of 3 ms) inside the 15-bit counter
+// while still resolving 3.2 us.
+#define RMT_RESOLUTION_HZ 312500
+#define RMT_TICK_NS (1000000000u / RMT_RESOLUTION_HZ)
+#define RMT_IDLE_MAX_TICKS 32767
+#define RMT_GLITCH_NS 2000
+#define CAPTURE_SYMBOLS 64 // One frame is at most 17 symbols (33 runs)
+
+#define DECODER_TASK_STACK 3072
+#define DECODER_TASK_PRIORITY (configMAX_PRIORITIES - 3)
+
+static const char* TAG = "PhotodiodeRx";
+
+static rmt_channel_handle_t s_channel = NULL;
+static TaskHandle_t s_task = NULL;
+static rmt_symbol_word_t s_symbols[2][CAPTURE_SYMBOLS]; // Ping-pong capture buffers
+static volatile size_t s_done_symbols = 0;
+static volatile int64_t s_done_us = 0;
+static uint8_t s_profile = LASER_PROFILE_CLASSIC;
+static uint32_t s_bit_q8 = 0; // Bit period estimate in us, Q8; decoder task only
+
+// SPSC ring: the decoder task produces, one consumer task drains
+static PhotodiodeFrame s_ring[RING_DEPTH];
+static uint32_t s_head = 0;
+static uint32_t s_tail = 0;
+static SemaphoreHandle_t s_ready = NULL;
+static PhotodiodeRxStats s_stats = {0, 0, 0, 0, 0, RING_DEPTH};
+
+static bool IRAM_ATTR rx_done_cb(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t* edata, void* arg)
+{
+    (void)channel;
+    (void)arg;
+    s_done_us = esp_timer_get_time();
+    s_done_symbols = edata->num_symbols;
+    BaseType_t hp_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_task, &hp_task_woken);
+    return hp_task_woken == pdTRUE;
+}
+
+static void arm_capture(int buf)
+{
+    // Shorter than every profile's pause_ms (checked in protocol_config.h),
+    // so frames sent at the shot rate floor end up in separate captures
+    uint32_t idle_ns = laser_idle_gap_us(__atomic_load_n(&s_profile, __ATOMIC_RELAXED)) * 1000;
+    if (idle_ns > RMT_IDLE_MAX_TICKS * RMT_TICK_NS)
+        idle_ns = RMT_IDLE_MAX_TICKS * RMT_TICK_NS;
+
+    rmt_receive_config_t cfg = {};
+    cfg.signal_range_min_ns = RMT_GLITCH_NS;
+    cfg.signal_range_max_ns = idle_ns;
+    esp_err_t err = rmt_receive(s_channel, s_symbols[buf], sizeof(s_symbols[buf]), &cfg);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "rmt_receive failed: %s", esp_err_to_name(err));
+}
+
+static void ring_push(const PhotodiodeFrame* frame)
+{
+    uint32_t head = s_head;
+    uint32_t used = head - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE);
+    if (used >= RING_DEPTH)
+    {
+        __atomic_fetch_add(&s_stats.overflows, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    s_ring[head & RING_MASK] = *frame;
+    __atomic_store_n(&s_head, head + 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&s_stats.frames, 1, __ATOMIC_RELAXED);
+    if (used + 1 > s_stats.high_watermark)
+        __atomic_store_n(&s_stats.high_watermark, (uint16_t)(used + 1), __ATOMIC_RELAXED);
+    xSemaphoreGive(s_ready);
+}
+
+// Run-length decode of one capture. Returns false if it is not a frame.
+static bool decode_capture(const rmt_symbol_word_t* symbols, size_t count, uint8_t profile, PhotodiodeFrame* out)
+{
+    const LaserTimingProfile* p = laser_timing_profile(profile);
+    const uint32_t nominal_q8 = (uint32_t)p->bit_us << 8;
+    if (s_bit_q8 == 0 || s_bit_q8 > nominal_q8 + nominal_q8 / 4 || s_bit_q8 < nominal_q8 - nominal_q8 / 4)
+        s_bit_q8 = nominal_q8; // Profile changed or estimate drifted away
+
+    uint32_t bits = 0;
+    uint32_t nbits = 0;
+    uint32_t total_ticks = 0;
+    bool start_seen = false;
+
+    for (size_t i = 0; i < count * 2; i++)
+    {
+        const rmt_symbol_word_t* sym = &symbols[i / 2];
+        uint32_t ticks = (i & 1) ? sym->duration1 : sym->duration0;
+        uint32_t level = (i & 1) ? sym->level1 : sym->level0;
+        if (ticks == 0)
+            break; // End marker: the line went idle
+        total_ticks += ticks;
+        uint32_t run_q8 = (uint32_t)(((uint64_t)ticks * RMT_TICK_NS << 8) / 1000);
+
+        uint32_t n = (run_q8 + s_bit_q8 / 2) / s_bit_q8;
+        if (!start_seen)
+        {
+            // The first mark is the start mark, possibly merged with leading 1 bits
+            if (!level || n < LASER_START_BITS)
+                return false;
+            if (n == LASER_START_BITS)
+            {
+                // Track the emitter's bit period (EMA, 1/8 step)
+                int32_t err = (int32_t)(run_q8 / LASER_START_BITS) - (int32_t)s_bit_q8;
+                s_bit_q8 = (uint32_t)((int32_t)s_bit_q8 + err / 8);
+            }
+            n -= LASER_START_BITS;
+            start_seen = true;
+            if (n == 0)
+                continue;
+        }
+
+        if (n == 0 || nbits + n > p->frame_bits)
+            return false;
+        for (uint32_t k = 0; k < n; k++)
+            bits = (bits << 1) | (level ? 1u : 0u);
+        nbits += n;
+    }
+
+    if (!start_seen)
+        return false;
+    // Trailing zeros run into the idle gap
+    if (nbits < p->frame_bits)
+        bits <<= (p->frame_bits - nbits);
+    if (p->frame_bits < 32)
+        bits &= (1u << p->frame_bits) - 1;
+
+    out->bits = bits;
+    out->nbits = p->frame_bits;
+    out->profile = profile;
+    out->timestamp_us = s_done_us - laser_idle_gap_us(profile) - (int64_t)total_ticks * RMT_TICK_NS / 1000;
+    return true;
+}
+
+static void decoder_task(void* arg)
+{
+    (void)arg;
+    int buf = 0;
+    arm_capture(buf);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        size_t count = s_done_symbols;
+        int done = buf;
+
+        // Re-arm on the other buffer before decoding. Edges that arrive between
+        // the done interrupt and this call are lost; the pause after the idle
+        // timeout leaves LASER_REARM_MARGIN_US for the wakeup.
+        buf ^= 1;
+        arm_capture(buf);
+
+        uint8_t profile = __atomic_load_n(&s_profile, __ATOMIC_RELAXED);
+        PhotodiodeFrame frame;
+        METRICS_CYCLES_BEGIN(decode_start);
+        bool decoded = decode_capture(s_symbols[done], count, profile, &frame);
+        METRICS_CYCLES_END(METRICS_HIST_PHOTODIODE_DECODE, decode_start);
+        if (decoded)
+            ring_push(&frame);
+        else
+            __atomic_fetch_add(&s_stats.invalid, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&s_stats.bit_period_us, s_bit_q8 >> 8, __ATOMIC_RELAXED);
+    }
+}
+
+esp_err_t photodiode_rx_init(int gpio, bool active_low, uint8_t profile)
+{
+    if (s_channel)
+        return ESP_OK;
+
+    s_profile = profile < LASER_PROFILE_COUNT ? profile : LASER_PROFILE_CLASSIC;
+    s_ready = xSemaphoreCreateBinary();
+    if (!s_ready)
+        return ESP_ERR_NO_MEM;
+
+    rmt_rx_channel_config_t cfg = {};
+    cfg.gpio_num = (gpio_num_t)gpio;
+    cfg.clk_src = RMT_CLK_SRC_DEFAULT;
+    cfg.resolution_hz = RMT_RESOLUTION_HZ;
+    cfg.mem_block_symbols = CAPTURE_SYMBOLS;
+    cfg.flags.invert_in = active_low;
+    esp_err_t err = rmt_new_rx_channel(&cfg, &s_channel);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "rmt_new_rx_channel failed: %s", esp_err_to_name(err));
+        s_channel = NULL;
+        vSemaphoreDelete(s_ready);
+        s_ready = NULL;
+        return err;
+    }
+
+    rmt_rx_event_callbacks_t cbs = {};
+    cbs.on_recv_done = rx_done_cb;
+    rmt_rx_register_event_callbacks(s_channel, &cbs, NULL);
+    rmt_enable(s_channel);
+
+    // Same core as the caller: the game task consuming the ring
+    if (xTaskCreatePinnedToCore(decoder_task, "pd_rx", DECODER_TASK_STACK, NULL, DECODER_TASK_PRIORITY, &s_task,
+                                xPortGetCoreID()) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create decoder task");
+        rmt_disable(s_channel);
+        rmt_del_channel(s_channel);
+        s_channel = NULL;
+        vSemaphoreDelete(s_ready);
+        s_ready = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Edge capture on GPIO %d, profile %u", gpio, s_profile);
+    return ESP_OK;
+}
+
+void photodiode_rx_set_profile(uint8_t profile)
+{
+    if (profile < LASER_PROFILE_COUNT)
+        __atomic_store_n(&s_profile, profile, __ATOMIC_RELAXED);
+}
+
+static bool ring_pop(PhotodiodeFrame* out)
+{
+    uint32_t tail = s_tail;
+    if (tail == __atomic_load_n(&s_head, __ATOMIC_ACQUIRE))
+        return false;
+    *out = s_ring[tail & RING_MASK];
+    __atomic_store_n(&s_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool photodiode_rx_receive(PhotodiodeFrame* out, TickType_t ticks_to_wait)
+{
+    if (!out || !s_ready)
+        return false;
+    if (ring_pop(out))
+        return true;
+
+    // The semaphore may be stale from a frame already drained; retry until
+    // the deadline
+    TickType_t start = xTaskGetTickCount();
+    TickType_t remaining = ticks_to_wait;
+    while (ticks_to_wait != 0 && xSemaphoreTake(s_ready, remaining) == pdTRUE)
+    {
+        if (ring_pop(out))
+            return true;
+        if (ticks_to_wait != portMAX_DELAY)
+        {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= ticks_to_wait)
+                break;
+            remaining = ticks_to_wait - elapsed;
+        }
+    }
+    return ring_pop(out);
+}
+
+void photodiode_rx_get_stats(PhotodiodeRxStats* out)
+{
+    if (!out)
+        return;
+    out->frames = __atomic_load_n(&s_stats.frames, __ATOMIC_RELAXED);
+    out->invalid = __atomic_load_n(&s_stats.invalid, __ATOMIC_RELAXED);
+    out->overflows = __atomic_load_n(&s_stats.overflows, __ATOMIC_RELAXED);
+    out->bit_period_us = __atomic_load_n(&s_stats.bit_period_us, __ATOMIC_RELAXED);
+    out->high_watermark = __atomic_load_n(&s_stats.high_watermark, __ATOMIC_RELAXED);
+    out->depth = RING_DEPTH;
+}
@@ -0,0 +1,162 @@
+#include "radio_policy.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdio.h>
+#include <freertos/FreeRTOS.h>
+#include "game_state.h"
+
+#ifndef CONFIG_RAYZ_RADIO_IDLE_HEARTBEAT_MS
+#define CONFIG_RAYZ_RADIO_IDLE_HEARTBEAT_MS 5000
+#endif
+#ifndef CONFIG_RAYZ_RADIO_MATCH_HEARTBEAT_MS
+#define CONFIG_RAYZ_RADIO_MATCH_HEARTBEAT_MS 1000
+#endif
+#ifdef CONFIG_RAYZ_RADIO_IDLE_MODEM_SLEEP
+#define IDLE_MODEM_SLEEP 1
+#else
+#define IDLE_MODEM_SLEEP 0
+#endif
+
+static const char* TAG = "RadioPolicy";
+static const char* const kModeNames[RADIO_MODE_COUNT] = {"idle", "match"};
+
+typedef struct
+{
+    wifi_ps_type_t ps;
+    esp_coex_prefer_t coex;
+    uint32_t heartbeat_ms;
+} radio_profile_t;
+
+static const radio_profile_t kProfiles[RADIO_MODE_COUNT] = {
+    {IDLE_MODEM_SLEEP ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE, ESP_COEX_PREFER_BALANCE,
+     CONFIG_RAYZ_RADIO_IDLE_HEARTBEAT_MS},
+    {WIFI_PS_NONE, ESP_COEX_PREFER_WIFI, CONFIG_RAYZ_RADIO_MATCH_HEARTBEAT_MS},
+};
+
+// Commands arrive on the httpd task, game over on the esp_timer task
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static RadioMode s_mode = RADIO_MODE_IDLE;
+static int64_t s_mode_since_us = 0;
+static uint64_t s_time_in_mode_us[RADIO_MODE_COUNT] = {};
+static uint32_t s_transitions = 0;
+static bool s_listening = false;
+
+static void apply_profile(RadioMode mode)
+{
+    const radio_profile_t* p = &kProfiles[mode];
+    wifi_mode_t wifi_mode = WIFI_MODE_NULL;
+    if (esp_wifi_get_mode(&wifi_mode) != ESP_OK)
+        return; // Driver not up yet; it reads the profile before starting
+    // The setup AP has no power saving, and a sleeping APSTA would drop clients
+    if (wifi_mode == WIFI_MODE_STA)
+        esp_wifi_set_ps(p->ps);
+    esp_coex_preference_set(p->coex);
+}
+
+static void on_game_event(uint32_t event)
+{
+    if (event == GS_EVT_GAME_OVER)
+        radio_policy_set_mode(RADIO_MODE_IDLE);
+}
+
+void radio_policy_init(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (s_mode_since_us == 0)
+        s_mode_since_us = esp_timer_get_time();
+    bool listen = !s_listening;
+    s_listening = true;
+    portEXIT_CRITICAL(&s_lock);
+    if (listen && !game_state_add_event_listener(on_game_event))
+        ESP_LOGW(TAG, "No game event listener slot, game over will not end the match profile");
+}
+
+void radio_policy_set_mode(RadioMode mode)
+{
+    if (mode >= RADIO_MODE_COUNT)
+        return;
+    const int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    const RadioMode prev = s_mode;
+    if (prev != mode)
+    {
+        if (s_mode_since_us > 0)
+            s_time_in_mode_us[prev] += (uint64_t)(now - s_mode_since_us);
+        s_mode_since_us = now;
+        s_mode = mode;
+        s_transitions++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (prev == mode)
+        return;
+
+    apply_profile(mode);
+    ESP_LOGI(TAG, "%s -> %s (heartbeat %lu ms)", kModeNames[prev], kModeNames[mode],
+             (unsigned long)kProfiles[mode].heartbeat_ms);
+}
+
+void radio_policy_on_command(GameCommandType cmd)
+{
+    switch (cmd)
+    {
+        case CMD_START:
+        case CMD_UNPAUSE:
+            radio_policy_set_mode(RADIO_MODE_MATCH);
+            break;
+        case CMD_STOP:
+        case CMD_PAUSE:
+        case CMD_RESET:
+            radio_policy_set_mode(RADIO_MODE_IDLE);
+            break;
+    }
+}
+
+RadioMode radio_policy_mode(void)
+{
+    return s_mode;
+}
+
+wifi_ps_type_t radio_policy_wifi_ps(void)
+{
+    return kProfiles[s_mode].ps;
+}
+
+esp_coex_prefer_t radio_policy_coex(void)
+{
+    return kProfiles[s_mode].coex;
+}
+
+uint32_t radio_policy_heartbeat_interval_ms(void)
+{
+    return kProfiles[s_mode].heartbeat_ms;
+}
+
+void radio_policy_get_stats(RadioPolicyStats* out)
+{
+    if (!out)
+        return;
+    const int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    out->mode = s_mode;
+    for (int i = 0; i < RADIO_MODE_COUNT; i++)
+    {
+        uint64_t us = s_time_in_mode_us[i];
+        if (i == s_mode && s_mode_since_us > 0)
+            us += (uint64_t)(now - s_mode_since_us);
+        out->time_in_mode_ms[i] = (uint32_t)(us / 1000);
+    }
+    out->transitions = s_transitions;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int radio_policy_stats_json(char* buffer, size_t max_len)
+{
+    if (!buffer || max_len == 0)
+        return -1;
+    RadioPolicyStats st;
+    radio_policy_get_stats(&st);
+    int len = snprintf(buffer, max_len, "{\"mode\":\"%s\",\"idle_ms\":%lu,\"match_ms\":%lu,\"transitions\":%lu}",
+                       kModeNames[st.mode], (unsigned long)st.time_in_mode_ms[RADIO_MODE_IDLE],
+                       (unsigned long)st.time_in_mode_ms[RADIO_MODE_MATCH], (unsigned long)st.transitions);
+    return len < (int)max_len ? len : -1;
+}
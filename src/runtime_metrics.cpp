@@ -1,8 +1,22 @@
 #include "runtime_metrics.h"
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_rom_sys.h>
 #include <esp_system.h>
 #include <esp_timer.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "espnow_comm.h"
 #include "game_state.h"
+#include "photodiode_rx.h"
+#include "radio_policy.h"
+#include "time_sync.h"
+#include "ws_server.h"
 
+static const char* TAG = "Metrics";
 
 uint32_t system_uptime_ms(void)
 {
@@ -55,3 +69,431 @@ uint32_t __attribute__((weak)) metric_last_hit_ms_ago(void)
 {
     return 0;
 }
+
+// ============================================================================
+// System sampler
+// ============================================================================
+
+#define WATCH_MAX 8
+#define SCAN_MAX_TASKS 32 // uxTaskGetSystemState() fails if there are more
+
+// This component's own tasks; applications add theirs with system_stats_watch_task()
+static char s_watch[WATCH_MAX][sizeof(SystemTaskStats::name)] = {"httpd", "espnow_tx", "pd_rx", "oled_flush", "nvs_wb"};
+static uint8_t s_watch_count = 5;
+
+static SystemStats s_sample;
+static portMUX_TYPE s_sample_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_sampler = NULL;
+
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t s_scan[SCAN_MAX_TASKS];
+#if configGENERATE_RUN_TIME_STATS
+// Run-time counters of the previous sample, keyed by task number
+static struct
+{
+    UBaseType_t number;
+    uint32_t runtime;
+} s_prev[SCAN_MAX_TASKS];
+static int s_prev_count = 0;
+static uint32_t s_prev_total = 0;
+#endif
+#endif
+
+bool system_stats_watch_task(const char* name)
+{
+    if (!name || s_watch_count >= WATCH_MAX)
+        return false;
+    for (int i = 0; i < s_watch_count; i++)
+    {
+        if (strcmp(s_watch[i], name) == 0)
+            return true;
+    }
+    // Copied in before the count is published; the sampler reads it unlocked
+    strncpy(s_watch[s_watch_count], name, sizeof(s_watch[0]) - 1);
+    __atomic_store_n(&s_watch_count, (uint8_t)(s_watch_count + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+static void heap_stats(uint32_t caps, SystemHeapStats* out)
+{
+    out->free_bytes = (uint32_t)heap_caps_get_free_size(caps);
+    out->largest_block = (uint32_t)heap_caps_get_largest_free_block(caps);
+    out->min_free = (uint32_t)heap_caps_get_minimum_free_size(caps);
+}
+
+// Keep the SYSTEM_STATS_MAX_TASKS tasks with the least stack headroom
+static void add_task(SystemStats* st, const char* name, uint32_t stack_free, uint8_t cpu_pct)
+{
+    int pos = st->task_count;
+    if (pos == SYSTEM_STATS_MAX_TASKS)
+    {
+        if (stack_free >= st->tasks[pos - 1].stack_free)
+            return;
+        pos--;
+    }
+    else
+    {
+        st->task_count++;
+    }
+    while (pos > 0 && st->tasks[pos - 1].stack_free > stack_free)
+    {
+        st->tasks[pos] = st->tasks[pos - 1];
+        pos--;
+    }
+    SystemTaskStats* t = &st->tasks[pos];
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    t->name[sizeof(t->name) - 1] = '\0';
+    t->stack_free = stack_free;
+    t->cpu_pct = cpu_pct;
+}
+
+static void sample_tasks(SystemStats* st)
+{
+    st->cpu_load_pct[0] = SYSTEM_STATS_CPU_UNKNOWN;
+    st->cpu_load_pct[1] = SYSTEM_STATS_CPU_UNKNOWN;
+
+#if configUSE_TRACE_FACILITY
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(s_scan, SCAN_MAX_TASKS, &total);
+    if (n > 0)
+    {
+#if configGENERATE_RUN_TIME_STATS
+        const uint32_t elapsed = total - s_prev_total;
+        const bool have_prev = s_prev_count > 0 && elapsed > 0;
+#endif
+        for (UBaseType_t i = 0; i < n; i++)
+        {
+            const TaskStatus_t* t = &s_scan[i];
+            uint8_t cpu = SYSTEM_STATS_CPU_UNKNOWN;
+#if configGENERATE_RUN_TIME_STATS
+            if (have_prev)
+            {
+                for (int j = 0; j < s_prev_count; j++)
+                {
+                    if (s_prev[j].number == t->xTaskNumber)
+                    {
+                        uint64_t pct = (uint64_t)(t->ulRunTimeCounter - s_prev[j].runtime) * 100 / elapsed;
+                        cpu = (uint8_t)(pct > 100 ? 100 : pct);
+                        break;
+                    }
+                }
+                // Idle task "IDLE0"/"IDLE1" (or "IDLE" on older releases) per core
+                if (cpu != SYSTEM_STATS_CPU_UNKNOWN && strncmp(t->pcTaskName, "IDLE", 4) == 0)
+                {
+                    int core = t->pcTaskName[4] == '1' ? 1 : 0;
+                    st->cpu_load_pct[core] = (uint8_t)(100 - cpu);
+                }
+            }
+#endif
+            add_task(st, t->pcTaskName, (uint32_t)t->usStackHighWaterMark, cpu);
+        }
+#if configGENERATE_RUN_TIME_STATS
+        for (UBaseType_t i = 0; i < n; i++)
+        {
+            s_prev[i].number = s_scan[i].xTaskNumber;
+            s_prev[i].runtime = s_scan[i].ulRunTimeCounter;
+        }
+        s_prev_count = (int)n;
+        s_prev_total = total;
+#endif
+        return;
+    }
+#endif
+
+    // No trace facility (or more tasks than SCAN_MAX_TASKS): watched tasks only
+    const int watch_count = __atomic_load_n(&s_watch_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < watch_count; i++)
+    {
+        TaskHandle_t h = xTaskGetHandle(s_watch[i]);
+        if (h)
+            add_task(st, s_watch[i], (uint32_t)uxTaskGetStackHighWaterMark(h), SYSTEM_STATS_CPU_UNKNOWN);
+    }
+}
+
+void system_stats_sample(void)
+{
+    // Too large for the esp_timer task stack; only the sampler writes it
+    static SystemStats st;
+    memset(&st, 0, sizeof(st));
+    st.sampled_ms = system_uptime_ms();
+    heap_stats(MALLOC_CAP_INTERNAL, &st.internal);
+    heap_stats(MALLOC_CAP_SPIRAM, &st.psram);
+    sample_tasks(&st);
+
+    portENTER_CRITICAL(&s_sample_lock);
+    s_sample = st;
+    portEXIT_CRITICAL(&s_sample_lock);
+}
+
+bool system_stats_get(SystemStats* out)
+{
+    if (!out)
+        return false;
+    portENTER_CRITICAL(&s_sample_lock);
+    *out = s_sample;
+    portEXIT_CRITICAL(&s_sample_lock);
+    return out->sampled_ms != 0;
+}
+
+static void sampler_cb(void* arg)
+{
+    (void)arg;
+    system_stats_sample();
+    if (ws_server_client_count() > 0)
+        ws_server_broadcast_system_stats();
+}
+
+bool system_stats_start(void)
+{
+    if (CONFIG_RAYZ_SYSTEM_STATS_PERIOD_MS == 0)
+        return false;
+    if (s_sampler)
+        return true;
+    const esp_timer_create_args_t args = {
+        .callback = sampler_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sys_stats",
+        .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&args, &s_sampler) != ESP_OK)
+    {
+        s_sampler = NULL;
+        ESP_LOGW(TAG, "System stats sampler unavailable");
+        return false;
+    }
+    system_stats_sample();
+    esp_timer_start_periodic(s_sampler, (uint64_t)CONFIG_RAYZ_SYSTEM_STATS_PERIOD_MS * 1000);
+    return true;
+}
+
+uint32_t system_largest_free_block(void)
+{
+    return (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t system_min_free_heap(void)
+{
+    return (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+}
+
+int system_cpu_load_pct(void)
+{
+    portENTER_CRITICAL(&s_sample_lock);
+    uint8_t a = s_sample.cpu_load_pct[0];
+    uint8_t b = s_sample.cpu_load_pct[1];
+    portEXIT_CRITICAL(&s_sample_lock);
+    if (a == SYSTEM_STATS_CPU_UNKNOWN && b == SYSTEM_STATS_CPU_UNKNOWN)
+        return -1;
+    if (a == SYSTEM_STATS_CPU_UNKNOWN)
+        return b;
+    if (b == SYSTEM_STATS_CPU_UNKNOWN)
+        return a;
+    return a > b ? a : b;
+}
+
+const char* system_tightest_task(uint32_t* stack_free)
+{
+    // The name is copied out so the caller never sees a half-written sample
+    static char name[sizeof(((SystemTaskStats*)nullptr)->name)];
+    uint32_t free_bytes = 0;
+    bool found = false;
+    portENTER_CRITICAL(&s_sample_lock);
+    if (s_sample.task_count > 0)
+    {
+        memcpy(name, s_sample.tasks[0].name, sizeof(name));
+        free_bytes = s_sample.tasks[0].stack_free;
+        found = true;
+    }
+    portEXIT_CRITICAL(&s_sample_lock);
+    if (stack_free)
+        *stack_free = free_bytes;
+    return found ? name : NULL;
+}
+
+// ============================================================================
+// Hot-path registry
+// ============================================================================
+
+#if RAYZ_METRICS
+MetricsHistogram g_metrics_hists[METRICS_HIST_COUNT];
+uint32_t g_metrics_counters[METRICS_CTR_COUNT];
+#endif
+
+#define WS_STATS_SLOTS WS_MAX_CLIENTS
+
+// JSON keys, unit suffix included so a reader needs no lookup table
+static const char* const kHistNames[METRICS_HIST_COUNT] = {
+    "espnow_rx_latency_us",
+    "espnow_send_cycles",
+    "ws_queue_depth",
+    "ws_encode_json_cycles",
+    "ws_encode_msgpack_cycles",
+    "photodiode_decode_cycles",
+    "display_flush_us",
+};
+static const char* const kCounterNames[METRICS_CTR_COUNT] = {
+    "espnow_send_errors",
+    "ws_encode_errors",
+};
+
+void metrics_snapshot(MetricsSnapshot* out)
+{
+    if (!out)
+        return;
+    memset(out, 0, sizeof(*out));
+    out->uptime_ms = system_uptime_ms();
+    out->cpu_mhz = esp_rom_get_cpu_ticks_per_us();
+#if RAYZ_METRICS
+    for (int i = 0; i < METRICS_HIST_COUNT; i++)
+    {
+        const MetricsHistogram* h = &g_metrics_hists[i];
+        out->hists[i].count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        out->hists[i].sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+        out->hists[i].max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        for (int b = 0; b < METRICS_HIST_BUCKETS; b++)
+            out->hists[i].buckets[b] = __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < METRICS_CTR_COUNT; i++)
+        out->counters[i] = __atomic_load_n(&g_metrics_counters[i], __ATOMIC_RELAXED);
+#endif
+}
+
+void metrics_reset(void)
+{
+#if RAYZ_METRICS
+    for (int i = 0; i < METRICS_HIST_COUNT; i++)
+    {
+        MetricsHistogram* h = &g_metrics_hists[i];
+        __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+        for (int b = 0; b < METRICS_HIST_BUCKETS; b++)
+            __atomic_store_n(&h->buckets[b], 0, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < METRICS_CTR_COUNT; i++)
+        __atomic_store_n(&g_metrics_counters[i], 0, __ATOMIC_RELAXED);
+#endif
+}
+
+// snprintf into buffer at *pos; false once the buffer is full
+static bool append(char* buffer, size_t max_len, size_t* pos, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static bool append(char* buffer, size_t max_len, size_t* pos, const char* fmt, ...)
+{
+    if (*pos >= max_len)
+        return false;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer + *pos, max_len - *pos, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= max_len - *pos)
+    {
+        *pos = max_len;
+        return false;
+    }
+    *pos += (size_t)n;
+    return true;
+}
+
+// ============================================================================
+// Boot timeline
+// ============================================================================
+
+static const char* const kBootPhaseNames[BOOT_PHASE_COUNT] = {
+    "wifi_init", "radio_ready", "espnow_ready", "associated", "got_ip", "services",
+};
+
+static uint32_t s_boot_ms[BOOT_PHASE_COUNT];
+
+void boot_phase_mark(BootPhase phase)
+{
+    if (phase < 0 || phase >= BOOT_PHASE_COUNT)
+        return;
+    // Never 0 once marked, so 0 keeps meaning "not reached"
+    uint32_t now = system_uptime_ms() | 1;
+    uint32_t unset = 0;
+    if (__atomic_compare_exchange_n(&s_boot_ms[phase], &unset, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ESP_LOGI(TAG, "Boot phase %s at %lu ms", kBootPhaseNames[phase], (unsigned long)now);
+}
+
+uint32_t boot_phase_ms(BootPhase phase)
+{
+    if (phase < 0 || phase >= BOOT_PHASE_COUNT)
+        return 0;
+    return __atomic_load_n(&s_boot_ms[phase], __ATOMIC_RELAXED);
+}
+
+int metrics_snapshot_json(char* buffer, size_t max_len)
+{
+    if (!buffer || max_len == 0)
+        return -1;
+
+    // Too large for the httpd stack; the single httpd task is the only caller
+    static MetricsSnapshot snap;
+    metrics_snapshot(&snap);
+
+    size_t pos = 0;
+    append(buffer, max_len, &pos, "{\"uptime_ms\":%lu,\"free_heap\":%lu,\"cpu_mhz\":%lu,\"enabled\":%s,\"hist\":{",
+           (unsigned long)snap.uptime_ms, (unsigned long)system_free_heap(), (unsigned long)snap.cpu_mhz,
+           RAYZ_METRICS ? "true" : "false");
+    for (int i = 0; i < METRICS_HIST_COUNT; i++)
+    {
+        const MetricsHistogram* h = &snap.hists[i];
+        append(buffer, max_len, &pos, "%s\"%s\":{\"n\":%lu,\"sum\":%lu,\"max\":%lu,\"buckets\":[", i ? "," : "",
+               kHistNames[i], (unsigned long)h->count, (unsigned long)h->sum, (unsigned long)h->max);
+        // Trailing empty buckets are left out
+        int last = METRICS_HIST_BUCKETS - 1;
+        while (last >= 0 && h->buckets[last] == 0)
+            last--;
+        for (int b = 0; b <= last; b++)
+            append(buffer, max_len, &pos, "%s%lu", b ? "," : "", (unsigned long)h->buckets[b]);
+        append(buffer, max_len, &pos, "]}");
+    }
+    append(buffer, max_len, &pos, "},\"boot\":{");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+        append(buffer, max_len, &pos, "%s\"%s\":%lu", i ? "," : "", kBootPhaseNames[i],
+               (unsigned long)boot_phase_ms((BootPhase)i));
+    append(buffer, max_len, &pos, "},\"time_sync\":");
+    if (pos < max_len)
+    {
+        int n = time_sync_status_json(buffer + pos, max_len - pos);
+        pos = n < 0 ? max_len : pos + (size_t)n;
+    }
+    append(buffer, max_len, &pos, ",\"radio\":");
+    if (pos < max_len)
+    {
+        int n = radio_policy_stats_json(buffer + pos, max_len - pos);
+        pos = n < 0 ? max_len : pos + (size_t)n;
+    }
+    append(buffer, max_len, &pos, ",\"counters\":{");
+    for (int i = 0; i < METRICS_CTR_COUNT; i++)
+        append(buffer, max_len, &pos, "%s\"%s\":%lu", i ? "," : "", kCounterNames[i],
+               (unsigned long)snap.counters[i]);
+
+    // Where a lost hit can have gone: radio, laser decoder or WebSocket
+    EspnowRxStats rx;
+    EspnowTxStats tx;
+    PhotodiodeRxStats pd;
+    espnow_comm_get_rx_stats(&rx);
+    espnow_comm_get_tx_stats(&tx);
+    photodiode_rx_get_stats(&pd);
+    WsClientQueueStats queues[WS_STATS_SLOTS];
+    int nq = ws_server_get_queue_stats(queues, WS_STATS_SLOTS);
+    uint32_t ws_dropped = 0;
+    for (int i = 0; i < nq; i++)
+        ws_dropped += queues[i].dropped;
+    append(buffer, max_len, &pos,
+           "},\"drops\":{\"espnow_rx_overflows\":%lu,\"espnow_rx_invalid\":%lu,\"espnow_rx_filtered\":%lu,"
+           "\"espnow_rx_auth_failed\":%lu,\"espnow_tx_queue_full\":%lu,"
+           "\"espnow_tx_failed\":%lu,\"laser_invalid\":%lu,\"laser_overflows\":%lu,\"ws_dropped\":%lu,"
+           "\"ws_rx_exhausted\":%lu,\"ws_congestion_disconnects\":%lu}}",
+           (unsigned long)rx.overflows, (unsigned long)rx.invalid, (unsigned long)rx.filtered,
+           (unsigned long)rx.auth_failed, (unsigned long)tx.queue_full,
+           (unsigned long)tx.failed, (unsigned long)pd.invalid, (unsigned long)pd.overflows,
+           (unsigned long)ws_dropped, (unsigned long)ws_server_rx_exhausted(),
+           (unsigned long)ws_server_congestion_disconnects());
+
+    return pos < max_len ? (int)pos : -1;
+}
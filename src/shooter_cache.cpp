@@ -0,0 +1,130 @@
+#include "shooter_cache.h"
+#include <esp_timer.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include "laser_codec.h"
+#include "protocol_config.h"
+
+#define SLOT_MASK (SHOOTER_CACHE_SLOTS - 1)
+#define PROBE_WINDOW 4 // Entries examined per lookup; bounds the hit path
+static_assert((SHOOTER_CACHE_SLOTS & SLOT_MASK) == 0, "SHOOTER_CACHE_SLOTS must be a power of two");
+
+typedef struct
+{
+    uint32_t frame;
+    uint32_t expires_ms; // 0 = empty
+    ShooterInfo info;
+} cache_entry_t;
+
+// Written by the ESP-NOW consumer, read on the hit path; the critical
+// sections only cover a probe window.
+static cache_entry_t s_entries[SHOOTER_CACHE_SLOTS];
+static ShooterCacheStats s_stats = {};
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static inline uint32_t slot_of(uint32_t frame)
+{
+    return (frame * 0x9E3779B1u) >> (32 - __builtin_ctz(SHOOTER_CACHE_SLOTS));
+}
+
+static inline bool live(const cache_entry_t* e, uint32_t now)
+{
+    return e->expires_ms != 0 && (int32_t)(e->expires_ms - now) > 0;
+}
+
+static uint32_t frame_for(uint8_t player_id, uint8_t device_id, uint8_t profile)
+{
+    if (profile == LASER_PROFILE_COMPACT)
+        return createCompactLaserMessage(player_id, device_id & 0x03);
+    return RayzLaserCode::encode(player_id, device_id);
+}
+
+void shooter_cache_announce(const PlayerMessage* msg, uint8_t profile)
+{
+    if (!msg || msg->type != ESPNOW_MSG_SHOT)
+        return;
+
+    const uint32_t now = now_ms();
+    const uint32_t frame = frame_for(msg->player_id, msg->device_id, profile);
+    const uint32_t base = slot_of(frame);
+
+    portENTER_CRITICAL(&s_lock);
+    cache_entry_t* target = NULL;
+    cache_entry_t* oldest = NULL;
+    for (uint32_t i = 0; i < PROBE_WINDOW; i++)
+    {
+        cache_entry_t* e = &s_entries[(base + i) & SLOT_MASK];
+        if (e->frame == frame || !live(e, now))
+        {
+            // Re-announcement refreshes its own entry, otherwise take a free one
+            if (!target || e->frame == frame)
+                target = e;
+            if (e->frame == frame)
+                break;
+        }
+        else if (!oldest || (int32_t)(e->expires_ms - oldest->expires_ms) < 0)
+        {
+            oldest = e;
+        }
+    }
+    if (!target)
+    {
+        target = oldest;
+        s_stats.evicted++;
+    }
+    target->frame = frame;
+    target->expires_ms = (now + SHOOTER_CACHE_TTL_MS) | 1; // Never 0 while live
+    target->info.player_id = msg->player_id;
+    target->info.device_id = msg->device_id;
+    target->info.team_id = msg->team_id;
+    target->info.announced_ms = now;
+    s_stats.announced++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+bool shooter_cache_match(uint32_t frame, ShooterInfo* out)
+{
+    const uint32_t now = now_ms();
+    const uint32_t base = slot_of(frame);
+    bool found = false;
+
+    portENTER_CRITICAL(&s_lock);
+    for (uint32_t i = 0; i < PROBE_WINDOW; i++)
+    {
+        const cache_entry_t* e = &s_entries[(base + i) & SLOT_MASK];
+        if (e->frame == frame && live(e, now))
+        {
+            if (out)
+                *out = e->info;
+            found = true;
+            break;
+        }
+    }
+    if (found)
+        s_stats.matched++;
+    else
+        s_stats.missed++;
+    portEXIT_CRITICAL(&s_lock);
+    return found;
+}
+
+void shooter_cache_clear(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(s_entries, 0, sizeof(s_entries));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void shooter_cache_get_stats(ShooterCacheStats* out)
+{
+    if (!out)
+        return;
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -7,9 +7,9 @@ bool hasExpectedMessage = false;
 TickType_t last_expected_update = 0;
 uint8_t last_shooter_hash = 0;
 
-uint16_t all_expected_messages = 0;
-uint16_t correct_messages = 0;
-uint16_t not_expected_messages = 0;
+std::atomic<uint16_t> all_expected_messages{0};
+std::atomic<uint16_t> correct_messages{0};
+std::atomic<uint16_t> not_expected_messages{0};
 
 QueueHandle_t photodiodeMessageQueue = nullptr;
 SemaphoreHandle_t statsMutex = nullptr;
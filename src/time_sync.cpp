@@ -0,0 +1,424 @@
+#include "time_sync.h"
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include "game_state.h"
+#include "ws_server.h"
+
+#ifndef CONFIG_RAYZ_TIME_SYNC_PERIOD_MS
+#define CONFIG_RAYZ_TIME_SYNC_PERIOD_MS 2000
+#endif
+#define SYNC_PERIOD_US ((int64_t)CONFIG_RAYZ_TIME_SYNC_PERIOD_MS * 1000)
+#define FILTER_DEPTH 4                // Exchanges the min-RTT filter picks from
+#define MAX_RTT_US 20000              // Slower exchanges sat in a queue somewhere
+#define STEP_US 2000                  // Larger errors are stepped, smaller ones slewed
+#define DRIFT_MIN_SPAN_US 10000000LL  // Samples this far apart feed the drift estimate
+#define DRIFT_MAX_PPB 200000          // Crystals are +-20 ppm each; beyond that it is noise
+#define REF_STALE_PERIODS 4           // A reference silent this long is dropped
+#define TURNAROUND_SATURATED 0xFFFF
+
+static const char* TAG = "TimeSync";
+
+typedef struct
+{
+    int64_t local_us;  // Midpoint of the exchange on the local clock
+    int64_t offset_us; // Shared minus local time at that point
+    uint32_t rtt_us;
+} sample_t;
+
+// Written by the Wi-Fi task (responses), the ESP-NOW TX task (stamping) and
+// the sync timer; read from anywhere. Every access is a few loads and stores.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TimeSyncRole s_role = TIME_SYNC_AUTO;
+static esp_timer_handle_t s_timer = NULL;
+static uint8_t s_own_mac[ESP_NOW_ETH_ALEN];
+static bool s_reference = false;
+static bool s_dashboard = false;
+
+// shared = local + base_offset + (local - base_local) * drift. Kept when the
+// reference goes away, so the timeline freewheels instead of snapping back.
+static bool s_synced = false;
+static int64_t s_base_local_us = 0;
+static int64_t s_base_offset_us = 0;
+static int32_t s_drift_ppb = 0;
+static bool s_drift_valid = false;
+static sample_t s_anchor; // Last sample the drift was measured against
+
+static bool s_have_ref = false;
+static uint8_t s_ref_mac[ESP_NOW_ETH_ALEN];
+static int64_t s_ref_seen_us = 0;
+
+static int64_t s_req_t1_us = 0; // Outstanding request, 0 = none
+static bool s_req_done = false;
+
+static sample_t s_samples[FILTER_DEPTH];
+static uint8_t s_sample_count = 0;
+static uint8_t s_sample_next = 0;
+
+static uint32_t s_rtt_us = 0;
+static uint32_t s_last_sync_ms = 0;
+static uint32_t s_exchanges = 0;
+static uint32_t s_rejected = 0;
+static uint32_t s_answered = 0;
+
+static inline int64_t offset_at_unsafe(int64_t local_us)
+{
+    return s_base_offset_us + (local_us - s_base_local_us) * s_drift_ppb / 1000000000LL;
+}
+
+static bool refresh_reference_unsafe(void)
+{
+    bool reference;
+    switch (s_role)
+    {
+    case TIME_SYNC_REFERENCE:
+        reference = true;
+        break;
+    case TIME_SYNC_CLIENT:
+        reference = false;
+        break;
+    default:
+        // A dashboard device still defers to a lower-MAC reference
+        reference = s_dashboard && !(s_have_ref && memcmp(s_ref_mac, s_own_mac, ESP_NOW_ETH_ALEN) < 0);
+        break;
+    }
+    bool changed = reference != s_reference;
+    s_reference = reference;
+    if (reference)
+        s_synced = false;
+    return changed;
+}
+
+static void reset_filter_unsafe(void)
+{
+    s_sample_count = 0;
+    s_sample_next = 0;
+}
+
+static void step_unsafe(const sample_t* sample)
+{
+    s_base_local_us = sample->local_us;
+    s_base_offset_us = sample->offset_us;
+    s_drift_ppb = 0;
+    s_drift_valid = false;
+    s_anchor = *sample;
+}
+
+static void apply_unsafe(const sample_t* sample)
+{
+    if (!s_synced)
+    {
+        step_unsafe(sample);
+        s_synced = true;
+        return;
+    }
+
+    const int64_t predicted = offset_at_unsafe(sample->local_us);
+    const int64_t err = sample->offset_us - predicted;
+    if (err > STEP_US || err < -STEP_US)
+    {
+        step_unsafe(sample);
+        return;
+    }
+
+    const int64_t span = sample->local_us - s_anchor.local_us;
+    if (span >= DRIFT_MIN_SPAN_US)
+    {
+        int64_t measured = (sample->offset_us - s_anchor.offset_us) * 1000000000LL / span;
+        if (measured > DRIFT_MAX_PPB)
+            measured = DRIFT_MAX_PPB;
+        else if (measured < -DRIFT_MAX_PPB)
+            measured = -DRIFT_MAX_PPB;
+        s_drift_ppb = s_drift_valid ? (int32_t)(s_drift_ppb + (measured - s_drift_ppb) / 4) : (int32_t)measured;
+        s_drift_valid = true;
+        s_anchor = *sample;
+    }
+    // Slew half the error so one exchange with asymmetric delay only moves
+    // the clock by half of it
+    s_base_local_us = sample->local_us;
+    s_base_offset_us = predicted + err / 2;
+}
+
+// Returns true if the sample was applied to the clock model
+static bool handle_response_unsafe(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const EspnowTimeSync* msg,
+                                   int64_t rx_us, bool* switched)
+{
+    *switched = false;
+    if (s_role == TIME_SYNC_REFERENCE || s_req_t1_us == 0 || (uint32_t)s_req_t1_us != msg->t1 ||
+        msg->turnaround_us == TURNAROUND_SATURATED)
+        return false;
+    if (s_reference && memcmp(src_mac, s_own_mac, ESP_NOW_ETH_ALEN) > 0)
+        return false;
+
+    if (!s_have_ref || memcmp(src_mac, s_ref_mac, ESP_NOW_ETH_ALEN) != 0)
+    {
+        // Follow the lowest MAC answering
+        if (s_have_ref && memcmp(src_mac, s_ref_mac, ESP_NOW_ETH_ALEN) > 0)
+            return false;
+        memcpy(s_ref_mac, src_mac, ESP_NOW_ETH_ALEN);
+        s_have_ref = true;
+        s_synced = false;
+        s_req_done = false;
+        reset_filter_unsafe();
+        *switched = true;
+    }
+    if (s_req_done)
+        return false;
+    s_req_done = true;
+    s_ref_seen_us = rx_us;
+
+    const int64_t t1 = s_req_t1_us;
+    const int64_t t4 = rx_us;
+    const int64_t t3 = (int64_t)(((uint64_t)msg->t3_hi << 32) | msg->t3_lo);
+    const int64_t t2 = t3 - msg->turnaround_us;
+    const int64_t rtt = (t4 - t1) - (t3 - t2);
+    if (rtt < 0 || rtt > MAX_RTT_US)
+        return false;
+
+    sample_t sample;
+    sample.local_us = t1 + (t4 - t1) / 2;
+    sample.offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    sample.rtt_us = (uint32_t)rtt;
+    s_samples[s_sample_next] = sample;
+    s_sample_next = (uint8_t)((s_sample_next + 1) % FILTER_DEPTH);
+    if (s_sample_count < FILTER_DEPTH)
+        s_sample_count++;
+
+    // Queueing only ever adds delay, so the fastest recent exchange is the
+    // most symmetric one; the others are kept only to compare against
+    for (uint8_t i = 0; i < s_sample_count; i++)
+    {
+        if (s_samples[i].rtt_us < sample.rtt_us && s_synced)
+            return false;
+    }
+    refresh_reference_unsafe();
+    apply_unsafe(&sample);
+    s_rtt_us = sample.rtt_us;
+    s_last_sync_ms = (uint32_t)(rx_us / 1000);
+    s_exchanges++;
+    return true;
+}
+
+static void fill_header(EspnowTimeSync* msg, uint8_t phase)
+{
+    const DeviceConfig* cfg = game_state_get_config();
+    memset(msg, 0, sizeof(*msg));
+    msg->type = ESPNOW_MSG_TIME_SYNC;
+    msg->phase = phase;
+    if (cfg)
+    {
+        msg->player_id = cfg->player_id;
+        msg->device_id = cfg->device_id;
+        msg->team_id = cfg->team_id;
+    }
+}
+
+static void send_sync(const uint8_t* mac, const EspnowTimeSync* msg)
+{
+    static_assert(sizeof(EspnowTimeSync) == sizeof(PlayerMessage), "time sync must match the record size");
+    PlayerMessage out;
+    memcpy(&out, msg, sizeof(out));
+    if (mac)
+        espnow_comm_send(mac, &out);
+    else
+        espnow_comm_broadcast(&out);
+}
+
+static void sync_timer_cb(void* arg)
+{
+    (void)arg;
+    const bool dashboard = ws_server_client_count() > 0;
+    const int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    bool lost = false;
+    if (s_have_ref && now - s_ref_seen_us > REF_STALE_PERIODS * SYNC_PERIOD_US)
+    {
+        s_have_ref = false;
+        lost = s_synced;
+        s_synced = false;
+        reset_filter_unsafe();
+    }
+    s_dashboard = dashboard;
+    const bool changed = refresh_reference_unsafe();
+    const bool reference = s_reference;
+    const TimeSyncRole role = s_role;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (lost)
+        ESP_LOGW(TAG, "Reference lost, freewheeling");
+    if (changed)
+        ESP_LOGI(TAG, "%s reference", reference ? "Acting as" : "No longer");
+
+    // An AUTO reference keeps asking so it can defer to a lower MAC
+    if (role != TIME_SYNC_REFERENCE)
+    {
+        EspnowTimeSync req;
+        fill_header(&req, ESPNOW_TIME_SYNC_REQUEST);
+        send_sync(NULL, &req); // t1 is stamped by the TX task
+    }
+}
+
+void time_sync_init(void)
+{
+    if (s_timer || SYNC_PERIOD_US <= 0)
+        return;
+    esp_read_mac(s_own_mac, ESP_MAC_WIFI_STA);
+    const esp_timer_create_args_t args = {
+        .callback = sync_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "time_sync",
+        .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&args, &s_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create sync timer");
+        s_timer = NULL;
+        return;
+    }
+    esp_timer_start_periodic(s_timer, (uint64_t)SYNC_PERIOD_US);
+}
+
+void time_sync_set_role(TimeSyncRole role)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_role = role;
+    bool changed = refresh_reference_unsafe();
+    portEXIT_CRITICAL(&s_lock);
+    if (changed)
+        ESP_LOGI(TAG, "Role %d, %s reference", (int)role, s_reference ? "acting as" : "no longer");
+}
+
+TimeSyncRole time_sync_get_role(void)
+{
+    return s_role;
+}
+
+int64_t time_sync_to_shared_us(int64_t local_us)
+{
+    portENTER_CRITICAL_SAFE(&s_lock);
+    int64_t shared = local_us + offset_at_unsafe(local_us);
+    portEXIT_CRITICAL_SAFE(&s_lock);
+    return shared;
+}
+
+int64_t time_sync_now_us(void)
+{
+    return time_sync_to_shared_us(esp_timer_get_time());
+}
+
+bool time_sync_is_synced(void)
+{
+    return s_synced;
+}
+
+void time_sync_get_status(TimeSyncStatus* out)
+{
+    if (!out)
+        return;
+    const int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_lock);
+    out->role = s_role;
+    out->reference = s_reference;
+    out->synced = s_synced;
+    if (s_have_ref)
+        memcpy(out->ref_mac, s_ref_mac, ESP_NOW_ETH_ALEN);
+    else
+        memset(out->ref_mac, 0, ESP_NOW_ETH_ALEN);
+    out->offset_us = offset_at_unsafe(now);
+    out->drift_ppb = s_drift_ppb;
+    out->rtt_us = s_rtt_us;
+    out->last_sync_ms = s_last_sync_ms;
+    out->exchanges = s_exchanges;
+    out->rejected = s_rejected;
+    out->answered = s_answered;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int time_sync_status_json(char* buffer, size_t max_len)
+{
+    static const char* const kRoleNames[] = {"auto", "reference", "client"};
+    if (!buffer || max_len == 0)
+        return -1;
+    TimeSyncStatus st;
+    time_sync_get_status(&st);
+    const uint8_t* m = st.ref_mac;
+    int len = snprintf(buffer, max_len,
+                       "{\"role\":\"%s\",\"reference\":%s,\"synced\":%s,\"ref\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+                       "\"offset_us\":%lld,\"drift_ppb\":%ld,\"rtt_us\":%lu,\"last_sync_ms\":%lu,\"exchanges\":%lu,"
+                       "\"rejected\":%lu,\"answered\":%lu}",
+                       kRoleNames[st.role <= TIME_SYNC_CLIENT ? st.role : 0], st.reference ? "true" : "false",
+                       st.synced ? "true" : "false", m[0], m[1], m[2], m[3], m[4], m[5], (long long)st.offset_us,
+                       (long)st.drift_ppb, (unsigned long)st.rtt_us, (unsigned long)st.last_sync_ms,
+                       (unsigned long)st.exchanges, (unsigned long)st.rejected, (unsigned long)st.answered);
+    return len < (int)max_len ? len : -1;
+}
+
+void time_sync_on_rx(const uint8_t src_mac[ESP_NOW_ETH_ALEN], const EspnowTimeSync* msg, int64_t rx_us,
+                     bool known_peer)
+{
+    if (!src_mac || !msg)
+        return;
+
+    if (msg->phase == ESPNOW_TIME_SYNC_REQUEST)
+    {
+        if (!s_reference)
+            return;
+        EspnowTimeSync resp;
+        fill_header(&resp, ESPNOW_TIME_SYNC_RESPONSE);
+        resp.t1 = msg->t1;
+        // t2 rides in t3_lo until the TX task turns it into the turnaround
+        resp.t3_lo = (uint32_t)time_sync_to_shared_us(rx_us);
+        // Unicast needs a registered peer; anyone else gets a broadcast and
+        // matches it by t1
+        send_sync(known_peer ? src_mac : NULL, &resp);
+        portENTER_CRITICAL(&s_lock);
+        s_answered++;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+
+    if (msg->phase != ESPNOW_TIME_SYNC_RESPONSE)
+        return;
+    bool switched;
+    portENTER_CRITICAL(&s_lock);
+    bool applied = handle_response_unsafe(src_mac, msg, rx_us, &switched);
+    if (!applied)
+        s_rejected++;
+    const int64_t offset = s_base_offset_us;
+    const uint32_t rtt = s_rtt_us;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (switched)
+        ESP_LOGI(TAG, "Following %02X:%02X:%02X:%02X:%02X:%02X", src_mac[0], src_mac[1], src_mac[2], src_mac[3],
+                 src_mac[4], src_mac[5]);
+    if (applied)
+        ESP_LOGD(TAG, "offset=%lld us rtt=%lu us", (long long)offset, (unsigned long)rtt);
+}
+
+void time_sync_stamp_tx(EspnowTimeSync* msg)
+{
+    if (!msg)
+        return;
+    const int64_t local = esp_timer_get_time();
+    if (msg->phase == ESPNOW_TIME_SYNC_REQUEST)
+    {
+        msg->t1 = (uint32_t)local;
+        portENTER_CRITICAL(&s_lock);
+        s_req_t1_us = local;
+        s_req_done = false;
+        portEXIT_CRITICAL(&s_lock);
+    }
+    else if (msg->phase == ESPNOW_TIME_SYNC_RESPONSE)
+    {
+        const int64_t t3 = time_sync_to_shared_us(local);
+        const uint32_t turnaround = (uint32_t)t3 - msg->t3_lo;
+        msg->turnaround_us = turnaround >= TURNAROUND_SATURATED ? TURNAROUND_SATURATED : (uint16_t)turnaround;
+        msg->t3_lo = (uint32_t)t3;
+        msg->t3_hi = (uint16_t)((uint64_t)t3 >> 32);
+    }
+}
@@ -1,5 +1,7 @@
 #include "http_api.h"
 #include "nvs_store.h"
+#include "radio_policy.h"
+#include "runtime_metrics.h"
 #include "wifi_internal.h"
 #include "ws_server.h"
 
@@ -10,16 +12,77 @@
 #include <esp_netif.h>
 #include <esp_wifi.h>
 #include <esp_mac.h>
+#include <esp_random.h>
+#include <esp_timer.h>
 #include <string.h>
 #include <string>
 
 static const char* TAG = "WiFiCore";
 
+#ifdef CONFIG_RAYZ_WIFI_FAST_BOOT
+#define FAST_BOOT 1
+#else
+#define FAST_BOOT 0
+#endif
+
+#ifdef CONFIG_RAYZ_WIFI_REUSE_LEASE
+#define REUSE_LEASE 1
+#else
+#define REUSE_LEASE 0
+#endif
+
 // Retry tracking
 static int s_retry_count = 0;
 static const int MAX_RETRY_COUNT = 15;
+static const int FAST_RETRY_COUNT = 2; // Attempts on the cached BSSID/channel before a full scan
+static const int FAST_RETRY_DELAY_MS[FAST_RETRY_COUNT] = {20, 200};
+static const int BACKOFF_BASE_MS = 250;
+static const int BACKOFF_MAX_MS = 5000;
+static const int RESTART_DELAY_MS = 500;
 static esp_netif_t* s_netif = NULL;
 
+typedef enum
+{
+    RECONNECT_IDLE,     // Connected, or not in STA mode
+    RECONNECT_FAST,     // Next attempt targets the cached AP
+    RECONNECT_FULL,     // Next attempt scans for any AP with our SSID
+    RECONNECT_RESTART,  // Out of retries, the driver is stopped next
+    RECONNECT_STARTING, // Driver stopped, started again next
+} reconnect_state_t;
+
+// AP of the last successful association, retried first after a drop
+typedef struct
+{
+    bool valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+} cached_ap_t;
+
+static esp_timer_handle_t s_reconnect_timer = NULL;
+static reconnect_state_t s_reconnect_state = RECONNECT_IDLE;
+static cached_ap_t s_last_ap = {};
+static bool s_bssid_locked = false;
+static int64_t s_disconnected_us = 0;
+
+// Network parameters of the last successful join, kept in NVS so the next
+// boot can skip the scan (and with REUSE_LEASE, DHCP)
+#define AP_CACHE_VERSION 1
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[WIFI_MAX_SSID_LEN + 1]; // The cache is only used for the same network
+    uint32_t ip; // Last lease, network byte order
+    uint32_t netmask;
+    uint32_t gw;
+} wifi_ap_cache_t;
+
+static esp_timer_handle_t s_services_timer = NULL;
+static bool s_services_started = false;
+static bool s_static_lease = false; // DHCP client stopped for a reused lease
+
 static const char* reason_to_str(int reason)
 {
     switch (reason)
@@ -41,6 +104,102 @@ static const char* reason_to_str(int reason)
     }
 }
 
+// Reconnect state machine. The disconnect handler only picks the next step
+// and arms a one-shot timer; the driver calls happen in the timer callback,
+// so the default event loop never sleeps. The first attempts go straight
+// back to the AP and channel we were on; after that the BSSID lock is
+// dropped and a full scan runs with jittered exponential backoff.
+static bool schedule_reconnect(int delay_ms)
+{
+    if (!s_reconnect_timer)
+        return false;
+    esp_timer_stop(s_reconnect_timer);
+    if (delay_ms < 1)
+        delay_ms = 1;
+    return esp_timer_start_once(s_reconnect_timer, (uint64_t)delay_ms * 1000) == ESP_OK;
+}
+
+static void cancel_reconnect(void)
+{
+    s_reconnect_state = RECONNECT_IDLE;
+    if (s_reconnect_timer)
+        esp_timer_stop(s_reconnect_timer);
+}
+
+// 250 ms doubling up to 5 s, +-25% so devices dropped by the same AP blip
+// do not all come back in the same instant
+static int backoff_ms(int attempt)
+{
+    int shift = attempt > 5 ? 5 : (attempt < 1 ? 0 : attempt - 1);
+    int base = BACKOFF_BASE_MS << shift;
+    if (base > BACKOFF_MAX_MS)
+        base = BACKOFF_MAX_MS;
+    return base * 3 / 4 + (int)(esp_random() % (uint32_t)(base / 2 + 1));
+}
+
+// Point the STA config at the cached AP (fast) or at any AP with our SSID
+static void set_sta_target(bool fast)
+{
+    const bool lock = fast && s_last_ap.valid;
+    if (lock == s_bssid_locked)
+        return;
+
+    wifi_config_t conf = {};
+    if (esp_wifi_get_config(WIFI_IF_STA, &conf) != ESP_OK)
+        return;
+    conf.sta.bssid_set = lock;
+    if (lock)
+    {
+        memcpy(conf.sta.bssid, s_last_ap.bssid, sizeof(conf.sta.bssid));
+        conf.sta.channel = s_last_ap.channel;
+        conf.sta.scan_method = WIFI_FAST_SCAN;
+    }
+    else
+    {
+        memset(conf.sta.bssid, 0, sizeof(conf.sta.bssid));
+        conf.sta.channel = 0;
+        conf.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_STA, &conf);
+    if (ret == ESP_OK)
+        s_bssid_locked = lock;
+    else
+        ESP_LOGW(TAG, "Failed to update STA target: %s", esp_err_to_name(ret));
+}
+
+static void reconnect_timer_cb(void* arg)
+{
+    esp_err_t ret = ESP_OK;
+    switch (s_reconnect_state)
+    {
+        case RECONNECT_IDLE:
+            return;
+        case RECONNECT_FAST:
+        case RECONNECT_FULL:
+            set_sta_target(s_reconnect_state == RECONNECT_FAST);
+            ret = esp_wifi_connect();
+            break;
+        case RECONNECT_RESTART:
+            ESP_LOGW(TAG, "Restarting WiFi driver...");
+            set_sta_target(false);
+            s_reconnect_state = RECONNECT_STARTING;
+            esp_wifi_stop();
+            schedule_reconnect(RESTART_DELAY_MS);
+            return;
+        case RECONNECT_STARTING:
+            s_retry_count = 0;
+            s_reconnect_state = RECONNECT_FULL;
+            esp_wifi_set_ps(radio_policy_wifi_ps());
+            esp_coex_preference_set(radio_policy_coex());
+            ret = esp_wifi_start();
+            if (ret == ESP_OK)
+                ret = esp_wifi_connect();
+            break;
+    }
+    if (ret != ESP_OK)
+        ESP_LOGE(TAG, "Reconnect attempt failed: %s", esp_err_to_name(ret));
+}
+
 static void on_wifi_disconnect(void* arg, esp_event_base_t base, int32_t id, void* data)
 {
     if (g_wifi_events)
@@ -48,61 +207,116 @@ static void on_wifi_disconnect(void* arg, esp_event_base_t base, int32_t id, voi
         xEventGroupClearBits(g_wifi_events, WIFI_EVENT_STA_CONNECTED_BIT);
     }
 
+    int reason = 0;
     if (data)
     {
         wifi_event_sta_disconnected_t* ev = (wifi_event_sta_disconnected_t*)data;
+        reason = ev->reason;
         ESP_LOGW(TAG, "WiFi disconnected: reason=%d (%s)", ev->reason, reason_to_str(ev->reason));
     }
 
+    // The driver restart disconnects on purpose
+    if (s_reconnect_state == RECONNECT_RESTART || s_reconnect_state == RECONNECT_STARTING)
+        return;
+
+    if (s_retry_count == 0)
+        s_disconnected_us = esp_timer_get_time();
     s_retry_count++;
-    if (s_retry_count < MAX_RETRY_COUNT)
-    {
-        ESP_LOGW(TAG, "WiFi disconnected, retry %d/%d...", s_retry_count, MAX_RETRY_COUNT);
-        // Exponential backoff: 500ms, 1s, 2s, 5s, 5s, ...
-        int backoff_ms = 500;
-        if (s_retry_count == 1)
-            backoff_ms = 500;
-        else if (s_retry_count == 2)
-            backoff_ms = 1000;
-        else if (s_retry_count == 3)
-            backoff_ms = 2000;
-        else
-            backoff_ms = 5000;
-        vTaskDelay(pdMS_TO_TICKS(backoff_ms));
-        esp_wifi_set_ps(WIFI_PS_NONE); // Disable power saving before reconnect
-        esp_err_t cret = esp_wifi_connect();
-        if (cret != ESP_OK)
-        {
-            ESP_LOGE(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(cret));
-        }
+
+    int delay_ms;
+    if (s_retry_count >= MAX_RETRY_COUNT)
+    {
+        ESP_LOGE(TAG, "WiFi connection failed after %d attempts. Check credentials.", MAX_RETRY_COUNT);
+        s_reconnect_state = RECONNECT_RESTART;
+        delay_ms = 0;
+    }
+    else if (s_last_ap.valid && s_retry_count <= FAST_RETRY_COUNT && reason != WIFI_REASON_NO_AP_FOUND)
+    {
+        s_reconnect_state = RECONNECT_FAST;
+        delay_ms = FAST_RETRY_DELAY_MS[s_retry_count - 1];
+        ESP_LOGW(TAG, "Fast reconnect %d/%d to last AP on channel %u", s_retry_count, MAX_RETRY_COUNT,
+                 s_last_ap.channel);
     }
     else
     {
-        ESP_LOGE(TAG, "WiFi connection failed after %d attempts. Check credentials.", MAX_RETRY_COUNT);
-
-        // Try clearing BSSID lock if we were stuck on a specific AP
-        wifi_config_t conf = {};
-        if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK)
+        // A reused lease is only trusted on the AP it came from
+        if (s_static_lease)
         {
-            if (conf.sta.bssid_set)
-            {
-                ESP_LOGW(TAG, "Clearing BSSID lock to allow roaming for next attempt");
-                conf.sta.bssid_set = false;
-                memset(conf.sta.bssid, 0, 6);
-                esp_wifi_set_config(WIFI_IF_STA, &conf);
-            }
+            esp_netif_dhcpc_start(s_netif);
+            s_static_lease = false;
         }
+        s_reconnect_state = RECONNECT_FULL;
+        delay_ms = backoff_ms(s_retry_count);
+        ESP_LOGW(TAG, "WiFi disconnected, retry %d/%d in %d ms...", s_retry_count, MAX_RETRY_COUNT, delay_ms);
+    }
+
+    if (!schedule_reconnect(delay_ms))
+        ESP_LOGE(TAG, "Failed to arm reconnect timer");
+}
+
+static bool load_ap_cache(const char* ssid, wifi_ap_cache_t* out)
+{
+    size_t len = sizeof(*out);
+    if (!FAST_BOOT || !nvs_store_read_blob(NVS_NS_WIFI, NVS_KEY_AP_CACHE, out, &len))
+        return false;
+    return len == sizeof(*out) && out->version == AP_CACHE_VERSION && out->channel > 0 &&
+           strncmp(out->ssid, ssid, sizeof(out->ssid)) == 0;
+}
 
-        ESP_LOGW(TAG, "Restarting WiFi driver...");
-        esp_wifi_stop();
-        vTaskDelay(pdMS_TO_TICKS(500));
-        esp_wifi_start();
-        // Force scan of all channels by ensuring config is flexible?
-        // esp_wifi_connect() uses current config.
+static void store_ap_cache(const esp_netif_ip_info_t* ip_info)
+{
+    if (!FAST_BOOT || !s_last_ap.valid)
+        return;
 
-        esp_wifi_set_ps(WIFI_PS_NONE);
-        esp_wifi_connect();
-        s_retry_count = 0;
+    wifi_config_t conf = {};
+    if (esp_wifi_get_config(WIFI_IF_STA, &conf) != ESP_OK)
+        return;
+
+    wifi_ap_cache_t cache = {};
+    cache.version = AP_CACHE_VERSION;
+    cache.channel = s_last_ap.channel;
+    memcpy(cache.bssid, s_last_ap.bssid, sizeof(cache.bssid));
+    memcpy(cache.ssid, conf.sta.ssid, WIFI_MAX_SSID_LEN);
+    cache.ip = ip_info->ip.addr;
+    cache.netmask = ip_info->netmask.addr;
+    cache.gw = ip_info->gw.addr;
+    // Written back in the background, and not at all if nothing changed
+    nvs_store_write_blob(NVS_NS_WIFI, NVS_KEY_AP_CACHE, &cache, sizeof(cache));
+}
+
+// HTTP server, REST API and WebSocket endpoint: started once, after the
+// first IP, from the esp_timer task rather than the event loop. The server
+// keeps running across reconnects.
+static void start_services(void* arg)
+{
+    if (s_services_started)
+        return;
+    s_services_started = true;
+
+    if (!g_httpd)
+        wifi_start_http_server(false);
+#if !WS_DISABLE_HTTP_API
+    http_api_start(g_httpd);
+#endif
+    ws_server_register(g_httpd);
+    boot_phase_mark(BOOT_PHASE_SERVICES);
+}
+
+static void on_wifi_connected(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    boot_phase_mark(BOOT_PHASE_ASSOCIATED);
+    if (data)
+    {
+        wifi_event_sta_connected_t* ev = (wifi_event_sta_connected_t*)data;
+        g_wifi_channel = ev->channel;
+        memcpy(s_last_ap.bssid, ev->bssid, sizeof(s_last_ap.bssid));
+        s_last_ap.channel = ev->channel;
+        s_last_ap.valid = true;
+    }
+    boot_phase_mark(BOOT_PHASE_RADIO_READY);
+    if (g_wifi_events)
+    {
+        xEventGroupSetBits(g_wifi_events, WIFI_EVENT_RADIO_READY_BIT);
     }
 }
 
@@ -111,21 +325,29 @@ static void on_got_ip(void* arg, esp_event_base_t base, int32_t id, void* data)
     ip_event_got_ip_t* event = (ip_event_got_ip_t*)data;
     snprintf(g_wifi_ip, sizeof(g_wifi_ip), IPSTR, IP2STR(&event->ip_info.ip));
     ESP_LOGI(TAG, "Got IP: %s", g_wifi_ip);
+    cancel_reconnect();
+    if (s_retry_count > 0)
+    {
+        ESP_LOGI(TAG, "Rejoined after %d attempts in %lu ms", s_retry_count,
+                 (unsigned long)((esp_timer_get_time() - s_disconnected_us) / 1000));
+    }
     s_retry_count = 0; // Reset retry count on successful connection
+    boot_phase_mark(BOOT_PHASE_GOT_IP);
     if (g_wifi_events)
     {
         xEventGroupSetBits(g_wifi_events, WIFI_EVENT_STA_CONNECTED_BIT);
     }
-    esp_wifi_set_ps(WIFI_PS_NONE);
-    wifi_start_http_server(false);
-    http_api_start(g_httpd);
-    ws_server_register(g_httpd);
+    if (!s_services_started && (!s_services_timer || esp_timer_start_once(s_services_timer, 1000) != ESP_OK))
+        start_services(NULL);
 
     // Lock Wi-Fi channel to AP channel for ESP-NOW coexistence
     wifi_ap_record_t ap_info = {};
     if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
     {
         g_wifi_channel = ap_info.primary;
+        memcpy(s_last_ap.bssid, ap_info.bssid, sizeof(s_last_ap.bssid));
+        s_last_ap.channel = ap_info.primary;
+        s_last_ap.valid = true;
         esp_err_t chret = esp_wifi_set_channel(g_wifi_channel, ap_info.second);
         if (chret == ESP_OK)
         {
@@ -136,12 +358,14 @@ static void on_got_ip(void* arg, esp_event_base_t base, int32_t id, void* data)
             ESP_LOGW(TAG, "Failed to lock channel: %s", esp_err_to_name(chret));
         }
     }
+    store_ap_cache(&event->ip_info);
 }
 
 void wifi_start_ap()
 {
     ESP_LOGI(TAG, "Starting AP provisioning mode");
     g_wifi_boot_mode = WIFI_BOOT_PROVISIONING;
+    cancel_reconnect();
     s_retry_count = 0;
 
     // Clean up any existing netif
@@ -207,7 +431,6 @@ void wifi_start_ap()
 
     ESP_LOGI(TAG, "AP mode started, SSID=%s", ssid_buf);
     g_wifi_channel = ap_config.ap.channel;
-    esp_wifi_set_ps(WIFI_PS_NONE);
 
     wifi_start_http_server(true);
 }
@@ -215,7 +438,11 @@ void wifi_start_ap()
 void wifi_start_sta(const char* ssid, const char* pass)
 {
     g_wifi_boot_mode = WIFI_BOOT_STA;
+    cancel_reconnect();
     s_retry_count = 0;
+    s_last_ap.valid = false;
+    s_bssid_locked = false;
+    s_static_lease = false;
     ESP_LOGI(TAG, "Starting STA mode SSID=%s, PASSCODE=%s", ssid, pass);
 
     // Clean up any existing netif
@@ -234,6 +461,29 @@ void wifi_start_sta(const char* ssid, const char* pass)
         return;
     }
 
+    if (!s_reconnect_timer)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = reconnect_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "wifi_reconnect",
+            .skip_unhandled_events = true,
+        };
+        esp_timer_create(&args, &s_reconnect_timer);
+    }
+    if (!s_services_timer)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = start_services,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "wifi_services",
+            .skip_unhandled_events = true,
+        };
+        esp_timer_create(&args, &s_services_timer);
+    }
+
     // Register event handlers for connection management
     esp_err_t hret =
         esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, on_wifi_disconnect, NULL, NULL);
@@ -241,6 +491,11 @@ void wifi_start_sta(const char* ssid, const char* pass)
     {
         ESP_LOGE(TAG, "Failed to register WIFI_EVENT handler: %s", esp_err_to_name(hret));
     }
+    hret = esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, on_wifi_connected, NULL, NULL);
+    if (hret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to register WIFI_EVENT handler: %s", esp_err_to_name(hret));
+    }
     hret = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, on_got_ip, NULL, NULL);
     if (hret != ESP_OK)
     {
@@ -254,7 +509,7 @@ void wifi_start_sta(const char* ssid, const char* pass)
         return;
     }
 
-    esp_coex_preference_set(ESP_COEX_PREFER_WIFI);
+    esp_coex_preference_set(radio_policy_coex());
 
     wifi_config_t sta_config = {};
     strncpy((char*)sta_config.sta.ssid, ssid, sizeof(sta_config.sta.ssid));
@@ -266,6 +521,36 @@ void wifi_start_sta(const char* ssid, const char* pass)
     sta_config.sta.listen_interval = 3;
     sta_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
 
+    // Fast boot: go straight for the AP of the last join on its channel. If
+    // it is gone the reconnect state machine falls back to a full scan.
+    wifi_ap_cache_t cache;
+    const bool cached = load_ap_cache(ssid, &cache);
+    if (cached)
+    {
+        sta_config.sta.channel = cache.channel;
+        memcpy(sta_config.sta.bssid, cache.bssid, sizeof(sta_config.sta.bssid));
+        sta_config.sta.bssid_set = true;
+        sta_config.sta.scan_method = WIFI_FAST_SCAN;
+        memcpy(s_last_ap.bssid, cache.bssid, sizeof(s_last_ap.bssid));
+        s_last_ap.channel = cache.channel;
+        s_last_ap.valid = true;
+        s_bssid_locked = true;
+        g_wifi_channel = cache.channel;
+        ESP_LOGI(TAG, "Fast boot: cached AP on channel %u", cache.channel);
+
+        if (REUSE_LEASE && cache.ip != 0)
+        {
+            esp_netif_ip_info_t ip_info = {};
+            ip_info.ip.addr = cache.ip;
+            ip_info.netmask.addr = cache.netmask;
+            ip_info.gw.addr = cache.gw;
+            if (esp_netif_dhcpc_stop(s_netif) == ESP_OK && esp_netif_set_ip_info(s_netif, &ip_info) == ESP_OK)
+                s_static_lease = true;
+            else
+                esp_netif_dhcpc_start(s_netif);
+        }
+    }
+
     /*
     wifi_ap_record_t best = {};
     if (find_best_ap(ssid, &best))
@@ -289,6 +574,10 @@ void wifi_start_sta(const char* ssid, const char* pass)
         return;
     }
 
+    // Set before every driver start (the reconnect state machine's restarts
+    // re-apply it too); mode changes update it in between
+    esp_wifi_set_ps(radio_policy_wifi_ps());
+
     ret = esp_wifi_start();
     if (ret != ESP_OK)
     {
@@ -296,8 +585,18 @@ void wifi_start_sta(const char* ssid, const char* pass)
         return;
     }
 
-    // Non-blocking connect - will retry asynchronously via event handler
-    esp_wifi_set_ps(WIFI_PS_NONE); // Disable power saving before connect
+    // On the cached channel the radio is usable for ESP-NOW right away,
+    // long before the association and DHCP finish
+    if (cached && esp_wifi_set_channel(cache.channel, WIFI_SECOND_CHAN_NONE) == ESP_OK)
+    {
+        boot_phase_mark(BOOT_PHASE_RADIO_READY);
+        if (g_wifi_events)
+        {
+            xEventGroupSetBits(g_wifi_events, WIFI_EVENT_RADIO_READY_BIT);
+        }
+    }
+
+    // Non-blocking connect - retries are driven by the reconnect timer
     ret = esp_wifi_connect();
     if (ret != ESP_OK)
     {
@@ -6,50 +6,42 @@
 #include <errno.h>
 #include <string.h>
 
+#include "http_stream.h"
 #include "nvs_store.h"
 #include "wifi_internal.h"
+#include "ws_server.h"
 
 static const char* TAG = "WiFiHttp";
 
+// httpd keeps three sockets for itself on top of max_open_sockets
+#define HTTPD_SOCKETS_NEEDED (WS_MAX_CLIENTS + 3 + 3)
+#ifdef CONFIG_LWIP_MAX_SOCKETS
+static_assert(HTTPD_SOCKETS_NEEDED <= CONFIG_LWIP_MAX_SOCKETS,
+              "LWIP_MAX_SOCKETS must be at least CONFIG_RAYZ_WS_MAX_CLIENTS + 6");
+#endif
+
+// Gzipped at build time from assets/provision.html (see CMakeLists.txt)
+extern const uint8_t provision_html_gz_start[] asm("_binary_provision_html_gz_start");
+extern const uint8_t provision_html_gz_end[] asm("_binary_provision_html_gz_end");
+
+static HttpAsset s_provision_page = {};
+
 static esp_err_t root_get_handler(httpd_req_t* req)
 {
     if (g_wifi_boot_mode == WIFI_BOOT_PROVISIONING)
     {
-        const char* page = "<!DOCTYPE html>"
-                           "<html>"
-                           "<head>"
-                           "<meta name=\"viewport\" content=\"width=device-width,initial-scale=1\">"
-                           "<style>"
-                           "*{box-sizing:border-box}"
-                           "body{margin:0;min-height:100vh;display:flex;justify-content:center;align-items:center;"
-                           "background:#fff;color:#111;font-family:sans-serif}"
-                           "form{background:#fff;padding:20px;border-radius:10px;width:100%;max-width:320px;"
-                           "box-shadow:0 10px 30px rgba(0,0,0,.08)}"
-                           "h2{text-align:center;margin:0 0 12px}"
-                           "input,button{width:100%;padding:10px;margin:6px 0;border-radius:8px;font-size:14px}"
-                           "input{border:1px solid #e5e7eb}"
-                           "button{border:0;background:#111;color:#fff;font-weight:600}"
-                           "</style>"
-                           "</head>"
-                           "<body>"
-                           "<form method=\"POST\" action=\"/config\">"
-                           "<h2>RayZ Provisioning</h2>"
-                           "<input name=\"ssid\" placeholder=\"SSID\" maxlength=\"32\" required>"
-                           "<input name=\"pass\" type=\"password\" placeholder=\"Password\" maxlength=\"64\">"
-                           "<input name=\"name\" placeholder=\"Device Name\" maxlength=\"32\" required>"
-                           "<button>Save &amp; Connect</button>"
-                           "</form>"
-                           "</body>"
-                           "</html>";
-
-        httpd_resp_send(req, page, HTTPD_RESP_USE_STRLEN);
+        if (!s_provision_page.data)
+        {
+            s_provision_page.data = provision_html_gz_start;
+            s_provision_page.len = (size_t)(provision_html_gz_end - provision_html_gz_start);
+            s_provision_page.content_type = "text/html";
+            s_provision_page.content_encoding = "gzip";
+        }
+        return http_send_asset(req, &s_provision_page);
     }
 
-    else
-    {
-        const char* page = "<html><body><h2>RayZ Online</h2><p>Device connected.</p></body></html>";
-        httpd_resp_send(req, page, HTTPD_RESP_USE_STRLEN);
-    }
+    const char* page = "<html><body><h2>RayZ Online</h2><p>Device connected.</p></body></html>";
+    httpd_resp_send(req, page, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
@@ -98,12 +90,14 @@ static esp_err_t config_post_handler(httpd_req_t* req)
         return ESP_OK;
     }
 
+    nvs_store_begin();
     nvs_store_write_str(NVS_NS_WIFI, NVS_KEY_SSID, ssid);
     nvs_store_write_str(NVS_NS_WIFI, NVS_KEY_PASS, pass);
     if (name[0])
         nvs_store_write_str(NVS_NS_WIFI, NVS_KEY_NAME, name);
     if (role[0])
         nvs_store_write_str(NVS_NS_WIFI, NVS_KEY_ROLE, role);
+    nvs_store_commit();
 
     char response[256];
     snprintf(response, sizeof(response),
@@ -119,6 +113,8 @@ static esp_err_t config_post_handler(httpd_req_t* req)
     // Give time for HTTP response to be sent
     vTaskDelay(pdMS_TO_TICKS(500));
 
+    nvs_store_flush();
+
     // Clean restart is the safest way to switch from AP to STA
     // This avoids race conditions with netif/driver cleanup
     esp_restart();
@@ -145,6 +141,8 @@ void wifi_start_http_server(bool provisioning_mode)
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
     config.stack_size = 8192;
+    config.max_uri_handlers = 12; // Portal, REST API and the WebSocket endpoint
+    config.max_open_sockets = WS_MAX_CLIENTS + 3; // Dashboards plus portal / REST requests
     esp_err_t ret = httpd_start(&g_httpd, &config);
     if (ret == ESP_OK)
     {
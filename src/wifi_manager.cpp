@@ -11,6 +11,7 @@
 
 
 #include "nvs_store.h"
+#include "runtime_metrics.h"
 #include "wifi_internal.h"
 #include "wifi_manager.h"
 
@@ -56,9 +57,42 @@ uint8_t wifi_manager_get_channel()
     return g_wifi_channel;
 }
 
+static char s_peer_csv[WIFI_PEER_LIST_LEN]; // Rendered from g_peers whenever they change
+
+static void render_peer_csv()
+{
+    if (espnow_comm_format_peer_csv(g_peers, g_peer_count, s_peer_csv, sizeof(s_peer_csv)) < 0)
+        s_peer_csv[0] = '\0';
+}
+
+int wifi_manager_get_peers(uint8_t (*out)[ESP_NOW_ETH_ALEN], int max_count)
+{
+    if (!out)
+        return 0;
+    int count = g_peer_count < max_count ? g_peer_count : max_count;
+    memcpy(out, g_peers, (size_t)count * ESP_NOW_ETH_ALEN);
+    return count;
+}
+
+bool wifi_manager_set_peers(const uint8_t (*macs)[ESP_NOW_ETH_ALEN], int count)
+{
+    if (!macs && count > 0)
+        return false;
+    if (count < 0)
+        count = 0;
+    if (count > ESPNOW_MAX_PEERS)
+        count = ESPNOW_MAX_PEERS;
+    if (count > 0)
+        memcpy(g_peers, macs, (size_t)count * ESP_NOW_ETH_ALEN);
+    g_peer_count = (uint8_t)count;
+    render_peer_csv();
+    return nvs_store_write_blob(NVS_NS_WIFI, NVS_KEY_PEER_MACS, g_peers, (size_t)count * ESP_NOW_ETH_ALEN);
+}
+
+// Not rendered here: concurrent readers would overwrite each other's copy
 const char* wifi_manager_get_peer_list()
 {
-    return g_peer_list;
+    return s_peer_csv;
 }
 
 bool wifi_manager_set_peer_list(const char* csv_peers)
@@ -66,34 +100,59 @@ bool wifi_manager_set_peer_list(const char* csv_peers)
     if (!csv_peers)
         return false;
 
-    strncpy(g_peer_list, csv_peers, sizeof(g_peer_list) - 1);
-    g_peer_list[sizeof(g_peer_list) - 1] = '\0';
-    return nvs_store_write_str(NVS_NS_WIFI, NVS_KEY_PEERS, g_peer_list);
+    uint8_t macs[ESPNOW_MAX_PEERS][ESP_NOW_ETH_ALEN];
+    int count = espnow_comm_parse_peer_csv(csv_peers, macs, ESPNOW_MAX_PEERS);
+    // An empty list clears the peers; one where nothing parses is a mistake
+    if (count == 0 && csv_peers[strspn(csv_peers, ",; \t\r\n")] != '\0')
+    {
+        ESP_LOGW(TAG, "No valid MAC in peer list, keeping current peers");
+        return false;
+    }
+    return wifi_manager_set_peers(macs, count);
 }
 
 bool wifi_manager_load_peer_list(char* out, size_t max_len)
 {
     if (!out || max_len == 0)
         return false;
-    bool ok = nvs_store_read_str(NVS_NS_WIFI, NVS_KEY_PEERS, out, max_len);
-    if (ok)
+    return espnow_comm_format_peer_csv(g_peers, g_peer_count, out, max_len) >= 0;
+}
+
+// Packed MACs, or the CSV string older firmware stored (rewritten as MACs)
+static void load_stored_peers()
+{
+    size_t len = sizeof(g_peers);
+    if (nvs_store_read_blob(NVS_NS_WIFI, NVS_KEY_PEER_MACS, g_peers, &len))
+    {
+        g_peer_count = (uint8_t)(len / ESP_NOW_ETH_ALEN);
+        render_peer_csv();
+        return;
+    }
+    g_peer_count = 0;
+    char csv[WIFI_PEER_LIST_LEN];
+    if (!nvs_store_read_str(NVS_NS_WIFI, NVS_KEY_PEERS, csv, sizeof(csv)) || !csv[0])
     {
-        strncpy(g_peer_list, out, sizeof(g_peer_list) - 1);
-        g_peer_list[sizeof(g_peer_list) - 1] = '\0';
+        render_peer_csv();
+        return;
     }
-    return ok;
+    if (!wifi_manager_set_peer_list(csv))
+        render_peer_csv();
+    nvs_store_write_str(NVS_NS_WIFI, NVS_KEY_PEERS, "");
+    ESP_LOGI(TAG, "Migrated %u peers from the CSV peer list", g_peer_count);
 }
 
 void wifi_manager_factory_reset()
 {
     ESP_LOGW(TAG, "Factory reset requested");
     nvs_store_erase_namespace(NVS_NS_WIFI);
-    g_peer_list[0] = '\0';
+    g_peer_count = 0;
+    nvs_store_flush();
     esp_restart();
 }
 
 void wifi_manager_init(const char* device_name, const char* role)
 {
+    boot_phase_mark(BOOT_PHASE_WIFI_INIT);
     if (!g_wifi_events)
         g_wifi_events = xEventGroupCreate();
     if (device_name)
@@ -112,10 +171,10 @@ void wifi_manager_init(const char* device_name, const char* role)
     esp_event_loop_create_default();
 
     // Load cached peer list from NVS (used by ESP-NOW after Wi-Fi is ready)
-    nvs_store_read_str(NVS_NS_WIFI, NVS_KEY_PEERS, g_peer_list, sizeof(g_peer_list));
-    if (strlen(g_peer_list) > 0)
+    load_stored_peers();
+    if (g_peer_count > 0)
     {
-        ESP_LOGI(TAG, "Loaded %u bytes of peer list from NVS", (unsigned)strlen(g_peer_list));
+        ESP_LOGI(TAG, "Loaded %u peers from NVS", g_peer_count);
     }
 
     wifi_evaluate_boot_mode();
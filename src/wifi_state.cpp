@@ -7,4 +7,5 @@ httpd_handle_t g_httpd = NULL;
 char g_device_name[32] = {0};
 char g_role[12] = {0};
 uint8_t g_wifi_channel = 1;
-char g_peer_list[256] = {0};
+uint8_t g_peers[ESPNOW_MAX_PEERS][ESP_NOW_ETH_ALEN] = {};
+uint8_t g_peer_count = 0;
@@ -0,0 +1,1260 @@
+#include "ws_codec.h"
+#include <esp_timer.h>
+#include <string.h>
+#include "config_fields.h"
+#include "game_state.h"
+#include "time_sync.h"
+
+// ============================================================================
+// WRITER
+// ============================================================================
+
+// Streaming writer over a fixed buffer that emits either JSON or MessagePack.
+// Map sizes are only needed by MessagePack and must count every field except
+// the JSON-only "type" string. Overflow is sticky: once set, further writes
+// are ignored and finish() reports failure.
+struct MsgWriter
+{
+    WsFormat fmt;
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+    bool need_comma;
+
+    MsgWriter(WsFormat f, uint8_t* b, size_t c)
+        : fmt(f), buf(b), cap(c), len(0), overflow(b == nullptr || c == 0), need_comma(false)
+    {
+    }
+
+    bool json() const
+    {
+        return fmt == WS_FORMAT_JSON;
+    }
+
+    void put(uint8_t c)
+    {
+        // Keep one byte spare for the JSON terminator
+        if (len + 1 >= cap)
+        {
+            overflow = true;
+            return;
+        }
+        buf[len++] = c;
+    }
+
+    void put(const void* s, size_t n)
+    {
+        if (len + n >= cap)
+        {
+            overflow = true;
+            return;
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+    }
+
+    void put_be(uint64_t v, int bytes)
+    {
+        for (int i = bytes - 1; i >= 0; i--)
+            put((uint8_t)(v >> (i * 8)));
+    }
+
+    // --- MessagePack primitives ---
+
+    void mp_str(const char* s, size_t n)
+    {
+        if (n < 32)
+            put((uint8_t)(0xa0 | n));
+        else if (n <= 0xff)
+        {
+            put(0xd9);
+            put((uint8_t)n);
+        }
+        else
+        {
+            put(0xda);
+            put_be(n, 2);
+        }
+        put(s, n);
+    }
+
+    void mp_uint(uint64_t v)
+    {
+        if (v < 0x80)
+            put((uint8_t)v);
+        else if (v <= 0xff)
+        {
+            put(0xcc);
+            put((uint8_t)v);
+        }
+        else if (v <= 0xffff)
+        {
+            put(0xcd);
+            put_be(v, 2);
+        }
+        else if (v <= 0xffffffffu)
+        {
+            put(0xce);
+            put_be(v, 4);
+        }
+        else
+        {
+            put(0xcf);
+            put_be(v, 8);
+        }
+    }
+
+    // --- JSON primitives ---
+
+    void json_uint(uint64_t v)
+    {
+        char tmp[20];
+        int n = 0;
+        do
+        {
+            tmp[n++] = (char)('0' + (v % 10));
+            v /= 10;
+        } while (v);
+        while (n)
+            put((uint8_t)tmp[--n]);
+    }
+
+    void json_str(const char* v)
+    {
+        put('"');
+        for (; v && *v; v++)
+        {
+            const char c = *v;
+            if (c == '"' || c == '\\')
+            {
+                put('\\');
+                put(c);
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                static const char hex[] = "0123456789abcdef";
+                char esc[6] = {'\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF]};
+                put(esc, sizeof(esc));
+            }
+            else
+            {
+                put(c);
+            }
+        }
+        put('"');
+    }
+
+    // --- Structure ---
+
+    void key(const char* k)
+    {
+        if (json())
+        {
+            if (need_comma)
+                put(',');
+            need_comma = true;
+            put('"');
+            put(k, strlen(k));
+            put("\":", 2);
+        }
+        else
+        {
+            mp_str(k, strlen(k));
+        }
+    }
+
+    void begin_map(uint8_t fields)
+    {
+        if (json())
+        {
+            put('{');
+            need_comma = false;
+        }
+        else
+        {
+            put((uint8_t)(0x80 | (fields & 0x0f)));
+        }
+    }
+
+    void begin_map(const char* k, uint8_t fields)
+    {
+        key(k);
+        begin_map(fields);
+    }
+
+    void end_map()
+    {
+        if (json())
+        {
+            put('}');
+            need_comma = true;
+        }
+    }
+
+    // --- Fields ---
+
+    void u64(const char* k, uint64_t v)
+    {
+        key(k);
+        if (json())
+            json_uint(v);
+        else
+            mp_uint(v);
+    }
+
+    void u32(const char* k, uint32_t v)
+    {
+        u64(k, v);
+    }
+
+    void boolean(const char* k, bool v)
+    {
+        key(k);
+        if (json())
+        {
+            if (v)
+                put("true", 4);
+            else
+                put("false", 5);
+        }
+        else
+        {
+            put(v ? 0xc3 : 0xc2);
+        }
+    }
+
+    void str(const char* k, const char* v)
+    {
+        key(k);
+        if (json())
+            json_str(v);
+        else
+            mp_str(v ? v : "", v ? strlen(v) : 0);
+    }
+
+    int finish()
+    {
+        if (overflow)
+            return -1;
+        if (json())
+            buf[len] = '\0';
+        return (int)len;
+    }
+};
+
+static uint64_t uptime_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000);
+}
+
+// Event time on the shared mesh clock
+static uint64_t event_time_us(void)
+{
+    return (uint64_t)game_state_synced_time_us();
+}
+
+// Opens the root map with op (and the JSON-only type string). `fields` must
+// include op itself.
+static void write_header(MsgWriter& w, OpCode op, uint8_t fields)
+{
+    w.begin_map(fields);
+    w.u32("op", op);
+    if (w.json())
+        w.str("type", ws_codec_op_name(op));
+}
+
+// ============================================================================
+// ENCODERS
+// ============================================================================
+
+static const uint8_t* config_target(ConfigTarget target)
+{
+    if (target == CFG_TARGET_DEVICE)
+        return (const uint8_t*)game_state_get_config();
+    if (target == CFG_TARGET_GAME)
+        return (const uint8_t*)game_state_get_game_config();
+    return nullptr;
+}
+
+static void write_config(MsgWriter& w)
+{
+    w.begin_map("config", config_status_field_count());
+    for (const ConfigField& f : kConfigFields)
+    {
+        if (!(f.flags & CFG_STATUS))
+            continue;
+        const uint8_t* base = config_target(f.target);
+        if (f.type == CFG_STR)
+        {
+            w.str(f.key, (const char*)(base + f.cfg_offset));
+            continue;
+        }
+        uint32_t v = config_field_load(f.type, base + f.cfg_offset);
+        if (f.type == CFG_BOOL && (f.flags & CFG_INVERT))
+            v = !v;
+        if (f.flags & CFG_STATUS_TRUE)
+            w.boolean(f.key, true);
+        else if (f.flags & CFG_STATUS_NUM)
+            w.u32(f.key, v ? 1 : 0);
+        else if (f.type == CFG_BOOL)
+            w.boolean(f.key, v);
+        else
+            w.u32(f.key, v / f.scale);
+    }
+    w.end_map();
+}
+
+// The stats/state blocks only carry the fields selected by `fields`
+// (GS_DIRTY_* bits); full snapshots pass GS_DIRTY_ALL.
+static void write_stats(MsgWriter& w, const GameStateData* st, uint32_t fields)
+{
+    w.begin_map("stats", (uint8_t)__builtin_popcount(fields & GS_DIRTY_STATS));
+    if (fields & GS_DIRTY_SHOTS)
+        w.u32("shots", st->shots_fired);
+    if (fields & GS_DIRTY_ENEMY_KILLS)
+        w.u32("enemy_kills", st->kills);
+    if (fields & GS_DIRTY_FRIENDLY_KILLS)
+        w.u32("friendly_kills", st->friendly_fire_count);
+    if (fields & GS_DIRTY_DEATHS)
+        w.u32("deaths", st->deaths);
+    w.end_map();
+}
+
+static void write_state(MsgWriter& w, const GameStateData* st, uint32_t fields)
+{
+    w.begin_map("state", (uint8_t)__builtin_popcount(fields & GS_DIRTY_STATE));
+    if (fields & GS_DIRTY_HEARTS)
+        w.u32("current_hearts", st->hearts_remaining);
+    if (fields & GS_DIRTY_AMMO)
+        w.u32("current_ammo", st->current_ammo);
+    if (fields & GS_DIRTY_RESPAWNING)
+        w.boolean("is_respawning", st->respawning);
+    if (fields & GS_DIRTY_RELOADING)
+        w.boolean("is_reloading", st->reloading);
+    w.end_map();
+}
+
+int ws_codec_status(WsFormat fmt, uint8_t* buffer, size_t max_len)
+{
+    GameStateData st;
+    game_state_snapshot(&st);
+
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_STATUS, 6);
+    w.u32("seq", game_state_status_seq());
+    w.u64("uptime_ms", uptime_ms());
+    write_config(w);
+    write_stats(w, &st, GS_DIRTY_ALL);
+    write_state(w, &st, GS_DIRTY_ALL);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_status_delta(WsFormat fmt, uint8_t* buffer, size_t max_len, uint32_t fields, uint32_t seq)
+{
+    const bool config = fields & GS_DIRTY_CONFIG;
+    const bool stats = fields & GS_DIRTY_STATS;
+    const bool state = fields & GS_DIRTY_STATE;
+
+    GameStateData st;
+    game_state_snapshot(&st);
+
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_STATUS_DELTA, (uint8_t)(3 + config + stats + state));
+    w.u32("seq", seq);
+    w.u64("uptime_ms", uptime_ms());
+    if (config)
+        write_config(w);
+    if (stats)
+        write_stats(w, &st, fields);
+    if (state)
+        write_state(w, &st, fields);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_heartbeat_ack(WsFormat fmt, uint8_t* buffer, size_t max_len)
+{
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_HEARTBEAT_ACK, 1);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_shot_fired(WsFormat fmt, uint8_t* buffer, size_t max_len)
+{
+    const GameStateData* st = game_state_get();
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_SHOT_FIRED, 5);
+    const uint64_t ts = event_time_us();
+    w.u64("timestamp_ms", ts / 1000);
+    w.u64("timestamp_us", ts);
+    w.boolean("clock_synced", time_sync_is_synced());
+    w.u32("seq_id", st->shots_fired);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_hit_report(WsFormat fmt, uint8_t* buffer, size_t max_len, uint8_t shooter_id)
+{
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_HIT_REPORT, 5);
+    const uint64_t ts = event_time_us();
+    w.u64("timestamp_ms", ts / 1000);
+    w.u64("timestamp_us", ts);
+    w.boolean("clock_synced", time_sync_is_synced());
+    w.u32("shooter_id", shooter_id);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_respawn(WsFormat fmt, uint8_t* buffer, size_t max_len)
+{
+    const GameStateData* st = game_state_get();
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_RESPAWN, 3);
+    w.u64("timestamp_ms", event_time_us() / 1000);
+    w.u32("current_hearts", st->hearts_remaining);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_reload_event(WsFormat fmt, uint8_t* buffer, size_t max_len, uint16_t current_ammo)
+{
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_RELOAD_EVENT, 2);
+    w.u32("current_ammo", current_ammo);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_game_over(WsFormat fmt, uint8_t* buffer, size_t max_len)
+{
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_GAME_OVER, 2);
+    w.u64("timestamp_ms", event_time_us() / 1000);
+    w.end_map();
+    return w.finish();
+}
+
+int ws_codec_ack(WsFormat fmt, uint8_t* buffer, size_t max_len, const char* reply_to, bool success)
+{
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_ACK, 3);
+    w.str("reply_to", reply_to ? reply_to : "");
+    w.boolean("success", success);
+    w.end_map();
+    return w.finish();
+}
+
+static void write_heap(MsgWriter& w, const char* k, const SystemHeapStats* h)
+{
+    w.begin_map(k, 3);
+    w.u32("free", h->free_bytes);
+    w.u32("largest_block", h->largest_block);
+    w.u32("min_free", h->min_free);
+    w.end_map();
+}
+
+int ws_codec_system_stats(WsFormat fmt, uint8_t* buffer, size_t max_len, const SystemStats* stats)
+{
+    if (!stats)
+        return -1;
+    const bool psram = stats->psram.free_bytes != 0 || stats->psram.min_free != 0;
+    const uint8_t cores = (stats->cpu_load_pct[0] != SYSTEM_STATS_CPU_UNKNOWN) +
+                          (stats->cpu_load_pct[1] != SYSTEM_STATS_CPU_UNKNOWN);
+
+    MsgWriter w(fmt, buffer, max_len);
+    write_header(w, OP_SYSTEM_STATS, (uint8_t)(4 + psram + (cores > 0)));
+    w.u32("uptime_ms", stats->sampled_ms);
+    write_heap(w, "heap", &stats->internal);
+    if (psram)
+        write_heap(w, "psram", &stats->psram);
+    if (cores > 0)
+    {
+        w.begin_map("cpu", cores);
+        if (stats->cpu_load_pct[0] != SYSTEM_STATS_CPU_UNKNOWN)
+            w.u32("core0", stats->cpu_load_pct[0]);
+        if (stats->cpu_load_pct[1] != SYSTEM_STATS_CPU_UNKNOWN)
+            w.u32("core1", stats->cpu_load_pct[1]);
+        w.end_map();
+    }
+    w.begin_map("tasks", stats->task_count);
+    for (uint8_t i = 0; i < stats->task_count; i++)
+    {
+        const SystemTaskStats* t = &stats->tasks[i];
+        const bool cpu = t->cpu_pct != SYSTEM_STATS_CPU_UNKNOWN;
+        w.begin_map(t->name, (uint8_t)(1 + cpu));
+        w.u32("stack_free", t->stack_free);
+        if (cpu)
+            w.u32("cpu", t->cpu_pct);
+        w.end_map();
+    }
+    w.end_map();
+    w.end_map();
+    return w.finish();
+}
+
+const char* ws_codec_op_name(int op)
+{
+    switch (op)
+    {
+        case OP_GET_STATUS:
+            return "get_status";
+        case OP_HEARTBEAT:
+            return "heartbeat";
+        case OP_CONFIG_UPDATE:
+            return "config_update";
+        case OP_GAME_COMMAND:
+            return "game_command";
+        case OP_HIT_FORWARD:
+            return "hit_forward";
+        case OP_KILL_CONFIRMED:
+            return "kill_confirmed";
+        case OP_REMOTE_SOUND:
+            return "remote_sound";
+        case OP_NVS_SNAPSHOT:
+            return "nvs_snapshot";
+        case OP_STATUS:
+            return "status";
+        case OP_HEARTBEAT_ACK:
+            return "heartbeat_ack";
+        case OP_SHOT_FIRED:
+            return "shot_fired";
+        case OP_HIT_REPORT:
+            return "hit_report";
+        case OP_RESPAWN:
+            return "respawn";
+        case OP_RELOAD_EVENT:
+            return "reload_event";
+        case OP_GAME_OVER:
+            return "game_over";
+        case OP_STATUS_DELTA:
+            return "status_delta";
+        case OP_SYSTEM_STATS:
+            return "system_stats";
+        case OP_ACK:
+            return "ack";
+        default:
+            return "unknown";
+    }
+}
+
+static OpCode op_from_name(const char* name, size_t len)
+{
+    static const OpCode client_ops[] = {OP_GET_STATUS,     OP_HEARTBEAT,    OP_CONFIG_UPDATE,
+                                        OP_GAME_COMMAND,   OP_HIT_FORWARD,  OP_KILL_CONFIRMED,
+                                        OP_REMOTE_SOUND,   OP_NVS_SNAPSHOT};
+    for (OpCode op : client_ops)
+    {
+        const char* n = ws_codec_op_name(op);
+        if (strlen(n) == len && memcmp(n, name, len) == 0)
+            return op;
+    }
+    return (OpCode)0;
+}
+
+// ============================================================================
+// DECODER - shared field mapping
+// ============================================================================
+
+// A decoded scalar or string value, independent of the wire format.
+struct FieldValue
+{
+    enum Kind
+    {
+        NONE,
+        INT,
+        BOOL,
+        STR
+    } kind;
+    int64_t i;
+    const char* s;
+    size_t s_len;
+    bool s_escaped; // JSON string still contains backslash escapes
+};
+
+// Collects every field the decoder understands; copied into the WsClientMessage
+// union view once the op is known, so field order in the frame doesn't matter.
+struct DecodeState
+{
+    OpCode op;
+    char req_id[24];
+    WsConfigUpdate config;
+    uint8_t command;
+    uint8_t shooter_id;
+    uint8_t sound_id;
+    bool diff;
+};
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static void copy_str(char* dst, size_t cap, const FieldValue& v)
+{
+    if (!v.s_escaped)
+    {
+        size_t n = v.s_len < cap - 1 ? v.s_len : cap - 1;
+        memcpy(dst, v.s, n);
+        dst[n] = '\0';
+        return;
+    }
+
+    // Unescape while copying; the reader has already validated the string
+    size_t n = 0;
+    for (size_t i = 0; i < v.s_len && n < cap - 1; i++)
+    {
+        char c = v.s[i];
+        if (c != '\\' || i + 1 >= v.s_len)
+        {
+            dst[n++] = c;
+            continue;
+        }
+        c = v.s[++i];
+        switch (c)
+        {
+            case 'b':
+                dst[n++] = '\b';
+                break;
+            case 'f':
+                dst[n++] = '\f';
+                break;
+            case 'n':
+                dst[n++] = '\n';
+                break;
+            case 'r':
+                dst[n++] = '\r';
+                break;
+            case 't':
+                dst[n++] = '\t';
+                break;
+            case 'u':
+            {
+                uint32_t cp = 0;
+                for (int k = 0; k < 4 && i + 1 < v.s_len; k++)
+                    cp = (cp << 4) | (uint32_t)hex_digit(v.s[++i]);
+                // UTF-8; surrogate pairs are not needed by the protocol
+                if (cp >= 0xD800 && cp <= 0xDFFF)
+                    cp = '?';
+                if (cp < 0x80)
+                    dst[n++] = (char)cp;
+                else if (cp < 0x800 && n + 2 < cap)
+                {
+                    dst[n++] = (char)(0xC0 | (cp >> 6));
+                    dst[n++] = (char)(0x80 | (cp & 0x3F));
+                }
+                else if (cp >= 0x800 && n + 3 < cap)
+                {
+                    dst[n++] = (char)(0xE0 | (cp >> 12));
+                    dst[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    dst[n++] = (char)(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    n = cap - 1; // No room for the whole character
+                }
+                break;
+            }
+            default:
+                dst[n++] = c; // \" \\ \/
+                break;
+        }
+    }
+    dst[n] = '\0';
+}
+
+static bool key_is(const char* key, size_t key_len, const char* name)
+{
+    return strlen(name) == key_len && memcmp(key, name, key_len) == 0;
+}
+
+static const ConfigField* find_config_field(const char* key, size_t key_len)
+{
+    for (const ConfigField& f : kConfigFields)
+    {
+        if (f.present && f.key_len == key_len && memcmp(f.key, key, key_len) == 0)
+            return &f;
+    }
+    return nullptr;
+}
+
+// Stores one top-level field. Unknown keys and mistyped values are ignored.
+static void apply_field(DecodeState* st, const char* key, size_t key_len, const FieldValue& v)
+{
+    if (v.kind == FieldValue::STR)
+    {
+        if (key_is(key, key_len, "type"))
+        {
+            if (st->op == 0)
+                st->op = op_from_name(v.s, v.s_len);
+        }
+        else if (key_is(key, key_len, "req_id"))
+            copy_str(st->req_id, sizeof(st->req_id), v);
+        else if (const ConfigField* f = find_config_field(key, key_len))
+        {
+            if (f->type == CFG_STR)
+            {
+                copy_str((char*)&st->config + f->msg_offset, f->msg_size, v);
+                st->config.present |= f->present;
+            }
+        }
+        return;
+    }
+    if (v.kind != FieldValue::INT && v.kind != FieldValue::BOOL)
+        return;
+
+    const int64_t i = v.i;
+    if (key_is(key, key_len, "op"))
+        st->op = (OpCode)i; // an explicit op wins over the type string
+    else if (key_is(key, key_len, "command"))
+        st->command = (uint8_t)i;
+    else if (key_is(key, key_len, "shooter_id"))
+        st->shooter_id = (uint8_t)i;
+    else if (key_is(key, key_len, "sound_id"))
+        st->sound_id = (uint8_t)i;
+    else if (key_is(key, key_len, "diff"))
+        st->diff = i != 0;
+    else if (const ConfigField* f = find_config_field(key, key_len))
+    {
+        if (f->type == CFG_STR)
+            return;
+        // Integers wrap to the field width; apply clamps the stored value
+        config_field_store(f->type, (uint8_t*)&st->config + f->msg_offset, (uint32_t)i);
+        st->config.present |= f->present;
+    }
+}
+
+static void finish_decode(const DecodeState* st, WsClientMessage* out)
+{
+    out->op = st->op;
+    memcpy(out->req_id, st->req_id, sizeof(out->req_id));
+    switch ((int)st->op)
+    {
+        case 0: // Bare config object (game_state_config_from_json)
+        case OP_CONFIG_UPDATE:
+            out->config = st->config;
+            break;
+        case OP_GAME_COMMAND:
+            out->game_command.command = st->command;
+            break;
+        case OP_HIT_FORWARD:
+            out->hit_forward.shooter_id = st->shooter_id;
+            break;
+        case OP_REMOTE_SOUND:
+            out->remote_sound.sound_id = st->sound_id;
+            break;
+        case OP_NVS_SNAPSHOT:
+            out->nvs_snapshot.diff = st->diff;
+            break;
+        default:
+            break;
+    }
+}
+
+// ============================================================================
+// DECODER - MessagePack
+// ============================================================================
+
+struct MpReader
+{
+    const uint8_t* p;
+    const uint8_t* end;
+    bool error;
+
+    MpReader(const uint8_t* d, size_t n) : p(d), end(d + n), error(false) {}
+
+    bool need(size_t n)
+    {
+        if ((size_t)(end - p) < n)
+            error = true;
+        return !error;
+    }
+
+    uint64_t be(int bytes)
+    {
+        if (!need(bytes))
+            return 0;
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++)
+            v = (v << 8) | *p++;
+        return v;
+    }
+
+    // Reads any scalar or string; containers are skipped and reported as NONE.
+    FieldValue value(int depth = 0)
+    {
+        FieldValue v = {FieldValue::NONE, 0, nullptr, 0, false};
+        if (!need(1))
+            return v;
+        const uint8_t t = *p++;
+
+        if (t <= 0x7f || t >= 0xe0)
+        {
+            v.kind = FieldValue::INT;
+            v.i = (int8_t)t;
+            if (t <= 0x7f)
+                v.i = t;
+            return v;
+        }
+        if ((t & 0xe0) == 0xa0 || t == 0xd9 || t == 0xda || t == 0xdb)
+        {
+            size_t n = (t & 0xe0) == 0xa0 ? (t & 0x1f) : (size_t)be(t == 0xd9 ? 1 : t == 0xda ? 2 : 4);
+            if (!need(n))
+                return v;
+            v.kind = FieldValue::STR;
+            v.s = (const char*)p;
+            v.s_len = n;
+            p += n;
+            return v;
+        }
+        switch (t)
+        {
+            case 0xc0:
+                return v;
+            case 0xc2:
+            case 0xc3:
+                v.kind = FieldValue::BOOL;
+                v.i = t == 0xc3;
+                return v;
+            case 0xcc:
+            case 0xcd:
+            case 0xce:
+            case 0xcf:
+                v.kind = FieldValue::INT;
+                v.i = (int64_t)be(1 << (t - 0xcc));
+                return v;
+            case 0xd0:
+                v.kind = FieldValue::INT;
+                v.i = (int8_t)be(1);
+                return v;
+            case 0xd1:
+                v.kind = FieldValue::INT;
+                v.i = (int16_t)be(2);
+                return v;
+            case 0xd2:
+                v.kind = FieldValue::INT;
+                v.i = (int32_t)be(4);
+                return v;
+            case 0xd3:
+                v.kind = FieldValue::INT;
+                v.i = (int64_t)be(8);
+                return v;
+            case 0xca:
+                be(4); // float32: not used by the protocol
+                return v;
+            case 0xcb:
+                be(8);
+                return v;
+            case 0xc4:
+            case 0xc5:
+            case 0xc6:
+            {
+                size_t n = (size_t)be(1 << (t - 0xc4));
+                if (need(n))
+                    p += n;
+                return v;
+            }
+            default:
+                break;
+        }
+
+        // Containers
+        size_t count = 0;
+        size_t per_entry = 1;
+        if ((t & 0xf0) == 0x90)
+            count = t & 0x0f;
+        else if ((t & 0xf0) == 0x80)
+            count = t & 0x0f, per_entry = 2;
+        else if (t == 0xdc || t == 0xdd)
+            count = (size_t)be(t == 0xdc ? 2 : 4);
+        else if (t == 0xde || t == 0xdf)
+            count = (size_t)be(t == 0xde ? 2 : 4), per_entry = 2;
+        else
+        {
+            error = true; // ext types are not part of the protocol
+            return v;
+        }
+        if (depth >= 4)
+        {
+            error = true;
+            return v;
+        }
+        for (size_t i = 0; i < count * per_entry && !error; i++)
+            value(depth + 1);
+        return v;
+    }
+
+    // Returns the entry count of a map header, or -1 if the next value is not a map.
+    int map_header()
+    {
+        if (!need(1))
+            return -1;
+        const uint8_t t = *p;
+        if ((t & 0xf0) == 0x80)
+        {
+            p++;
+            return t & 0x0f;
+        }
+        if (t == 0xde || t == 0xdf)
+        {
+            p++;
+            return (int)be(t == 0xde ? 2 : 4);
+        }
+        return -1;
+    }
+};
+
+static bool decode_msgpack(const uint8_t* data, size_t len, DecodeState* out)
+{
+    MpReader r(data, len);
+    int entries = r.map_header();
+    if (entries < 0)
+        return false;
+    for (int i = 0; i < entries && !r.error; i++)
+    {
+        FieldValue k = r.value();
+        FieldValue v = r.value();
+        if (!r.error && k.kind == FieldValue::STR)
+            apply_field(out, k.s, k.s_len, v);
+    }
+    return !r.error;
+}
+
+// ============================================================================
+// DECODER - JSON
+// ============================================================================
+
+// Single pass over the frame, no allocation: keys and string values are
+// returned as spans into the buffer and only copied (and unescaped) when a
+// field is stored.
+struct JsonReader
+{
+    const char* p;
+    const char* end;
+    bool error;
+
+    JsonReader(const uint8_t* d, size_t n) : p((const char*)d), end((const char*)d + n), error(false) {}
+
+    void ws()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool eat(char c)
+    {
+        ws();
+        if (p < end && *p == c)
+        {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(const char* lit, size_t n)
+    {
+        if ((size_t)(end - p) < n || memcmp(p, lit, n) != 0)
+        {
+            error = true;
+            return false;
+        }
+        p += n;
+        return true;
+    }
+
+    // At the opening quote
+    FieldValue string()
+    {
+        FieldValue v = {FieldValue::STR, 0, ++p, 0, false};
+        while (p < end && *p != '"')
+        {
+            if ((unsigned char)*p < 0x20)
+                break;
+            if (*p == '\\')
+            {
+                v.s_escaped = true;
+                if (++p >= end)
+                    break;
+                if (*p == 'u')
+                {
+                    if (end - p < 5 || hex_digit(p[1]) < 0 || hex_digit(p[2]) < 0 || hex_digit(p[3]) < 0 ||
+                        hex_digit(p[4]) < 0)
+                        break;
+                    p += 4;
+                }
+                else if (!strchr("\"\\/bfnrt", *p))
+                    break;
+            }
+            p++;
+        }
+        if (p >= end || *p != '"')
+        {
+            error = true;
+            v.kind = FieldValue::NONE;
+            return v;
+        }
+        v.s_len = (size_t)(p - v.s);
+        p++;
+        return v;
+    }
+
+    // Integer part with optional fraction and exponent, truncated toward zero
+    FieldValue number()
+    {
+        FieldValue v = {FieldValue::INT, 0, nullptr, 0, false};
+        const bool neg = p < end && *p == '-';
+        if (neg)
+            p++;
+        if (p >= end || *p < '0' || *p > '9')
+        {
+            error = true;
+            return v;
+        }
+        uint64_t mant = 0;
+        int exp10 = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            if (mant < 100000000000000000ull)
+                mant = mant * 10 + (uint64_t)(*p - '0');
+            else
+                exp10++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+            {
+                if (mant < 100000000000000000ull)
+                {
+                    mant = mant * 10 + (uint64_t)(*p - '0');
+                    exp10--;
+                }
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool eneg = false;
+            if (p < end && (*p == '+' || *p == '-'))
+                eneg = *p++ == '-';
+            int e = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; p++)
+                e = e < 1000 ? e * 10 + (*p - '0') : e;
+            exp10 += eneg ? -e : e;
+        }
+        for (; exp10 < 0 && mant; exp10++)
+            mant /= 10;
+        for (; exp10 > 0 && mant; exp10--)
+            mant = mant > UINT64_MAX / 10 ? UINT64_MAX : mant * 10;
+        if (mant > (uint64_t)INT64_MAX)
+            mant = (uint64_t)INT64_MAX;
+        v.i = neg ? -(int64_t)mant : (int64_t)mant;
+        return v;
+    }
+
+    // Reads any scalar or string; containers are skipped and reported as NONE.
+    FieldValue value(int depth = 0)
+    {
+        FieldValue v = {FieldValue::NONE, 0, nullptr, 0, false};
+        ws();
+        if (p >= end)
+        {
+            error = true;
+            return v;
+        }
+        switch (*p)
+        {
+            case '"':
+                return string();
+            case 't':
+                if (literal("true", 4))
+                    v.kind = FieldValue::BOOL, v.i = 1;
+                return v;
+            case 'f':
+                if (literal("false", 5))
+                    v.kind = FieldValue::BOOL;
+                return v;
+            case 'n':
+                literal("null", 4);
+                return v;
+            case '{':
+            case '[':
+                break;
+            default:
+                return number();
+        }
+
+        const char close = *p == '{' ? '}' : ']';
+        const bool object = *p == '{';
+        p++;
+        if (depth >= 4)
+        {
+            error = true;
+            return v;
+        }
+        if (eat(close))
+            return v;
+        do
+        {
+            if (object)
+            {
+                ws();
+                if (p >= end || *p != '"' || string().kind != FieldValue::STR || !eat(':'))
+                {
+                    error = true;
+                    return v;
+                }
+            }
+            value(depth + 1);
+        } while (!error && eat(','));
+        if (!error && !eat(close))
+            error = true;
+        return v;
+    }
+};
+
+static bool decode_json(const uint8_t* data, size_t len, DecodeState* out)
+{
+    JsonReader r(data, len);
+    if (!r.eat('{'))
+        return false;
+    if (r.eat('}'))
+        return true;
+    do
+    {
+        r.ws();
+        if (r.p >= r.end || *r.p != '"')
+            return false;
+        FieldValue k = r.string();
+        if (r.error || !r.eat(':'))
+            return false;
+        FieldValue v = r.value();
+        if (r.error)
+            return false;
+        if (!k.s_escaped)
+            apply_field(out, k.s, k.s_len, v);
+    } while (r.eat(','));
+    return r.eat('}');
+}
+
+bool ws_codec_decode(WsFormat fmt, const uint8_t* data, size_t len, WsClientMessage* out)
+{
+    if (!data || len == 0 || !out)
+        return false;
+    DecodeState st;
+    memset(&st, 0, sizeof(st));
+    bool ok = fmt == WS_FORMAT_MSGPACK ? decode_msgpack(data, len, &st) : decode_json(data, len, &st);
+    memset(out, 0, sizeof(*out));
+    if (ok)
+        finish_decode(&st, out);
+    return ok;
+}
+
+// ============================================================================
+// OPCODE PEEK
+// ============================================================================
+
+static bool op_value(const FieldValue& v, OpCode* op)
+{
+    if (v.kind != FieldValue::INT && v.kind != FieldValue::BOOL)
+        return false;
+    *op = (OpCode)v.i;
+    return true;
+}
+
+static OpCode peek_msgpack(const uint8_t* data, size_t len)
+{
+    MpReader r(data, len);
+    int entries = r.map_header();
+    OpCode by_type = (OpCode)0;
+    for (int i = 0; i < entries && !r.error; i++)
+    {
+        FieldValue k = r.value();
+        FieldValue v = r.value();
+        if (r.error || k.kind != FieldValue::STR)
+            continue;
+        OpCode op;
+        if (key_is(k.s, k.s_len, "op") && op_value(v, &op))
+            return op;
+        if (key_is(k.s, k.s_len, "type") && v.kind == FieldValue::STR && by_type == 0)
+            by_type = op_from_name(v.s, v.s_len);
+    }
+    return r.error ? (OpCode)0 : by_type;
+}
+
+static OpCode peek_json(const uint8_t* data, size_t len)
+{
+    JsonReader r(data, len);
+    if (!r.eat('{') || r.eat('}'))
+        return (OpCode)0;
+    OpCode by_type = (OpCode)0;
+    do
+    {
+        r.ws();
+        if (r.p >= r.end || *r.p != '"')
+            return (OpCode)0;
+        FieldValue k = r.string();
+        if (r.error || !r.eat(':'))
+            return (OpCode)0;
+        FieldValue v = r.value();
+        if (r.error)
+            return (OpCode)0;
+        if (k.s_escaped)
+            continue;
+        OpCode op;
+        if (key_is(k.s, k.s_len, "op") && op_value(v, &op))
+            return op;
+        if (key_is(k.s, k.s_len, "type") && v.kind == FieldValue::STR && by_type == 0)
+            by_type = op_from_name(v.s, v.s_len);
+    } while (r.eat(','));
+    return r.eat('}') ? by_type : (OpCode)0;
+}
+
+OpCode ws_codec_peek_op(WsFormat fmt, const uint8_t* data, size_t len)
+{
+    if (!data || len == 0)
+        return (OpCode)0;
+    return fmt == WS_FORMAT_MSGPACK ? peek_msgpack(data, len) : peek_json(data, len);
+}
+
+void ws_codec_apply_config(const WsConfigUpdate* upd, DeviceConfig* dev, GameConfig* game)
+{
+    if (!upd)
+        return;
+    for (const ConfigField& f : kConfigFields)
+    {
+        if (!(upd->present & f.present))
+            continue;
+        uint8_t* base = f.target == CFG_TARGET_DEVICE ? (uint8_t*)dev
+                        : f.target == CFG_TARGET_GAME ? (uint8_t*)game
+                                                      : nullptr;
+        if (!base)
+            continue;
+        const uint8_t* src = (const uint8_t*)upd + f.msg_offset;
+        uint8_t* dst = base + f.cfg_offset;
+        if (f.type == CFG_STR)
+        {
+            size_t n = strnlen((const char*)src, f.msg_size);
+            if (n >= f.cfg_size)
+                n = f.cfg_size - 1;
+            memcpy(dst, src, n);
+            dst[n] = '\0';
+            continue;
+        }
+        uint64_t v = (uint64_t)config_field_load(f.type, src) * f.scale;
+        if (f.flags & CFG_INVERT)
+            v = !v;
+        if (f.flags & CFG_CLAMP)
+            v = v < f.min ? f.min : v > f.max ? f.max : v;
+        config_field_store(f.type, dst, (uint32_t)v);
+    }
+}
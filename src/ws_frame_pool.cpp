@@ -0,0 +1,180 @@
+#include "ws_frame_pool.h"
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char* TAG = "WsFramePool";
+
+// A frame can be in flight on more than one job (e.g. a resend while the
+// original broadcast is still queued), so keep a few spare job slots.
+#define WS_FANOUT_JOB_COUNT (WS_FRAME_POOL_SIZE * 2)
+
+typedef struct
+{
+    bool in_use;
+    httpd_handle_t server;
+    ws_frame_t* frame;
+    ws_frame_done_cb_t on_done;
+    int count;
+    int fds[WS_FRAME_MAX_TARGETS];
+    bool ok[WS_FRAME_MAX_TARGETS];
+} fanout_job_t;
+
+static ws_frame_t s_frames[WS_FRAME_POOL_SIZE];
+static fanout_job_t s_jobs[WS_FANOUT_JOB_COUNT];
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+ws_frame_t* ws_frame_alloc(void)
+{
+    ws_frame_t* frame = NULL;
+    portENTER_CRITICAL(&s_pool_lock);
+    for (int i = 0; i < WS_FRAME_POOL_SIZE; i++)
+    {
+        if (s_frames[i].refs == 0)
+        {
+            s_frames[i].refs = 1;
+            frame = &s_frames[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_pool_lock);
+
+    if (!frame)
+    {
+        ESP_LOGW(TAG, "Frame pool exhausted");
+        return NULL;
+    }
+    frame->binary = false;
+    frame->op = 0;
+    frame->len = 0;
+    return frame;
+}
+
+ws_frame_t* ws_frame_from(const void* data, size_t len, bool binary)
+{
+    if (!data || len == 0 || len > WS_FRAME_MAX_LEN)
+        return NULL;
+    ws_frame_t* frame = ws_frame_alloc();
+    if (!frame)
+        return NULL;
+    memcpy(frame->data, data, len);
+    frame->len = len;
+    frame->binary = binary;
+    return frame;
+}
+
+void ws_frame_ref(ws_frame_t* frame)
+{
+    if (!frame)
+        return;
+    portENTER_CRITICAL(&s_pool_lock);
+    frame->refs++;
+    portEXIT_CRITICAL(&s_pool_lock);
+}
+
+void ws_frame_unref(ws_frame_t* frame)
+{
+    if (!frame)
+        return;
+    portENTER_CRITICAL(&s_pool_lock);
+    if (frame->refs > 0)
+        frame->refs--;
+    portEXIT_CRITICAL(&s_pool_lock);
+}
+
+int ws_frame_pool_available(void)
+{
+    int free_count = 0;
+    portENTER_CRITICAL(&s_pool_lock);
+    for (int i = 0; i < WS_FRAME_POOL_SIZE; i++)
+    {
+        if (s_frames[i].refs == 0)
+            free_count++;
+    }
+    portEXIT_CRITICAL(&s_pool_lock);
+    return free_count;
+}
+
+static fanout_job_t* job_acquire(void)
+{
+    fanout_job_t* job = NULL;
+    portENTER_CRITICAL(&s_pool_lock);
+    for (int i = 0; i < WS_FANOUT_JOB_COUNT; i++)
+    {
+        if (!s_jobs[i].in_use)
+        {
+            s_jobs[i].in_use = true;
+            job = &s_jobs[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_pool_lock);
+    return job;
+}
+
+static void job_release(fanout_job_t* job)
+{
+    portENTER_CRITICAL(&s_pool_lock);
+    job->in_use = false;
+    portEXIT_CRITICAL(&s_pool_lock);
+}
+
+// Runs on the httpd task, where httpd_ws_send_frame_async writes synchronously,
+// so every socket is served straight from the shared buffer.
+static void fanout_worker(void* arg)
+{
+    fanout_job_t* job = (fanout_job_t*)arg;
+    ws_frame_t* frame = job->frame;
+
+    httpd_ws_frame_t ws_pkt;
+    memset(&ws_pkt, 0, sizeof(ws_pkt));
+    ws_pkt.payload = frame->data;
+    ws_pkt.len = frame->len;
+    ws_pkt.type = frame->binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
+    ws_pkt.final = true;
+
+    for (int i = 0; i < job->count; i++)
+    {
+        esp_err_t r = httpd_ws_send_frame_async(job->server, job->fds[i], &ws_pkt);
+        job->ok[i] = (r == ESP_OK);
+        if (r != ESP_OK)
+            ESP_LOGW(TAG, "Send failed fd=%d err=%d", job->fds[i], r);
+    }
+
+    if (job->on_done)
+        job->on_done(job->fds, job->ok, job->count);
+
+    ws_frame_unref(frame);
+    job_release(job);
+}
+
+bool ws_frame_fanout(httpd_handle_t server, ws_frame_t* frame, const int* fds, int count,
+                     ws_frame_done_cb_t on_done)
+{
+    if (!server || !frame || frame->len == 0 || !fds || count <= 0)
+        return false;
+
+    fanout_job_t* job = job_acquire();
+    if (!job)
+    {
+        ESP_LOGW(TAG, "No free fan-out job, dropping frame");
+        return false;
+    }
+
+    if (count > WS_FRAME_MAX_TARGETS)
+        count = WS_FRAME_MAX_TARGETS;
+    job->server = server;
+    job->frame = frame;
+    job->on_done = on_done;
+    job->count = count;
+    memcpy(job->fds, fds, count * sizeof(int));
+
+    ws_frame_ref(frame);
+    if (httpd_queue_work(server, fanout_worker, job) != ESP_OK)
+    {
+        ws_frame_unref(frame);
+        job_release(job);
+        return false;
+    }
+    return true;
+}
@@ -1,231 +1,1399 @@
+/**
+ * WebSocket server for the browser dashboard
+ *
+ * - One client table and one send pipeline for every message type
+ * - Broadcasts encoded once per format into a shared pooled frame
+ * - MessagePack binary protocol, negotiated per client via subprotocol
+ * - Frames routed by opcode, only the selected handler decodes fields
+ *
+ * Configuration flags (see ws_server.h, set in platformio.ini):
+ * - WS_ENABLE_MSGPACK=1     : Enable MessagePack support
+ * - WS_ENABLE_ASYNC_SEND=1  : Per-client queues drained by the httpd task (0 = blocking sends)
+ * - WS_USE_NATIVE_PING=1    : Periodic WebSocket PING and idle timeout
+ * - WS_DISABLE_HTTP_API=0   : Keep HTTP API (0=keep, 1=disable)
+ */
+
 #include "ws_server.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
 #include <esp_log.h>
 #include <esp_timer.h>
-#include <cJSON.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
-#include "game_state.h"
+#include "espnow_auth.h"
 #include "espnow_comm.h"
+#include "game_state.h"
+#include "nvs_snapshot.h"
+#include "radio_policy.h"
+#include "runtime_metrics.h"
+#include "ws_codec.h"
+#include "ws_frame_pool.h"
+
+// ============================================================================
+// CONSTANTS & CONFIGURATION
+// ============================================================================
 
 static const char* TAG = "WsServer";
 
-#define MAX_WS_CLIENTS 4
 #define WS_MAX_FRAME_SIZE 1024
-#define WS_CLIENT_TIMEOUT_MS 10000 // 10 seconds without activity = stale
+#define WS_CLIENT_TIMEOUT_MS 30000 // Nothing received (data, PONG) for this long = stale
+#define WS_SUBPROTOCOL_MSGPACK "msgpack"
+static_assert(WS_FRAME_MAX_TARGETS >= WS_MAX_CLIENTS, "a fan-out job must reach every client");
+
+// ============================================================================
+// DATA STRUCTURES
+// ============================================================================
 
 typedef struct
 {
     int fd;
     bool active;
     uint32_t last_activity_ms;
+    bool supports_binary;
+    bool simulated; // No socket behind it, frames are discarded (benchmarks)
+
+    // Pending frames, oldest at txq_head (guarded by s_ws_mutex)
+    ws_frame_t* txq[WS_CLIENT_QUEUE_DEPTH];
+    uint8_t txq_head;
+    uint8_t txq_len;
+    uint32_t congested_since_ms; // 0 while under the watermark
+    WsClientQueueStats stats;
 } ws_client_t;
 
-static ws_client_t s_clients[MAX_WS_CLIENTS];
+// Static state
+static ws_client_t s_clients[WS_MAX_CLIENTS];
 static httpd_handle_t s_server = NULL;
 static WsServerConfig s_config = {};
 static bool s_initialized = false;
 static SemaphoreHandle_t s_ws_mutex = NULL;
 
-// Forward declaration
-int ws_server_client_count(void);
-void ws_server_send_status_to(int fd);
+static WsSendQueuePolicy s_queue_policy = {
+    .high_watermark = 4,
+    .congested_timeout_ms = 5000,
+    .coalesce_status = true,
+};
+static bool s_pump_queued = false; // A pump work item is pending on the httpd task
+static TaskHandle_t s_httpd_task = NULL; // Recorded by ws_handler, which always runs on it
+static uint32_t s_congestion_disconnects = 0;
+
+// Indexed by opcode; a frame is only decoded by the handler it routes to
+static ws_server_op_handler_t s_op_handlers[WS_OP_TABLE_SIZE] = {};
+
+// Receive buffers: a fixed pool instead of malloc per frame. Free slots are
+// kept on a stack so acquire and release are O(1); a buffer's index follows
+// from its address, which is how on_message borrows it.
+#define WS_RX_POOL_SIZE (WS_MAX_CLIENTS * WS_RX_BUFFERS_PER_CLIENT)
+static_assert(WS_RX_POOL_SIZE > 0 && WS_RX_POOL_SIZE <= 255, "WS_RX_BUFFERS_PER_CLIENT out of range");
+
+static uint8_t s_rx_pool[WS_RX_POOL_SIZE][WS_MAX_FRAME_SIZE];
+static uint8_t s_rx_free[WS_RX_POOL_SIZE];
+static uint8_t s_rx_free_count = 0;
+static bool s_rx_borrowed[WS_RX_POOL_SIZE];
+static bool s_rx_in_use[WS_RX_POOL_SIZE];
+static uint16_t s_rx_len[WS_RX_POOL_SIZE]; // Payload length of the frame in each buffer
+static uint32_t s_rx_exhausted = 0;
+static portMUX_TYPE s_rx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============================================================================
+// UTILITY FUNCTIONS
+// ============================================================================
+
+/**
+ * Get current time in milliseconds
+ */
+static inline uint32_t get_time_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void rx_pool_init(void)
+{
+    portENTER_CRITICAL(&s_rx_lock);
+    for (int i = 0; i < WS_RX_POOL_SIZE; i++)
+    {
+        s_rx_free[i] = (uint8_t)(WS_RX_POOL_SIZE - 1 - i);
+        s_rx_borrowed[i] = false;
+        s_rx_in_use[i] = false;
+    }
+    s_rx_free_count = WS_RX_POOL_SIZE;
+    portEXIT_CRITICAL(&s_rx_lock);
+}
+
+static uint8_t* rx_acquire(void)
+{
+    uint8_t* buf = NULL;
+    portENTER_CRITICAL(&s_rx_lock);
+    if (s_rx_free_count > 0)
+    {
+        uint8_t idx = s_rx_free[--s_rx_free_count];
+        s_rx_in_use[idx] = true;
+        s_rx_borrowed[idx] = false;
+        buf = s_rx_pool[idx];
+    }
+    else
+    {
+        s_rx_exhausted++;
+    }
+    portEXIT_CRITICAL(&s_rx_lock);
+    return buf;
+}
+
+// Index of a pooled buffer, -1 for any other pointer
+static int rx_index(const uint8_t* data)
+{
+    const uint8_t* base = &s_rx_pool[0][0];
+    if (!data || data < base || data >= base + sizeof(s_rx_pool))
+        return -1;
+    size_t off = (size_t)(data - base);
+    if (off % WS_MAX_FRAME_SIZE != 0)
+        return -1;
+    return (int)(off / WS_MAX_FRAME_SIZE);
+}
+
+// Returns the buffer to the pool unless on_message borrowed it
+static void rx_release(int idx, bool from_borrower)
+{
+    portENTER_CRITICAL(&s_rx_lock);
+    if (s_rx_in_use[idx] && s_rx_borrowed[idx] == from_borrower)
+    {
+        s_rx_in_use[idx] = false;
+        s_rx_borrowed[idx] = false;
+        s_rx_free[s_rx_free_count++] = (uint8_t)idx;
+    }
+    portEXIT_CRITICAL(&s_rx_lock);
+}
+
+/**
+ * Count active clients (must be called with mutex held)
+ */
+static int count_active_clients_unsafe(void)
+{
+    int count = 0;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (s_clients[i].active)
+            count++;
+    }
+    return count;
+}
+
+/**
+ * Initialize client array
+ */
+static void init_client_array(void)
+{
+    memset(s_clients, 0, sizeof(s_clients));
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        s_clients[i].fd = -1;
+        s_clients[i].active = false;
+    }
+}
+
+// ============================================================================
+// MUTEX WRAPPER FUNCTIONS
+// ============================================================================
 
+/**
+ * Acquire mutex with error checking
+ */
+static inline bool acquire_mutex(const char* context)
+{
+    if (s_ws_mutex && xSemaphoreTake(s_ws_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Failed to acquire mutex in %s", context);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Release mutex
+ */
+static inline void release_mutex(void)
+{
+    if (s_ws_mutex)
+        xSemaphoreGive(s_ws_mutex);
+}
+
+// ============================================================================
+// CLIENT MANAGEMENT
+// ============================================================================
+
+/**
+ * Find first available client slot
+ * @return Slot index or -1 if no slots available
+ */
 static int find_client_slot(void)
 {
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (!s_clients[i].active)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Find client by file descriptor
+ * @param fd File descriptor
+ * @return Client index or -1 if not found
+ */
+static int find_client_by_fd(int fd)
+{
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (s_clients[i].active && s_clients[i].fd == fd)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Drop every queued frame of a client (unsafe - mutex must be held)
+ */
+static void flush_queue_unsafe(ws_client_t* client)
+{
+    while (client->txq_len > 0)
+    {
+        ws_frame_unref(client->txq[client->txq_head]);
+        client->txq_head = (client->txq_head + 1) % WS_CLIENT_QUEUE_DEPTH;
+        client->txq_len--;
+    }
+    client->txq_head = 0;
+    client->congested_since_ms = 0;
+}
+
+/**
+ * Remove stale entry for file descriptor (unsafe - mutex must be held)
+ */
+static void remove_stale_fd_unsafe(int fd)
+{
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (s_clients[i].active && s_clients[i].fd == fd)
+        {
+            ESP_LOGW(TAG, "Removing stale entry for fd=%d at slot %d", fd, i);
+            flush_queue_unsafe(&s_clients[i]);
+            s_clients[i].active = false;
+            s_clients[i].fd = -1;
+            break;
+        }
+    }
+}
+
+/**
+ * Add a new client connection
+ * @param fd File descriptor
+ * @param supports_binary Client supports binary protocol
+ */
+static void add_client(int fd, bool supports_binary)
+{
+    if (!acquire_mutex("add_client"))
+        return;
+
+    // Remove any existing entry with this fd
+    remove_stale_fd_unsafe(fd);
+
+    // Find available slot
+    int slot = find_client_slot();
+    if (slot < 0)
+    {
+        ESP_LOGE(TAG, "✗ No free slots for fd=%d", fd);
+        release_mutex();
+        return;
+    }
+
+    // Initialize client
+    memset(&s_clients[slot], 0, sizeof(s_clients[slot]));
+    s_clients[slot].stats.fd = fd;
+    s_clients[slot].fd = fd;
+    s_clients[slot].active = true;
+    s_clients[slot].last_activity_ms = get_time_ms();
+    s_clients[slot].supports_binary = supports_binary;
+
+    int count = count_active_clients_unsafe();
+    release_mutex();
+
+    ESP_LOGI(TAG, "✓ Client fd=%d added to slot %d (binary=%d, total=%d)", fd, slot,
+             supports_binary, count);
+
+    // Notify callback outside of mutex
+    if (s_config.on_connect)
+        s_config.on_connect(fd, true);
+}
+
+/**
+ * Remove a client connection
+ * @param fd File descriptor
+ */
+static void remove_client(int fd)
+{
+    if (!acquire_mutex("remove_client"))
+        return;
+
+    int slot = find_client_by_fd(fd);
+    bool found = slot >= 0;
+    bool simulated = found && s_clients[slot].simulated;
+
+    if (found)
+    {
+        ESP_LOGI(TAG, "Removing client fd=%d from slot %d", fd, slot);
+        flush_queue_unsafe(&s_clients[slot]);
+        s_clients[slot].active = false;
+        s_clients[slot].fd = -1;
+    }
+
+    release_mutex();
+
+    // Notify callback outside of mutex
+    if (found && !simulated && s_config.on_connect)
+        s_config.on_connect(fd, false);
+}
+
+/**
+ * Update client activity timestamp
+ * @param fd File descriptor
+ * @return false if the client is not in the table
+ */
+static bool update_client_activity(int fd)
+{
+    if (!acquire_mutex("update_activity"))
+        return false;
+
+    int slot = find_client_by_fd(fd);
+    if (slot >= 0)
+    {
+        s_clients[slot].last_activity_ms = get_time_ms();
+    }
+
+    release_mutex();
+    return slot >= 0;
+}
+
+// ============================================================================
+// MESSAGE SENDING
+// ============================================================================
+
+/**
+ * Frames that must reach every client even under congestion
+ */
+static inline bool is_critical_op(uint8_t op)
+{
+    return op == OP_HIT_REPORT || op == OP_SHOT_FIRED || op == OP_GAME_OVER;
+}
+
+/**
+ * Remove the frame at queue position pos (0 = oldest) without releasing it
+ */
+static ws_frame_t* queue_remove_at_unsafe(ws_client_t* client, int pos)
+{
+    int idx = (client->txq_head + pos) % WS_CLIENT_QUEUE_DEPTH;
+    ws_frame_t* frame = client->txq[idx];
+    if (pos == 0)
+    {
+        client->txq_head = (client->txq_head + 1) % WS_CLIENT_QUEUE_DEPTH;
+        client->txq_len--;
+        return frame;
+    }
+    for (int i = pos; i < client->txq_len - 1; i++)
+    {
+        int cur = (client->txq_head + i) % WS_CLIENT_QUEUE_DEPTH;
+        int next = (cur + 1) % WS_CLIENT_QUEUE_DEPTH;
+        client->txq[cur] = client->txq[next];
+    }
+    client->txq_len--;
+    return frame;
+}
+
+/**
+ * Queue position of the oldest frame that may be dropped, or -1
+ */
+static int oldest_droppable_unsafe(const ws_client_t* client)
+{
+    for (int i = 0; i < client->txq_len; i++)
+    {
+        const ws_frame_t* f = client->txq[(client->txq_head + i) % WS_CLIENT_QUEUE_DEPTH];
+        if (!is_critical_op(f->op))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * Apply the queue policy and append a frame (unsafe - mutex must be held)
+ */
+static void enqueue_unsafe(ws_client_t* client, ws_frame_t* frame, uint32_t now)
+{
+    // Supersede a status snapshot that has not been written yet. The new one
+    // goes to the tail: in the old slot it would overtake deltas queued after
+    // it that describe older state.
+    if (s_queue_policy.coalesce_status && frame->op == OP_STATUS)
+    {
+        for (int i = 0; i < client->txq_len; i++)
+        {
+            int idx = (client->txq_head + i) % WS_CLIENT_QUEUE_DEPTH;
+            if (client->txq[idx]->op == OP_STATUS)
+            {
+                ws_frame_unref(queue_remove_at_unsafe(client, i));
+                client->stats.coalesced++;
+                break;
+            }
+        }
+    }
+
+    if (client->txq_len == WS_CLIENT_QUEUE_DEPTH)
+    {
+        int victim = oldest_droppable_unsafe(client);
+        if (victim < 0 && !is_critical_op(frame->op))
+        {
+            // Queue holds only critical frames: the newcomer yields
+            client->stats.dropped++;
+            return;
+        }
+        ws_frame_unref(queue_remove_at_unsafe(client, victim < 0 ? 0 : victim));
+        client->stats.dropped++;
+    }
+
+    ws_frame_ref(frame);
+    client->txq[(client->txq_head + client->txq_len) % WS_CLIENT_QUEUE_DEPTH] = frame;
+    client->txq_len++;
+
+    client->stats.depth = client->txq_len;
+    if (client->txq_len > client->stats.max_depth)
+        client->stats.max_depth = client->txq_len;
+    METRICS_RECORD(METRICS_HIST_WS_QUEUE_DEPTH, client->txq_len);
+    if (client->txq_len >= s_queue_policy.high_watermark && client->congested_since_ms == 0)
+        client->congested_since_ms = now ? now : 1;
+}
+
+/**
+ * Drain the send queues on the httpd task
+ *
+ * Serves one frame per client per round so a slow socket only delays its own
+ * traffic, and exits once every queue is empty.
+ */
+static void pump_worker(void* arg)
+{
+    for (;;)
+    {
+        int fds[WS_MAX_CLIENTS];
+        ws_frame_t* frames[WS_MAX_CLIENTS];
+        bool simulated[WS_MAX_CLIENTS];
+        bool ok[WS_MAX_CLIENTS];
+        int count = 0;
+
+        if (!acquire_mutex("pump"))
+            return;
+        for (int i = 0; i < WS_MAX_CLIENTS; i++)
+        {
+            ws_client_t* client = &s_clients[i];
+            if (!client->active || client->txq_len == 0)
+                continue;
+            fds[count] = client->fd;
+            simulated[count] = client->simulated;
+            frames[count] = queue_remove_at_unsafe(client, 0); // Reference moves to us
+            count++;
+            client->stats.depth = client->txq_len;
+            if (client->txq_len < s_queue_policy.high_watermark)
+                client->congested_since_ms = 0;
+        }
+        if (count == 0)
+            s_pump_queued = false;
+        release_mutex();
+
+        if (count == 0)
+            return;
+
+        for (int i = 0; i < count; i++)
+        {
+            if (simulated[i])
+            {
+                ok[i] = true;
+                ws_frame_unref(frames[i]);
+                continue;
+            }
+
+            httpd_ws_frame_t ws_pkt;
+            memset(&ws_pkt, 0, sizeof(ws_pkt));
+            ws_pkt.payload = frames[i]->data;
+            ws_pkt.len = frames[i]->len;
+            ws_pkt.type = frames[i]->binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
+            ws_pkt.final = true;
+
+            esp_err_t ret = httpd_ws_send_frame_async(s_server, fds[i], &ws_pkt);
+            ok[i] = (ret == ESP_OK);
+            if (ret != ESP_OK)
+                ESP_LOGW(TAG, "Send failed to fd=%d: %s", fds[i], esp_err_to_name(ret));
+            ws_frame_unref(frames[i]);
+        }
+
+        if (!acquire_mutex("pump_done"))
+            return;
+        for (int i = 0; i < count; i++)
+        {
+            int slot = find_client_by_fd(fds[i]);
+            if (slot < 0)
+                continue;
+            if (ok[i])
+                s_clients[slot].stats.sent++;
+            else
+                s_clients[slot].stats.send_errors++;
+        }
+        release_mutex();
+    }
+}
+
+/**
+ * Write a frame to a set of clients from the calling task
+ *
+ * Used without WS_ENABLE_ASYNC_SEND: httpd_ws_send_data() hands each write
+ * to the httpd task and waits for it, so nothing is queued or dropped but
+ * the caller blocks on slow sockets. On the httpd task itself (WebSocket and
+ * HTTP handlers) that wait would never end, so the frame is written to the
+ * socket directly instead.
+ *
+ * @return true if the frame reached at least one client
+ */
+static bool send_frame_sync(ws_frame_t* frame, const int* fds, int count)
+{
+    httpd_ws_frame_t ws_pkt;
+    memset(&ws_pkt, 0, sizeof(ws_pkt));
+    ws_pkt.payload = frame->data;
+    ws_pkt.len = frame->len;
+    ws_pkt.type = frame->binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
+    ws_pkt.final = true;
+
+    const bool on_httpd_task = s_httpd_task && xTaskGetCurrentTaskHandle() == s_httpd_task;
+    int sent = 0;
+    for (int i = 0; i < count; i++)
+    {
+        esp_err_t ret = ESP_OK;
+        if (fds[i] > WS_SIMULATED_FD_BASE)
+            ret = on_httpd_task ? httpd_ws_send_frame_async(s_server, fds[i], &ws_pkt)
+                                : httpd_ws_send_data(s_server, fds[i], &ws_pkt);
+        if (ret != ESP_OK)
+            ESP_LOGW(TAG, "Send failed to fd=%d: %s", fds[i], esp_err_to_name(ret));
+
+        if (!acquire_mutex("send_sync"))
+            break;
+        int slot = find_client_by_fd(fds[i]);
+        if (slot >= 0 && ret == ESP_OK)
+            s_clients[slot].stats.sent++;
+        else if (slot >= 0)
+            s_clients[slot].stats.send_errors++;
+        release_mutex();
+        sent += ret == ESP_OK;
+    }
+
+    ws_frame_unref(frame);
+    return sent > 0;
+}
+
+/**
+ * Queue a pooled frame to a set of clients and drop the caller's reference
+ *
+ * Clients that stayed over the watermark longer than the policy allows are
+ * disconnected here rather than being allowed to hold pool frames forever.
+ *
+ * @return true if the frame was queued to at least one client
+ */
+static bool send_frame_to(ws_frame_t* frame, const int* fds, int count)
+{
+    if (!frame)
+        return false;
+    if (!s_server || count <= 0)
+    {
+        ws_frame_unref(frame);
+        return false;
+    }
+    if (!WS_ENABLE_ASYNC_SEND)
+        return send_frame_sync(frame, fds, count);
+
+    int congested_fds[WS_MAX_CLIENTS];
+    int congested_count = 0;
+    int queued = 0;
+    bool need_pump = false;
+
+    if (!acquire_mutex("enqueue"))
+    {
+        ws_frame_unref(frame);
+        return false;
+    }
+
+    uint32_t now = get_time_ms();
+    for (int i = 0; i < count; i++)
+    {
+        int slot = find_client_by_fd(fds[i]);
+        if (slot < 0)
+            continue;
+        ws_client_t* client = &s_clients[slot];
+
+        if (client->congested_since_ms && s_queue_policy.congested_timeout_ms &&
+            now - client->congested_since_ms > s_queue_policy.congested_timeout_ms)
+        {
+            congested_fds[congested_count++] = client->fd;
+            continue;
+        }
+
+        enqueue_unsafe(client, frame, now);
+        queued++;
+    }
+    if (queued > 0 && !s_pump_queued)
+    {
+        s_pump_queued = true;
+        need_pump = true;
+    }
+    s_congestion_disconnects += congested_count;
+    release_mutex();
+
+    ws_frame_unref(frame);
+
+    if (need_pump && httpd_queue_work(s_server, pump_worker, NULL) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to queue send pump");
+        acquire_mutex("pump_failed");
+        s_pump_queued = false;
+        release_mutex();
+    }
+
+    for (int i = 0; i < congested_count; i++)
+    {
+        ESP_LOGW(TAG, "Client fd=%d congested for >%lums, disconnecting", congested_fds[i],
+                 (unsigned long)s_queue_policy.congested_timeout_ms);
+        remove_client(congested_fds[i]);
+        if (congested_fds[i] > WS_SIMULATED_FD_BASE)
+            httpd_sess_trigger_close(s_server, congested_fds[i]);
+    }
+
+    return queued > 0;
+}
+
+/**
+ * Free a pool frame by dropping the oldest non-critical frame of the
+ * deepest queue. Used when the pool runs dry so that one stalled client
+ * cannot starve everyone else of buffers.
+ */
+static void shed_one_frame(void)
+{
+    if (!acquire_mutex("shed"))
+        return;
+
+    ws_client_t* deepest = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        ws_client_t* client = &s_clients[i];
+        if (client->active && client->txq_len > 0 && (!deepest || client->txq_len > deepest->txq_len))
+            deepest = client;
+    }
+    if (deepest)
+    {
+        int victim = oldest_droppable_unsafe(deepest);
+        if (victim >= 0)
+        {
+            ws_frame_unref(queue_remove_at_unsafe(deepest, victim));
+            deepest->stats.dropped++;
+            deepest->stats.depth = deepest->txq_len;
+        }
+    }
+
+    release_mutex();
+}
+
+/**
+ * Allocate a pool frame, shedding queued traffic once if the pool is empty
+ */
+static ws_frame_t* alloc_frame(void)
+{
+    ws_frame_t* frame = ws_frame_alloc();
+    if (!frame)
+    {
+        shed_one_frame();
+        frame = ws_frame_alloc();
+    }
+    return frame;
+}
+
+/**
+ * Copy a caller payload into a pool frame
+ */
+static ws_frame_t* copy_frame(const uint8_t* data, size_t len, bool binary)
+{
+    if (len > WS_FRAME_MAX_LEN)
+    {
+        ESP_LOGW(TAG, "Frame too large (%u bytes)", (unsigned)len);
+        return NULL;
+    }
+    ws_frame_t* frame = alloc_frame();
+    if (!frame)
+        return NULL;
+    memcpy(frame->data, data, len);
+    frame->len = len;
+    frame->binary = binary;
+    return frame;
+}
+
+/**
+ * Send raw WebSocket frame to client
+ * @param client_fd Target client file descriptor
+ * @param data Frame payload
+ * @param len Payload length
+ * @param binary true for binary frame, false for text
+ * @return true if queued successfully
+ */
+bool ws_server_send_raw(int client_fd, const uint8_t* data, size_t len, bool binary)
+{
+    if (!s_server || !data || len == 0)
+    {
+        ESP_LOGW(TAG, "Invalid send parameters");
+        return false;
+    }
+
+    return send_frame_to(copy_frame(data, len, binary), &client_fd, 1);
+}
+
+/**
+ * Broadcast raw frame to all connected clients
+ *
+ * The payload is copied into one pooled frame and written to every socket
+ * by a single httpd work item.
+ *
+ * @param data Frame payload
+ * @param len Payload length
+ * @param binary true for binary frame, false for text
+ */
+void ws_server_broadcast_raw(const uint8_t* data, size_t len, bool binary)
+{
+    if (!data || len == 0)
+        return;
+
+    int active_fds[WS_MAX_CLIENTS];
+    int total_clients = 0;
+
+    if (!acquire_mutex("broadcast"))
+        return;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (s_clients[i].active)
+        {
+            active_fds[total_clients++] = s_clients[i].fd;
+        }
+    }
+
+    release_mutex();
+
+    if (total_clients == 0)
+        return;
+
+    bool queued = send_frame_to(copy_frame(data, len, binary), active_fds, total_clients);
+    ESP_LOGD(TAG, "Broadcast %s to %d clients", queued ? "queued" : "dropped", total_clients);
+}
+
+bool ws_server_send(int client_fd, const char* message)
+{
+    if (!message)
+        return false;
+    return ws_server_send_raw(client_fd, (const uint8_t*)message, strlen(message), false);
+}
+
+void ws_server_broadcast(const char* message)
+{
+    if (!message)
+        return;
+    ws_server_broadcast_raw((const uint8_t*)message, strlen(message), false);
+}
+
+// ============================================================================
+// FORMAT-AWARE MESSAGING
+// ============================================================================
+
+static WsFormat format_for(bool binary)
+{
+    return (WS_ENABLE_MSGPACK && binary) ? WS_FORMAT_MSGPACK : WS_FORMAT_JSON;
+}
+
+bool ws_server_client_is_binary(int client_fd)
+{
+    if (!acquire_mutex("is_binary"))
+        return false;
+    int slot = find_client_by_fd(client_fd);
+    bool binary = slot >= 0 && s_clients[slot].supports_binary;
+    release_mutex();
+    return binary;
+}
+
+/**
+ * Snapshot connected clients, split by negotiated format
+ * @return Total number of clients
+ */
+static int snapshot_clients(int* json_fds, int* json_count, int* binary_fds, int* binary_count)
+{
+    *json_count = 0;
+    *binary_count = 0;
+
+    if (!acquire_mutex("snapshot"))
+        return 0;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (!s_clients[i].active)
+            continue;
+        if (WS_ENABLE_MSGPACK && s_clients[i].supports_binary)
+            binary_fds[(*binary_count)++] = s_clients[i].fd;
+        else
+            json_fds[(*json_count)++] = s_clients[i].fd;
+    }
+
+    release_mutex();
+    return *json_count + *binary_count;
+}
+
+/**
+ * Encode a message straight into a pooled frame
+ * @return Frame holding one reference, or NULL on pool exhaustion / encode error
+ */
+static ws_frame_t* encode_frame(WsFormat fmt, uint8_t op, ws_server_encode_fn_t encode, const void* ctx)
+{
+    ws_frame_t* frame = alloc_frame();
+    if (!frame)
+        return NULL;
+
+    METRICS_CYCLES_BEGIN(encode_start);
+    int len = encode(fmt, frame->data, sizeof(frame->data), ctx);
+    METRICS_CYCLES_END(fmt == WS_FORMAT_MSGPACK ? METRICS_HIST_WS_ENCODE_MSGPACK : METRICS_HIST_WS_ENCODE_JSON,
+                       encode_start);
+    if (len <= 0)
+    {
+        METRICS_COUNT(METRICS_CTR_WS_ENCODE_ERRORS);
+        ESP_LOGW(TAG, "Encode failed (fmt=%d)", fmt);
+        ws_frame_unref(frame);
+        return NULL;
+    }
+    frame->len = (size_t)len;
+    frame->binary = (fmt == WS_FORMAT_MSGPACK);
+    frame->op = op;
+    return frame;
+}
+
+/**
+ * Encode and queue to one client; op tags the frame for the queue policy
+ */
+static bool send_encoded(int client_fd, uint8_t op, ws_server_encode_fn_t encode, const void* ctx)
+{
+    if (!encode || !s_server)
+        return false;
+
+    const WsFormat fmt = format_for(ws_server_client_is_binary(client_fd));
+    return send_frame_to(encode_frame(fmt, op, encode, ctx), &client_fd, 1);
+}
+
+/**
+ * Encode at most once per format and queue to every client
+ */
+static void broadcast_encoded(uint8_t op, ws_server_encode_fn_t encode, const void* ctx)
+{
+    if (!encode || !s_server)
+        return;
+
+    int json_fds[WS_MAX_CLIENTS];
+    int binary_fds[WS_MAX_CLIENTS];
+    int json_count = 0;
+    int binary_count = 0;
+
+    if (snapshot_clients(json_fds, &json_count, binary_fds, &binary_count) == 0)
+        return;
+
+    // One encode, one buffer and one httpd work item per format in use
+    if (json_count > 0)
+        send_frame_to(encode_frame(WS_FORMAT_JSON, op, encode, ctx), json_fds, json_count);
+    if (binary_count > 0)
+        send_frame_to(encode_frame(WS_FORMAT_MSGPACK, op, encode, ctx), binary_fds, binary_count);
+}
+
+bool ws_server_send_encoded(int client_fd, ws_server_encode_fn_t encode, const void* ctx)
+{
+    return send_encoded(client_fd, 0, encode, ctx);
+}
+
+void ws_server_broadcast_encoded(ws_server_encode_fn_t encode, const void* ctx)
+{
+    broadcast_encoded(0, encode, ctx);
+}
+
+static int encode_status(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_status(fmt, buf, max_len);
+}
+
+static int encode_heartbeat_ack(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_heartbeat_ack(fmt, buf, max_len);
+}
+
+static int encode_hit(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_hit_report(fmt, buf, max_len, *(const uint8_t*)ctx);
+}
+
+static int encode_shot(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_shot_fired(fmt, buf, max_len);
+}
+
+static int encode_respawn(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_respawn(fmt, buf, max_len);
+}
+
+static int encode_reload(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_reload_event(fmt, buf, max_len, *(const uint16_t*)ctx);
+}
+
+static int encode_game_over(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_game_over(fmt, buf, max_len);
+}
+
+typedef struct
+{
+    uint32_t fields;
+    uint32_t seq;
+} delta_ctx_t;
+
+static int encode_status_delta(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    const delta_ctx_t* delta = (const delta_ctx_t*)ctx;
+    return ws_codec_status_delta(fmt, buf, max_len, delta->fields, delta->seq);
+}
+
+static int encode_system_stats(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    return ws_codec_system_stats(fmt, buf, max_len, (const SystemStats*)ctx);
+}
+
+typedef struct
+{
+    const char* reply_to;
+    bool success;
+} ack_ctx_t;
+
+static int encode_ack(WsFormat fmt, uint8_t* buf, size_t max_len, const void* ctx)
+{
+    const ack_ctx_t* ack = (const ack_ctx_t*)ctx;
+    return ws_codec_ack(fmt, buf, max_len, ack->reply_to, ack->success);
+}
+
+void ws_server_send_status_to(int client_fd)
+{
+    send_encoded(client_fd, OP_STATUS, encode_status, NULL);
+}
+
+void ws_server_send_status(void)
+{
+    // A full snapshot supersedes pending changes and advances the sequence
+    game_state_take_dirty(NULL);
+    broadcast_encoded(OP_STATUS, encode_status, NULL);
+}
+
+void ws_server_broadcast_status_delta(void)
+{
+    delta_ctx_t delta;
+    delta.fields = game_state_take_dirty(&delta.seq);
+    if (delta.fields)
+        broadcast_encoded(OP_STATUS_DELTA, encode_status_delta, &delta);
+}
+
+void ws_server_send_heartbeat_ack(int client_fd)
+{
+    send_encoded(client_fd, OP_HEARTBEAT_ACK, encode_heartbeat_ack, NULL);
+}
+
+void ws_server_broadcast_hit(const char* shooter_id_str)
+{
+    uint8_t shooter_id = shooter_id_str ? (uint8_t)atoi(shooter_id_str) : 0;
+    broadcast_encoded(OP_HIT_REPORT, encode_hit, &shooter_id);
+}
+
+void ws_server_broadcast_shot(void)
+{
+    broadcast_encoded(OP_SHOT_FIRED, encode_shot, NULL);
+}
+
+void ws_server_broadcast_game_state(void)
+{
+    ws_server_send_status();
+}
+
+void ws_server_broadcast_respawn(void)
+{
+    broadcast_encoded(OP_RESPAWN, encode_respawn, NULL);
+}
+
+void ws_server_broadcast_reload(uint16_t current_ammo)
+{
+    broadcast_encoded(OP_RELOAD_EVENT, encode_reload, &current_ammo);
+}
+
+void ws_server_broadcast_game_over(void)
+{
+    broadcast_encoded(OP_GAME_OVER, encode_game_over, NULL);
+}
+
+void ws_server_broadcast_system_stats(void)
+{
+    SystemStats stats;
+    if (system_stats_get(&stats))
+        broadcast_encoded(OP_SYSTEM_STATS, encode_system_stats, &stats);
+}
+
+void ws_server_send_ack(int client_fd, const char* reply_to, bool success)
+{
+    ack_ctx_t ack = {reply_to, success};
+    send_encoded(client_fd, OP_ACK, encode_ack, &ack);
+}
+
+/**
+ * JSON always starts with '{' (optionally after whitespace); anything else is
+ * treated as a MessagePack payload.
+ */
+static bool looks_like_json(const void* data, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (p[i] == ' ' || p[i] == '\t' || p[i] == '\r' || p[i] == '\n')
+            continue;
+        return p[i] == '{';
+    }
+    return false;
+}
+
+bool ws_server_send_auto(int client_fd, const void* json_or_msgpack, size_t len)
+{
+    if (!json_or_msgpack)
+        return false;
+    if (len == 0)
+        len = strlen((const char*)json_or_msgpack);
+    return ws_server_send_raw(client_fd, (const uint8_t*)json_or_msgpack, len,
+                                        !looks_like_json(json_or_msgpack, len));
+}
+
+void ws_server_broadcast_auto(const void* json_or_msgpack, size_t len)
+{
+    if (!json_or_msgpack)
+        return;
+    if (len == 0)
+        len = strlen((const char*)json_or_msgpack);
+    ws_server_broadcast_raw((const uint8_t*)json_or_msgpack, len, !looks_like_json(json_or_msgpack, len));
+}
+
+// ============================================================================
+// SEND QUEUE POLICY & STATS
+// ============================================================================
+
+void ws_server_set_queue_policy(const WsSendQueuePolicy* policy)
+{
+    if (!policy)
+        return;
+    if (!acquire_mutex("set_policy"))
+        return;
+    s_queue_policy = *policy;
+    if (s_queue_policy.high_watermark == 0 || s_queue_policy.high_watermark > WS_CLIENT_QUEUE_DEPTH)
+        s_queue_policy.high_watermark = WS_CLIENT_QUEUE_DEPTH;
+    release_mutex();
+}
+
+int ws_server_get_queue_stats(WsClientQueueStats* out, int max_entries)
+{
+    if (!out || max_entries <= 0)
+        return 0;
+    if (!acquire_mutex("queue_stats"))
+        return 0;
+
+    int n = 0;
+    for (int i = 0; i < WS_MAX_CLIENTS && n < max_entries; i++)
+    {
+        if (s_clients[i].active)
+            out[n++] = s_clients[i].stats;
+    }
+
+    release_mutex();
+    return n;
+}
+
+uint32_t ws_server_congestion_disconnects(void)
+{
+    if (!acquire_mutex("congestion_count"))
+        return 0;
+    uint32_t count = s_congestion_disconnects;
+    release_mutex();
+    return count;
+}
+
+// ============================================================================
+// SIMULATED CLIENTS
+// ============================================================================
+
+int ws_server_add_simulated_clients(int count, bool binary)
+{
+    // Without the endpoint nothing is ever queued, so a load test would measure nothing
+    if (!s_server || !acquire_mutex("add_simulated"))
+        return 0;
+
+    int added = 0;
+    uint32_t now = get_time_ms();
+    while (added < count)
+    {
+        int slot = find_client_slot();
+        if (slot < 0)
+            break;
+
+        // Lowest free fd below the base, so they never collide with sockets
+        int fd = WS_SIMULATED_FD_BASE;
+        while (find_client_by_fd(fd) >= 0)
+            fd--;
+
+        memset(&s_clients[slot], 0, sizeof(s_clients[slot]));
+        s_clients[slot].stats.fd = fd;
+        s_clients[slot].fd = fd;
+        s_clients[slot].active = true;
+        s_clients[slot].simulated = true;
+        s_clients[slot].last_activity_ms = now;
+        s_clients[slot].supports_binary = binary;
+        added++;
+    }
+
+    release_mutex();
+    return added;
+}
+
+void ws_server_remove_simulated_clients(void)
+{
+    if (!acquire_mutex("remove_simulated"))
+        return;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (!s_clients[i].active || !s_clients[i].simulated)
+            continue;
+        flush_queue_unsafe(&s_clients[i]);
+        s_clients[i].active = false;
+        s_clients[i].simulated = false;
+        s_clients[i].fd = -1;
+    }
+
+    release_mutex();
+}
+
+// ============================================================================
+// WEBSOCKET PING/PONG
+// ============================================================================
+
+/**
+ * Write a PING to every client; runs on the httpd task
+ */
+static void ping_worker(void* arg)
+{
+    int active_fds[WS_MAX_CLIENTS];
+    int count = 0;
+
+    if (!acquire_mutex("ping_clients"))
+        return;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (s_clients[i].active && !s_clients[i].simulated)
+        {
+            active_fds[count++] = s_clients[i].fd;
+        }
+    }
+
+    release_mutex();
+
+    httpd_ws_frame_t ping_frame;
+    memset(&ping_frame, 0, sizeof(ping_frame));
+    ping_frame.type = HTTPD_WS_TYPE_PING;
+    ping_frame.final = true;
+
+    for (int i = 0; i < count; i++)
+    {
+        httpd_ws_send_frame_async(s_server, active_fds[i], &ping_frame);
+    }
+
+    if (count > 0)
     {
-        if (!s_clients[i].active)
-            return i;
+        ESP_LOGD(TAG, "PING sent to %d clients", count);
     }
-    return -1;
 }
 
-static int find_client_by_fd(int fd)
+/**
+ * Send WebSocket PING to all clients
+ */
+void ws_server_ping_clients(void)
 {
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active && s_clients[i].fd == fd)
-            return i;
-    }
-    return -1;
+    if (!s_server)
+        return;
+
+    if (httpd_queue_work(s_server, ping_worker, NULL) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to queue PING");
 }
 
-static uint32_t get_time_ms(void)
+#if WS_USE_NATIVE_PING
+static esp_timer_handle_t s_keepalive_timer = NULL;
+
+/**
+ * Periodic keep-alive: ping everyone, then drop clients that stayed silent
+ */
+static void keepalive_cb(void* arg)
 {
-    return (uint32_t)(esp_timer_get_time() / 1000);
+    ws_server_ping_clients();
+    ws_server_cleanup_stale();
 }
+#endif
 
-static void add_client(int fd)
+// ============================================================================
+// CLEANUP & STATUS
+// ============================================================================
+
+/**
+ * Remove clients whose socket reports an error or that haven't been active
+ * recently (the idle check needs PING/PONG or application heartbeats)
+ */
+void ws_server_cleanup_stale(void)
 {
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
+    uint32_t now = get_time_ms();
+    int stale_fds[WS_MAX_CLIENTS];
+    int stale_count = 0;
+
+    if (!acquire_mutex("cleanup_stale"))
+        return;
 
-    // First, remove any existing slot with this fd (handle reconnects)
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
     {
-        if (s_clients[i].active && s_clients[i].fd == fd)
+        if (!s_clients[i].active || s_clients[i].simulated)
+            continue;
+
+        int fd = s_clients[i].fd;
+        int opt_val = 0;
+        socklen_t opt_len = sizeof(opt_val);
+        uint32_t idle_time = now - s_clients[i].last_activity_ms;
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &opt_val, &opt_len) != 0 || opt_val != 0)
         {
-            ESP_LOGW(TAG, "[ADD_CLIENT] Removing old entry for fd=%d at slot %d", fd, i);
-            s_clients[i].active = false;
-            s_clients[i].fd = -1;
-            break;
+            stale_fds[stale_count++] = fd;
+            ESP_LOGW(TAG, "Client fd=%d has a dead socket", fd);
+        }
+        else if (idle_time > WS_CLIENT_TIMEOUT_MS)
+        {
+            stale_fds[stale_count++] = fd;
+            ESP_LOGW(TAG, "Client fd=%d timed out (idle=%lums)", fd, (unsigned long)idle_time);
         }
     }
 
-    int slot = find_client_slot();
-    if (slot >= 0)
-    {
-        s_clients[slot].fd = fd;
-        s_clients[slot].active = true;
-        s_clients[slot].last_activity_ms = get_time_ms();
-
-        // Count active clients while holding mutex
-        int count = 0;
-        for (int i = 0; i < MAX_WS_CLIENTS; i++)
-            if (s_clients[i].active)
-                count++;
-
-        ESP_LOGI(TAG, "[ADD_CLIENT] fd=%d added to slot=%d (total=%d)", fd, slot, count);
-        if (s_ws_mutex)
-            xSemaphoreGive(s_ws_mutex);
+    release_mutex();
 
-        if (s_config.on_connect)
-            s_config.on_connect(fd, true);
-    }
-    else
+    // Remove stale clients outside of mutex and let httpd free the sessions
+    for (int i = 0; i < stale_count; i++)
     {
-        ESP_LOGE(TAG, "[ADD_CLIENT] FAILED: No free slots! fd=%d", fd);
-        if (s_ws_mutex)
-            xSemaphoreGive(s_ws_mutex);
+        remove_client(stale_fds[i]);
+        if (s_server)
+            httpd_sess_trigger_close(s_server, stale_fds[i]);
     }
 }
 
-static void remove_client(int fd)
+/**
+ * Check if any client is connected
+ * @return true if at least one client is active
+ */
+bool ws_server_is_connected(void)
 {
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    int slot = find_client_by_fd(fd);
-    if (slot >= 0)
-    {
-        ESP_LOGI(TAG, "[REMOVE] Removing client fd=%d from slot %d", fd, slot);
-        s_clients[slot].active = false;
-        s_clients[slot].fd = -1;
-        if (s_ws_mutex)
-            xSemaphoreGive(s_ws_mutex);
+    if (!acquire_mutex("is_connected"))
+        return false;
 
-        // Call disconnect callback AFTER releasing mutex to avoid nested lock
-        if (s_config.on_connect)
-            s_config.on_connect(fd, false);
-    }
-    else
+    bool connected = false;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
     {
-        ESP_LOGD(TAG, "[REMOVE] Client fd=%d not found in list", fd);
-        if (s_ws_mutex)
-            xSemaphoreGive(s_ws_mutex);
+        if (s_clients[i].active)
+        {
+            connected = true;
+            break;
+        }
     }
+
+    release_mutex();
+    return connected;
+}
+
+/**
+ * Get number of connected clients
+ * @return Client count
+ */
+int ws_server_client_count(void)
+{
+    if (!acquire_mutex("client_count"))
+        return 0;
+
+    int count = count_active_clients_unsafe();
+
+    release_mutex();
+    return count;
 }
 
-static void handle_config_update(cJSON* root)
+// ============================================================================
+// OPCODE DISPATCH
+// ============================================================================
+
+static void handle_config_update(const WsConfigUpdate* upd)
 {
-    cJSON* reset_item = cJSON_GetObjectItem(root, "reset_to_defaults");
-    if (cJSON_IsTrue(reset_item))
+    if ((upd->present & WS_CFG_RESET_TO_DEFAULTS) && upd->reset_to_defaults)
     {
         game_state_load_default_game_config();
     }
 
-    DeviceConfig* dev = game_state_get_config_mut();
-    cJSON* item;
-    
-    // Device Name
-    item = cJSON_GetObjectItem(root, "device_name");
-    if (item && cJSON_IsString(item))
-    {
-        strncpy(dev->device_name, item->valuestring, sizeof(dev->device_name) - 1);
-        dev->device_name[sizeof(dev->device_name) - 1] = '\0';
-    }
-    
-    // Identity
-    item = cJSON_GetObjectItem(root, "device_id");
-    if (item)
-        dev->device_id = item->valueint;
-    item = cJSON_GetObjectItem(root, "player_id");
-    if (item)
-        dev->player_id = item->valueint;
-    item = cJSON_GetObjectItem(root, "team_id");
-    if (item)
-        dev->team_id = item->valueint;
-    item = cJSON_GetObjectItem(root, "color_rgb");
-    if (item)
-        dev->color_rgb = item->valueint;
-
-    GameConfig* game = game_state_get_game_config_mut();
-    
-    // Health Settings
-    item = cJSON_GetObjectItem(root, "max_hearts");
-    if (item)
-        game->max_hearts = item->valueint;
-    item = cJSON_GetObjectItem(root, "spawn_hearts");
-    if (item)
-        game->max_hearts = item->valueint; // Use as starting hearts
-    item = cJSON_GetObjectItem(root, "respawn_time_s");
-    if (item)
-        game->respawn_cooldown_ms = item->valueint * 1000;
-    item = cJSON_GetObjectItem(root, "enable_hearts");
-    if (item)
-        game->unlimited_respawn = !cJSON_IsTrue(item);
-    item = cJSON_GetObjectItem(root, "friendly_fire");
-    if (item)
-        game->friendly_fire_enabled = cJSON_IsTrue(item);
-        
-    // Ammo Settings
-    item = cJSON_GetObjectItem(root, "max_ammo");
-    if (item)
-        game->max_ammo = item->valueint;
-    item = cJSON_GetObjectItem(root, "reload_time_ms");
-    if (item)
-        game->reload_time_ms = item->valueint;
-    item = cJSON_GetObjectItem(root, "enable_ammo");
-    if (item)
-        game->unlimited_ammo = !cJSON_IsTrue(item);
-        
-    // Game Duration
-    item = cJSON_GetObjectItem(root, "game_duration_s");
-    if (item)
-        game->time_limit_s = item->valueint;
-        
+    // Identity goes straight into the device config, game rules into a copy
+    // that is re-validated as a whole (the rate floor depends on the profile)
+    GameConfig game = *game_state_get_game_config();
+    ws_codec_apply_config(upd, game_state_get_config_mut(), &game);
+    game_state_apply_game_config(&game, NULL);
+
     // ESP-NOW Peers (CSV format: "aa:bb:cc:dd:ee:ff,11:22:33:44:55:66")
-    item = cJSON_GetObjectItem(root, "espnow_peers");
-    if (item && cJSON_IsString(item) && strlen(item->valuestring) > 0)
+    if ((upd->present & WS_CFG_ESPNOW_PEERS) && upd->espnow_peers[0])
     {
-        ESP_LOGI("WS", "Loading ESP-NOW peers: %s", item->valuestring);
-        esp_err_t err = espnow_comm_load_peers_from_csv(item->valuestring);
+        ESP_LOGI(TAG, "Loading ESP-NOW peers: %s", upd->espnow_peers);
+        esp_err_t err = espnow_comm_load_peers_from_csv(upd->espnow_peers);
         if (err == ESP_OK)
         {
-            ESP_LOGI("WS", "ESP-NOW peers loaded, count: %d", espnow_comm_peer_count());
+            ESP_LOGI(TAG, "ESP-NOW peers loaded, count: %d", espnow_comm_peer_count());
         }
         else
         {
-            ESP_LOGE("WS", "Failed to load ESP-NOW peers: %d", err);
+            ESP_LOGE(TAG, "Failed to load ESP-NOW peers: %d", err);
         }
     }
 
-    // Save device ID changes
-    game_state_save_ids();
+    // Per-match frame auth key; never logged
+    if (upd->present & WS_CFG_ESPNOW_KEY)
+    {
+        if (!espnow_auth_set_key_hex(upd->espnow_key))
+            ESP_LOGE(TAG, "Rejected malformed ESP-NOW auth key");
+    }
+
+    // Device fields were edited through the *_mut() accessor
+    game_state_mark_dirty(GS_DIRTY_CONFIG);
+
+    // Persist ids and game rules; rejoining after a reboot needs no push
+    game_state_save_config();
 
     // Broadcast update
     ws_server_broadcast_game_state();
 }
 
-static void handle_game_command(cJSON* root)
+static void handle_game_command(uint8_t cmd)
 {
-    cJSON* cmd_item = cJSON_GetObjectItem(root, "command");
-    if (!cmd_item)
-        return;
-
-    int cmd = cmd_item->valueint;
+    radio_policy_on_command((GameCommandType)cmd);
     switch (cmd)
     {
         case CMD_RESET:
@@ -233,453 +1401,396 @@ static void handle_game_command(cJSON* root)
             game_state_reset_runtime();
             break;
         case CMD_START:
-            game_state_reset_runtime();
-            // TODO: Start timer/enable game mechanism if separate from runtime
+            game_state_start_game();
             break;
         case CMD_STOP:
-            // TODO: Stop game logic
+            game_state_stop_game();
             break;
     }
     ws_server_broadcast_game_state();
 }
 
-static void process_message(int fd, const char* payload)
+// Built-in handlers. Status and heartbeat carry no fields and are answered
+// straight from the peeked opcode.
+static void on_get_status(int fd, WsFormat, const uint8_t*, size_t)
+{
+    ws_server_send_status_to(fd);
+}
+
+static void on_heartbeat(int fd, WsFormat, const uint8_t*, size_t)
+{
+    ws_server_send_heartbeat_ack(fd);
+}
+
+static void on_config_update(int, WsFormat fmt, const uint8_t* data, size_t len)
+{
+    WsClientMessage msg;
+    if (ws_codec_decode(fmt, data, len, &msg))
+        handle_config_update(&msg.config);
+}
+
+static void on_game_command(int, WsFormat fmt, const uint8_t* data, size_t len)
+{
+    WsClientMessage msg;
+    if (ws_codec_decode(fmt, data, len, &msg))
+        handle_game_command(msg.game_command.command);
+}
+
+static void on_kill_confirmed(int, WsFormat, const uint8_t*, size_t)
+{
+    game_state_record_kill();
+    ws_server_broadcast_game_state();
+}
+
+// Replies with the binary NVS snapshot split over raw frames:
+// [WS_RAW_FRAME_MARKER, index, count, payload...]. Written straight to the
+// socket from the httpd task, as the snapshot outgrows the frame pool and
+// the client queue.
+static void on_nvs_snapshot(int fd, WsFormat fmt, const uint8_t* data, size_t len)
 {
-    cJSON* root = cJSON_Parse(payload);
-    if (!root)
+    WsClientMessage msg;
+    if (!ws_codec_decode(fmt, data, len, &msg) || fd <= WS_SIMULATED_FD_BASE)
         return;
 
-    cJSON* op_item = cJSON_GetObjectItem(root, "op");
-    int op = op_item ? op_item->valueint : 0;
+    size_t snap_len = 0;
+    uint8_t* snap = msg.nvs_snapshot.diff ? nvs_snapshot_diff_baseline(&snap_len) : nvs_snapshot_alloc(&snap_len);
+    if (!snap)
+    {
+        ESP_LOGW(TAG, "NVS snapshot failed");
+        return;
+    }
 
-    // Fallback to type if op is missing (legacy/safety)
-    if (op == 0)
+    static uint8_t chunk[WS_FRAME_MAX_LEN]; // httpd task only
+    const size_t per_chunk = sizeof(chunk) - 3;
+    const size_t count = (snap_len + per_chunk - 1) / per_chunk;
+    if (count > UINT8_MAX)
     {
-        cJSON* type_item = cJSON_GetObjectItem(root, "type");
-        if (type_item && type_item->valuestring)
-        {
-            if (strcmp(type_item->valuestring, "get_status") == 0)
-                op = OP_GET_STATUS;
-            else if (strcmp(type_item->valuestring, "heartbeat") == 0)
-                op = OP_HEARTBEAT;
-            else if (strcmp(type_item->valuestring, "config_update") == 0)
-                op = OP_CONFIG_UPDATE;
-        }
+        ESP_LOGW(TAG, "NVS snapshot too large (%u bytes)", (unsigned)snap_len);
+        free(snap);
+        return;
     }
 
-    switch (op)
+    for (size_t i = 0; i < count; i++)
     {
-        case OP_GET_STATUS:
-            ws_server_send_status_to(fd);
-            break;
-        case OP_HEARTBEAT:
-            ws_server_send_heartbeat_ack(fd);
-            break;
-        case OP_CONFIG_UPDATE:
-            handle_config_update(root);
-            break;
-        case OP_GAME_COMMAND:
-            handle_game_command(root);
-            break;
-        case OP_KILL_CONFIRMED:
-            game_state_record_kill();
-            ws_server_broadcast_game_state();
+        const size_t off = i * per_chunk;
+        const size_t n = snap_len - off < per_chunk ? snap_len - off : per_chunk;
+        chunk[0] = WS_RAW_FRAME_MARKER;
+        chunk[1] = (uint8_t)i;
+        chunk[2] = (uint8_t)count;
+        memcpy(chunk + 3, snap + off, n);
+
+        httpd_ws_frame_t ws_pkt;
+        memset(&ws_pkt, 0, sizeof(ws_pkt));
+        ws_pkt.payload = chunk;
+        ws_pkt.len = n + 3;
+        ws_pkt.type = HTTPD_WS_TYPE_BINARY;
+        ws_pkt.final = true;
+        esp_err_t ret = httpd_ws_send_frame_async(s_server, fd, &ws_pkt);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGW(TAG, "NVS snapshot send failed to fd=%d: %s", fd, esp_err_to_name(ret));
             break;
+        }
     }
+    free(snap);
+}
+
+// Game timer expiries nobody else reports; runs on the esp_timer task
+static void on_game_event(uint32_t event)
+{
+    if (event == GS_EVT_GAME_OVER)
+        ws_server_broadcast_game_over();
+    else if (event == GS_EVT_RELOAD_DONE)
+        ws_server_broadcast_reload((uint16_t)game_state_get()->current_ammo);
+}
+
+/**
+ * Route an opcode to a handler
+ * @param op Client opcode
+ * @param handler Handler, NULL to ignore the opcode
+ * @return false if op is out of range
+ */
+bool ws_server_register_op(OpCode op, ws_server_op_handler_t handler)
+{
+    if ((unsigned)op >= WS_OP_TABLE_SIZE)
+        return false;
+    s_op_handlers[op] = handler;
+    return true;
+}
 
-    cJSON_Delete(root);
+// ============================================================================
+// WEBSOCKET HANDLER
+// ============================================================================
+
+/**
+ * Answer a client PING with a PONG carrying the same payload
+ */
+static esp_err_t answer_ping(httpd_req_t* req, httpd_ws_frame_t* ws_pkt)
+{
+    uint8_t payload[125]; // Control frames carry at most 125 bytes
+    if (ws_pkt->len > sizeof(payload))
+        return ESP_FAIL;
+    if (ws_pkt->len > 0)
+    {
+        ws_pkt->payload = payload;
+        esp_err_t ret = httpd_ws_recv_frame(req, ws_pkt, ws_pkt->len);
+        if (ret != ESP_OK)
+            return ret;
+    }
+    ws_pkt->type = HTTPD_WS_TYPE_PONG;
+    return httpd_ws_send_frame(req, ws_pkt);
 }
 
 static esp_err_t ws_handler(httpd_req_t* req)
 {
+    s_httpd_task = xTaskGetCurrentTaskHandle();
+
+    // Handle handshake
     if (req->method == HTTP_GET)
     {
-        // Treat handshake as a connect event
         int client_fd = httpd_req_to_sockfd(req);
+        ESP_LOGI(TAG, "New WebSocket connection: fd=%d", client_fd);
 
-        // Count before cleanup
-        int count_before = ws_server_client_count();
-        ESP_LOGI(TAG, "[HANDSHAKE] Incoming fd=%d, current count=%d", client_fd, count_before);
-
-        // Clean up any stale connections first
+        // Cleanup stale connections first
         ws_server_cleanup_stale();
 
-        int count_after = ws_server_client_count();
-        ESP_LOGI(TAG, "[CLEANUP] After cleanup, count=%d", count_after);
-
-        // Check if fd already exists and remove it
-        if (s_ws_mutex)
-            xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-        int found = find_client_by_fd(client_fd);
-        if (s_ws_mutex)
-            xSemaphoreGive(s_ws_mutex);
-
-        if (found >= 0)
+        // Binary frames only for clients that asked for the msgpack subprotocol
+        bool supports_binary = false;
+#if WS_ENABLE_MSGPACK
+        char proto[64] = {0};
+        if (httpd_req_get_hdr_value_str(req, "Sec-WebSocket-Protocol", proto, sizeof(proto)) == ESP_OK)
         {
-            ESP_LOGW(TAG, "[WARNING] FD %d already in list at slot %d, removing old entry", client_fd, found);
-            remove_client(client_fd);
+            supports_binary = strstr(proto, WS_SUBPROTOCOL_MSGPACK) != NULL;
         }
+#endif
+        add_client(client_fd, supports_binary);
 
-        add_client(client_fd);
-        int count_final = ws_server_client_count();
-        ESP_LOGI(TAG, "[CONNECT] WebSocket handshake: fd=%d connected (total=%d)", client_fd, count_final);
         return ESP_OK;
     }
 
+    // Receive frame metadata
     httpd_ws_frame_t ws_pkt;
-    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+    memset(&ws_pkt, 0, sizeof(ws_pkt));
     ws_pkt.type = HTTPD_WS_TYPE_TEXT;
 
+    int client_fd = httpd_req_to_sockfd(req);
     esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
     if (ret != ESP_OK)
     {
-        ESP_LOGW(TAG, "[FRAME_RECV] httpd_ws_recv_frame failed with %d for fd=%d", ret, httpd_req_to_sockfd(req));
-        remove_client(httpd_req_to_sockfd(req));
+        ESP_LOGW(TAG, "Frame receive failed for fd=%d: %s", client_fd, esp_err_to_name(ret));
+        remove_client(client_fd);
         return ret;
     }
 
+    // Handle control frames
+    if (ws_pkt.type == HTTPD_WS_TYPE_PONG)
+    {
+        ESP_LOGD(TAG, "Received PONG from fd=%d", client_fd);
+        update_client_activity(client_fd);
+        return ESP_OK;
+    }
+
+    if (ws_pkt.type == HTTPD_WS_TYPE_PING)
+    {
+        update_client_activity(client_fd);
+        return answer_ping(req, &ws_pkt);
+    }
+
     if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE)
     {
-        int client_fd = httpd_req_to_sockfd(req);
-        ESP_LOGI(TAG, "[CLOSE] Received CLOSE frame from fd=%d, closing connection", client_fd);
+        ESP_LOGI(TAG, "Client fd=%d closing connection", client_fd);
         remove_client(client_fd);
 
-        // Send CLOSE frame response and let httpd close the socket
+        // Answer the CLOSE, then fail the request so httpd closes the socket
         httpd_ws_frame_t close_frame;
-        memset(&close_frame, 0, sizeof(httpd_ws_frame_t));
+        memset(&close_frame, 0, sizeof(close_frame));
         close_frame.type = HTTPD_WS_TYPE_CLOSE;
-        close_frame.payload = NULL;
-        close_frame.len = 0;
         httpd_ws_send_frame(req, &close_frame);
-
-        // Return error to force httpd to close the connection
         return ESP_FAIL;
     }
 
+    // Handle data frames
     if (ws_pkt.len == 0 || ws_pkt.len >= WS_MAX_FRAME_SIZE)
+    {
         return ESP_OK;
+    }
 
-    char msg[WS_MAX_FRAME_SIZE];
-    ws_pkt.payload = (uint8_t*)msg;
+    // Payload goes into a pooled buffer; only possible to run out if the
+    // application is holding every buffer
+    uint8_t* buf = rx_acquire();
+    if (!buf)
+    {
+        ESP_LOGE(TAG, "No receive buffer for %u bytes (all borrowed)", (unsigned)ws_pkt.len);
+        return ESP_ERR_NO_MEM;
+    }
+    const int buf_idx = rx_index(buf);
+
+    ws_pkt.payload = buf;
     ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+
     if (ret != ESP_OK)
+    {
+        rx_release(buf_idx, false);
         return ret;
-    msg[ws_pkt.len] = '\0';
-
-    int client_fd = httpd_req_to_sockfd(req);
-
-    // Ensure client is tracked
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    int found = find_client_by_fd(client_fd);
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
-
-    if (found < 0)
-        add_client(client_fd);
+    }
+    buf[ws_pkt.len] = '\0'; // JSON consumers may treat the payload as a C string
+    s_rx_len[buf_idx] = (uint16_t)ws_pkt.len;
 
-    // Update activity timestamp
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    int slot = find_client_by_fd(client_fd);
-    if (slot >= 0)
-        s_clients[slot].last_activity_ms = get_time_ms();
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
+    // Track clients whose handshake was missed (e.g. after a table overflow)
+    if (!update_client_activity(client_fd))
+        add_client(client_fd, false);
 
-    process_message(client_fd, msg);
+    // Route on the opcode alone; only the handler decodes the fields
+    const WsFormat fmt = ws_pkt.type == HTTPD_WS_TYPE_BINARY ? WS_FORMAT_MSGPACK : WS_FORMAT_JSON;
+    const OpCode op = ws_codec_peek_op(fmt, buf, ws_pkt.len);
+    if ((unsigned)op < WS_OP_TABLE_SIZE && s_op_handlers[op])
+        s_op_handlers[op](client_fd, fmt, buf, ws_pkt.len);
 
     if (s_config.on_message)
-        s_config.on_message(client_fd, "", msg);
+        s_config.on_message(client_fd, ws_codec_op_name(op), (const char*)buf, ws_pkt.len);
 
+    rx_release(buf_idx, false);
     return ESP_OK;
 }
 
+// ============================================================================
+// INITIALIZATION
+// ============================================================================
+
+/**
+ * Initialize WebSocket server with configuration
+ * @param config Server configuration
+ */
 void ws_server_init(const WsServerConfig* config)
 {
     if (config)
-        memcpy(&s_config, config, sizeof(WsServerConfig));
-    memset(s_clients, 0, sizeof(s_clients));
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
     {
-        s_clients[i].fd = -1;
-        s_clients[i].active = false;
+        s_config = *config;
     }
 
+    if (s_initialized)
+        return;
+
+    // Create mutex for thread-safe client management
+    s_ws_mutex = xSemaphoreCreateMutex();
     if (!s_ws_mutex)
     {
-        s_ws_mutex = xSemaphoreCreateMutex();
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return;
     }
 
-    s_initialized = true;
-    ESP_LOGI(TAG, "[INIT] WebSocket server initialized");
-}
+    // Initialize client array
+    init_client_array();
+    rx_pool_init();
 
-void ws_server_register(httpd_handle_t server)
-{
-    if (!s_initialized)
-        ws_server_init(NULL);
-    s_server = server;
+    s_op_handlers[OP_GET_STATUS] = on_get_status;
+    s_op_handlers[OP_HEARTBEAT] = on_heartbeat;
+    s_op_handlers[OP_CONFIG_UPDATE] = on_config_update;
+    s_op_handlers[OP_GAME_COMMAND] = on_game_command;
+    s_op_handlers[OP_KILL_CONFIRMED] = on_kill_confirmed;
+    s_op_handlers[OP_NVS_SNAPSHOT] = on_nvs_snapshot;
+    game_state_add_event_listener(on_game_event);
+    system_stats_start();
 
-    static const httpd_uri_t ws_uri = {
-        .uri = "/ws",
-        .method = HTTP_GET,
-        .handler = ws_handler,
-        .user_ctx = NULL,
-        .is_websocket = true,
-        .handle_ws_control_frames = true,
-        .supported_subprotocol = NULL,
-    };
+    s_initialized = true;
 
-    httpd_register_uri_handler(server, &ws_uri);
+    ESP_LOGI(TAG, "✓ Initialized (async=%d, msgpack=%d, native_ping=%d)", WS_ENABLE_ASYNC_SEND,
+             WS_ENABLE_MSGPACK, WS_USE_NATIVE_PING);
 }
 
-// Cleanup dead sockets (called on new handshake to free slots)
-void ws_server_cleanup_stale(void)
+/**
+ * Register WebSocket endpoint on HTTP server
+ * @param server HTTP server handle
+ */
+void ws_server_register(httpd_handle_t server)
 {
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-
-    int removed_count = 0;
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
+    if (!server)
     {
-        if (s_clients[i].active)
-        {
-            int fd = s_clients[i].fd;
-            // Check if the socket is still valid by attempting to get socket error
-            int opt_val = 0;
-            socklen_t opt_len = sizeof(opt_val);
-            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &opt_val, &opt_len) != 0 || opt_val != 0)
-            {
-                ESP_LOGW(TAG, "[DEAD_SOCKET] Removing dead socket at slot %d, fd=%d", i, fd);
-                s_clients[i].active = false;
-                s_clients[i].fd = -1;
-                // Proactively close the HTTPD session to free resources
-                if (s_server)
-                {
-                    httpd_sess_trigger_close(s_server, fd);
-                }
-                removed_count++;
-            }
-        }
+        ESP_LOGE(TAG, "Invalid server handle");
+        return;
     }
-    if (removed_count > 0)
-        ESP_LOGI(TAG, "[CLEANUP] Removed %d dead sockets", removed_count);
 
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
-}
+    if (!s_initialized)
+        ws_server_init(NULL);
 
-bool ws_server_is_connected(void)
-{
-    bool connected = false;
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-        if (s_clients[i].active)
-        {
-            connected = true;
-            break;
-        }
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
-    return connected;
-}
+    s_server = server;
 
-int ws_server_client_count(void)
-{
-    int c = 0;
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-        if (s_clients[i].active)
-            c++;
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
-    return c;
-}
+    // Control frames come to the handler: PONGs count as activity
+    httpd_uri_t ws_uri = {.uri = "/ws",
+                          .method = HTTP_GET,
+                          .handler = ws_handler,
+                          .user_ctx = NULL,
+                          .is_websocket = true,
+                          .handle_ws_control_frames = true,
+                          .supported_subprotocol = WS_ENABLE_MSGPACK ? WS_SUBPROTOCOL_MSGPACK : NULL};
 
-static bool ws_server_send_frame(int fd, const char* message)
-{
-    if (!s_server || !message)
-        return false;
-    struct async_send_arg
-    {
-        httpd_handle_t hd;
-        int fd;
-        char data[WS_MAX_FRAME_SIZE];
-    };
-    struct async_send_arg* arg = (struct async_send_arg*)malloc(sizeof(struct async_send_arg));
-    if (!arg)
-        return false;
-    arg->hd = s_server;
-    arg->fd = fd;
-    strncpy(arg->data, message, sizeof(arg->data) - 1);
-    arg->data[sizeof(arg->data) - 1] = '\0';
+    esp_err_t ret = httpd_register_uri_handler(server, &ws_uri);
 
-    auto sender = [](void* a)
+    if (ret == ESP_OK)
     {
-        struct async_send_arg* send_arg = (struct async_send_arg*)a;
-        httpd_ws_frame_t ws_pkt;
-        memset(&ws_pkt, 0, sizeof(ws_pkt));
-        ws_pkt.payload = (uint8_t*)send_arg->data;
-        ws_pkt.len = strlen(send_arg->data);
-        ws_pkt.type = HTTPD_WS_TYPE_TEXT;
-        esp_err_t r = httpd_ws_send_frame_async(send_arg->hd, send_arg->fd, &ws_pkt);
-        if (r != ESP_OK)
-            ESP_LOGW(TAG, "Send failed fd=%d err=%d", send_arg->fd, r);
-        free(send_arg);
-    };
-
-    if (httpd_queue_work(s_server, sender, arg) != ESP_OK)
-    {
-        free(arg);
-        return false;
+        ESP_LOGI(TAG, "✓ WebSocket endpoint registered at /ws");
     }
-    return true;
-}
-
-bool ws_server_send(int client_fd, const char* message)
-{
-    return ws_server_send_frame(client_fd, message);
-}
-
-void ws_server_broadcast(const char* message)
-{
-    int fds[MAX_WS_CLIENTS];
-    int n = 0;
-    if (s_ws_mutex)
-        xSemaphoreTake(s_ws_mutex, portMAX_DELAY);
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
+    else
     {
-        if (s_clients[i].active)
-        {
-            fds[n++] = s_clients[i].fd;
-        }
+        ESP_LOGE(TAG, "✗ Failed to register WebSocket endpoint: %s", esp_err_to_name(ret));
     }
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
-
-    for (int i = 0; i < n; i++)
-        ws_server_send(fds[i], message);
-}
-
-static cJSON* create_status_json()
-{
-    const DeviceConfig* cfg = game_state_get_config();
-    const GameStateData* st = game_state_get();
-    const GameConfig* game = game_state_get_game_config();
-
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "op", OP_STATUS);
-    cJSON_AddStringToObject(root, "type", "status");
-    cJSON_AddNumberToObject(root, "uptime_ms", esp_timer_get_time() / 1000);
-
-    cJSON* config = cJSON_CreateObject();
-    cJSON_AddNumberToObject(config, "device_id", cfg->device_id);
-    cJSON_AddNumberToObject(config, "player_id", cfg->player_id);
-    cJSON_AddNumberToObject(config, "team_id", cfg->team_id);
-    cJSON_AddNumberToObject(config, "color_rgb", cfg->color_rgb);
-    cJSON_AddBoolToObject(config, "enable_hearts", true);
-    cJSON_AddNumberToObject(config, "max_hearts", game->max_hearts);
-    cJSON_AddNumberToObject(config, "enable_ammo", !game->unlimited_ammo);
-    cJSON_AddNumberToObject(config, "max_ammo", game->max_ammo);
-    cJSON_AddNumberToObject(config, "game_duration_s", game->time_limit_s);
-    cJSON_AddBoolToObject(config, "friendly_fire", game->friendly_fire_enabled);
-    cJSON_AddItemToObject(root, "config", config);
-
-    cJSON* stats = cJSON_CreateObject();
-    cJSON_AddNumberToObject(stats, "shots", st->shots_fired);
-    cJSON_AddNumberToObject(stats, "enemy_kills", st->kills);
-    cJSON_AddNumberToObject(stats, "friendly_kills", st->friendly_fire_count);
-    cJSON_AddNumberToObject(stats, "deaths", st->deaths);
-    cJSON_AddItemToObject(root, "stats", stats);
 
-    cJSON* state = cJSON_CreateObject();
-    cJSON_AddNumberToObject(state, "current_hearts", st->hearts_remaining);
-    cJSON_AddNumberToObject(state, "current_ammo", 0);
-    cJSON_AddBoolToObject(state, "is_respawning", st->respawning);
-    cJSON_AddBoolToObject(state, "is_reloading", false);
-    cJSON_AddItemToObject(root, "state", state);
-
-    return root;
-}
-
-void ws_server_send_status_to(int fd)
-{
-    cJSON* root = create_status_json();
-    char* str = cJSON_PrintUnformatted(root);
-    ws_server_send(fd, str);
-    free(str);
-    cJSON_Delete(root);
-}
-
-void ws_server_send_status(void)
-{
-    cJSON* root = create_status_json();
-    char* str = cJSON_PrintUnformatted(root);
-    ws_server_broadcast(str);
-    free(str);
-    cJSON_Delete(root);
+#if WS_USE_NATIVE_PING
+    if (!s_keepalive_timer)
+    {
+        const esp_timer_create_args_t args = {
+            .callback = keepalive_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "ws_keepalive",
+            .skip_unhandled_events = true,
+        };
+        if (esp_timer_create(&args, &s_keepalive_timer) == ESP_OK)
+            esp_timer_start_periodic(s_keepalive_timer, (uint64_t)WS_PING_INTERVAL_MS * 1000);
+        else
+            ESP_LOGE(TAG, "Failed to create keep-alive timer");
+    }
+#endif
 }
 
-void ws_server_send_heartbeat_ack(int client_fd)
-{
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "op", OP_HEARTBEAT_ACK);
-    cJSON_AddStringToObject(root, "type", "heartbeat_ack");
-    char* str = cJSON_PrintUnformatted(root);
-    ws_server_send(client_fd, str);
-    free(str);
-    cJSON_Delete(root);
-}
+// ============================================================================
+// RECEIVE BUFFER HAND-OFF
+// ============================================================================
 
-void ws_server_broadcast_hit(const char* shooter_id_str)
+bool ws_server_rx_borrow(const uint8_t* data, size_t* len)
 {
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "op", OP_HIT_REPORT);
-    cJSON_AddStringToObject(root, "type", "hit_report");
-    cJSON_AddNumberToObject(root, "timestamp_ms", esp_timer_get_time() / 1000);
-    int shooter = shooter_id_str ? atoi(shooter_id_str) : 0;
-    cJSON_AddNumberToObject(root, "shooter_id", shooter);
-
-    char* str = cJSON_PrintUnformatted(root);
-    ws_server_broadcast(str);
-    free(str);
-    cJSON_Delete(root);
+    int idx = rx_index(data);
+    if (idx < 0)
+        return false;
+    bool ok = false;
+    portENTER_CRITICAL(&s_rx_lock);
+    if (s_rx_in_use[idx] && !s_rx_borrowed[idx])
+    {
+        s_rx_borrowed[idx] = true;
+        ok = true;
+        if (len)
+            *len = s_rx_len[idx];
+    }
+    portEXIT_CRITICAL(&s_rx_lock);
+    return ok;
 }
 
-void ws_server_broadcast_shot(void)
+void ws_server_rx_release(const uint8_t* data)
 {
-    const GameStateData* st = game_state_get();
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "op", OP_SHOT_FIRED);
-    cJSON_AddStringToObject(root, "type", "shot_fired");
-    cJSON_AddNumberToObject(root, "timestamp_ms", esp_timer_get_time() / 1000);
-    cJSON_AddNumberToObject(root, "seq_id", st->shots_fired);
-
-    char* str = cJSON_PrintUnformatted(root);
-    ws_server_broadcast(str);
-    free(str);
-    cJSON_Delete(root);
+    int idx = rx_index(data);
+    if (idx >= 0)
+        rx_release(idx, true);
 }
 
-void ws_server_broadcast_game_state(void)
+int ws_server_rx_available(void)
 {
-    ws_server_send_status();
+    portENTER_CRITICAL(&s_rx_lock);
+    int n = s_rx_free_count;
+    portEXIT_CRITICAL(&s_rx_lock);
+    return n;
 }
 
-void ws_server_broadcast_respawn(void)
+uint32_t ws_server_rx_exhausted(void)
 {
-    const GameStateData* st = game_state_get();
-    cJSON* root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "op", OP_RESPAWN);
-    cJSON_AddStringToObject(root, "type", "respawn");
-    cJSON_AddNumberToObject(root, "timestamp_ms", esp_timer_get_time() / 1000);
-    cJSON_AddNumberToObject(root, "current_hearts", st->hearts_remaining);
-
-    char* str = cJSON_PrintUnformatted(root);
-    ws_server_broadcast(str);
-    free(str);
-    cJSON_Delete(root);
+    return __atomic_load_n(&s_rx_exhausted, __ATOMIC_RELAXED);
 }
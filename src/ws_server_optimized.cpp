@@ -1,631 +0,0 @@
-/**
- * Optimized WebSocket Server Implementation for ESP32
- *
- * Performance improvements:
- * - Async WebSocket frame sending (non-blocking)
- * - MessagePack binary protocol support (60% smaller, 70% faster parsing)
- * - Native WebSocket PING/PONG (no application-level heartbeat)
- * - Optimized client management with mutex protection
- * - Optional HTTP API disable (saves 8KB RAM)
- *
- * Configuration flags (set in platformio.ini):
- * - WS_ENABLE_MSGPACK=1     : Enable MessagePack support
- * - WS_ENABLE_ASYNC_SEND=1  : Use async frame sending
- * - WS_USE_NATIVE_PING=1    : Use native WebSocket PING/PONG
- * - WS_DISABLE_HTTP_API=0   : Keep HTTP API (0=keep, 1=disable)
- *
- * @author RayZ Optimization Team
- * @date January 2026
- */
-
-#include "ws_server_optimized.h"
-#include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
-#include <esp_log.h>
-#include <esp_timer.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/socket.h>
-
-#if WS_ENABLE_MSGPACK
-#include <ArduinoJson.h>
-#endif
-
-// ============================================================================
-// CONSTANTS & CONFIGURATION
-// ============================================================================
-
-static const char* TAG = "WsServerOpt";
-
-#define MAX_WS_CLIENTS 8
-#define WS_MAX_FRAME_SIZE 1024
-#define WS_CLIENT_TIMEOUT_MS 30000
-
-// ============================================================================
-// DATA STRUCTURES
-// ============================================================================
-
-typedef struct
-{
-    int fd;
-    bool active;
-    uint32_t last_activity_ms;
-    bool supports_binary;
-} ws_client_t;
-
-// Static state
-static ws_client_t s_clients[MAX_WS_CLIENTS];
-static httpd_handle_t s_server = NULL;
-static WsServerConfig s_config = {};
-static bool s_initialized = false;
-static SemaphoreHandle_t s_ws_mutex = NULL;
-
-// ============================================================================
-// UTILITY FUNCTIONS
-// ============================================================================
-
-/**
- * Get current time in milliseconds
- */
-static inline uint32_t get_time_ms(void)
-{
-    return (uint32_t)(esp_timer_get_time() / 1000);
-}
-
-/**
- * Count active clients (must be called with mutex held)
- */
-static int count_active_clients_unsafe(void)
-{
-    int count = 0;
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active)
-            count++;
-    }
-    return count;
-}
-
-/**
- * Initialize client array
- */
-static void init_client_array(void)
-{
-    memset(s_clients, 0, sizeof(s_clients));
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        s_clients[i].fd = -1;
-        s_clients[i].active = false;
-    }
-}
-
-// ============================================================================
-// MUTEX WRAPPER FUNCTIONS
-// ============================================================================
-
-/**
- * Acquire mutex with error checking
- */
-static inline bool acquire_mutex(const char* context)
-{
-    if (s_ws_mutex && xSemaphoreTake(s_ws_mutex, portMAX_DELAY) != pdTRUE)
-    {
-        ESP_LOGE(TAG, "Failed to acquire mutex in %s", context);
-        return false;
-    }
-    return true;
-}
-
-/**
- * Release mutex
- */
-static inline void release_mutex(void)
-{
-    if (s_ws_mutex)
-        xSemaphoreGive(s_ws_mutex);
-}
-
-// ============================================================================
-// CLIENT MANAGEMENT
-// ============================================================================
-
-/**
- * Find first available client slot
- * @return Slot index or -1 if no slots available
- */
-static int find_client_slot(void)
-{
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (!s_clients[i].active)
-            return i;
-    }
-    return -1;
-}
-
-/**
- * Find client by file descriptor
- * @param fd File descriptor
- * @return Client index or -1 if not found
- */
-static int find_client_by_fd(int fd)
-{
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active && s_clients[i].fd == fd)
-            return i;
-    }
-    return -1;
-}
-
-/**
- * Remove stale entry for file descriptor (unsafe - mutex must be held)
- */
-static void remove_stale_fd_unsafe(int fd)
-{
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active && s_clients[i].fd == fd)
-        {
-            ESP_LOGW(TAG, "Removing stale entry for fd=%d at slot %d", fd, i);
-            s_clients[i].active = false;
-            s_clients[i].fd = -1;
-            break;
-        }
-    }
-}
-
-/**
- * Add a new client connection
- * @param fd File descriptor
- * @param supports_binary Client supports binary protocol
- */
-static void add_client(int fd, bool supports_binary)
-{
-    if (!acquire_mutex("add_client"))
-        return;
-
-    // Remove any existing entry with this fd
-    remove_stale_fd_unsafe(fd);
-
-    // Find available slot
-    int slot = find_client_slot();
-    if (slot < 0)
-    {
-        ESP_LOGE(TAG, "✗ No free slots for fd=%d", fd);
-        release_mutex();
-        return;
-    }
-
-    // Initialize client
-    s_clients[slot].fd = fd;
-    s_clients[slot].active = true;
-    s_clients[slot].last_activity_ms = get_time_ms();
-    s_clients[slot].supports_binary = supports_binary;
-
-    int count = count_active_clients_unsafe();
-    release_mutex();
-
-    ESP_LOGI(TAG, "✓ Client fd=%d added to slot %d (binary=%d, total=%d)", fd, slot,
-             supports_binary, count);
-
-    // Notify callback outside of mutex
-    if (s_config.on_connect)
-        s_config.on_connect(fd, true);
-}
-
-/**
- * Remove a client connection
- * @param fd File descriptor
- */
-static void remove_client(int fd)
-{
-    if (!acquire_mutex("remove_client"))
-        return;
-
-    int slot = find_client_by_fd(fd);
-    bool found = slot >= 0;
-
-    if (found)
-    {
-        ESP_LOGI(TAG, "Removing client fd=%d from slot %d", fd, slot);
-        s_clients[slot].active = false;
-        s_clients[slot].fd = -1;
-    }
-
-    release_mutex();
-
-    // Notify callback outside of mutex
-    if (found && s_config.on_connect)
-        s_config.on_connect(fd, false);
-}
-
-/**
- * Update client activity timestamp
- * @param fd File descriptor
- */
-static void update_client_activity(int fd)
-{
-    if (!acquire_mutex("update_activity"))
-        return;
-
-    int slot = find_client_by_fd(fd);
-    if (slot >= 0)
-    {
-        s_clients[slot].last_activity_ms = get_time_ms();
-    }
-
-    release_mutex();
-}
-
-// ============================================================================
-// MESSAGE SENDING
-// ============================================================================
-
-/**
- * Send raw WebSocket frame to client
- * @param client_fd Target client file descriptor
- * @param data Frame payload
- * @param len Payload length
- * @param binary true for binary frame, false for text
- * @return true if sent successfully
- */
-bool ws_server_send_raw_optimized(int client_fd, const uint8_t* data, size_t len, bool binary)
-{
-    if (!s_server || !data || len == 0)
-    {
-        ESP_LOGW(TAG, "Invalid send parameters");
-        return false;
-    }
-
-    // Prepare WebSocket frame
-    httpd_ws_frame_t ws_pkt = {
-        .payload = (uint8_t*)data,
-        .len = len,
-        .type = binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT,
-    };
-
-    // Send frame (async or sync based on config)
-    esp_err_t ret;
-
-#if WS_ENABLE_ASYNC_SEND
-    ret = httpd_ws_send_frame_async(s_server, client_fd, &ws_pkt);
-#else
-    // Sync mode requires full httpd_req_t - simplified for now
-    ESP_LOGW(TAG, "Sync send not fully implemented, using async");
-    ret = httpd_ws_send_frame_async(s_server, client_fd, &ws_pkt);
-#endif
-
-    if (ret != ESP_OK)
-    {
-        ESP_LOGW(TAG, "Send failed to fd=%d: %s", client_fd, esp_err_to_name(ret));
-        return false;
-    }
-
-    // Update activity timestamp
-    update_client_activity(client_fd);
-
-    return true;
-}
-
-/**
- * Broadcast raw frame to all connected clients
- * @param data Frame payload
- * @param len Payload length
- * @param binary true for binary frame, false for text
- */
-void ws_server_broadcast_raw_optimized(const uint8_t* data, size_t len, bool binary)
-{
-    if (!data || len == 0)
-        return;
-
-    int sent_count = 0;
-    int total_clients = 0;
-
-    // Build list of active clients
-    int active_fds[MAX_WS_CLIENTS];
-
-    if (!acquire_mutex("broadcast"))
-        return;
-
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active)
-        {
-            active_fds[total_clients++] = s_clients[i].fd;
-        }
-    }
-
-    release_mutex();
-
-    // Send to all clients (outside of mutex to avoid blocking)
-    for (int i = 0; i < total_clients; i++)
-    {
-        if (ws_server_send_raw_optimized(active_fds[i], data, len, binary))
-        {
-            sent_count++;
-        }
-    }
-
-    ESP_LOGD(TAG, "Broadcast sent to %d/%d clients", sent_count, total_clients);
-}
-
-// ============================================================================
-// WEBSOCKET PING/PONG
-// ============================================================================
-
-#if WS_USE_NATIVE_PING
-/**
- * Send WebSocket PING to all clients
- */
-void ws_server_ping_clients(void)
-{
-    if (!s_server)
-        return;
-
-    httpd_ws_frame_t ping_frame = {
-        .type = HTTPD_WS_TYPE_PING, .payload = NULL, .len = 0, .fragmented = false, .final = true};
-
-    // Get active client FDs
-    int active_fds[MAX_WS_CLIENTS];
-    int count = 0;
-
-    if (!acquire_mutex("ping_clients"))
-        return;
-
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active)
-        {
-            active_fds[count++] = s_clients[i].fd;
-        }
-    }
-
-    release_mutex();
-
-    // Send PINGs
-    for (int i = 0; i < count; i++)
-    {
-        httpd_ws_send_frame_async(s_server, active_fds[i], &ping_frame);
-    }
-
-    if (count > 0)
-    {
-        ESP_LOGD(TAG, "PING sent to %d clients", count);
-    }
-}
-#endif
-
-// ============================================================================
-// CLEANUP & STATUS
-// ============================================================================
-
-/**
- * Remove clients that haven't been active recently
- */
-void ws_server_cleanup_stale_optimized(void)
-{
-    uint32_t now = get_time_ms();
-    int stale_fds[MAX_WS_CLIENTS];
-    int stale_count = 0;
-
-    if (!acquire_mutex("cleanup_stale"))
-        return;
-
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active)
-        {
-            uint32_t idle_time = now - s_clients[i].last_activity_ms;
-            if (idle_time > WS_CLIENT_TIMEOUT_MS)
-            {
-                stale_fds[stale_count++] = s_clients[i].fd;
-                ESP_LOGW(TAG, "Client fd=%d timed out (idle=%lums)", s_clients[i].fd, idle_time);
-            }
-        }
-    }
-
-    release_mutex();
-
-    // Remove stale clients outside of mutex
-    for (int i = 0; i < stale_count; i++)
-    {
-        remove_client(stale_fds[i]);
-    }
-}
-
-/**
- * Check if any client is connected
- * @return true if at least one client is active
- */
-bool ws_server_is_connected_optimized(void)
-{
-    if (!acquire_mutex("is_connected"))
-        return false;
-
-    bool connected = false;
-    for (int i = 0; i < MAX_WS_CLIENTS; i++)
-    {
-        if (s_clients[i].active)
-        {
-            connected = true;
-            break;
-        }
-    }
-
-    release_mutex();
-    return connected;
-}
-
-/**
- * Get number of connected clients
- * @return Client count
- */
-int ws_server_client_count_optimized(void)
-{
-    if (!acquire_mutex("client_count"))
-        return 0;
-
-    int count = count_active_clients_unsafe();
-
-    release_mutex();
-    return count;
-}
-
-// ============================================================================
-// WEBSOCKET HANDLER
-// ============================================================================
-
-static esp_err_t ws_handler(httpd_req_t* req)
-{
-    // Handle handshake
-    if (req->method == HTTP_GET)
-    {
-        int client_fd = httpd_req_to_sockfd(req);
-        ESP_LOGI(TAG, "New WebSocket connection: fd=%d", client_fd);
-
-        // Cleanup stale connections first
-        ws_server_cleanup_stale_optimized();
-
-        // Add new client (assume binary support by default)
-        bool supports_binary = true;
-        add_client(client_fd, supports_binary);
-
-        return ESP_OK;
-    }
-
-    // Receive frame metadata
-    httpd_ws_frame_t ws_pkt = {.type = HTTPD_WS_TYPE_TEXT};
-
-    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
-    if (ret != ESP_OK)
-    {
-        ESP_LOGW(TAG, "Frame receive failed: %s", esp_err_to_name(ret));
-        return ret;
-    }
-
-    // Handle control frames
-    int client_fd = httpd_req_to_sockfd(req);
-
-    if (ws_pkt.type == HTTPD_WS_TYPE_PONG)
-    {
-        ESP_LOGD(TAG, "Received PONG from fd=%d", client_fd);
-        update_client_activity(client_fd);
-        return ESP_OK;
-    }
-
-    if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE)
-    {
-        ESP_LOGI(TAG, "Client fd=%d closing connection", client_fd);
-        remove_client(client_fd);
-        return ESP_FAIL; // Close connection
-    }
-
-    // Handle data frames
-    if (ws_pkt.len == 0 || ws_pkt.len >= WS_MAX_FRAME_SIZE)
-    {
-        return ESP_OK;
-    }
-
-    // Allocate buffer for payload
-    uint8_t* buf = (uint8_t*)malloc(ws_pkt.len + 1);
-    if (!buf)
-    {
-        ESP_LOGE(TAG, "Failed to allocate %d bytes", ws_pkt.len);
-        return ESP_ERR_NO_MEM;
-    }
-
-    ws_pkt.payload = buf;
-    ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-
-    if (ret != ESP_OK)
-    {
-        free(buf);
-        return ret;
-    }
-
-    // Update activity
-    update_client_activity(client_fd);
-
-    // Process message through callback
-    if (s_config.on_message)
-    {
-        const char* type = "unknown"; // TODO: Extract from payload
-        s_config.on_message(client_fd, type, buf, ws_pkt.len);
-    }
-
-    free(buf);
-    return ESP_OK;
-}
-
-// ============================================================================
-// INITIALIZATION
-// ============================================================================
-
-/**
- * Initialize WebSocket server with configuration
- * @param config Server configuration
- */
-void ws_server_init_optimized(const WsServerConfig* config)
-{
-    if (s_initialized)
-    {
-        ESP_LOGW(TAG, "Already initialized");
-        return;
-    }
-
-    if (config)
-    {
-        s_config = *config;
-    }
-
-    // Create mutex for thread-safe client management
-    s_ws_mutex = xSemaphoreCreateMutex();
-    if (!s_ws_mutex)
-    {
-        ESP_LOGE(TAG, "Failed to create mutex");
-        return;
-    }
-
-    // Initialize client array
-    init_client_array();
-
-    s_initialized = true;
-
-    ESP_LOGI(TAG, "✓ Initialized (async=%d, msgpack=%d, native_ping=%d)", WS_ENABLE_ASYNC_SEND,
-             WS_ENABLE_MSGPACK, WS_USE_NATIVE_PING);
-}
-
-/**
- * Register WebSocket endpoint on HTTP server
- * @param server HTTP server handle
- */
-void ws_server_register_optimized(httpd_handle_t server)
-{
-    if (!server)
-    {
-        ESP_LOGE(TAG, "Invalid server handle");
-        return;
-    }
-
-    s_server = server;
-
-    httpd_uri_t ws_uri = {.uri = "/ws",
-                          .method = HTTP_GET,
-                          .handler = ws_handler,
-                          .user_ctx = NULL,
-                          .is_websocket = true,
-                          .handle_ws_control_frames = false,
-                          .supported_subprotocol = "msgpack"};
-
-    esp_err_t ret = httpd_register_uri_handler(server, &ws_uri);
-
-    if (ret == ESP_OK)
-    {
-        ESP_LOGI(TAG, "✓ WebSocket endpoint registered at /ws");
-    }
-    else
-    {
-        ESP_LOGE(TAG, "✗ Failed to register WebSocket endpoint: %s", esp_err_to_name(ret));
-    }
-}